@@ -0,0 +1,237 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+#include <owl/common/parallel/parallel_for.h>
+#include "AdaptiveGrid.h"
+
+namespace exa {
+
+  void AdaptiveGrid::build(const box3f   *domains,
+                           const range1f *ranges,
+                           size_t         numPrims,
+                           const box3f   &bounds,
+                           const vec3i    dims,
+                           int            refinement,
+                           float          refineThreshold)
+  {
+    double t0 = getCurrentTime();
+
+    this->dims        = dims;
+    this->refinement  = std::max(refinement,1);
+    this->worldBounds = bounds;
+
+    const size_t numCoarse = dims.x*size_t(dims.y)*dims.z;
+    const vec3f coarseSize = bounds.size()/vec3f(dims);
+
+    // ==================================================================
+    // Bin primitives into coarse cells (CSR: count, scan, fill)
+    // ==================================================================
+
+    auto coarseRange = [&](size_t primID, vec3i &lo, vec3i &hi) {
+      lo = projectOnGrid(domains[primID].lower,dims,bounds);
+      hi = projectOnGrid(domains[primID].upper,dims,bounds);
+    };
+
+    std::vector<std::atomic<uint32_t>> counts(numCoarse);
+    parallel_for_blocked(0ull,numPrims,1024,[&](size_t begin, size_t end) {
+      for (size_t primID=begin; primID<end; ++primID) {
+        vec3i lo, hi;
+        coarseRange(primID,lo,hi);
+        for (int z=lo.z; z<=hi.z; ++z)
+        for (int y=lo.y; y<=hi.y; ++y)
+        for (int x=lo.x; x<=hi.x; ++x) {
+          counts[linearIndex(vec3i(x,y,z),dims)]++;
+        }
+      }
+    });
+
+    std::vector<size_t> offsets(numCoarse+1);
+    offsets[0] = 0;
+    for (size_t i=0; i<numCoarse; ++i) {
+      offsets[i+1] = offsets[i]+counts[i];
+      counts[i] = 0;
+    }
+
+    std::vector<uint32_t> cellPrims(offsets[numCoarse]);
+    parallel_for_blocked(0ull,numPrims,1024,[&](size_t begin, size_t end) {
+      for (size_t primID=begin; primID<end; ++primID) {
+        vec3i lo, hi;
+        coarseRange(primID,lo,hi);
+        for (int z=lo.z; z<=hi.z; ++z)
+        for (int y=lo.y; y<=hi.y; ++y)
+        for (int x=lo.x; x<=hi.x; ++x) {
+          const size_t cellID = linearIndex(vec3i(x,y,z),dims);
+          cellPrims[offsets[cellID]+counts[cellID]++] = (uint32_t)primID;
+        }
+      }
+    });
+
+    // ==================================================================
+    // Per coarse cell: value range, coverage, and refinement decision
+    // ==================================================================
+
+    auto cellBounds = [&](size_t cellID) {
+      const vec3i coarseID = gridIndex(cellID,dims);
+      return box3f(bounds.lower+vec3f(coarseID)*coarseSize,
+                   bounds.lower+vec3f(coarseID+1)*coarseSize);
+    };
+
+    std::vector<range1f> coarseRanges(numCoarse);
+    std::vector<uint8_t> refine(numCoarse,0);
+    parallel_for_blocked(0ull,numCoarse,256,[&](size_t begin, size_t end) {
+      for (size_t cellID=begin; cellID<end; ++cellID) {
+        range1f range{1e30f,-1e30f};
+        const box3f cb = cellBounds(cellID);
+        const float cellVolume = volume(cb);
+        float coveredVolume = 0.f;
+        float weightedWidth = 0.f;
+        for (size_t i=offsets[cellID]; i<offsets[cellID+1]; ++i) {
+          const uint32_t primID = cellPrims[i];
+          range.lower = fminf(range.lower,ranges[primID].lower);
+          range.upper = fmaxf(range.upper,ranges[primID].upper);
+          const float overlap = volume(intersection(domains[primID],cb));
+          coveredVolume += overlap;
+          weightedWidth += overlap*(ranges[primID].upper-ranges[primID].lower);
+        }
+        coarseRanges[cellID] = range;
+
+        if (this->refinement == 1 || range.upper < range.lower)
+          continue;
+
+        const bool partiallyEmpty = coveredVolume < cellVolume*(1.f-1e-3f);
+        const float width = range.upper-range.lower;
+        const float avgWidth = coveredVolume > 0.f ? weightedWidth/coveredVolume : 0.f;
+        refine[cellID] = partiallyEmpty || width > refineThreshold*avgWidth;
+      }
+    });
+
+    // ==================================================================
+    // Assign leaf IDs; fine cells of a refined cell are contiguous
+    // ==================================================================
+
+    const size_t numFine = size_t(this->refinement)*this->refinement*this->refinement;
+
+    cells.resize(numCoarse);
+    size_t numLeaves = 0;
+    size_t numRefined = 0;
+    for (size_t cellID=0; cellID<numCoarse; ++cellID) {
+      if (refine[cellID]) {
+        cells[cellID] = uint32_t(numLeaves) | AdaptiveGridTraversable::REFINED;
+        numLeaves += numFine;
+        numRefined++;
+      } else {
+        cells[cellID] = uint32_t(numLeaves);
+        numLeaves++;
+      }
+      if (numLeaves >= AdaptiveGridTraversable::REFINED)
+        throw std::runtime_error("AdaptiveGrid: too many leaves");
+    }
+
+    // ==================================================================
+    // Leaf value ranges; fine ranges from the coarse cell's primitives
+    // ==================================================================
+
+    valueRanges.assign(numLeaves,range1f{1e30f,-1e30f});
+    const vec3i fineDims(this->refinement);
+    parallel_for_blocked(0ull,numCoarse,64,[&](size_t begin, size_t end) {
+      for (size_t cellID=begin; cellID<end; ++cellID) {
+        const uint32_t cell = cells[cellID];
+        if (!(cell & AdaptiveGridTraversable::REFINED)) {
+          valueRanges[cell] = coarseRanges[cellID];
+          continue;
+        }
+
+        const uint32_t firstLeaf = cell & ~AdaptiveGridTraversable::REFINED;
+        const box3f cb = cellBounds(cellID);
+        for (size_t i=offsets[cellID]; i<offsets[cellID+1]; ++i) {
+          const uint32_t primID = cellPrims[i];
+          const box3f overlap = intersection(domains[primID],cb);
+          const vec3i lo = projectOnGrid(overlap.lower,fineDims,cb);
+          const vec3i hi = projectOnGrid(overlap.upper,fineDims,cb);
+          for (int z=lo.z; z<=hi.z; ++z)
+          for (int y=lo.y; y<=hi.y; ++y)
+          for (int x=lo.x; x<=hi.x; ++x) {
+            range1f &leafRange = valueRanges[firstLeaf+linearIndex(vec3i(x,y,z),fineDims)];
+            leafRange.lower = fminf(leafRange.lower,ranges[primID].lower);
+            leafRange.upper = fmaxf(leafRange.upper,ranges[primID].upper);
+          }
+        }
+      }
+    });
+
+    maxOpacities.clear();
+
+    stats.numCoarseCells  = numCoarse;
+    stats.numRefinedCells = numRefined;
+    stats.numLeaves       = numLeaves;
+    stats.numCellPrims    = cellPrims.size();
+    stats.buildTime       = getCurrentTime()-t0;
+  }
+
+  void AdaptiveGrid::computeMaxOpacities(const vec4f *colorMap,
+                                         size_t numColors,
+                                         range1f xfRange)
+  {
+    TFRangeMax xfRangeMax;
+    xfRangeMax.build(colorMap,numColors);
+    const TFRangeMaxTraversable rm = xfRangeMax.traversable();
+
+    maxOpacities.resize(valueRanges.size());
+    parallel_for_blocked(0ull,valueRanges.size(),4096,[&](size_t begin, size_t end) {
+      for (size_t i=begin; i<end; ++i) {
+        maxOpacities[i] = maxOpacity(valueRanges[i],rm,xfRange);
+      }
+    });
+  }
+
+  void AdaptiveGrid::initGPU(OWLContext owl)
+  {
+    cellBuffer       = owlDeviceBufferCreate(owl,OWL_UINT,cells.size(),cells.data());
+    valueRangeBuffer = owlDeviceBufferCreate(owl,OWL_USER_TYPE(range1f),
+                                             valueRanges.size(),valueRanges.data());
+    maxOpacityBuffer = owlDeviceBufferCreate(owl,OWL_FLOAT,valueRanges.size(),nullptr);
+
+    deviceTraversable = traversable();
+    deviceTraversable.cells = (const uint32_t *)owlBufferGetPointer(cellBuffer,0);
+  }
+
+  size_t AdaptiveGrid::bytes() const
+  {
+    return cells.size()*sizeof(cells[0])
+         + valueRanges.size()*sizeof(valueRanges[0])
+         + valueRanges.size()*sizeof(float); // majorants
+  }
+
+  void AdaptiveGrid::printStats() const
+  {
+    std::cout << "#exa: adaptive grid " << dims << " x " << refinement
+              << ": " << prettyNumber(stats.numLeaves) << " leaves, "
+              << prettyNumber(stats.numRefinedCells) << " of "
+              << prettyNumber(stats.numCoarseCells) << " cells refined ("
+              << (stats.numCoarseCells ? 100.0*stats.numRefinedCells/stats.numCoarseCells : 0.0)
+              << "%), built in " << prettyDouble(stats.buildTime) << "s\n";
+    std::cout << "#exa: memory: " << prettyBytes(bytes())
+              << ", avg prims/cell: "
+              << (stats.numCoarseCells ? stats.numCellPrims/double(stats.numCoarseCells) : 0.0)
+              << '\n';
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
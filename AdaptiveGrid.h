@@ -0,0 +1,211 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <owl/common/math/box.h>
+#include <owl/common/math/vec.h>
+#include <owl/owl.h>
+#include "common.h"
+#include "Grid.cuh"
+#include "TFRangeMax.h"
+
+namespace exa {
+
+  /*! Host- or device-side view of an AdaptiveGrid */
+  struct AdaptiveGridTraversable {
+    //! Set in cells[i] if coarse cell i is refined
+    static const uint32_t REFINED = 0x80000000u;
+
+    owl::vec3i      dims;       // coarse cells
+    int             refinement; // fine cells per coarse cell and dimension
+    owl::box3f      bounds;
+    /*! per coarse cell: its leaf ID, or, if REFINED is set, the leaf ID
+      of its first fine cell (the others follow in linear order) */
+    const uint32_t *cells;
+  };
+
+  /*! Two-level majorant grid: a uniform coarse grid, each cell of which
+    is either a leaf, or refined into refinement^3 fine cells that are
+    leaves. Coarse cells are refined where the value ranges of the
+    primitives inside vary (the cell's range is wider than the average
+    primitive's), and where they are only partially covered, so that
+    majorants are tight around fine structures and empty space is
+    skipped at fine granularity, while uniform regions cost a single
+    cell. Like with Grid, valueRanges and maxOpacities are per leaf,
+    and traversal calls func(leafID,t0,t1). With refinement 1, this is
+    a plain uniform grid */
+  struct AdaptiveGrid
+  {
+    typedef std::shared_ptr<AdaptiveGrid> SP;
+
+    struct Stats {
+      size_t numCoarseCells  = 0;
+      size_t numRefinedCells = 0;
+      size_t numLeaves       = 0;
+      size_t numCellPrims    = 0; // (coarse cell,primitive) pairs
+      double buildTime       = 0.0;
+    };
+
+    /*! Build from primitives with domains and value ranges (e.g., ABRs);
+      coarse cells are refined if their range is more than
+      refineThreshold times as wide as the average (by volume) range
+      of the primitives inside, or if less than all of the cell is
+      covered by primitives */
+    void build(const box3f   *domains,
+               const range1f *ranges,
+               size_t         numPrims,
+               const box3f   &bounds,
+               const vec3i    dims,
+               int            refinement = 8,
+               float          refineThreshold = 2.f);
+
+    //! Per-leaf majorants, as Grid::computeMaxOpacities() does on the GPU
+    void computeMaxOpacities(const vec4f *colorMap,
+                             size_t numColors,
+                             range1f xfRange);
+
+    AdaptiveGridTraversable traversable() const
+    { return {dims,refinement,worldBounds,cells.data()}; }
+
+    /*! upload cells and valueRanges, create the (uninitialized)
+      maxOpacityBuffer, and set deviceTraversable */
+    void initGPU(OWLContext owl);
+
+    size_t numLeaves() const { return valueRanges.size(); }
+
+    size_t bytes() const;
+
+    void printStats() const;
+
+    vec3i dims{0};
+    int   refinement = 1;
+    box3f worldBounds;
+
+    std::vector<uint32_t> cells;        // see AdaptiveGridTraversable
+    std::vector<range1f>  valueRanges;  // per leaf
+    std::vector<float>    maxOpacities; // per leaf
+
+    Stats stats;
+
+    // GPU copies, see initGPU()
+    AdaptiveGridTraversable deviceTraversable;
+    OWLBuffer cellBuffer{ 0 };
+    OWLBuffer valueRangeBuffer{ 0 };
+    OWLBuffer maxOpacityBuffer{ 0 };
+  };
+
+  /*! DDA over the cells of a uniform grid spanning bounds, restricted
+    to [tmin,tmax] along the ray; calls func(cellID,t0,t1) front to
+    back until it returns false. Returns false if func stopped it */
+  template <typename Func>
+  inline __both__
+  bool ddaGrid(const vec3f  org,
+               const vec3f  dir,
+               const vec3i  dims,
+               const box3f &bounds,
+               float        tmin,
+               float        tmax,
+               const Func  &func)
+  {
+    const vec3f rcpDir(dir.x != 0.f ? 1.f/dir.x : 1e30f,
+                       dir.y != 0.f ? 1.f/dir.y : 1e30f,
+                       dir.z != 0.f ? 1.f/dir.z : 1e30f);
+
+    const vec3f lo = (bounds.lower-org)*rcpDir;
+    const vec3f hi = (bounds.upper-org)*rcpDir;
+    const float t0 = fmaxf(tmin,reduce_max(min(lo,hi)));
+    const float t1 = fminf(tmax,reduce_min(max(lo,hi)));
+    if (t0 >= t1)
+      return true;
+
+    const vec3f cellSize = bounds.size()/vec3f(dims);
+    vec3i cellID = projectOnGrid(org+dir*t0,dims,bounds);
+
+    vec3i step;
+    vec3f tnext, tdelta;
+    for (int i=0; i<3; ++i) {
+      if (dir[i] > 0.f) {
+        step[i] = 1;
+        tnext[i] = (bounds.lower[i]+(cellID[i]+1)*cellSize[i]-org[i])*rcpDir[i];
+        tdelta[i] = cellSize[i]*rcpDir[i];
+      } else if (dir[i] < 0.f) {
+        step[i] = -1;
+        tnext[i] = (bounds.lower[i]+cellID[i]*cellSize[i]-org[i])*rcpDir[i];
+        tdelta[i] = -cellSize[i]*rcpDir[i];
+      } else {
+        step[i] = 0;
+        tnext[i] = 1e30f;
+        tdelta[i] = 0.f;
+      }
+    }
+
+    float t = t0;
+    while (1) {
+      const float tn = fmaxf(t,fminf(reduce_min(tnext),t1));
+      if (!func(linearIndex(cellID,dims),t,tn))
+        return false;
+
+      if (tn >= t1)
+        return true;
+
+      const int axis = tnext.x <= tnext.y
+          ? (tnext.x <= tnext.z ? 0 : 2)
+          : (tnext.y <= tnext.z ? 1 : 2);
+      cellID[axis] += step[axis];
+      if (cellID[axis] < 0 || cellID[axis] >= dims[axis])
+        return true;
+      tnext[axis] += tdelta[axis];
+      t = tn;
+    }
+  }
+
+  /*! Front-to-back traversal of the leaves of an AdaptiveGrid along
+    [tmin,tmax]; calls func(leafID,t0,t1) until it returns false */
+  template <typename Func>
+  inline __both__
+  void traverse(const AdaptiveGridTraversable &grid,
+                const vec3f org,
+                const vec3f dir,
+                float tmin,
+                float tmax,
+                const Func &func)
+  {
+    const vec3f coarseSize = grid.bounds.size()/vec3f(grid.dims);
+    const vec3i fineDims(grid.refinement);
+
+    ddaGrid(org,dir,grid.dims,grid.bounds,tmin,tmax,
+      [&](size_t cellID, float t0, float t1) {
+        const uint32_t cell = grid.cells[cellID];
+        if (!(cell & AdaptiveGridTraversable::REFINED))
+          return func((int)cell,t0,t1);
+
+        const vec3i coarseID = gridIndex(cellID,grid.dims);
+        const box3f cellBounds(grid.bounds.lower+vec3f(coarseID)*coarseSize,
+                               grid.bounds.lower+vec3f(coarseID+1)*coarseSize);
+        const uint32_t firstLeaf = cell & ~AdaptiveGridTraversable::REFINED;
+        return ddaGrid(org,dir,fineDims,cellBounds,t0,t1,
+          [&](size_t fineID, float s0, float s1) {
+            return func((int)(firstLeaf+fineID),s0,s1);
+          });
+      });
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -22,13 +22,18 @@
 namespace exa {
 
   typedef vec3i GridIterationState;
-  
-  template <typename Func, int RT=0, int NRT=1>
-  inline __device__
-  void dda3(const owl::RayT<RT,NRT> &ray,
-            const owl::vec3i        &gridDims,
-            const owl::box3f        &modelBounds,
-            const Func              &func)
+
+  /*! DDA over the cells of the grid spanning modelBounds; calls
+    func(cellID,t0,t1) front to back until it returns false, or the
+    ray leaves the grid or reaches tmax. Ray is anything with origin,
+    direction, tmin and tmax (owl::RayT on the device, a plain struct
+    on the host); its origin must lie inside modelBounds */
+  template <typename Func, typename Ray>
+  inline __both__
+  void dda3(const Ray          &ray,
+            const owl::vec3i   &gridDims,
+            const owl::box3f   &modelBounds,
+            const Func         &func)
   {
     using namespace owl;
 
@@ -77,6 +82,9 @@ namespace exa {
       if (!func(linearIndex(cellID,gridDims),t0,t1))
         return;
 
+      if (t1 >= ray.tmax)
+        return;
+
 #if 0
       int axis = arg_min(tnext);
       tnext[axis] += dist[axis];
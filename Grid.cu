@@ -347,6 +347,10 @@ namespace exa {
       std::cout << cudaGetErrorString(cudaGetLastError()) << '\n';
     }
 
+#if EXA_STITCH_GRID_RANGE_BITS < 32
+    quantizeValueRanges(owl);
+#endif
+
     // init device traversable for DDA
 #ifdef EXA_STITCH_MIRROR_EXAJET
     deviceTraversable.traversable.dims = dims;
@@ -408,7 +412,7 @@ namespace exa {
             for (int x=0; x<brick.size.x; ++x) {
               vec3i index3(x,y,z);
               int idx = brick.getIndexIndex(index3);
-              const float value = sampler->model->scalars[idx];
+              const float value = sampler->model->scalarData()[idx];
 
               vec3i lower = brick.lower + index3*(1<<brick.level);
               vec3i upper = lower + (1<<brick.level);
@@ -442,6 +446,10 @@ namespace exa {
                                           hValueRanges.data());
     }
 
+#if EXA_STITCH_GRID_RANGE_BITS < 32
+    quantizeValueRanges(owl);
+#endif
+
     // init device traversable for DDA
 #ifdef EXA_STITCH_MIRROR_EXAJET
     deviceTraversable.traversable.dims = dims;
@@ -581,6 +589,10 @@ namespace exa {
       std::cout << tlast-tfirst << '\n';
     }
 
+#if EXA_STITCH_GRID_RANGE_BITS < 32
+    quantizeValueRanges(owl);
+#endif
+
     // init device traversable for DDA
 #ifdef EXA_STITCH_MIRROR_EXAJET
     deviceTraversable.traversable.dims = dims;
@@ -629,6 +641,10 @@ namespace exa {
       std::cout << cudaGetErrorString(cudaGetLastError()) << '\n';
     }
 
+#if EXA_STITCH_GRID_RANGE_BITS < 32
+    quantizeValueRanges(owl);
+#endif
+
     // init device traversable for DDA
 #ifdef EXA_STITCH_MIRROR_EXAJET
     deviceTraversable.traversable.dims = dims;
@@ -683,51 +699,82 @@ namespace exa {
     return true;
   }
 
-  __global__ void computeMaxOpacitiesGPU(float         *maxOpacities,
-                                         const range1f *valueRanges,
-                                         const vec4f   *colorMap,
-                                         size_t         numMCs,
-                                         size_t         numColors,
-                                         range1f        xfRange)
+  template <typename Ranges>
+  __global__ void computeMaxOpacitiesGPU(float                 *maxOpacities,
+                                         Ranges                 valueRanges,
+                                         TFRangeMaxTraversable  xfRangeMax,
+                                         size_t                 numMCs,
+                                         range1f                xfRange)
   {
     size_t threadID = blockIdx.x * size_t(blockDim.x) + threadIdx.x;
 
     if (threadID >= numMCs)
       return;
 
-    range1f valueRange = valueRanges[threadID];
+    maxOpacities[threadID] = maxOpacity(valueRanges[threadID],xfRangeMax,xfRange);
+  }
 
-    if (valueRange.upper < valueRange.lower) {
-      maxOpacities[threadID] = 0.f;
-      return;
+  GridValueRanges Grid::deviceValueRanges() const
+  {
+#if EXA_STITCH_GRID_RANGE_BITS < 32
+    return {(const QuantizedRange<GridRangeCode> *)owlBufferGetPointer(quantizedValueRanges,0),
+            rangeQuantizer};
+#else
+    return {(const range1f *)owlBufferGetPointer(valueRanges,0),sizeof(range1f)};
+#endif
+  }
+
+  std::vector<range1f> Grid::hostValueRanges() const
+  {
+    size_t numMCs = dims.x*size_t(dims.y)*dims.z;
+    std::vector<range1f> result(numMCs);
+#if EXA_STITCH_GRID_RANGE_BITS < 32
+    std::vector<QuantizedRange<GridRangeCode>> codes(numMCs);
+    cudaMemcpy(codes.data(),owlBufferGetPointer(quantizedValueRanges,0),
+               numMCs*sizeof(codes[0]),cudaMemcpyDeviceToHost);
+    for (size_t i=0; i<numMCs; ++i) {
+      result[i] = rangeQuantizer.decode(codes[i]);
     }
+#else
+    cudaMemcpy(result.data(),owlBufferGetPointer(valueRanges,0),
+               numMCs*sizeof(range1f),cudaMemcpyDeviceToHost);
+#endif
+    return result;
+  }
 
-    valueRange.lower -= xfRange.lower;
-    valueRange.lower /= xfRange.upper-xfRange.lower;
-    valueRange.upper -= xfRange.lower;
-    valueRange.upper /= xfRange.upper-xfRange.lower;
+#if EXA_STITCH_GRID_RANGE_BITS < 32
+  void Grid::quantizeValueRanges(OWLContext owl)
+  {
+    std::vector<range1f> hValueRanges(dims.x*size_t(dims.y)*dims.z);
+    cudaMemcpy(hValueRanges.data(),owlBufferGetPointer(valueRanges,0),
+               hValueRanges.size()*sizeof(range1f),cudaMemcpyDeviceToHost);
 
-    int lo = clamp(int(valueRange.lower*(numColors-1)),0,(int)numColors-1);
-    int hi = clamp(int(valueRange.upper*(numColors-1))+1,0,(int)numColors-1);
+    std::vector<QuantizedRange<GridRangeCode>> codes;
+    rangeQuantizer = quantizeRanges(hValueRanges,codes);
 
-    float maxOpacity = 0.f;
-    for (int i=lo; i<=hi; ++i) {
-      maxOpacity = fmaxf(maxOpacity,colorMap[i].w);
-    }
-    maxOpacities[threadID] = maxOpacity;
+    quantizedValueRanges = owlDeviceBufferCreate(owl, OWL_USER_TYPE(QuantizedRange<GridRangeCode>),
+                                                 codes.size(),codes.data());
+    owlBufferRelease(valueRanges);
+    valueRanges = 0;
+
+    std::cout << "#exa: MC value ranges quantized to " << EXA_STITCH_GRID_RANGE_BITS
+              << " bits: " << prettyBytes(hValueRanges.size()*sizeof(range1f)) << " -> "
+              << prettyBytes(codes.size()*sizeof(codes[0])) << '\n';
   }
+#endif
 
   void Grid::computeMaxOpacities(OWLContext owl, OWLBuffer colorMap, range1f xfRange)
   {
     size_t numMCs = dims.x*size_t(dims.y)*dims.z;
-    size_t numColors = owlBufferSizeInBytes(colorMap)/sizeof(vec4f);
+
+    xfRangeMax.build(owl,colorMap);
 
     size_t numThreads = 1024;
     computeMaxOpacitiesGPU<<<(uint32_t)iDivUp(numMCs, numThreads), (uint32_t)numThreads>>>(
       (float *)owlBufferGetPointer(maxOpacities,0),
-      (const range1f *)owlBufferGetPointer(valueRanges,0),
-      (const vec4f *)owlBufferGetPointer(colorMap,0),
-      numMCs,numColors,xfRange);
+      deviceValueRanges(),
+      xfRangeMax.traversable(),
+      numMCs,xfRange);
 
 #if EXA_STITCH_EXA_BRICK_TRAVERSAL_MODE == MC_BVH_TRAVERSAL
     owlGroupBuildAccel(blas);
@@ -735,6 +782,33 @@ namespace exa {
 #endif
   }
 
+  MajorantUpdateStats Grid::updateMaxOpacities(OWLContext owl,
+                                               OWLBuffer colorMap,
+                                               range1f xfRange,
+                                               range1f changedValues)
+  {
+    if (!updater.index.built) {
+      std::vector<range1f> hValueRanges = hostValueRanges();
+      updater.index.build(hValueRanges.data(),hValueRanges.size());
+    }
+
+    xfRangeMax.build(owl,colorMap);
+
+    MajorantUpdateStats stats = updater.update(owl,
+      (float *)owlBufferGetPointer(maxOpacities,0),
+      deviceValueRanges(),
+      xfRangeMax.traversable(),xfRange,changedValues);
+
+#if EXA_STITCH_EXA_BRICK_TRAVERSAL_MODE == MC_BVH_TRAVERSAL
+    if (stats.numUpdated > 0) {
+      owlGroupBuildAccel(blas);
+      owlGroupBuildAccel(tlas);
+    }
+#endif
+
+    return stats;
+  }
+
 } // ::exa
 
 // vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -22,9 +22,26 @@
 #include <owl/common/math/vec.h>
 #include "common.h"
 #include "Grid.cuh"
+#include "TFRangeMax.h"
+
+#ifndef EXA_STITCH_GRID_RANGE_BITS
+#define EXA_STITCH_GRID_RANGE_BITS 32
+#endif
 
 namespace exa {
 
+  // MC value ranges are stored as floats, or (conservatively)
+  // quantized to 16 or 8 bits per bound, see Quantization.h
+#if EXA_STITCH_GRID_RANGE_BITS == 8
+  typedef uint8_t                        GridRangeCode;
+  typedef QuantizedRanges<GridRangeCode> GridValueRanges;
+#elif EXA_STITCH_GRID_RANGE_BITS == 16
+  typedef uint16_t                       GridRangeCode;
+  typedef QuantizedRanges<GridRangeCode> GridValueRanges;
+#else
+  typedef StridedRanges                  GridValueRanges;
+#endif
+
   class AMRCellSampler;
   class ExaBrickSampler;
   class ExaStitchSampler;
@@ -64,14 +81,41 @@ namespace exa {
     //
     void computeMaxOpacities(OWLContext owl, OWLBuffer colorMap, range1f xfRange);
 
+    // Recompute the majorants of MCs whose value range overlaps changedValues
+    MajorantUpdateStats updateMaxOpacities(OWLContext owl,
+                                           OWLBuffer colorMap,
+                                           range1f xfRange,
+                                           range1f changedValues);
+
+    // Device-side accessor for the value ranges, quantized or not
+    GridValueRanges deviceValueRanges() const;
+
+    // Host copy of the (decoded) value ranges
+    std::vector<range1f> hostValueRanges() const;
+
     GridTraversableHandle deviceTraversable;
 
-    // min/max value ranges
+    // min/max value ranges; with EXA_STITCH_GRID_RANGE_BITS < 32,
+    // these are only used during build and then quantized
     OWLBuffer  valueRanges;
 
+#if EXA_STITCH_GRID_RANGE_BITS < 32
+    OWLBuffer  quantizedValueRanges { 0 };
+    RangeQuantizer<GridRangeCode> rangeQuantizer;
+
+    // Replace valueRanges with quantizedValueRanges
+    void quantizeValueRanges(OWLContext owl);
+#endif
+
     // Majorants
     OWLBuffer  maxOpacities { 0 };
 
+    // Range-max table over the color map, for O(1) majorants
+    TFRangeMaxGPU xfRangeMax;
+
+    // Interval index over MC value ranges, for incremental updates
+    MajorantUpdater updater;
+
     // Number of MCs
     owl::vec3i dims;
 
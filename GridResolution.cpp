@@ -0,0 +1,267 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include <atomic>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <owl/common/parallel/parallel_for.h>
+#include "model/ParallelReduce.h"
+#include "Grid.cuh"
+#include "GridResolution.h"
+
+namespace exa {
+
+  inline vec3i aspectDims(const vec3f size, float longest)
+  {
+    const float maxSize = reduce_max(size);
+    return max(vec3i(1),vec3i(ceilf(longest*size.x/maxSize),
+                              ceilf(longest*size.y/maxSize),
+                              ceilf(longest*size.z/maxSize)));
+  }
+
+  vec3i GridResolution::choose(const Params &params, const vec3i fallback)
+  {
+    double t0 = getCurrentTime();
+
+    candidates.clear();
+    best = Candidate();
+    best.dims = fallback;
+
+    const size_t numPrims = std::min(domains.size(),valueRanges.size());
+    const vec3f size = bounds.size();
+    if (numPrims == 0 || reduce_min(size) <= 0.f)
+      return fallback;
+
+    // ==================================================================
+    // Global statistics
+    // ==================================================================
+
+    const range1f globalRange = parallelValueRange(numPrims,[this](size_t i) {
+      const range1f r = valueRanges[i];
+      return r.upper >= r.lower ? r : range1f();
+    });
+    float globalWidth = globalRange.upper-globalRange.lower;
+    if (!(globalWidth > 0.f))
+      globalWidth = 1.f;
+
+    // finest cell width that holds at least 1% of the cells, and the
+    // median cell width (weighted by cell count)
+    size_t numCells = 0;
+    for (size_t n : cellsPerLevel)
+      numCells += n;
+
+    float finestWidth = 0.f;
+    float medianWidth = cbrtf(volume(bounds)/numPrims);
+    if (numCells > 0) {
+      size_t sum = 0;
+      finestWidth = -1.f;
+      for (size_t level=0; level<cellsPerLevel.size(); ++level) {
+        if (finestWidth < 0.f && cellsPerLevel[level]*100 >= numCells)
+          finestWidth = float(1<<level);
+        sum += cellsPerLevel[level];
+        if (sum*2 >= numCells) {
+          medianWidth = float(1<<level);
+          break;
+        }
+      }
+      finestWidth = std::max(finestWidth,0.f);
+    }
+
+    // isotropic rays crossing the bounds: mean chord length is 4V/S
+    // (Cauchy), and the mean of |dir[i]| is 1/2
+    const float area = 2.f*(size.x*size.y+size.y*size.z+size.z*size.x);
+    const double meanChord = 4.0*volume(bounds)/area;
+
+    // collisions per ray if the majorant spanned the whole value range;
+    // assuming the TF is dense enough for one per (median) cell
+    const double fullSamples = meanChord/medianWidth;
+
+    // ==================================================================
+    // Spatial index over the primitives (CSR, about one cell per prim)
+    // ==================================================================
+
+    const float indexRes = cbrtf(float(numPrims)/volume(bounds))*reduce_max(size);
+    const vec3i indexDims = aspectDims(size,std::min(std::max(indexRes,1.f),256.f));
+    const size_t numIndexCells = indexDims.x*size_t(indexDims.y)*indexDims.z;
+    const vec3f indexCellSize = size/vec3f(indexDims);
+
+    std::vector<std::atomic<uint32_t>> counts(numIndexCells);
+    parallel_for_blocked(0ull,numPrims,1024,[&](size_t begin, size_t end) {
+      for (size_t primID=begin; primID<end; ++primID) {
+        const vec3i lo = projectOnGrid(domains[primID].lower,indexDims,bounds);
+        const vec3i hi = projectOnGrid(domains[primID].upper,indexDims,bounds);
+        for (int z=lo.z; z<=hi.z; ++z)
+        for (int y=lo.y; y<=hi.y; ++y)
+        for (int x=lo.x; x<=hi.x; ++x) {
+          counts[linearIndex(vec3i(x,y,z),indexDims)]++;
+        }
+      }
+    });
+
+    std::vector<size_t> offsets(numIndexCells+1);
+    offsets[0] = 0;
+    for (size_t i=0; i<numIndexCells; ++i) {
+      offsets[i+1] = offsets[i]+counts[i];
+      counts[i] = 0;
+    }
+
+    std::vector<uint32_t> cellPrims(offsets[numIndexCells]);
+    parallel_for_blocked(0ull,numPrims,1024,[&](size_t begin, size_t end) {
+      for (size_t primID=begin; primID<end; ++primID) {
+        const vec3i lo = projectOnGrid(domains[primID].lower,indexDims,bounds);
+        const vec3i hi = projectOnGrid(domains[primID].upper,indexDims,bounds);
+        for (int z=lo.z; z<=hi.z; ++z)
+        for (int y=lo.y; y<=hi.y; ++y)
+        for (int x=lo.x; x<=hi.x; ++x) {
+          const size_t cellID = linearIndex(vec3i(x,y,z),indexDims);
+          cellPrims[offsets[cellID]+counts[cellID]++] = (uint32_t)primID;
+        }
+      }
+    });
+
+    // ==================================================================
+    // Score candidates; the same random positions select the sampled
+    // MCs for all of them
+    // ==================================================================
+
+    std::vector<vec3f> positions(std::max(params.numSamples,1));
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(0.f,1.f);
+    for (vec3f &pos : positions) {
+      pos = bounds.lower+vec3f(dist(rng),dist(rng),dist(rng))*size;
+    }
+
+    std::vector<double> excess(positions.size());
+    std::vector<uint8_t> empty(positions.size());
+
+    for (int k=0;; ++k) {
+      const int longest = (int)roundf(16.f*powf(sqrtf(2.f),float(k)));
+      if (longest > params.maxDims)
+        break;
+
+      Candidate c;
+      c.dims = aspectDims(size,float(longest));
+      const size_t numMCs = c.dims.x*size_t(c.dims.y)*c.dims.z;
+      c.bytes = numMCs*(sizeof(range1f)+sizeof(float));
+
+      // always keep the coarsest candidate
+      const vec3f mcSize = size/vec3f(c.dims);
+      if (!candidates.empty() &&
+          (c.bytes > params.maxBytes || reduce_max(mcSize) < finestWidth))
+        break;
+
+      c.steps = 1.0+meanChord*0.5*(c.dims.x/size.x+c.dims.y/size.y+c.dims.z/size.z);
+
+      parallel_for_blocked(0ull,positions.size(),64,[&](size_t begin, size_t end) {
+        for (size_t i=begin; i<end; ++i) {
+          const vec3i mcID = projectOnGrid(positions[i],c.dims,bounds);
+          const box3f mcBounds(bounds.lower+vec3f(mcID)*mcSize,
+                               bounds.lower+vec3f(mcID+1)*mcSize);
+
+          range1f range{1e30f,-1e30f};
+          float coveredVolume = 0.f;
+          float weightedWidth = 0.f;
+
+          // index cells partition the MC, so overlaps are counted once
+          const vec3i lo = projectOnGrid(mcBounds.lower,indexDims,bounds);
+          const vec3i hi = projectOnGrid(mcBounds.upper,indexDims,bounds);
+          for (int z=lo.z; z<=hi.z; ++z)
+          for (int y=lo.y; y<=hi.y; ++y)
+          for (int x=lo.x; x<=hi.x; ++x) {
+            const vec3i indexID(x,y,z);
+            const size_t cellID = linearIndex(indexID,indexDims);
+            const box3f indexCell(bounds.lower+vec3f(indexID)*indexCellSize,
+                                  bounds.lower+vec3f(indexID+1)*indexCellSize);
+            const box3f clip = intersection(mcBounds,indexCell);
+            for (size_t j=offsets[cellID]; j<offsets[cellID+1]; ++j) {
+              const uint32_t primID = cellPrims[j];
+              if (!domains[primID].overlaps(mcBounds))
+                continue;
+              const range1f r = valueRanges[primID];
+              range.lower = fminf(range.lower,r.lower);
+              range.upper = fmaxf(range.upper,r.upper);
+              const float overlap = volume(intersection(domains[primID],clip));
+              coveredVolume += overlap;
+              weightedWidth += overlap*(r.upper-r.lower);
+            }
+          }
+
+          empty[i] = range.upper < range.lower;
+          if (empty[i]) {
+            excess[i] = 0.0;
+            continue;
+          }
+
+          // null collisions come from the MC range being wider than
+          // the primitives', and from uncovered parts of the MC
+          const float mcVolume = volume(mcBounds);
+          const float avgWidth = coveredVolume > 0.f ? weightedWidth/coveredVolume : 0.f;
+          const float coverage = mcVolume > 0.f ? std::min(coveredVolume/mcVolume,1.f) : 1.f;
+          excess[i] = ((range.upper-range.lower)-coverage*avgWidth)/globalWidth;
+        }
+      });
+
+      double sumExcess = 0.0;
+      size_t numEmpty = 0;
+      for (size_t i=0; i<positions.size(); ++i) {
+        sumExcess += excess[i];
+        numEmpty += empty[i];
+      }
+
+      c.nullSamples = fullSamples*sumExcess/positions.size();
+      c.emptyFraction = numEmpty/double(positions.size());
+      c.cost = params.stepCost*c.steps+params.sampleCost*c.nullSamples;
+      candidates.push_back(c);
+
+      if (candidates.size() == 1 || c.cost < best.cost)
+        best = c;
+    }
+
+    chooseTime = getCurrentTime()-t0;
+    return best.dims;
+  }
+
+  void GridResolution::printStats() const
+  {
+    if (candidates.empty()) {
+      std::cout << "#exa: no statistics for choosing the majorant grid resolution, using "
+                << best.dims << '\n';
+      return;
+    }
+
+    std::cout << "#exa: majorant grid candidates (dims, memory, steps/ray, "
+              << "null collisions/ray, empty MCs, cost):\n";
+    const std::streamsize precision = std::cout.precision();
+    for (const Candidate &c : candidates) {
+      std::cout << (c.dims == best.dims ? "#exa: * " : "#exa:   ")
+                << c.dims << ", " << prettyBytes(c.bytes) << ", "
+                << std::fixed << std::setprecision(1) << c.steps << ", "
+                << c.nullSamples << ", " << 100.0*c.emptyFraction << "%, "
+                << c.cost << '\n';
+      std::cout.unsetf(std::ios::floatfield);
+      std::cout.precision(precision);
+    }
+    std::cout << "#exa: chose majorant grid " << best.dims << " (predicted cost "
+              << prettyDouble(best.cost) << " per ray) in "
+              << prettyDouble(chooseTime) << "s\n";
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
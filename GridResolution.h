@@ -0,0 +1,78 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include <vector>
+#include <owl/common/math/box.h>
+#include <owl/common/math/vec.h>
+#include "common.h"
+
+namespace exa {
+
+  /*! Chooses the majorant grid resolution for a model from its
+    primitives (domains with value ranges, e.g., ABRs or gridlets),
+    its cell width histogram, and the aspect ratio of its bounds.
+    Candidate grids (longest axis 16 to maxDims, in steps of sqrt(2))
+    are scored by a CPU cost model that trades DDA steps per ray
+    against null collisions, which grow with how much wider the MC
+    value ranges are than those of the primitives inside (estimated
+    from numSamples random MCs). Candidates with MCs smaller than the
+    finest cells, or exceeding maxBytes, are not considered */
+  struct GridResolution
+  {
+    struct Params {
+      size_t maxBytes   = size_t(1)<<30; // value ranges + majorants
+      int    maxDims    = 1024;
+      int    numSamples = 8192;
+      //! relative cost of a DDA step and of a (null) collision
+      float  stepCost   = 1.f;
+      float  sampleCost = 8.f;
+    };
+
+    struct Candidate {
+      vec3i  dims{0};
+      size_t bytes = 0;
+      double steps = 0.0;       // expected DDA steps per ray
+      double nullSamples = 0.0; // expected null collisions per ray
+      double emptyFraction = 0.0;
+      double cost = 0.0;
+    };
+
+    // Input, filled in by Model::getGridStatistics()
+    box3f                bounds;
+    std::vector<box3f>   domains;
+    std::vector<range1f> valueRanges;
+    //! number of cells per level (cell width 1<<level)
+    std::vector<size_t>  cellsPerLevel;
+
+    /*! score the candidates and return the best one's dims; returns
+      the fallback if no primitives were provided */
+    vec3i choose(const Params &params, const vec3i fallback = vec3i(128));
+
+    vec3i choose() { return choose(Params()); }
+
+    void printStats() const;
+
+    std::vector<Candidate> candidates;
+    Candidate              best;
+    double                 chooseTime = 0.0;
+  };
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,98 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <algorithm>
+#include "IntervalIndex.h"
+
+namespace exa {
+
+  void IntervalIndex::build(const range1f *ranges,
+                            size_t numRanges,
+                            size_t stride)
+  {
+    auto rangeOf = [&](size_t i) -> const range1f & {
+      return *(const range1f *)((const char *)ranges+i*stride);
+    };
+
+    this->numRanges = numRanges;
+    this->classes.clear();
+    this->built = true;
+
+    float maxWidth = 0.f;
+    for (size_t i=0; i<numRanges; ++i) {
+      const range1f &r = rangeOf(i);
+      if (r.upper >= r.lower)
+        maxWidth = std::max(maxWidth,r.upper-r.lower);
+    }
+
+    // class k: widths in (maxWidth/2^(k+1),maxWidth/2^k], the last
+    // class takes all that are narrower (incl. zero width)
+    const int numClasses = 24;
+    auto classOf = [&](float width) {
+      int k = 0;
+      float w = maxWidth*.5f;
+      while (k < numClasses-1 && width <= w) {
+        w *= .5f;
+        ++k;
+      }
+      return k;
+    };
+
+    std::vector<std::vector<uint32_t>> members(numClasses);
+    for (size_t i=0; i<numRanges; ++i) {
+      const range1f &r = rangeOf(i);
+      if (r.upper < r.lower)
+        continue;
+      members[classOf(r.upper-r.lower)].push_back((uint32_t)i);
+    }
+
+    for (int k=0; k<numClasses; ++k) {
+      std::vector<uint32_t> &ids = members[k];
+      if (ids.empty())
+        continue;
+
+      std::sort(ids.begin(),ids.end(),[&](uint32_t a, uint32_t b) {
+        return rangeOf(a).lower < rangeOf(b).lower;
+      });
+
+      WidthClass wc;
+      wc.lower.resize(ids.size());
+      wc.upper.resize(ids.size());
+      wc.rangeID = ids;
+      for (size_t i=0; i<ids.size(); ++i) {
+        const range1f &r = rangeOf(ids[i]);
+        wc.lower[i] = r.lower;
+        wc.upper[i] = r.upper;
+        wc.maxWidth = std::max(wc.maxWidth,r.upper-r.lower);
+      }
+      classes.push_back(std::move(wc));
+    }
+  }
+
+  void IntervalIndex::query(range1f q, std::vector<uint32_t> &rangeIDs) const
+  {
+    for (const WidthClass &wc : classes) {
+      auto it = std::lower_bound(wc.lower.begin(),wc.lower.end(),q.lower-wc.maxWidth);
+      for (size_t i=it-wc.lower.begin(); i<wc.lower.size() && wc.lower[i]<=q.upper; ++i) {
+        if (wc.upper[i] >= q.lower)
+          rangeIDs.push_back(wc.rangeID[i]);
+      }
+    }
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,55 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "common.h"
+
+namespace exa {
+
+  /*! Static index over value ranges to find those overlapping a query
+    range. Ranges are split into classes of (power-of-two) widths,
+    each sorted by lower bound; in a class of widths up to w, only
+    ranges with lower bound in [q.lower-w,q.upper] are candidates,
+    and as their widths are at least w/2, few of them are misses.
+    Empty ranges (upper<lower) are not indexed */
+  struct IntervalIndex
+  {
+    struct WidthClass {
+      float                 maxWidth = 0.f;
+      std::vector<float>    lower;
+      std::vector<float>    upper;
+      std::vector<uint32_t> rangeID;
+    };
+
+    /*! ranges[i] is at byte offset i*stride (e.g., inside an ABR) */
+    void build(const range1f *ranges,
+               size_t numRanges,
+               size_t stride = sizeof(range1f));
+
+    //! IDs of the ranges overlapping q (closed intervals), appended
+    void query(range1f q, std::vector<uint32_t> &rangeIDs) const;
+
+    bool   built = false;
+    size_t numRanges = 0;
+    std::vector<WidthClass> classes;
+  };
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -15,10 +15,19 @@
 // ======================================================================== //
 
 #include <float.h>
+#include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <iostream>
 #include <numeric>
+#include <stdexcept>
 #include <cuda_runtime.h>
+#include <owl/common/parallel/parallel_for.h>
+#include "common.h"
 #include "KDTree.h"
+#include "model/AccelFile.h"
+#include "model/ParallelReduce.h"
+#include "model/RadixSort.h"
 
 using namespace owl;
 using namespace owl::common;
@@ -50,8 +59,31 @@ namespace exa {
   {
     KDTree::SP result = std::make_shared<KDTree>();
 
+    if (AccelFile::isAccelFile(fileName)) {
+      std::string error;
+      AccelFile::SP file = AccelFile::open(fileName,error);
+      if (!file)
+        throw std::runtime_error("KDTree::load: "+error);
+
+      result->nodes       = file->read<KDTreeNode>(AccelFile::KDTREE_NODES);
+      result->primRefs    = file->read<PrimRef>(AccelFile::KDTREE_PRIM_REFS);
+      result->modelBounds = file->header().bounds;
+
+      if (!result->primRefs.empty() && !result->validate(result->primRefs.size(),error))
+        throw std::runtime_error("KDTree::load: "+fileName+": "+error);
+
+      return result;
+    }
+
+    // legacy files: raw nodes, sized by the file length
     std::ifstream in(fileName, std::ios::binary | std::ios::ate);
+    if (!in.good())
+      throw std::runtime_error("KDTree::load: cannot open "+fileName);
+
     std::streampos size = in.tellg();
+    if (size % sizeof(KDTreeNode) != 0)
+      throw std::runtime_error("KDTree::load: "+fileName+" is not a kd-tree file");
+
     result->nodes.resize(size/sizeof(KDTreeNode));
     in.seekg(0);
     in.read((char*)result->nodes.data(), size);
@@ -59,8 +91,384 @@ namespace exa {
     return result;
   }
 
+  bool KDTree::validate(size_t numPrims, std::string &error) const
+  {
+    if (nodes.empty()) {
+      error = "no nodes";
+      return false;
+    }
+
+    // depth-first from the root, as traversal would; in a tree, no
+    // node is visited twice, so more visits than nodes means cycles
+    struct Entry { size_t nodeID; int depth; };
+    std::vector<Entry> stack{ {0,0} };
+    size_t numVisited = 0;
+    while (!stack.empty()) {
+      const Entry e = stack.back();
+      stack.pop_back();
+
+      if (++numVisited > nodes.size()) {
+        error = "nodes are referenced more than once";
+        return false;
+      }
+
+      const KDTreeNode &node = nodes[e.nodeID];
+      if (node.is_inner()) {
+        const size_t child = node.get_child(0);
+        if (child+1 >= nodes.size()) {
+          error = "node "+std::to_string(e.nodeID)+" has invalid children";
+          return false;
+        }
+        if (e.depth+1 > kd::STACK_SIZE) {
+          error = "tree is deeper than the traversal stack ("
+              +std::to_string((int)kd::STACK_SIZE)+")";
+          return false;
+        }
+        stack.push_back({child,e.depth+1});
+        stack.push_back({child+1,e.depth+1});
+      } else {
+        const auto indices = node.get_indices();
+        const size_t numRefs = primRefs.empty() ? numPrims : primRefs.size();
+        if (indices.first >= indices.last || indices.last > numRefs) {
+          error = "leaf "+std::to_string(e.nodeID)+" references invalid primitives";
+          return false;
+        }
+      }
+    }
+
+    for (size_t i=0; i<primRefs.size(); ++i) {
+      if (primRefs[i].primID >= numPrims) {
+        error = "prim ref "+std::to_string(i)+" references an invalid primitive";
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool KDTree::save(const std::string fileName) const
+  {
+    return AccelFile::write(fileName,modelBounds,{
+      {AccelFile::KDTREE_NODES,sizeof(KDTreeNode),nodes.size(),nodes.data()},
+      {AccelFile::KDTREE_PRIM_REFS,sizeof(PrimRef),primRefs.size(),primRefs.data()},
+    });
+  }
+
+  // ==================================================================
+  // Builder
+  // ==================================================================
+
+  struct KDTreeBuildTask {
+    box3f                 bounds; // the node's region
+    std::vector<uint32_t> prims;  // boxes overlapping it
+    uint32_t              nodeID;
+    int                   depth;
+  };
+
+  struct KDTreeSplit {
+    int   axis = -1;
+    float plane = 0.f;
+    float cost = FLT_MAX;
+  };
+
+  //! box coordinates are integers, so they sort by their int keys
+  static void sortCoords(std::vector<float> &coords, bool parallel)
+  {
+    if (!parallel) {
+      std::sort(coords.begin(),coords.end());
+      return;
+    }
+
+    std::vector<uint32_t> keys(coords.size());
+    parallel_for_blocked(0ull,coords.size(),1<<16,[&](size_t begin, size_t end) {
+      for (size_t i=begin; i<end; ++i)
+        keys[i] = uint32_t((int)coords[i])^0x80000000u;
+    });
+    radixSortPairs(keys,coords);
+  }
+
+  /*! candidate planes are the box faces strictly inside the region;
+    a plane is valid if it leaves fewer boxes on either side than in
+    the node (and none of the sides empty), which disjoint boxes
+    always permit. With parallel, the axes, sorts and plane sweeps
+    run in parallel; the result is the same as the serial one */
+  static KDTreeSplit findSplit(const KDTreeBuildTask &task,
+                               const box3f *boxes,
+                               KDTree::BuildMode mode,
+                               bool parallel)
+  {
+    const size_t n = task.prims.size();
+    const box3f &region = task.bounds;
+
+    int axes[3] = {0,1,2};
+    if (mode == KDTree::Median) {
+      const vec3f size = region.size();
+      std::sort(axes,axes+3,[&](int a, int b) { return size[a] > size[b]; });
+    }
+
+    auto better = [](const KDTreeSplit &a, const KDTreeSplit &b) {
+      return b.cost < a.cost ? b : a;
+    };
+
+    auto splitAxis = [&](int axis) {
+      std::vector<float> lowers(n), uppers(n);
+      auto clip = [&](size_t begin, size_t end) {
+        for (size_t i=begin; i<end; ++i) {
+          const box3f &box = boxes[task.prims[i]];
+          lowers[i] = std::max(box.lower[axis],region.lower[axis]);
+          uppers[i] = std::min(box.upper[axis],region.upper[axis]);
+        }
+      };
+      if (parallel)
+        parallel_for_blocked(0ull,n,1<<16,clip);
+      else
+        clip(0,n);
+
+      if (parallel) {
+        parallel_for(2,[&](int i) { sortCoords(i==0 ? lowers : uppers,true); });
+      } else {
+        sortCoords(lowers,false);
+        sortCoords(uppers,false);
+      }
+
+      // faces strictly inside the region, sorted and unique
+      std::vector<float> planes(2*n);
+      planes.erase(std::merge(std::upper_bound(lowers.begin(),lowers.end(),region.lower[axis]),
+                              lowers.end(),
+                              uppers.begin(),
+                              std::lower_bound(uppers.begin(),uppers.end(),region.upper[axis]),
+                              planes.begin()),
+                   planes.end());
+      planes.erase(std::unique(planes.begin(),planes.end()),planes.end());
+
+      // approximately the median box center
+      const float median = 0.5f*(lowers[n/2]+uppers[n/2]);
+
+      auto sweep = [&](size_t begin, size_t end) {
+        KDTreeSplit best;
+        for (size_t i=begin; i<end; ++i) {
+          const float plane = planes[i];
+          const size_t numLeft = std::lower_bound(lowers.begin(),lowers.end(),plane)-lowers.begin();
+          const size_t numRight = n-(std::upper_bound(uppers.begin(),uppers.end(),plane)-uppers.begin());
+          if (numLeft == 0 || numRight == 0 || numLeft == n || numRight == n)
+            continue;
+
+          float cost = 0.f;
+          if (mode == KDTree::SAH) {
+            box3f left = region, right = region;
+            left.upper[axis] = plane;
+            right.lower[axis] = plane;
+            cost = halfArea(left)*numLeft+halfArea(right)*numRight;
+          } else {
+            cost = fabsf(plane-median);
+          }
+
+          if (cost < best.cost) {
+            best.axis  = axis;
+            best.plane = plane;
+            best.cost  = cost;
+          }
+        }
+        return best;
+      };
+
+      return parallel ? parallelReduce(planes.size(),KDTreeSplit(),sweep,better,1<<14)
+                      : sweep(0,planes.size());
+    };
+
+    KDTreeSplit axisSplits[3];
+    if (parallel) {
+      parallel_for(3,[&](int i) { axisSplits[i] = splitAxis(axes[i]); });
+    } else {
+      for (int i=0; i<3; ++i) {
+        axisSplits[i] = splitAxis(axes[i]);
+        if (mode == KDTree::Median && axisSplits[i].axis >= 0)
+          break;
+      }
+    }
+
+    // SAH: cheapest over all axes, median: first valid along the
+    // longest axes
+    KDTreeSplit best;
+    for (int i=0; i<3; ++i) {
+      if (mode == KDTree::Median && axisSplits[i].axis >= 0)
+        return axisSplits[i];
+      best = better(best,axisSplits[i]);
+    }
+
+    return best;
+  }
+
+  KDTree::SP KDTree::build(size_t numBoxes,
+                           const box3f *boxes,
+                           const int *levels,
+                           BuildMode mode)
+  {
+    double t0 = getCurrentTime();
+
+    KDTree::SP result = std::make_shared<KDTree>();
+    if (numBoxes == 0)
+      return result;
+
+    std::atomic<bool> integral(true);
+    parallel_for_blocked(0ull,numBoxes,4096,[&](size_t begin, size_t end) {
+      for (size_t i=begin; i<end; ++i) {
+        const box3f &box = boxes[i];
+        for (int axis=0; axis<3; ++axis) {
+          if (box.lower[axis] != floorf(box.lower[axis]) ||
+              box.upper[axis] != floorf(box.upper[axis]))
+            integral = false;
+        }
+      }
+    });
+
+    if (!integral) {
+      throw std::runtime_error("KDTree::build: box coordinates must be integers");
+    }
+
+    auto maxLevel = [levels](const std::vector<uint32_t> &prims) {
+      int result = 0;
+      if (levels) {
+        for (uint32_t primID : prims)
+          result = std::max(result,levels[primID]);
+      }
+      return result;
+    };
+
+    box3f bounds;
+    for (size_t i=0; i<numBoxes; ++i) {
+      bounds.extend(boxes[i]);
+    }
+
+    Stats &stats = result->stats;
+    std::vector<KDTreeNode> &nodes = result->nodes;
+    nodes.resize(1);
+
+    std::vector<KDTreeBuildTask> open(1);
+    open[0].bounds = bounds;
+    open[0].prims.resize(numBoxes);
+    std::iota(open[0].prims.begin(),open[0].prims.end(),0u);
+    open[0].nodeID = 0;
+    open[0].depth  = 0;
+
+    std::vector<PrimRef> &primRefs = result->primRefs;
+
+    // level by level, the nodes of a level are split in parallel; as
+    // long as there are few of them, they are split one by one, each
+    // w/ a parallel findSplit
+    while (!open.empty()) {
+      std::vector<KDTreeSplit> splits(open.size());
+      std::vector<KDTreeBuildTask> children(2*open.size());
+      const bool parallelSplit = open.size() < 16;
+      auto splitTask = [&](size_t taskID) {
+        const KDTreeBuildTask &task = open[taskID];
+        if (task.prims.size() <= 1 || task.depth >= kd::STACK_SIZE)
+          return;
+
+        const KDTreeSplit split = findSplit(task,boxes,mode,
+                                            parallelSplit && task.prims.size() >= (1<<14));
+        splits[taskID] = split;
+        if (split.axis < 0)
+          return;
+
+        KDTreeBuildTask &left = children[2*taskID];
+        KDTreeBuildTask &right = children[2*taskID+1];
+        left.bounds = right.bounds = task.bounds;
+        left.bounds.upper[split.axis] = split.plane;
+        right.bounds.lower[split.axis] = split.plane;
+        for (uint32_t primID : task.prims) {
+          if (boxes[primID].lower[split.axis] < split.plane)
+            left.prims.push_back(primID);
+          if (boxes[primID].upper[split.axis] > split.plane)
+            right.prims.push_back(primID);
+        }
+        left.depth = right.depth = task.depth+1;
+      };
+      if (parallelSplit)
+        serial_for(open.size(),splitTask);
+      else
+        parallel_for(open.size(),splitTask);
+
+      std::vector<KDTreeBuildTask> next;
+      for (size_t taskID=0; taskID<open.size(); ++taskID) {
+        const KDTreeBuildTask &task = open[taskID];
+        const KDTreeSplit &split = splits[taskID];
+
+        KDTreeNode node = {};
+        if (split.axis < 0) {
+          // one box, boxes that overlap and can't be separated, or
+          // the max depth was reached
+          node.set_leaf((uint32_t)primRefs.size(),(uint32_t)task.prims.size());
+          node.max_level = maxLevel(task.prims);
+          for (uint32_t primID : task.prims)
+            primRefs.push_back({primID,boxes[primID]});
+          stats.numLeaves++;
+          if (task.prims.size() > 1) {
+            if (task.depth >= kd::STACK_SIZE)
+              stats.numDepthLimit++;
+            else
+              stats.numUnsplit++;
+          }
+        } else {
+          const uint32_t firstChild = (uint32_t)nodes.size();
+          if (firstChild+2 > 0x3FFFFFFFu)
+            throw std::runtime_error("KDTree::build: too many nodes");
+          node.set_inner(split.axis,(int)split.plane,maxLevel(task.prims));
+          node.set_first_child(firstChild);
+          nodes.resize(firstChild+2);
+          children[2*taskID].nodeID = firstChild;
+          children[2*taskID+1].nodeID = firstChild+1;
+          next.push_back(std::move(children[2*taskID]));
+          next.push_back(std::move(children[2*taskID+1]));
+          stats.numInnerNodes++;
+        }
+        nodes[task.nodeID] = node;
+        stats.maxDepth = std::max(stats.maxDepth,task.depth);
+      }
+      open.swap(next);
+    }
+
+    if (primRefs.size() > 0x3FFFFFFFu)
+      throw std::runtime_error("KDTree::build: too many prim refs");
+    stats.numDuplicates = primRefs.size() > numBoxes ? primRefs.size()-numBoxes : 0;
+    result->modelBounds = bounds;
+
+    stats.buildTime = getCurrentTime()-t0;
+
+    return result;
+  }
+
+  KDTreeTraversableHandle KDTree::hostTraversable()
+  {
+    KDTreeTraversableHandle result;
+    result.nodes       = nodes.data();
+    result.primRefs    = primRefs.data();
+    result.modelBounds = modelBounds;
+    return result;
+  }
+
+  void KDTree::printStats() const
+  {
+    std::cout << "#exa: kd-tree: " << prettyNumber(stats.numInnerNodes) << " inner nodes, "
+              << prettyNumber(stats.numLeaves) << " leaves ("
+              << prettyNumber(stats.numDuplicates)
+              << " duplicate refs), max depth "
+              << stats.maxDepth << ", built in " << prettyDouble(stats.buildTime) << "s\n";
+
+    if (stats.numDepthLimit > 0) {
+      std::cout << "#exa: WARNING: " << stats.numDepthLimit
+                << " leaves w/ several boxes at the max depth (" << (int)kd::STACK_SIZE << ")\n";
+    }
+
+    if (stats.numUnsplit > 0) {
+      std::cout << "#exa: WARNING: " << stats.numUnsplit
+                << " leaves w/ overlapping boxes that couldn't be separated\n";
+    }
+  }
+
   void KDTree::setLeaves(const std::vector<box3f> &leaves)
   {
+    primRefs.clear();
     for (uint32_t i=0; i < leaves.size(); ++i) {
       primRefs.push_back({i,leaves[i]});
     }
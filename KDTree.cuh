@@ -158,6 +158,9 @@ namespace exa {
   };
 
   namespace kd { // kdtree helpers
+    //! traversal stack size; KDTree::build limits the depth to it
+    enum { STACK_SIZE = 32 };
+
     template <typename Ray>
     inline __both__ bool boxTest(const Ray &ray, const owl::vec3f &invDir,
                                  const owl::box3f &box,
@@ -187,7 +190,7 @@ namespace exa {
         float tnear;
         float tfar;
       };
-      typedef StackEntry Stack[32];
+      typedef StackEntry Stack[STACK_SIZE];
 
       box3f bbox = tree.modelBounds;
 
@@ -223,6 +226,7 @@ namespace exa {
           } else if (d >= se.tfar) {
             se.nodeID = node.get_child(nearChild);
           } else {
+            assert(ptr < STACK_SIZE);
             stack[ptr++] = { (unsigned)node.get_child(farChild), d, se.tfar };
             se.nodeID = node.get_child(nearChild);
             se.tfar = d;
@@ -233,11 +237,43 @@ namespace exa {
         KDTreeHitRec hitRec = {false,FLT_MAX}; // found a leaf
 
         const auto indices = node.get_indices();
-        assert(indices.last-indices.first==1);
-        unsigned i = indices.first;
-
-        isect(ray, prd, tree.primRefs[i].primID,
-              se.tnear, se.tfar, hitRec);
+        if (indices.last-indices.first == 1) {
+          isect(ray, prd, tree.primRefs[indices.first].primID,
+                se.tnear, se.tfar, hitRec);
+        } else {
+          // depth-limited leaf, or boxes that overlap: visit them
+          // front to back, ordered by (entry distance,index)
+          float prevT0 = -FLT_MAX;
+          unsigned prev = 0;
+          while (!hitRec.hit) {
+            unsigned next = indices.last;
+            float nextT0 = FLT_MAX, nextT1 = -FLT_MAX;
+            for (unsigned i=indices.first; i<indices.last; ++i) {
+              float b0 = 0.f, b1 = 0.f;
+              if (!kd::boxTest(ray,invDir,tree.primRefs[i].box,b0,b1))
+                continue;
+              b0 = fmaxf(b0,se.tnear);
+              b1 = fminf(b1,se.tfar);
+              if (b0 >= b1)
+                continue;
+              const bool after = b0 > prevT0 || (b0 == prevT0 && i > prev);
+              if (after && b0 < nextT0) {
+                next = i;
+                nextT0 = b0;
+                nextT1 = b1;
+              }
+            }
+
+            if (next == indices.last)
+              break;
+
+            isect(ray, prd, tree.primRefs[next].primID,
+                  nextT0, nextT1, hitRec);
+
+            prevT0 = nextT0;
+            prev = next;
+          }
+        }
 
         if (hitRec.hit) return true;
 
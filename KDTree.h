@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 #include "KDTree.cuh"
@@ -27,26 +28,76 @@ namespace exa {
   {
     typedef std::shared_ptr<KDTree> SP;
 
+    enum BuildMode { SAH, Median };
+
     KDTree();
    ~KDTree();
 
     static KDTree::SP load(const std::string fileName);
 
+    /*! Build over non-overlapping boxes (e.g., brick bounds) with
+      integer coordinates (split planes are stored as int). Space is
+      split until each leaf overlaps exactly one box, or the depth
+      reaches the traversal stack size (kd::STACK_SIZE); leaves with
+      several boxes are traversed front to back. Boxes straddling a
+      plane are referenced on both sides. Planes are chosen from the
+      box faces, either by SAH or closest to the median box center
+      along the longest axis; the nodes of each tree level are split
+      in parallel, the few large nodes of the top levels with
+      parallel sorts and plane sweeps. levels (optional) are the
+      boxes' AMR levels, stored as max_level in the nodes. Leaves
+      reference ranges of primRefs, which are in leaf order */
+    static KDTree::SP build(size_t numBoxes,
+                            const owl::box3f *boxes,
+                            const int *levels = nullptr,
+                            BuildMode mode = SAH);
+
+    /*! Write nodes, primRefs and model bounds to an AccelFile; load()
+      reads these, as well as legacy (raw node) files */
+    bool save(const std::string fileName) const;
+
+    /*! Check that child and primitive indices are in range, and the
+      depth fits the traversal stack; leaves index primRefs, or, for
+      legacy files w/o primRefs, the numPrims boxes directly */
+    bool validate(size_t numPrims, std::string &error) const;
+
+    const owl::box3f &getModelBounds() const { return modelBounds; }
+
+    //! Legacy files store no primRefs, the leaves are set from the boxes
+    bool hasPrimRefs() const { return !primRefs.empty(); }
+
     void setLeaves(const std::vector<owl::box3f> &leaves);
 
     void setModelBounds(const owl::box3f &bounds);
 
     bool initGPU(int deviceID=0);
 
+    //! Traversable referencing the host copies, e.g., for testing
+    KDTreeTraversableHandle hostTraversable();
+
+    void printStats() const;
+
     KDTreeTraversableHandle deviceTraversable;
 
+    struct Stats {
+      size_t numInnerNodes = 0;
+      size_t numLeaves     = 0;
+      size_t numUnsplit    = 0; // leaves w/ overlapping boxes
+      size_t numDepthLimit = 0; // leaves at max depth w/ several boxes
+      size_t numDuplicates = 0; // boxes referenced by several leaves
+      int    maxDepth      = 0;
+      double buildTime     = 0.0;
+    };
+
+    Stats stats;
+
   private:
 
     std::vector<KDTreeNode> nodes;
     std::vector<PrimRef>    primRefs;
     owl::box3f              modelBounds;
 
-    int deviceID;
+    int deviceID = 0;
   };
 
 } // ::exa
@@ -1,4 +1,5 @@
 #include <cuda_runtime.h>
+#include <random>
 #include <vector>
 #include <owl/owl.h>
 #include <owl/common/math/box.h>
@@ -21,7 +22,7 @@ void isect(const owl::Ray &ray, PRD &prd, int primID, float tmin, float tmax, KD
   hitRec.t   = tmin;
 }
 
-__global__ void test(KDTreeTraversable tree)
+__global__ void test(KDTreeTraversableHandle tree)
 {
   owl::Ray ray;
   ray.origin = vec3f(-1.f,-1.f,0.f);
@@ -32,12 +33,142 @@ __global__ void test(KDTreeTraversable tree)
   kd::traceRay(tree,ray,prd,isect);
 }
 
+struct HostRay {
+  vec3f origin;
+  vec3f direction;
+  float tmin;
+  float tmax;
+};
+
+struct Segment {
+  int primID;
+  float t0, t1;
+};
+
+// Host traversal w/ kd::traceRayInternal against brute force: the
+// segments reported per box must add up to its extent along the ray, and
+// come front to back; overlapping boxes (which end up in the same leaf)
+// may overlap along the ray, but must still be entered front to back
+bool testHost(KDTree &kd, const std::vector<box3f> &boxes, int numRays,
+              bool overlapping = false)
+{
+  const KDTreeTraversableHandle tree = kd.hostTraversable();
+
+  box3f bounds;
+  for (const box3f &b : boxes) bounds.extend(b);
+
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<float> dist(0.f,1.f);
+
+  auto clip = [](const HostRay &ray, const box3f &box, float &t0, float &t1) {
+    const vec3f t_lo = (box.lower - ray.origin) / ray.direction;
+    const vec3f t_hi = (box.upper - ray.origin) / ray.direction;
+    t0 = fmaxf(ray.tmin,reduce_max(min(t_lo,t_hi)));
+    t1 = fminf(ray.tmax,reduce_min(max(t_lo,t_hi)));
+    return t0 < t1;
+  };
+
+  int numFailed = 0;
+  for (int rayID=0; rayID<numRays; ++rayID) {
+    HostRay ray;
+    ray.origin = bounds.lower-bounds.size()*0.5f+vec3f(dist(rng),dist(rng),dist(rng))*bounds.size()*2.f;
+    const vec3f target = bounds.lower+vec3f(dist(rng),dist(rng),dist(rng))*bounds.size();
+    ray.direction = normalize(target-ray.origin);
+    ray.tmin = 0.f;
+    ray.tmax = 1e30f;
+
+    std::vector<Segment> segments;
+    PRD prd;
+    kd::traceRayInternal(tree,ray,prd,[&](const HostRay &ray, PRD &prd, int primID,
+                                          float tmin, float tmax, KDTreeHitRec &hitRec) {
+      float t0, t1;
+      if (clip(ray,boxes[primID],t0,t1)) {
+        t0 = fmaxf(t0,tmin);
+        t1 = fminf(t1,tmax);
+        if (t0 < t1) segments.push_back({primID,t0,t1});
+      }
+      hitRec.hit = false;
+    });
+
+    std::vector<float> length(boxes.size(),0.f);
+    bool ok = true;
+    for (size_t i=0; i<segments.size(); ++i) {
+      length[segments[i].primID] += segments[i].t1-segments[i].t0;
+      if (i > 0 && segments[i].t0 < (overlapping ? segments[i-1].t0 : segments[i-1].t1)-1e-3f)
+        ok = false; // not front to back
+    }
+
+    for (size_t primID=0; primID<boxes.size(); ++primID) {
+      float t0, t1;
+      const float expected = clip(ray,boxes[primID],t0,t1) ? t1-t0 : 0.f;
+      if (fabsf(length[primID]-expected) > 1e-3f*fmaxf(1.f,expected))
+        ok = false;
+    }
+
+    numFailed += !ok;
+  }
+
+  printf("host traversal: %i of %i rays failed\n",numFailed,numRays);
+  return numFailed == 0;
+}
+
 int main() {
   std::vector<box3f> boxes;
   boxes.push_back(box3f({0,0,0},{2,2,2}));
   boxes.push_back(box3f({0,2,0},{1,3,2}));
   boxes.push_back(box3f({1,2,0},{2,3,2}));
 
+  // bricks of an octree-like refinement: one level 1 brick, refined
+  // into level 0 bricks in one octant, leaving a hole
+  std::vector<box3f> bricks;
+  std::vector<int> levels;
+  for (int z=0; z<2; ++z)
+  for (int y=0; y<2; ++y)
+  for (int x=0; x<2; ++x) {
+    const vec3f lower(x*8,y*8,z*8);
+    if (x == 1 && y == 1 && z == 1)
+      continue; // hole
+    if (x == 0 && y == 0 && z == 0) {
+      for (int i=0; i<8; ++i) {
+        const vec3f l = lower+vec3f(i&1,(i>>1)&1,i>>2)*4.f;
+        bricks.push_back(box3f(l,l+vec3f(4.f)));
+        levels.push_back(0);
+      }
+    } else {
+      bricks.push_back(box3f(lower,lower+vec3f(8.f)));
+      levels.push_back(1);
+    }
+  }
+
+  // two boxes that overlap and can't be separated, next to a third
+  std::vector<box3f> overlapping;
+  overlapping.push_back(box3f({0,0,0},{4,4,4}));
+  overlapping.push_back(box3f({2,2,2},{6,6,6}));
+  overlapping.push_back(box3f({6,0,0},{8,2,2}));
+
+  bool ok = true;
+  for (KDTree::BuildMode mode : {KDTree::SAH,KDTree::Median}) {
+    auto kd = KDTree::build(boxes.size(),boxes.data(),nullptr,mode);
+    kd->printStats();
+    ok &= testHost(*kd,boxes,1000);
+
+    kd = KDTree::build(bricks.size(),bricks.data(),levels.data(),mode);
+    kd->printStats();
+    ok &= testHost(*kd,bricks,1000);
+
+    kd = KDTree::build(overlapping.size(),overlapping.data(),nullptr,mode);
+    kd->printStats();
+    std::string error;
+    if (kd->stats.numUnsplit != 1 || !kd->validate(overlapping.size(),error)) {
+      printf("overlapping boxes: expected one valid unsplit leaf %s\n",error.c_str());
+      ok = false;
+    }
+    ok &= testHost(*kd,overlapping,1000,true);
+  }
+
+  if (!ok)
+    return 1;
+
   auto kd = KDTree::build(boxes.size(),boxes.data());
 
   kd->initGPU();
@@ -31,6 +31,7 @@
 #include "sampler/ExaStitchSampler.h"
 #include "sampler/QuickClustersSampler.h"
 #include "common.h"
+#include "AdaptiveGrid.h"
 #include "Grid.cuh"
 #include "KDTree.cuh"
 
@@ -66,6 +67,7 @@ namespace exa {
     OptixTraversableHandle  majorantBVH;
     KDTreeTraversableHandle majorantKDTree;
     GridTraversableHandle   majorantGrid;
+    AdaptiveGridTraversable majorantAdaptiveGrid;
 
     box3f     worldSpaceBounds;
     affine3f  voxelSpaceTransform;
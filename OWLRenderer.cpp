@@ -14,7 +14,12 @@
 // limitations under the License.                                           //
 // ======================================================================== //
 
+#include <atomic>
+#include <climits>
+#include <cstring>
 #include <fstream>
+#include <owl/common/parallel/parallel_for.h>
+#include "model/AccelFile.h"
 #include "model/AMRCellModel.h"
 #include "model/BigMeshModel.h"
 #include "model/ExaBrickModel.h"
@@ -64,6 +69,7 @@ namespace exa {
      { "majorantBVH",    OWL_GROUP,  OWL_OFFSETOF(LaunchParams,majorantBVH)},
      { "majorantKDTree", OWL_USER_TYPE(KDTreeTraversableHandle),  OWL_OFFSETOF(LaunchParams,majorantKDTree)},
      { "majorantGrid", OWL_USER_TYPE(GridTraversableHandle),  OWL_OFFSETOF(LaunchParams,majorantGrid)},
+     { "majorantAdaptiveGrid", OWL_USER_TYPE(AdaptiveGridTraversable),  OWL_OFFSETOF(LaunchParams,majorantAdaptiveGrid)},
      { "worldSpaceBounds.lower",  OWL_FLOAT3, OWL_OFFSETOF(LaunchParams,worldSpaceBounds.lower)},
      { "worldSpaceBounds.upper",  OWL_FLOAT3, OWL_OFFSETOF(LaunchParams,worldSpaceBounds.upper)},
      { "voxelSpaceTransform", OWL_USER_TYPE(affine3f), OWL_OFFSETOF(LaunchParams,voxelSpaceTransform)},
@@ -200,11 +206,43 @@ namespace exa {
       if (mdl->traversalMode != EXABRICK_BVH_TRAVERSAL)
         throw std::runtime_error("compile with EXABRICK_BVH_TRAVERSAL for own majorants!");
 
-      std::ifstream majorantsFile(majorantsFileName, std::ios::binary);
-      uint64_t numMajorants = 0;
-      majorantsFile.read((char *)&numMajorants,sizeof(numMajorants));
-      majorants.resize(numMajorants);
-      majorantsFile.read((char *)majorants.data(),majorants.size()*sizeof(majorants[0]));
+      if (AccelFile::isAccelFile(majorantsFileName)) {
+        std::string error;
+        AccelFile::SP file = AccelFile::open(majorantsFileName,error);
+        if (!file)
+          throw std::runtime_error(error);
+
+        const box3f &bounds = file->header().bounds;
+        if (bounds.lower != model->cellBounds.lower || bounds.upper != model->cellBounds.upper)
+          throw std::runtime_error(majorantsFileName+" was built for a different model");
+
+        if (file->findSection(AccelFile::VALUE_RANGE_NODES)) {
+          // TF-independent, see updateOwnMajorants(); until a TF is
+          // set, all of the model is considered opaque
+          majorantTree = ValueRangeTree::load(majorantsFileName);
+          majorantTree->printStats();
+          std::vector<float> nodeMajorants;
+          majorantTree->computeMajorants({vec4f(1.f),vec4f(1.f)},model->valueRange,nodeMajorants);
+          majorants = majorantTree->cut(nodeMajorants,maxMajorantDomains);
+        } else {
+          majorants = file->read<std::pair<box3f,float>>(AccelFile::MAJORANT_DOMAINS);
+        }
+      } else {
+        // legacy files: count, then (domain,majorant) pairs
+        std::ifstream majorantsFile(majorantsFileName, std::ios::binary | std::ios::ate);
+        const uint64_t fileSize = majorantsFile.tellg();
+        majorantsFile.seekg(0);
+        uint64_t numMajorants = 0;
+        majorantsFile.read((char *)&numMajorants,sizeof(numMajorants));
+        if (!majorantsFile.good() ||
+            numMajorants != (fileSize-sizeof(numMajorants))/sizeof(majorants[0]))
+          throw std::runtime_error("corrupt majorants file: "+majorantsFileName);
+        majorants.resize(numMajorants);
+        majorantsFile.read((char *)majorants.data(),majorants.size()*sizeof(majorants[0]));
+      }
+
+      if (majorants.empty())
+        throw std::runtime_error("no majorants in "+majorantsFileName);
     }
 
     // ==================================================================
@@ -303,7 +341,95 @@ namespace exa {
                            const box3f remap_to,
                            const vec3i numMCs)
   {
-    throw std::runtime_error("block array constructor not implemented yet");
+    if (numBlocks == 0) {
+      throw std::runtime_error("No blocks given");
+    }
+
+    double t0 = getCurrentTime();
+
+    // -------------------------------------------------------
+    // blocks -> bricks; block bounds are given in the block's
+    // level space, with upper being inclusive (like OpenVKL)
+    // -------------------------------------------------------
+
+    std::vector<ExaBrick> bricks(numBlocks);
+    std::atomic<bool> sizesMatch(true);
+    parallel_for(numBlocks,[&](size_t i) {
+      const int level = blockLevel[i];
+      ExaBrick &brick = bricks[i];
+      brick.lower = blockBounds[i].lower*(1<<level);
+      brick.size  = blockBounds[i].upper-blockBounds[i].lower+vec3i(1);
+      brick.level = level;
+      if (brick.size != blockData[i].size || !blockData[i].data)
+        sizesMatch = false;
+    });
+
+    if (!sizesMatch) {
+      throw std::runtime_error("Block data does not match block bounds");
+    }
+
+    // brick offsets (exclusive prefix sum); if the caller's blocks
+    // are laid out back to back, we can use their memory in place
+    bool contiguous = true;
+    size_t numCells = 0;
+    for (size_t i=0; i<numBlocks; ++i) {
+      bricks[i].begin = (uint32_t)numCells;
+      contiguous &= blockData[i].data == blockData[0].data+numCells;
+      numCells += bricks[i].numCells();
+    }
+
+    if (numCells > UINT_MAX) {
+      throw std::runtime_error("Too many cells for 32-bit brick offsets");
+    }
+
+    ExaBrickModel::SP mdl = std::make_shared<ExaBrickModel>();
+    mdl->bricks = std::move(bricks);
+
+    if (contiguous) {
+      mdl->externalScalars = blockData[0].data;
+      mdl->numExternalScalars = numCells;
+    } else {
+      mdl->scalars.resize(numCells);
+      parallel_for(numBlocks,[&](size_t i) {
+        const ExaBrick &brick = mdl->bricks[i];
+        memcpy(mdl->scalars.data()+brick.begin,
+               blockData[i].data,
+               brick.numCells()*sizeof(float));
+      });
+    }
+
+    double t1 = getCurrentTime();
+
+    mdl->init();
+    model = mdl;
+
+    double t2 = getCurrentTime();
+
+    std::cout << "#exa: ingested " << prettyDouble((double)numBlocks) << " blocks ("
+              << prettyDouble((double)numCells) << " cells, "
+              << (contiguous ? "zero-copy" : "gathered") << ") in "
+              << prettyDouble(t2-t0) << "s; per block: conversion "
+              << prettyDouble((t1-t0)/numBlocks*1e6) << "us, ABR build "
+              << prettyDouble((t2-t1)/numBlocks*1e6) << "us\n";
+
+    vec3f lightSpaceScale = 1.f;
+    vec3f cellSpaceSize = model->cellBounds.size();
+    while (reduce_max(cellSpaceSize) > 1000.f) {
+      cellSpaceSize /= 1000.f;
+      lightSpaceScale /= 1000.f;
+    }
+
+    model->setVoxelSpaceTransform(remap_from,remap_to);
+#ifdef EXA_STITCH_MIRROR_EXAJET
+    model->initMirrorExajet(); // before extending model bounds!
+#endif
+    lightSpaceTransform = lightSpaceTransform.scale(lightSpaceScale);
+    modelBounds.extend(model->getBounds());
+    valueRange.extend(model->valueRange);
+
+    model->setNumGridCells(numMCs);
+
+    initGPU();
   }
 
   void OWLRenderer::initGPU()
@@ -376,6 +502,13 @@ namespace exa {
 
         std::cout << "Using own majorants. Number of domains: " << domains.size() << '\n';
 
+        // domains cut from the tree change w/ the TF; reserve room for
+        // the finest cut, so the buffers (and SBT) remain the same
+        if (majorantTree) {
+          domains.resize(maxMajorantDomains);
+          maxOpacities.resize(maxMajorantDomains,0.f);
+        }
+
         ownMajorants.domainBuffer = owlDeviceBufferCreate(owl,
                                                           OWL_USER_TYPE(box3f),
                                                           domains.size(),
@@ -409,6 +542,7 @@ namespace exa {
         owlGeomSetPrimCount(majorantsGeom, majorants.size());
         owlGeomSetBuffer(majorantsGeom,"domains", ownMajorants.domainBuffer);
         owlGeomSetBuffer(majorantsGeom,"maxOpacities", ownMajorants.maxOpacityBuffer);
+        ownMajorants.geom = majorantsGeom;
 
         owlBuildPrograms(owl);
 
@@ -436,6 +570,8 @@ namespace exa {
         owlParamsSetRaw(lp,"majorantGrid",&sampler->majorantAccel.grid->deviceTraversable);
       } else if (sampler->majorantAccel.kdtree) {
         owlParamsSetRaw(lp,"majorantKDTree",&sampler->majorantAccel.kdtree->deviceTraversable);
+      } else if (sampler->majorantAccel.adaptiveGrid) {
+        owlParamsSetRaw(lp,"majorantAdaptiveGrid",&sampler->majorantAccel.adaptiveGrid->deviceTraversable);
       } else {
         fprintf(stderr,"Model's accels not set, forgot to call sampler->build()?\n");
       }
@@ -629,6 +765,13 @@ namespace exa {
 
   void OWLRenderer::setColorMap(const std::vector<vec4f> &newCM)
   {
+    // Localized edits (same TF size and range) only need the majorants
+    // updated whose value range maps to entries where alpha changed
+    const bool incremental = xf.majorantsValid && xf.colorMap.size() == newCM.size();
+    int changedLo = 0, changedHi = (int)newCM.size()-1;
+    const bool alphaChanged = !incremental
+        || diffAlpha(xf.colorMap.data(),newCM.data(),newCM.size(),changedLo,changedHi);
+
     xf.colorMap = newCM;
 
     size_t prevSize = 0;
@@ -649,7 +792,23 @@ namespace exa {
      xf.absDomain.lower + (xf.relDomain.upper/100.f) * (xf.absDomain.upper-xf.absDomain.lower)
     };
 
-    sampler->computeMaxOpacities(owl,xf.colorMapBuffer,r);
+    if (!incremental) {
+      sampler->computeMaxOpacities(owl,xf.colorMapBuffer,r);
+      xf.majorantsValid = true;
+    } else if (alphaChanged) {
+      range1f changedValues = valueRangeOfSpan(changedLo,changedHi,newCM.size(),r);
+      MajorantUpdateStats stats
+          = sampler->updateMaxOpacities(owl,xf.colorMapBuffer,r,changedValues);
+      if (stats.full)
+        std::cout << "#exa: TF edit: recomputed all majorants\n";
+      else
+        std::cout << "#exa: TF edit: entries [" << changedLo << ',' << changedHi
+                  << "], updated " << stats.numUpdated << " of " << stats.numTotal
+                  << " majorants\n";
+    }
+
+    if (majorantTree && alphaChanged)
+      updateOwnMajorants(r);
 
     if (ownMajorants.maxOpacityBuffer)
       owlParamsSetBuffer(lp,"maxOpacities",ownMajorants.maxOpacityBuffer);
@@ -725,6 +884,9 @@ namespace exa {
 
     sampler->computeMaxOpacities(owl,xf.colorMapBuffer,r);
 
+    if (majorantTree)
+      updateOwnMajorants(r);
+
     if (!ownMajorants.maxOpacityBuffer) {
       owlParamsSetBuffer(lp,"maxOpacities",sampler->maxOpacities);
     } else {
@@ -732,6 +894,39 @@ namespace exa {
     }
   }
 
+  void OWLRenderer::updateOwnMajorants(range1f xfRange)
+  {
+    if (xf.colorMap.empty() || !ownMajorants.domainBuffer)
+      return;
+
+    double t0 = getCurrentTime();
+
+    // one parallel pass over the tree nodes, then the cut
+    std::vector<float> nodeMajorants;
+    majorantTree->computeMajorants(xf.colorMap,xfRange,nodeMajorants);
+    majorants = majorantTree->cut(nodeMajorants,maxMajorantDomains);
+
+    std::vector<box3f> domains(majorants.size());
+    std::vector<float> maxOpacities(majorants.size());
+    for (size_t i=0; i<majorants.size(); ++i) {
+      domains[i] = majorants[i].first;
+      maxOpacities[i] = majorants[i].second;
+    }
+
+    cudaMemcpy((void *)owlBufferGetPointer(ownMajorants.domainBuffer,0),domains.data(),
+               domains.size()*sizeof(domains[0]),cudaMemcpyHostToDevice);
+    cudaMemcpy((void *)owlBufferGetPointer(ownMajorants.maxOpacityBuffer,0),maxOpacities.data(),
+               maxOpacities.size()*sizeof(maxOpacities[0]),cudaMemcpyHostToDevice);
+
+    owlGeomSetPrimCount(ownMajorants.geom,majorants.size());
+    owlGroupBuildAccel(ownMajorants.blas);
+    owlGroupBuildAccel(ownMajorants.tlas);
+
+    std::cout << "#exa: cut " << majorants.size() << " majorant domains from "
+              << prettyNumber(majorantTree->nodes.size()) << " value range tree nodes in "
+              << prettyDouble(getCurrentTime()-t0) << "s\n";
+  }
+
   void OWLRenderer::setRelDomain(interval<float> relDomain)
   {
     xf.relDomain = relDomain;
@@ -21,6 +21,7 @@
 #include "model/Model.h"
 #include "sampler/Sampler.h"
 #include "TriangleMesh.h"
+#include "ValueRangeTree.h"
 
 namespace exa {
 
@@ -55,8 +56,9 @@ namespace exa {
                 const vec3i numMCs = {128,128,128});
 
     /*! \brief  Construct as block-structured (like OSPRay, or VTK)
-     * TODO: as of now this constructor isn't implemented yet
-     * but will eventually generate an ExaStitch model internally! */
+     * Blocks are converted to ExaBricks; if the blocks' data arrays
+     * are laid out back to back in memory they are used in place
+     * (and must then outlive the renderer), otherwise they're copied */
     struct BlockData { vec3i size; float *data; };
     OWLRenderer(const box3i *blockBounds,
                 const int *blockLevel,
@@ -129,15 +131,24 @@ namespace exa {
     // SAHBuilder class and kdtreeBuilder tool. If own-majorants
     // and associated boxes are supplied (file-name constructor)
     // these are used for traversal. own-majorants (usually) are
-    // specific to a single, custom transfer function
+    // specific to a single, custom transfer function; if instead
+    // a value range tree is supplied, the domains and majorants
+    // are cut from that whenever the TF changes
     struct {
       OWLGeomType geomType;
+      OWLGeom geom;
       OWLGroup blas;
       OWLGroup tlas;
       OWLBuffer domainBuffer { 0 };
       OWLBuffer maxOpacityBuffer { 0 };
     } ownMajorants;
 
+    // Max. number of domains cut from the value range tree
+    const size_t maxMajorantDomains = 1<<14;
+
+    //! Cut domains for the current TF from majorantTree and upload
+    void updateOwnMajorants(range1f xfRange);
+
     // Internal data structures to represent the transfer function
     struct {
       std::vector<vec4f> colorMap;
@@ -146,6 +157,8 @@ namespace exa {
       OWLBuffer colorMapBuffer { 0 };
       cudaArray_t colorMapArray { 0 };
       cudaTextureObject_t colorMapTexture { 0 };
+      // majorants were computed for colorMap and the current range
+      bool majorantsValid { false };
     } xf;
 
     // Model can e.g. be ExaStitcher, ExaBricks, etc.
@@ -154,6 +167,7 @@ namespace exa {
     Sampler::SP sampler { 0 };
     std::vector<TriangleMesh::SP> meshes;
     std::vector<std::pair<box3f,float>> majorants; // (optional) majorant regions
+    ValueRangeTree::SP majorantTree; // (optional) to derive them from, per TF
 
     OWLBuffer accumBuffer { 0 };
     int accumID { 0 };
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include "owl/common/math/LinearSpace.h"
+
 typedef unsigned short ushort;
 
 namespace exa {
@@ -97,6 +99,45 @@ namespace exa {
     value = fa*a.w + fb*b.w + fc*c.w + fd*d.w;
     return true;
   }
+
+  /*! Precomputed barycentric transform of a tet, so that point
+    location is a single matrix-vector product instead of building
+    four planes: the weights of (a,b,c) are toBarycentric*(P-origin),
+    with origin=d, and d's weight is one minus their sum */
+  struct TetBarycentrics {
+    owl::common::LinearSpace3f toBarycentric;
+    vec3f origin;
+  };
+
+  inline __both__
+  TetBarycentrics makeTetBarycentrics(const vec3f a,
+                                      const vec3f b,
+                                      const vec3f c,
+                                      const vec3f d)
+  {
+    TetBarycentrics result;
+    result.toBarycentric = owl::common::LinearSpace3f(a-d,b-d,c-d).inverse();
+    result.origin = d;
+    return result;
+  }
+
+  inline __both__
+  bool intersectTet(float &value,
+                    const vec3f P,
+                    const TetBarycentrics &tet,
+                    const float fa,
+                    const float fb,
+                    const float fc,
+                    const float fd)
+  {
+    const vec3f l = tet.toBarycentric*(P-tet.origin);
+    const float ld = 1.f-l.x-l.y-l.z;
+    // written so that NaNs (degenerate tets) count as outside
+    if (!(l.x >= 0.f && l.y >= 0.f && l.z >= 0.f && ld >= 0.f)) return false;
+
+    value = l.x*fa + l.y*fb + l.z*fc + ld*fd;
+    return true;
+  }
   
   inline __both__
   bool intersectPair(float &value,
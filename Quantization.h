@@ -0,0 +1,153 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <owl/common/parallel/parallel_for.h>
+#include "common.h"
+
+namespace exa {
+
+  //! Value range stored as two T-bit codes; empty if upper<lower
+  template <typename T>
+  struct QuantizedRange {
+    T lower, upper;
+  };
+
+  /*! Maps value ranges to T-bit codes (T=uint8_t or uint16_t) with a
+    shared origin and step per structure; encoding rounds outward, so
+    decoded ranges always contain the original ones (as long as these
+    are inside the domain the quantizer was made for) */
+  template <typename T>
+  struct RangeQuantizer {
+    enum { MaxCode = (T)~T(0) };
+
+    float origin = 0.f;
+    float step   = 1.f;
+
+    static RangeQuantizer make(range1f domain)
+    {
+      RangeQuantizer q;
+      q.origin = domain.lower;
+      q.step   = fmaxf(domain.upper-domain.lower,FLT_MIN)/MaxCode;
+      // the top code must decode to >= domain.upper, even w/ slack
+      while (q.decode(T(MaxCode))-q.slack() < domain.upper)
+        q.step = nextafterf(q.step,FLT_MAX);
+      return q;
+    }
+
+    //! covers decode() rounding differently on the device (e.g., FMA)
+    float slack() const
+    { return 4.f*FLT_EPSILON*(fabsf(origin)+fabsf(origin+MaxCode*step)); }
+
+    inline __both__ float decode(T code) const
+    { return origin+float(code)*step; }
+
+    inline __both__ range1f decode(const QuantizedRange<T> &q) const
+    {
+      if (q.upper < q.lower)
+        return {1e30f,-1e30f};
+      return {decode(q.lower),decode(q.upper)};
+    }
+
+    QuantizedRange<T> encode(const range1f &r) const
+    {
+      if (r.upper < r.lower)
+        return {T(MaxCode),T(0)};
+
+      const float slack = this->slack();
+
+      int lo = (int)clamp(floorf((r.lower-origin)/step),0.f,(float)MaxCode);
+      while (lo > 0 && decode(T(lo))+slack > r.lower) --lo;
+
+      int hi = (int)clamp(ceilf((r.upper-origin)/step),0.f,(float)MaxCode);
+      while (hi < MaxCode && decode(T(hi))-slack < r.upper) ++hi;
+
+      return {T(lo),T(hi)};
+    }
+  };
+
+  /*! Majorants in [0,maxValue] as T-bit codes, rounded up; zero stays
+    zero, so empty space skipping is unaffected */
+  template <typename T>
+  struct MajorantQuantizer {
+    enum { MaxCode = (T)~T(0) };
+
+    float step = 1.f/MaxCode;
+
+    static MajorantQuantizer make(float maxValue = 1.f)
+    {
+      MajorantQuantizer q;
+      q.step = fmaxf(maxValue,FLT_MIN)/MaxCode;
+      return q;
+    }
+
+    inline __both__ float decode(T code) const
+    { return float(code)*step; }
+
+    T encode(float majorant) const
+    {
+      if (majorant <= 0.f)
+        return T(0);
+
+      const float slack = 4.f*FLT_EPSILON*(MaxCode*step);
+      int code = (int)clamp(ceilf(majorant/step),1.f,(float)MaxCode);
+      while (code < MaxCode && decode(T(code))-slack < majorant) ++code;
+      return T(code);
+    }
+  };
+
+  //! Device- or host-side accessor for quantized range buffers
+  template <typename T>
+  struct QuantizedRanges {
+    const QuantizedRange<T> *ranges;
+    RangeQuantizer<T>        quantizer;
+
+    inline __both__ range1f operator[](size_t i) const
+    { return quantizer.decode(ranges[i]); }
+  };
+
+  /*! Encode ranges w/ a quantizer made for the union of the non-empty
+    ones (or [0,1] if all are empty), and return that quantizer */
+  template <typename T>
+  RangeQuantizer<T> quantizeRanges(const std::vector<range1f>  &ranges,
+                                   std::vector<QuantizedRange<T>> &codes)
+  {
+    range1f domain;
+    for (const range1f &r : ranges) {
+      if (r.upper >= r.lower) domain.extend(r);
+    }
+    if (domain.upper < domain.lower)
+      domain = range1f(0.f,1.f);
+
+    const RangeQuantizer<T> quantizer = RangeQuantizer<T>::make(domain);
+
+    codes.resize(ranges.size());
+    owl::parallel_for_blocked(0ull,codes.size(),4096,[&](size_t begin, size_t end) {
+      for (size_t i=begin; i<end; ++i) {
+        codes[i] = quantizer.encode(ranges[i]);
+      }
+    });
+    return quantizer;
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
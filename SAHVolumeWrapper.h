@@ -14,9 +14,16 @@
 // limitations under the License.                                           //
 // ======================================================================== //
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include "owl/common/parallel/parallel_for.h"
 #include "model/ExaBrickModel.h"
+#include "model/Hash.h"
 #include "sampler/ExaBrickSamplerCPU.h"
 
 namespace exa {
@@ -28,20 +35,32 @@ namespace exa {
     range1f xfDomain;
     ExaBrickSamplerCPU::SP sampler = nullptr;
 
+    //! Bound on the cached value ranges (~100 bytes each)
+    size_t maxCachedRanges = size_t(1)<<20;
+
     SAHVolumeWrapper(ExaBrickModel::SP model, const std::vector<float> *rgbaCM = nullptr,
-                     range1f xfAbsDomain = {0.f,1.f}, range1f xfRelDomain = {0.f,100.f})
+                     range1f xfAbsDomain = {0.f,1.f}, range1f xfRelDomain = {0.f,100.f},
+                     const std::string bvhCacheFileName = "")
     {
       cellBounds = model->cellBounds;
 
       // valueRange = model->valueRange;
 
+      setXFDomain(xfAbsDomain,xfRelDomain);
+
+      sampler = std::make_shared<ExaBrickSamplerCPU>();
+      sampler->bvhCacheFileName = bvhCacheFileName;
+      sampler->build(model);
+    }
+
+    /*! Switch to another TF's domain; the cached value ranges are
+      TF-independent, so they're reused by the next build */
+    void setXFDomain(range1f xfAbsDomain, range1f xfRelDomain)
+    {
       xfDomain = {
        xfAbsDomain.lower + (xfRelDomain.lower/100.f) * (xfAbsDomain.upper-xfAbsDomain.lower),
        xfAbsDomain.lower + (xfRelDomain.upper/100.f) * (xfAbsDomain.upper-xfAbsDomain.lower)
       };
-
-      sampler = std::make_shared<ExaBrickSamplerCPU>();
-      sampler->build(model);
     }
 
     box3f getBounds() const
@@ -50,6 +69,108 @@ namespace exa {
     }
 
     range1f min_max(box3f V, const std::vector<float> *rgbaCM) const
+    {
+      range1f valueRange = cachedValueRange(V);
+
+      if (valueRange.lower > valueRange.upper)
+        return range1f{0.f,0.f};
+
+      assert(rgbaCM);
+
+      range1f result{1e31f,-1e31f};
+
+      valueRange.lower -= xfDomain.lower;
+      valueRange.lower /= (xfDomain.upper-xfDomain.lower);
+
+      valueRange.upper -= xfDomain.lower;
+      valueRange.upper /= (xfDomain.upper-xfDomain.lower);
+
+      int cmSize = rgbaCM->size()/4;
+
+#ifdef EXASTITCH_CUDA_TEXTURE_TF
+      const int idx_lo = clamp(int(valueRange.lower*cmSize),0,cmSize-1);
+      const int idx_hi = clamp(int(valueRange.upper*cmSize)+1,0,cmSize-1);
+#else
+      const int idx_lo = clamp(int(valueRange.lower*cmSize-1),0,cmSize-1);
+      const int idx_hi = clamp(int(valueRange.upper*cmSize-1)+1,0,cmSize-1);
+#endif
+
+      for (int i=idx_lo;i<=idx_hi;++i) {
+        float alpha = (*rgbaCM)[i*4+3];
+        result.lower = fminf(result.lower,alpha);
+        result.upper = fmaxf(result.upper,alpha);
+      }
+
+      return result;
+    }
+
+    /*! Raw value range of V, computed once per box: the binned
+      candidate planes are the same for all TFs until their trees
+      diverge, and leaves are candidate boxes of their parents. The
+      cache is split into shards w/ a lock each, so the planes that
+      are evaluated in parallel rarely wait on each other; a shard
+      that holds its share of maxCachedRanges is cleared */
+    range1f cachedValueRange(const box3f &V) const
+    {
+      Cache::Shard &shard = cache.shards[BoxHash()(V)%Cache::NUM_SHARDS];
+      {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.ranges.find(V);
+        if (it != shard.ranges.end()) {
+          cache.numHits++;
+          return it->second;
+        }
+      }
+
+      // computed outside the lock; concurrent misses on the same box
+      // compute the same range
+      const range1f valueRange = computeValueRange(V);
+      cache.numMisses++;
+
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      if (shard.ranges.size() >= std::max(size_t(1),maxCachedRanges/Cache::NUM_SHARDS)) {
+        shard.ranges.clear();
+        cache.numEvictions++;
+      }
+      shard.ranges.emplace(V,valueRange);
+      return valueRange;
+    }
+
+    struct BoxHash {
+      size_t operator()(const box3f &box) const
+      {
+        // +0.f, so -0.f and 0.f (which compare equal) hash the same
+        const float coords[6] = { box.lower.x+0.f, box.lower.y+0.f, box.lower.z+0.f,
+                                  box.upper.x+0.f, box.upper.y+0.f, box.upper.z+0.f };
+        uint32_t words[6];
+        std::memcpy(words,coords,sizeof(words));
+        return (size_t)hashWords(words,6,fnvOffsetBasis);
+      }
+    };
+
+    struct BoxEqual {
+      bool operator()(const box3f &a, const box3f &b) const
+      { return a.lower == b.lower && a.upper == b.upper; }
+    };
+
+    struct Cache {
+      enum { NUM_SHARDS = 64 };
+
+      struct Shard {
+        std::mutex mutex;
+        std::unordered_map<box3f,range1f,BoxHash,BoxEqual> ranges;
+      };
+
+      Shard shards[NUM_SHARDS];
+      std::atomic<size_t> numHits{0};
+      std::atomic<size_t> numMisses{0};
+      std::atomic<size_t> numEvictions{0}; // shards cleared
+    };
+
+    mutable Cache cache;
+
+  private:
+    range1f computeValueRange(const box3f &V) const
     {
       range1f valueRange(1e31f,-1e31f);
 
@@ -123,36 +244,7 @@ namespace exa {
         }
       }
 
-      if (valueRange.lower > valueRange.upper)
-        return range1f{0.f,0.f};
-
-      assert(rgbaCM);
-
-      range1f result{1e31f,-1e31f};
-
-      valueRange.lower -= xfDomain.lower;
-      valueRange.lower /= (xfDomain.upper-xfDomain.lower);
-
-      valueRange.upper -= xfDomain.lower;
-      valueRange.upper /= (xfDomain.upper-xfDomain.lower);
-
-      int cmSize = rgbaCM->size()/4;
-
-#ifdef EXASTITCH_CUDA_TEXTURE_TF
-      const int idx_lo = clamp(int(valueRange.lower*cmSize),0,cmSize-1);
-      const int idx_hi = clamp(int(valueRange.upper*cmSize)+1,0,cmSize-1);
-#else
-      const int idx_lo = clamp(int(valueRange.lower*cmSize-1),0,cmSize-1);
-      const int idx_hi = clamp(int(valueRange.upper*cmSize-1)+1,0,cmSize-1);
-#endif
-
-      for (int i=idx_lo;i<=idx_hi;++i) {
-        float alpha = (*rgbaCM)[i*4+3];
-        result.lower = fminf(result.lower,alpha);
-        result.upper = fmaxf(result.upper,alpha);
-      }
-
-      return result;
+      return valueRange;
     }
 
   };
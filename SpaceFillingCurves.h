@@ -0,0 +1,247 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <stdint.h>
+#include "common.h"
+#include "hilbert.h"
+
+namespace exa {
+
+  //-------------------------------------------------------------------------------------------------
+  // space filling curves
+  //-------------------------------------------------------------------------------------------------
+
+  __host__ __device__
+  inline uint64_t morton64_encode4D(uint64_t x, uint64_t y, uint64_t z, uint64_t w)
+  {
+      auto separate_bits = [](uint64_t n)
+      {
+          n &= 0b1111111111111111ull;
+          n = (n ^ (n << 24)) & 0b0000000000000000000000001111111100000000000000000000000011111111ull;
+          n = (n ^ (n << 12)) & 0b0000000000001111000000000000111100000000000011110000000000001111ull;
+          n = (n ^ (n <<  6)) & 0b0000001100000011000000110000001100000011000000110000001100000011ull;
+          n = (n ^ (n <<  3)) & 0b0001000100010001000100010001000100010001000100010001000100010001ull;
+
+          return n;
+      };
+
+      uint64_t xb = separate_bits(x);
+      uint64_t yb = separate_bits(y) << 1;
+      uint64_t zb = separate_bits(z) << 2;
+      uint64_t wb = separate_bits(w) << 3;
+      uint64_t code = xb | yb | zb | wb;
+
+      return code;
+  }
+
+  //! Interleave the lower 21 bits of x, y, and z (x in bit 0)
+  __host__ __device__
+  inline uint64_t morton64_interleave3D(uint64_t x, uint64_t y, uint64_t z)
+  {
+    auto separate_bits = [](uint64_t n)
+    {
+        n &= 0b1111111111111111111111ull;
+        n = (n ^ (n << 32)) & 0b1111111111111111000000000000000000000000000000001111111111111111ull;
+        n = (n ^ (n << 16)) & 0b0000000011111111000000000000000011111111000000000000000011111111ull;
+        n = (n ^ (n <<  8)) & 0b1111000000001111000000001111000000001111000000001111000000001111ull;
+        n = (n ^ (n <<  4)) & 0b0011000011000011000011000011000011000011000011000011000011000011ull;
+        n = (n ^ (n <<  2)) & 0b1001001001001001001001001001001001001001001001001001001001001001ull;
+        return n;
+    };
+
+    return separate_bits(x) | (separate_bits(y) << 1) | (separate_bits(z) << 2);
+  }
+
+  __host__ __device__
+  inline uint64_t morton64_encode3D(float x, float y, float z)
+  {
+    x = x * (float)(1 << 16);
+    y = y * (float)(1 << 16);
+    z = z * (float)(1 << 16);
+    return morton64_interleave3D(uint64_t(x), uint64_t(y), uint64_t(z));
+  }
+
+  //-------------------------------------------------------------------------------------------------
+  // table-driven 3D Hilbert curve
+  //-------------------------------------------------------------------------------------------------
+
+  /*! The 3D curve of hilbert_c2i() is a state machine over 12
+    orientations of the unit cube, independent of the level: per bit
+    plane (MSB first), the octant (x|y<<1|z<<2) and the current state
+    determine the next 3 index bits and the next state, starting in
+    state 0. One row holds the 8 transitions of a state as 7-bit
+    entries (digit|nextState<<3), so a step is a shift and a mask.
+    Rows were derived from, and are checked against, hilbert_c2i() */
+  __both__
+  inline constexpr uint64_t hilbert3D_encodeRow(unsigned state)
+  {
+    switch (state) {
+      case  0: return 0x5a71727246c888ull;
+      case  1: return 0x7a0a2437c05b90ull;
+      case  2: return 0xbb78509995e580ull;
+      case  3: return 0x8f3824db0c41b2ull;
+      case  4: return 0x721a42f7416ddcull;
+      case  5: return 0x6741a0785052a6ull;
+      case  6: return 0xb36870d30adfacull;
+      case  7: return 0xa729049a8d47b6ull;
+      case  8: return 0x9ea0f51182ced2ull;
+      case  9: return 0x3e51c138d150a2ull;
+      case 10: return 0x530153b2d7cabcull;
+      case 11: return 0x4690d55605ccd6ull;
+      default: return 0ull;
+    }
+  }
+
+  //! Inverse transitions, indexed by digit: octant|nextState<<3
+  __both__
+  inline constexpr uint64_t hilbert3D_decodeRow(unsigned state)
+  {
+    switch (state) {
+      case  0: return 0x48b579e344c888ull;
+      case  1: return 0x62edfc58818110ull;
+      case  2: return 0xa57afcb9234600ull;
+      case  3: return 0x8f3a60502c195bull;
+      case  4: return 0x5818158b2edfcdull;
+      case  5: return 0x08810b56f0e156ull;
+      case  6: return 0x7234628557af9bull;
+      case  7: return 0x12c1953af3a625ull;
+      case  8: return 0x9e74c8b1542a2eull;
+      case  9: return 0x3f0e11628810bdull;
+      case 10: return 0xb44c8b878b57c6ull;
+      case 11: return 0x2542a264e74cb3ull;
+      default: return 0ull;
+    }
+  }
+
+  /*! Hilbert index from the Morton code of the same point: the Morton
+    code's 3-bit digits are exactly the octants the state machine
+    consumes, so this is a pure transcoding */
+  __both__
+  inline uint64_t hilbert3D_fromMorton(uint64_t morton, unsigned nBits = 16)
+  {
+    uint64_t index = 0;
+    unsigned state = 0;
+    for (int b=nBits-1; b>=0; --b) {
+      const unsigned octant = (morton>>(3*b))&7;
+      const unsigned entry = (hilbert3D_encodeRow(state)>>(7*octant))&0x7f;
+      index = (index<<3) | (entry&7);
+      state = entry>>3;
+    }
+    return index;
+  }
+
+  /*! Bit-exact w/ hilbert_c2i(3,nBits,{x,y,z}), for 1 <= nBits <= 21 */
+  __both__
+  inline uint64_t hilbert3D_encode(uint32_t x, uint32_t y, uint32_t z, unsigned nBits = 16)
+  {
+    return hilbert3D_fromMorton(morton64_interleave3D(x,y,z), nBits);
+  }
+
+  /*! Bit-exact w/ hilbert_i2c(3,nBits,index,coord), for 1 <= nBits <= 21 */
+  __both__
+  inline void hilbert3D_decode(uint64_t index, uint32_t &x, uint32_t &y, uint32_t &z, unsigned nBits = 16)
+  {
+    x = y = z = 0;
+    unsigned state = 0;
+    for (int b=nBits-1; b>=0; --b) {
+      const unsigned digit = (index>>(3*b))&7;
+      const unsigned entry = (hilbert3D_decodeRow(state)>>(7*digit))&0x7f;
+      x = (x<<1) | (entry&1);
+      y = (y<<1) | ((entry>>1)&1);
+      z = (z<<1) | ((entry>>2)&1);
+      state = entry>>3;
+    }
+  }
+
+  /*! Host-side batch encoder. Morton codes are computed first (that
+    loop vectorizes), then transcoded two levels per step with a
+    12x64 table expanded from the rows above */
+  inline void hilbert3D_encode(const uint32_t *x,
+                               const uint32_t *y,
+                               const uint32_t *z,
+                               uint64_t *index,
+                               size_t count,
+                               unsigned nBits = 16)
+  {
+    // entry: 6-bit index digits | next state<<6
+    struct Table2 {
+      uint16_t entries[12*64];
+      Table2()
+      {
+        for (unsigned state=0; state<12; ++state) {
+          for (unsigned octants=0; octants<64; ++octants) {
+            const unsigned hi = (hilbert3D_encodeRow(state)>>(7*(octants>>3)))&0x7f;
+            const unsigned lo = (hilbert3D_encodeRow(hi>>3)>>(7*(octants&7)))&0x7f;
+            entries[state*64+octants] = uint16_t((hi&7)<<3 | (lo&7) | (lo>>3)<<6);
+          }
+        }
+      }
+    };
+    static const Table2 table;
+
+    for (size_t i=0; i<count; ++i) {
+      index[i] = morton64_interleave3D(x[i],y[i],z[i]);
+    }
+
+    for (size_t i=0; i<count; ++i) {
+      const uint64_t morton = index[i];
+      uint64_t idx = 0;
+      unsigned state = 0;
+      int b = nBits;
+      if (b&1) {
+        const unsigned entry = (hilbert3D_encodeRow(0)>>(7*((morton>>(3*--b))&7)))&0x7f;
+        idx = entry&7;
+        state = entry>>3;
+      }
+      while (b) {
+        b -= 2;
+        const unsigned entry = table.entries[state*64+((morton>>(3*b))&63)];
+        idx = (idx<<6) | (entry&63);
+        state = entry>>6;
+      }
+      index[i] = idx;
+    }
+  }
+
+  __host__ __device__
+  inline uint64_t hilbert64_encode3D(float x, float y, float z)
+  {
+    x = x * (float)(1 << 16);
+    y = y * (float)(1 << 16);
+    z = z * (float)(1 << 16);
+    return hilbert3D_encode(uint32_t(x), uint32_t(y), uint32_t(z), 16);
+  }
+
+  /*! Project pos to [0..1) relative to bounds, as expected by the
+    3D encoders above; positions outside bounds are clamped */
+  __host__ __device__
+  inline vec3f sfcNormalize(const vec3f pos, const box3f &bounds)
+  {
+    const float maxVal = 1.f-1.f/(1<<16);
+    const vec3f size = bounds.size();
+    vec3f pt = pos-bounds.lower;
+    pt.x = size.x > 0.f ? fminf(fmaxf(pt.x/size.x,0.f),maxVal) : 0.f;
+    pt.y = size.y > 0.f ? fminf(fmaxf(pt.y/size.y,0.f),maxVal) : 0.f;
+    pt.z = size.z > 0.f ? fminf(fmaxf(pt.z/size.z,0.f),maxVal) : 0.f;
+    return pt;
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
+
@@ -0,0 +1,50 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <owl/common/parallel/parallel_for.h>
+#include "TFRangeMax.h"
+
+namespace exa {
+
+  void TFRangeMax::build(const vec4f *colorMap, size_t numColors)
+  {
+    this->numColors = (int)numColors;
+    this->numLevels = numColors ? floorLog2((uint32_t)numColors)+1 : 0;
+
+    table.resize(size_t(numLevels)*numColors);
+    if (numColors == 0)
+      return;
+
+    for (size_t i=0; i<numColors; ++i) {
+      table[i] = colorMap[i].w;
+    }
+
+    for (int k=1; k<numLevels; ++k) {
+      const float *prev = table.data()+size_t(k-1)*numColors;
+      float *level = table.data()+size_t(k)*numColors;
+      const size_t half = size_t(1)<<(k-1);
+      // entries whose span exceeds the table aren't ever queried
+      parallel_for_blocked(0ull,numColors,1<<14,[&](size_t begin, size_t end) {
+        for (size_t i=begin; i<end; ++i) {
+          level[i] = i+half < numColors ? fmaxf(prev[i],prev[i+half]) : prev[i];
+        }
+      });
+    }
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,154 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "TFRangeMax.h"
+
+namespace exa {
+
+  inline int64_t __both__ iDivUp(int64_t a, int64_t b)
+  {
+    return (a + b - 1) / b;
+  }
+
+  __global__ void initRangeMaxGPU(float       *table,
+                                  const vec4f *colorMap,
+                                  size_t       numColors)
+  {
+    size_t threadID = blockIdx.x * size_t(blockDim.x) + threadIdx.x;
+    if (threadID >= numColors)
+      return;
+
+    table[threadID] = colorMap[threadID].w;
+  }
+
+  __global__ void buildRangeMaxLevelGPU(float  *table,
+                                        size_t  numColors,
+                                        int     level)
+  {
+    size_t threadID = blockIdx.x * size_t(blockDim.x) + threadIdx.x;
+    if (threadID >= numColors)
+      return;
+
+    const float *prev = table+(level-1)*numColors;
+    const size_t half = size_t(1)<<(level-1);
+
+    // entries whose span exceeds the table aren't ever queried
+    float value = prev[threadID];
+    if (threadID+half < numColors)
+      value = fmaxf(value,prev[threadID+half]);
+
+    table[level*numColors+threadID] = value;
+  }
+
+  void TFRangeMaxGPU::build(OWLContext owl, OWLBuffer colorMap)
+  {
+    const size_t numColors = owlBufferSizeInBytes(colorMap)/sizeof(vec4f);
+    const int numLevels = numColors ? floorLog2((uint32_t)numColors)+1 : 0;
+
+    if (!table) {
+      table = owlDeviceBufferCreate(owl, OWL_FLOAT, numLevels*numColors, nullptr);
+    } else if (numLevels != this->numLevels || (int)numColors != this->numColors) {
+      owlBufferResize(table, numLevels*numColors);
+    }
+
+    this->numColors = (int)numColors;
+    this->numLevels = numLevels;
+
+    if (numColors == 0)
+      return;
+
+    float *tablePtr = (float *)owlBufferGetPointer(table,0);
+
+    size_t numThreads = 1024;
+    initRangeMaxGPU<<<(uint32_t)iDivUp(numColors, numThreads), (uint32_t)numThreads>>>(
+      tablePtr,(const vec4f *)owlBufferGetPointer(colorMap,0),numColors);
+
+    for (int k=1; k<numLevels; ++k) {
+      buildRangeMaxLevelGPU<<<(uint32_t)iDivUp(numColors, numThreads), (uint32_t)numThreads>>>(
+        tablePtr,numColors,k);
+    }
+  }
+
+  template <typename Ranges>
+  __global__ void updateMaxOpacitiesGPU(float                 *maxOpacities,
+                                        Ranges                 ranges,
+                                        const uint32_t        *ids,
+                                        size_t                 numIDs,
+                                        TFRangeMaxTraversable  xfRangeMax,
+                                        range1f                xfRange)
+  {
+    size_t threadID = blockIdx.x * size_t(blockDim.x) + threadIdx.x;
+    if (threadID >= numIDs)
+      return;
+
+    const uint32_t id = ids[threadID];
+    maxOpacities[id] = maxOpacity(ranges[id],xfRangeMax,xfRange);
+  }
+
+  template <typename Ranges>
+  MajorantUpdateStats MajorantUpdater::update(OWLContext             owl,
+                                              float                 *maxOpacities,
+                                              const Ranges          &ranges,
+                                              TFRangeMaxTraversable  xfRangeMax,
+                                              range1f                xfRange,
+                                              range1f                changedValues)
+  {
+    ids.clear();
+    index.query(changedValues,ids);
+
+    MajorantUpdateStats stats;
+    stats.numUpdated = ids.size();
+    stats.numTotal   = index.numRanges;
+
+    if (ids.empty())
+      return stats;
+
+    if (!idBuffer) {
+      idBuffer = owlDeviceBufferCreate(owl, OWL_UINT, ids.size(), nullptr);
+    } else if (owlBufferSizeInBytes(idBuffer)/sizeof(uint32_t) < ids.size()) {
+      owlBufferResize(idBuffer, ids.size());
+    }
+    cudaMemcpy((void *)owlBufferGetPointer(idBuffer,0),ids.data(),
+               ids.size()*sizeof(uint32_t),cudaMemcpyHostToDevice);
+
+    size_t numThreads = 1024;
+    updateMaxOpacitiesGPU<<<(uint32_t)iDivUp(ids.size(), numThreads), (uint32_t)numThreads>>>(
+      maxOpacities,ranges,
+      (const uint32_t *)owlBufferGetPointer(idBuffer,0),
+      ids.size(),xfRangeMax,xfRange);
+
+    return stats;
+  }
+
+  template MajorantUpdateStats MajorantUpdater::update(
+      OWLContext, float *, const StridedRanges &,
+      TFRangeMaxTraversable, range1f, range1f);
+  template MajorantUpdateStats MajorantUpdater::update(
+      OWLContext, float *, const QuantizedRanges<uint8_t> &,
+      TFRangeMaxTraversable, range1f, range1f);
+  template MajorantUpdateStats MajorantUpdater::update(
+      OWLContext, float *, const QuantizedRanges<uint16_t> &,
+      TFRangeMaxTraversable, range1f, range1f);
+
+  TFRangeMaxTraversable TFRangeMaxGPU::traversable() const
+  {
+    return {table ? (const float *)owlBufferGetPointer(table,0) : nullptr,
+            numColors,numLevels};
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,241 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <owl/owl.h>
+#include <owl/common/math/vec.h>
+#include "common.h"
+#include "IntervalIndex.h"
+#include "Quantization.h"
+
+namespace exa {
+
+  /*! Host- or device-side view of a sparse table over the alpha
+    channel of a color map: level k stores, for each entry i, the max
+    alpha over [i,i+2^k), so that range-max queries are answered in
+    O(1) by combining two overlapping power-of-two spans */
+  struct TFRangeMaxTraversable {
+    const float *table;     // numLevels x numColors
+    int          numColors;
+    int          numLevels;
+  };
+
+  inline __both__
+  int floorLog2(uint32_t x)
+  {
+#if defined(__CUDA_ARCH__)
+    return 31-__clz((int)x);
+#elif defined(__GNUC__)
+    return 31-__builtin_clz(x);
+#else
+    int result = 0;
+    while (x >>= 1) ++result;
+    return result;
+#endif
+  }
+
+  //! Max. alpha over color map entries [lo,hi]
+  inline __both__
+  float rangeMax(const TFRangeMaxTraversable &rm, int lo, int hi)
+  {
+    const int k = floorLog2(uint32_t(hi-lo+1));
+    const float *level = rm.table+size_t(k)*rm.numColors;
+    return fmaxf(level[lo],level[hi-(1<<k)+1]);
+  }
+
+  /*! Span [lo,hi] of color map entries a value range maps to through
+    xfRange; returns false if the value range is empty. That's how
+    all the computeMaxOpacities() kernels map ranges to majorants */
+  inline __both__
+  bool colorMapSpan(range1f valueRange,
+                    size_t numColors,
+                    range1f xfRange,
+                    int &lo,
+                    int &hi)
+  {
+    if (valueRange.upper < valueRange.lower)
+      return false;
+
+    valueRange.lower -= xfRange.lower;
+    valueRange.lower /= xfRange.upper-xfRange.lower;
+    valueRange.upper -= xfRange.lower;
+    valueRange.upper /= xfRange.upper-xfRange.lower;
+
+    lo = clamp(int(valueRange.lower*(numColors-1)),  0,(int)numColors-1);
+    hi = clamp(int(valueRange.upper*(numColors-1))+1,0,(int)numColors-1);
+    return true;
+  }
+
+  //! Majorant for valueRange, in O(1)
+  inline __both__
+  float maxOpacity(const range1f &valueRange,
+                   const TFRangeMaxTraversable &rm,
+                   range1f xfRange)
+  {
+    int lo, hi;
+    if (!colorMapSpan(valueRange,rm.numColors,xfRange,lo,hi))
+      return 0.f;
+    return rangeMax(rm,lo,hi);
+  }
+
+  //! Majorant for valueRange by scanning the color map (reference)
+  inline __both__
+  float maxOpacity(const range1f &valueRange,
+                   const vec4f *colorMap,
+                   size_t numColors,
+                   range1f xfRange)
+  {
+    int lo, hi;
+    if (!colorMapSpan(valueRange,numColors,xfRange,lo,hi))
+      return 0.f;
+
+    float result = 0.f;
+    for (int i=lo; i<=hi; ++i) {
+      result = fmaxf(result,colorMap[i].w);
+    }
+    return result;
+  }
+
+  /*! Span [lo,hi] of entries whose alpha differs between two color
+    maps of the same size; returns false if no alpha changed (then,
+    no majorant changes either) */
+  inline bool diffAlpha(const vec4f *oldColorMap,
+                        const vec4f *newColorMap,
+                        size_t numColors,
+                        int &lo,
+                        int &hi)
+  {
+    lo = (int)numColors;
+    hi = -1;
+    for (size_t i=0; i<numColors; ++i) {
+      if (oldColorMap[i].w != newColorMap[i].w) {
+        lo = std::min(lo,(int)i);
+        hi = (int)i;
+      }
+    }
+    return hi >= lo;
+  }
+
+  /*! Conservative inverse of colorMapSpan(): value ranges whose span
+    overlaps [lo,hi] are exactly those overlapping the result */
+  inline range1f valueRangeOfSpan(int lo,
+                                  int hi,
+                                  size_t numColors,
+                                  range1f xfRange)
+  {
+    const float scale = (xfRange.upper-xfRange.lower)/float(numColors-1);
+    const float eps = 1e-5f*fabsf(xfRange.upper-xfRange.lower);
+    range1f result(-1e30f,1e30f);
+    if (lo > 0) // spans end at int(upper)+1 >= lo
+      result.lower = xfRange.lower+(lo-1)*scale-eps;
+    if (hi < (int)numColors-1) // spans begin at int(lower) <= hi
+      result.upper = xfRange.lower+(hi+1)*scale+eps;
+    return result;
+  }
+
+  /*! Host-side range-max table; build once per color map update */
+  struct TFRangeMax
+  {
+    void build(const vec4f *colorMap, size_t numColors);
+
+    TFRangeMaxTraversable traversable() const
+    { return {table.data(),numColors,numLevels}; }
+
+    size_t bytes() const { return table.size()*sizeof(table[0]); }
+
+    std::vector<float> table;
+    int numColors = 0;
+    int numLevels = 0;
+  };
+
+  /*! Device-side range-max table, built on the GPU from the color map
+    buffer; the buffer is only reallocated if the TF size changes */
+  struct TFRangeMaxGPU
+  {
+    void build(OWLContext owl, OWLBuffer colorMap);
+
+    TFRangeMaxTraversable traversable() const;
+
+    OWLBuffer table{ 0 };
+    int numColors = 0;
+    int numLevels = 0;
+  };
+
+  //! Accessor for value ranges at a byte stride (e.g., inside ABRs)
+  struct StridedRanges {
+    const range1f *ranges;
+    size_t         stride;
+
+    inline __both__ range1f operator[](size_t i) const
+    { return *(const range1f *)((const char *)ranges+i*stride); }
+  };
+
+  //! How many majorants an (incremental) update recomputed
+  struct MajorantUpdateStats {
+    size_t numUpdated = 0;
+    size_t numTotal   = 0;
+    bool   full       = false; // everything was recomputed
+
+    MajorantUpdateStats &operator+=(const MajorantUpdateStats &other)
+    {
+      numUpdated += other.numUpdated;
+      numTotal   += other.numTotal;
+      full       |= other.full;
+      return *this;
+    }
+  };
+
+  /*! Incremental majorant updates for primitives with value ranges on
+    the device: the interval index (built by the owner from a host
+    copy of the ranges) finds the primitives whose ranges overlap the
+    changed values; only their majorants are recomputed */
+  struct MajorantUpdater
+  {
+    /*! maxOpacities[i] = maxOpacity(ranges[i]) for the affected i's;
+      Ranges is StridedRanges or QuantizedRanges<T> (device pointers) */
+    template <typename Ranges>
+    MajorantUpdateStats update(OWLContext             owl,
+                               float                 *maxOpacities,
+                               const Ranges          &ranges,
+                               TFRangeMaxTraversable  xfRangeMax,
+                               range1f                xfRange,
+                               range1f                changedValues);
+
+    //! valueRanges is a device pointer, range i at i*stride
+    MajorantUpdateStats update(OWLContext             owl,
+                               float                 *maxOpacities,
+                               const range1f         *valueRanges,
+                               size_t                 stride,
+                               TFRangeMaxTraversable  xfRangeMax,
+                               range1f                xfRange,
+                               range1f                changedValues)
+    {
+      return update(owl,maxOpacities,StridedRanges{valueRanges,stride},
+                    xfRangeMax,xfRange,changedValues);
+    }
+
+    IntervalIndex         index;
+    std::vector<uint32_t> ids;
+    OWLBuffer             idBuffer{ 0 };
+  };
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -92,7 +92,8 @@ namespace exa {
                        const float4 _v1,
                        const float4 _v2,
                        const float4 _v3,
-                       const float4 _v4
+                       const float4 _v4,
+                       const vec3f &start
                        )
   {
 
@@ -105,7 +106,7 @@ namespace exa {
     const float determinantTolerance = 1e-6f;
     const float4 V[5] = {_v0,_v1,_v2,_v3,_v4};
 
-    float pcoords[3] = {.5f, .5f, .5f};
+    float pcoords[3] = {start.x, start.y, start.z};
     float derivs[15];
     float weights[5];
 
@@ -177,6 +178,102 @@ namespace exa {
   }
 
 
+  inline  __both__
+  bool intersectPyrEXT(float &value,
+                       const vec3f &P,
+                       const float4 _v0,
+                       const float4 _v1,
+                       const float4 _v2,
+                       const float4 _v3,
+                       const float4 _v4
+                       )
+  {
+    return intersectPyrEXT(value,P,_v0,_v1,_v2,_v3,_v4,vec3f(.5f));
+  }
+
+  /*! Precomputed per-element data for the Newton iteration of
+    pyramids and wedges: the bounds reject most candidates right away,
+    and the element map linearized at the parametric center (position
+    and inverse Jacobian there) yields a starting point that usually
+    leaves only one or two iterations to do */
+  struct UElemGuess {
+    box3f bounds;
+    vec3f center;
+    owl::common::LinearSpace3f invJacobian;
+  };
+
+  template <int N>
+  inline __both__
+  UElemGuess makeUElemGuess(const float4 *V,
+                            const float *weights/*[N]*/,
+                            const float *derivs/*[3*N]*/)
+  {
+    UElemGuess result;
+    result.bounds = box3f();
+    vec3f fcol = 0.f, rcol = 0.f, scol = 0.f, tcol = 0.f;
+    for (int i=0; i<N; ++i) {
+      const vec3f pt = V[i];
+      result.bounds.extend(pt);
+      fcol = fcol + pt * weights[i];
+      rcol = rcol + pt * derivs[i];
+      scol = scol + pt * derivs[i + N];
+      tcol = tcol + pt * derivs[i + 2*N];
+    }
+    result.center = fcol;
+    const owl::common::LinearSpace3f J = make_LinearSpace3f(rcol, scol, tcol);
+    if (fabsf(det(J)) < 1e-20f) {
+      // degenerate, always start at the center
+      result.invJacobian = make_LinearSpace3f(vec3f(0.f),vec3f(0.f),vec3f(0.f));
+    } else {
+      result.invJacobian = J.inverse();
+    }
+    return result;
+  }
+
+  inline __both__
+  vec3f initialGuess(const UElemGuess &guess, const vec3f &pcoordsCenter, const vec3f &P)
+  {
+    const vec3f pc = pcoordsCenter + guess.invJacobian*(P-guess.center);
+    return vec3f(fminf(fmaxf(pc.x,0.f),1.f),
+                 fminf(fmaxf(pc.y,0.f),1.f),
+                 fminf(fmaxf(pc.z,0.f),1.f));
+  }
+
+  inline __both__
+  UElemGuess makePyrGuess(const float4 _v0,
+                          const float4 _v1,
+                          const float4 _v2,
+                          const float4 _v3,
+                          const float4 _v4)
+  {
+    const float4 V[5] = {_v0,_v1,_v2,_v3,_v4};
+    float pcoords[3] = {.5f, .5f, .5f};
+    float derivs[15];
+    float weights[5];
+    pyramidInterpolationFunctions(pcoords, weights);
+    pyramidInterpolationDerivs(pcoords, derivs);
+    return makeUElemGuess<5>(V, weights, derivs);
+  }
+
+  inline  __both__
+  bool intersectPyrEXT(float &value,
+                       const vec3f &P,
+                       const UElemGuess &guess,
+                       const float4 _v0,
+                       const float4 _v1,
+                       const float4 _v2,
+                       const float4 _v3,
+                       const float4 _v4
+                       )
+  {
+    if (!guess.bounds.contains(P))
+      return false;
+
+    const vec3f start = initialGuess(guess,vec3f(.5f),P);
+    return intersectPyrEXT(value,P,_v0,_v1,_v2,_v3,_v4,start);
+  }
+
+
   inline __both__
   void wedgeInterpolationFunctions(float *pcoords/*[3]*/, float *sf/*[6]*/)
   {
@@ -224,7 +321,8 @@ namespace exa {
                          const float4 _v2,
                          const float4 _v3,
                          const float4 _v4,
-                         const float4 _v5)
+                         const float4 _v5,
+                         const vec3f &start)
   {
 
     #define WEDGE_DIVERGED               1e6
@@ -236,7 +334,7 @@ namespace exa {
     const float determinantTolerance = 1e-6f;
     const float4 V[6] = {_v0,_v1,_v2,_v3,_v4,_v5};
 
-    float pcoords[3] = {.5f, .5f, .5f};
+    float pcoords[3] = {start.x, start.y, start.z};
     float derivs[18];
     float weights[6];
 
@@ -310,6 +408,55 @@ namespace exa {
   }
 
 
+  inline  __both__
+  bool intersectWedgeEXT(float &value,
+                         const vec3f &P,
+                         const float4 _v0,
+                         const float4 _v1,
+                         const float4 _v2,
+                         const float4 _v3,
+                         const float4 _v4,
+                         const float4 _v5)
+  {
+    return intersectWedgeEXT(value,P,_v0,_v1,_v2,_v3,_v4,_v5,vec3f(.5f));
+  }
+
+  inline __both__
+  UElemGuess makeWedgeGuess(const float4 _v0,
+                            const float4 _v1,
+                            const float4 _v2,
+                            const float4 _v3,
+                            const float4 _v4,
+                            const float4 _v5)
+  {
+    const float4 V[6] = {_v0,_v1,_v2,_v3,_v4,_v5};
+    float pcoords[3] = {1.f/3.f, 1.f/3.f, .5f};
+    float derivs[18];
+    float weights[6];
+    wedgeInterpolationFunctions(pcoords, weights);
+    wedgeInterpolationDerivs(pcoords, derivs);
+    return makeUElemGuess<6>(V, weights, derivs);
+  }
+
+  inline  __both__
+  bool intersectWedgeEXT(float &value,
+                         const vec3f &P,
+                         const UElemGuess &guess,
+                         const float4 _v0,
+                         const float4 _v1,
+                         const float4 _v2,
+                         const float4 _v3,
+                         const float4 _v4,
+                         const float4 _v5)
+  {
+    if (!guess.bounds.contains(P))
+      return false;
+
+    const vec3f start = initialGuess(guess,vec3f(1.f/3.f,1.f/3.f,.5f),P);
+    return intersectWedgeEXT(value,P,_v0,_v1,_v2,_v3,_v4,_v5,start);
+  }
+
+
   inline __both__
   void hexInterpolationFunctions(float *pcoords/*[3]*/, float *sf/*[8]*/)
   {
@@ -0,0 +1,421 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include <float.h>
+#include <limits.h>
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <owl/common/parallel/parallel_for.h>
+#include "model/ABRs.h"
+#include "model/AccelFile.h"
+#include "ValueRangeTree.h"
+
+using namespace owl;
+using namespace owl::common;
+
+namespace exa {
+
+  // ==================================================================
+  // Builder
+  // ==================================================================
+
+  struct ValueRangeBuildTask {
+    box3f                 bounds;     // the node's region
+    range1f               valueRange; // of the regions overlapping it
+    std::vector<uint32_t> prims;      // regions overlapping it
+    uint32_t              nodeID;
+    int                   depth;
+  };
+
+  struct ValueRangeSplit {
+    int   axis = -1;
+    float plane = 0.f;
+    float cost = FLT_MAX;
+  };
+
+  inline float width(const range1f &r)
+  {
+    return r.upper > r.lower ? r.upper-r.lower : 0.f;
+  }
+
+  /*! like the kd-tree builder's findSplit(), but the SAH is weighted
+    by the value range width on either side; the ranges of all
+    planes come from prefix/suffix unions over the regions sorted by
+    their lower/upper faces. eps keeps constant-valued sides from
+    being free */
+  static ValueRangeSplit findSplit(const ValueRangeBuildTask &task,
+                                   const box3f *domains,
+                                   const range1f *valueRanges)
+  {
+    const size_t n = task.prims.size();
+    const box3f &region = task.bounds;
+    const float eps = 1e-3f*width(task.valueRange);
+
+    std::vector<uint32_t> byLower(n), byUpper(n);
+    std::vector<float> lowers(n), uppers(n), planes;
+    std::vector<range1f> leftRanges(n+1), rightRanges(n+1);
+    planes.reserve(2*n);
+
+    ValueRangeSplit best;
+    for (int axis=0; axis<3; ++axis) {
+      planes.clear();
+      for (size_t i=0; i<n; ++i) {
+        const box3f &domain = domains[task.prims[i]];
+        const float lo = std::max(domain.lower[axis],region.lower[axis]);
+        const float hi = std::min(domain.upper[axis],region.upper[axis]);
+        if (lo > region.lower[axis]) planes.push_back(lo);
+        if (hi < region.upper[axis]) planes.push_back(hi);
+      }
+
+      std::iota(byLower.begin(),byLower.end(),0u);
+      std::iota(byUpper.begin(),byUpper.end(),0u);
+      auto lower = [&](uint32_t i) { return domains[task.prims[i]].lower[axis]; };
+      auto upper = [&](uint32_t i) { return domains[task.prims[i]].upper[axis]; };
+      std::sort(byLower.begin(),byLower.end(),
+                [&](uint32_t a, uint32_t b) { return lower(a) < lower(b); });
+      std::sort(byUpper.begin(),byUpper.end(),
+                [&](uint32_t a, uint32_t b) { return upper(a) < upper(b); });
+
+      // leftRanges[k]: the k lowest lower faces; rightRanges[k]: all
+      // but the k lowest upper faces
+      leftRanges[0] = range1f();
+      rightRanges[n] = range1f();
+      for (size_t k=0; k<n; ++k) {
+        lowers[k] = lower(byLower[k]);
+        uppers[k] = upper(byUpper[k]);
+        leftRanges[k+1] = leftRanges[k];
+        leftRanges[k+1].extend(valueRanges[task.prims[byLower[k]]]);
+      }
+      for (size_t k=n; k>0; --k) {
+        rightRanges[k-1] = rightRanges[k];
+        rightRanges[k-1].extend(valueRanges[task.prims[byUpper[k-1]]]);
+      }
+
+      std::sort(planes.begin(),planes.end());
+      planes.erase(std::unique(planes.begin(),planes.end()),planes.end());
+
+      for (float plane : planes) {
+        const size_t numLeft = std::lower_bound(lowers.begin(),lowers.end(),plane)-lowers.begin();
+        const size_t numBelow = std::upper_bound(uppers.begin(),uppers.end(),plane)-uppers.begin();
+        const size_t numRight = n-numBelow;
+        if (numLeft == 0 || numRight == 0 || numLeft == n || numRight == n)
+          continue;
+
+        box3f left = region, right = region;
+        left.upper[axis] = plane;
+        right.lower[axis] = plane;
+        const float cost = halfArea(left)*numLeft*(width(leftRanges[numLeft])+eps)
+                         + halfArea(right)*numRight*(width(rightRanges[numBelow])+eps);
+
+        if (cost < best.cost) {
+          best.axis  = axis;
+          best.plane = plane;
+          best.cost  = cost;
+        }
+      }
+    }
+
+    return best;
+  }
+
+  ValueRangeTree::SP ValueRangeTree::build(size_t numRegions,
+                                           const box3f *domains,
+                                           const range1f *valueRanges,
+                                           int maxDepth)
+  {
+    double t0 = getCurrentTime();
+
+    ValueRangeTree::SP result = std::make_shared<ValueRangeTree>();
+    if (numRegions == 0)
+      return result;
+
+    Stats &stats = result->stats;
+    std::vector<ValueRangeNode> &nodes = result->nodes;
+    nodes.resize(1);
+
+    std::vector<ValueRangeBuildTask> open(1);
+    for (size_t i=0; i<numRegions; ++i) {
+      open[0].bounds.extend(domains[i]);
+      open[0].valueRange.extend(valueRanges[i]);
+    }
+    open[0].prims.resize(numRegions);
+    std::iota(open[0].prims.begin(),open[0].prims.end(),0u);
+    open[0].nodeID = 0;
+    open[0].depth  = 0;
+
+    result->modelBounds = open[0].bounds;
+
+    // level by level, the nodes of a level are split in parallel
+    while (!open.empty()) {
+      std::vector<ValueRangeSplit> splits(open.size());
+      std::vector<ValueRangeBuildTask> children(2*open.size());
+      parallel_for(open.size(),[&](size_t taskID) {
+        const ValueRangeBuildTask &task = open[taskID];
+        if (task.prims.size() <= 1 || width(task.valueRange) == 0.f || task.depth >= maxDepth)
+          return;
+
+        const ValueRangeSplit split = findSplit(task,domains,valueRanges);
+        splits[taskID] = split;
+        if (split.axis < 0)
+          return;
+
+        ValueRangeBuildTask &left = children[2*taskID];
+        ValueRangeBuildTask &right = children[2*taskID+1];
+        left.bounds = right.bounds = task.bounds;
+        left.bounds.upper[split.axis] = split.plane;
+        right.bounds.lower[split.axis] = split.plane;
+        for (uint32_t primID : task.prims) {
+          if (domains[primID].lower[split.axis] < split.plane) {
+            left.prims.push_back(primID);
+            left.valueRange.extend(valueRanges[primID]);
+          }
+          if (domains[primID].upper[split.axis] > split.plane) {
+            right.prims.push_back(primID);
+            right.valueRange.extend(valueRanges[primID]);
+          }
+        }
+        left.depth = right.depth = task.depth+1;
+      });
+
+      std::vector<ValueRangeBuildTask> next;
+      for (size_t taskID=0; taskID<open.size(); ++taskID) {
+        const ValueRangeBuildTask &task = open[taskID];
+        const ValueRangeSplit &split = splits[taskID];
+
+        ValueRangeNode &node = nodes[task.nodeID];
+        node.domain     = task.bounds;
+        node.valueRange = task.valueRange;
+        node.firstChild = -1;
+        if (split.axis < 0) {
+          stats.numLeaves++;
+        } else {
+          const size_t firstChild = nodes.size();
+          if (firstChild+2 > size_t(INT_MAX))
+            throw std::runtime_error("ValueRangeTree::build: too many nodes");
+          nodes[task.nodeID].firstChild = (int)firstChild;
+          nodes.resize(firstChild+2);
+          children[2*taskID].nodeID = (uint32_t)firstChild;
+          children[2*taskID+1].nodeID = (uint32_t)firstChild+1;
+          next.push_back(std::move(children[2*taskID]));
+          next.push_back(std::move(children[2*taskID+1]));
+          stats.numInnerNodes++;
+        }
+        stats.maxDepth = std::max(stats.maxDepth,task.depth);
+      }
+      open.swap(next);
+    }
+
+    stats.buildTime = getCurrentTime()-t0;
+
+    return result;
+  }
+
+  ValueRangeTree::SP ValueRangeTree::build(const ABRs &abrs, int maxDepth)
+  {
+    std::vector<box3f> domains(abrs.value.size());
+    std::vector<range1f> valueRanges(abrs.value.size());
+    for (size_t i=0; i<abrs.value.size(); ++i) {
+      domains[i] = abrs.value[i].domain;
+      valueRanges[i] = abrs.value[i].valueRange;
+    }
+    return build(domains.size(),domains.data(),valueRanges.data(),maxDepth);
+  }
+
+  // ==================================================================
+  // I/O
+  // ==================================================================
+
+  ValueRangeTree::SP ValueRangeTree::load(const std::string fileName)
+  {
+    std::string error;
+    AccelFile::SP file = AccelFile::open(fileName,error);
+    if (!file)
+      throw std::runtime_error("ValueRangeTree::load: "+error);
+
+    ValueRangeTree::SP result = std::make_shared<ValueRangeTree>();
+    result->nodes       = file->read<ValueRangeNode>(AccelFile::VALUE_RANGE_NODES);
+    result->modelBounds = file->header().bounds;
+
+    if (!result->validate(error))
+      throw std::runtime_error("ValueRangeTree::load: "+fileName+": "+error);
+
+    // children are stored after their parents
+    Stats &stats = result->stats;
+    std::vector<int> depths(result->nodes.size(),0);
+    for (size_t i=0; i<result->nodes.size(); ++i) {
+      const ValueRangeNode &node = result->nodes[i];
+      stats.maxDepth = std::max(stats.maxDepth,depths[i]);
+      if (node.firstChild < 0) {
+        stats.numLeaves++;
+      } else {
+        stats.numInnerNodes++;
+        depths[node.firstChild] = depths[node.firstChild+1] = depths[i]+1;
+      }
+    }
+
+    return result;
+  }
+
+  bool ValueRangeTree::save(const std::string fileName) const
+  {
+    return AccelFile::write(fileName,modelBounds,{
+      {AccelFile::VALUE_RANGE_NODES,sizeof(ValueRangeNode),nodes.size(),nodes.data()},
+    });
+  }
+
+  bool ValueRangeTree::validate(std::string &error) const
+  {
+    if (nodes.empty()) {
+      error = "no value range tree nodes";
+      return false;
+    }
+
+    // children are created once per inner node, so in a tree every
+    // node is reached exactly once
+    std::vector<size_t> stack{ 0 };
+    size_t numVisited = 0;
+    while (!stack.empty()) {
+      const size_t nodeID = stack.back();
+      stack.pop_back();
+
+      if (++numVisited > nodes.size()) {
+        error = "nodes are referenced more than once";
+        return false;
+      }
+
+      const ValueRangeNode &node = nodes[nodeID];
+      if (node.firstChild < 0)
+        continue;
+
+      const size_t child = (size_t)node.firstChild;
+      if (child+1 >= nodes.size()) {
+        error = "node "+std::to_string(nodeID)+" has invalid children";
+        return false;
+      }
+
+      for (size_t c=child; c<child+2; ++c) {
+        const ValueRangeNode &n = nodes[c];
+        const bool nested = n.domain.lower.x >= node.domain.lower.x
+                         && n.domain.lower.y >= node.domain.lower.y
+                         && n.domain.lower.z >= node.domain.lower.z
+                         && n.domain.upper.x <= node.domain.upper.x
+                         && n.domain.upper.y <= node.domain.upper.y
+                         && n.domain.upper.z <= node.domain.upper.z
+                         && (n.valueRange.upper < n.valueRange.lower
+                           || (n.valueRange.lower >= node.valueRange.lower
+                            && n.valueRange.upper <= node.valueRange.upper));
+        if (!nested) {
+          error = "node "+std::to_string(c)+" isn't nested in its parent";
+          return false;
+        }
+        stack.push_back(c);
+      }
+    }
+
+    if (numVisited != nodes.size()) {
+      error = std::to_string(nodes.size()-numVisited)+" nodes are unreachable";
+      return false;
+    }
+
+    return true;
+  }
+
+  // ==================================================================
+  // Majorants
+  // ==================================================================
+
+  void ValueRangeTree::computeMajorants(TFRangeMaxTraversable xfRangeMax,
+                                        range1f xfRange,
+                                        std::vector<float> &majorants) const
+  {
+    majorants.resize(nodes.size());
+    parallel_for_blocked(0ull,nodes.size(),4096,[&](size_t begin, size_t end) {
+      for (size_t i=begin; i<end; ++i) {
+        majorants[i] = maxOpacity(nodes[i].valueRange,xfRangeMax,xfRange);
+      }
+    });
+  }
+
+  void ValueRangeTree::computeMajorants(const std::vector<vec4f> &colorMap,
+                                        range1f xfRange,
+                                        std::vector<float> &majorants) const
+  {
+    TFRangeMax xfRangeMax;
+    xfRangeMax.build(colorMap.data(),colorMap.size());
+    computeMajorants(xfRangeMax.traversable(),xfRange,majorants);
+  }
+
+  std::vector<std::pair<box3f,float>> ValueRangeTree::cut(const std::vector<float> &majorants,
+                                                          size_t maxDomains) const
+  {
+    std::vector<std::pair<box3f,float>> result;
+    if (nodes.empty() || maxDomains == 0)
+      return result;
+
+    // split the node w/ the largest majorant times volume first; the
+    // reduction of a single split is a poor guide, as it's often zero
+    // although splits further down the subtree do reduce
+    struct Candidate {
+      float    weight;
+      uint32_t nodeID;
+      bool operator<(const Candidate &other) const
+      { return weight < other.weight; }
+    };
+
+    std::priority_queue<Candidate> queue;
+    size_t numDomains = 1;
+    auto push = [&](uint32_t nodeID) {
+      if (nodes[nodeID].firstChild < 0 || majorants[nodeID] == 0.f)
+        result.push_back({nodes[nodeID].domain,majorants[nodeID]});
+      else
+        queue.push({majorants[nodeID]*volume(nodes[nodeID].domain),nodeID});
+    };
+
+    push(0);
+    while (!queue.empty() && numDomains < maxDomains) {
+      const uint32_t nodeID = queue.top().nodeID;
+      queue.pop();
+      push(nodes[nodeID].firstChild);
+      push(nodes[nodeID].firstChild+1);
+      numDomains++;
+    }
+
+    while (!queue.empty()) {
+      const uint32_t nodeID = queue.top().nodeID;
+      queue.pop();
+      result.push_back({nodes[nodeID].domain,majorants[nodeID]});
+    }
+
+    return result;
+  }
+
+  void ValueRangeTree::printStats() const
+  {
+    std::cout << "#exa: value range tree: " << prettyNumber(stats.numInnerNodes) << " inner nodes, "
+              << prettyNumber(stats.numLeaves) << " leaves, max depth "
+              << stats.maxDepth << ", " << prettyBytes(nodes.size()*sizeof(nodes[0]));
+    if (stats.buildTime > 0.0)
+      std::cout << ", built in " << prettyDouble(stats.buildTime) << 's';
+    std::cout << '\n';
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,112 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "common.h"
+#include "TFRangeMax.h"
+
+namespace exa {
+
+  struct ABRs;
+
+  //! Node of a ValueRangeTree; the two children are stored adjacently
+  struct ValueRangeNode {
+    box3f   domain;     // region of space, disjoint from the sibling's
+    range1f valueRange; // of all input regions overlapping domain
+    int     firstChild; // -1 for leaves
+  };
+
+  /*! TF-independent spatial hierarchy over non-overlapping regions
+    (ABRs) that stores a conservative value range at every node, so
+    it's built once per data set. Majorants for any TF follow from
+    the node value ranges in a single parallel pass over the nodes
+    (computeMajorants()); cut() then selects the set of disjoint
+    majorant domains for that TF from the hierarchy. The TF-specific
+    SAH kd-tree (kdtreeBuilder) remains an optional refinement */
+  struct ValueRangeTree
+  {
+    typedef std::shared_ptr<ValueRangeTree> SP;
+
+    /*! Split planes are the regions' faces; the plane minimizes the
+      sum over both sides of surface area, number of regions, and
+      value range width, so that similar values end up in the same
+      subtree. Regions straddling a plane are referenced on both
+      sides. Nodes overlapping a single region or a constant value
+      range (where no TF could tell the children apart) become
+      leaves; the nodes of each tree level are split in parallel */
+    static ValueRangeTree::SP build(size_t numRegions,
+                                    const box3f *domains,
+                                    const range1f *valueRanges,
+                                    int maxDepth = 64);
+
+    static ValueRangeTree::SP build(const ABRs &abrs, int maxDepth = 64);
+
+    //! Throws if the file is invalid or holds no value range tree
+    static ValueRangeTree::SP load(const std::string fileName);
+
+    //! Write nodes and model bounds to an AccelFile
+    bool save(const std::string fileName) const;
+
+    /*! Check that children are in range and referenced once, and
+      nest inside their parent, both spatially and in value range */
+    bool validate(std::string &error) const;
+
+    //! majorants[i] is the max. opacity over nodes[i].valueRange
+    void computeMajorants(TFRangeMaxTraversable xfRangeMax,
+                          range1f xfRange,
+                          std::vector<float> &majorants) const;
+
+    //! Convenience overload, builds the range-max table first
+    void computeMajorants(const std::vector<vec4f> &colorMap,
+                          range1f xfRange,
+                          std::vector<float> &majorants) const;
+
+    /*! Disjoint (domain,majorant) pairs covering the tree's domain,
+      at most maxDomains of them: starting at the root, greedily
+      replaces the node w/ the largest majorant times volume by its
+      children. Nodes whose majorant is zero aren't split */
+    std::vector<std::pair<box3f,float>> cut(const std::vector<float> &majorants,
+                                            size_t maxDomains) const;
+
+    const box3f &getModelBounds() const { return modelBounds; }
+
+    void setModelBounds(const box3f &bounds) { modelBounds = bounds; }
+
+    void printStats() const;
+
+    struct Stats {
+      size_t numInnerNodes = 0;
+      size_t numLeaves     = 0;
+      int    maxDepth      = 0;
+      double buildTime     = 0.0;
+    };
+
+    std::vector<ValueRangeNode> nodes;
+    Stats                       stats;
+
+  private:
+    box3f modelBounds;
+  };
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -1,7 +1,6 @@
 #include "array/Array3D.h"
 #include "SpatialField.h"
 #include <OWLRenderer.h>
-#include "model/ExaBrickModel.h" // for struct ExaBrick
 
 namespace exa {
 
@@ -19,11 +18,33 @@ SpatialField::SpatialField(ExaStitchGlobalState *d)
   : Object(d)
 {}
 
+SpatialField::~SpatialField()
+{
+  observeBlocks(false);
+}
+
+void SpatialField::observeBlocks(bool observe)
+{
+  if (!blockData)
+    return;
+
+  for (size_t i=0; i<blockData->totalSize(); ++i) {
+    Object *bd = blockData->handlesBegin()[i];
+    if (observe)
+      bd->addCommitObserver(this);
+    else
+      bd->removeCommitObserver(this);
+  }
+}
+
 void SpatialField::commit()
 {
+  observeBlocks(false);
+
   blockBounds = getParamObject<Array1D>("block.bounds");
   if (!blockBounds) {
     std::cerr << "SpatialField::commit(): no block.bounds provided\n";
+    return;
   }
 
   blockLevel = getParamObject<Array1D>("block.level");
@@ -38,50 +59,34 @@ void SpatialField::commit()
     return;
   }
 
-  // std::cout << blockBounds->totalSize() << '\n';
-  // std::cout << blockLevel->totalSize() << '\n';
-  // std::cout << blockData->totalSize() << '\n';
-
-  std::vector<ExaBrick> bricks(blockBounds->totalSize());
-  for (size_t i=0; i<bricks.size(); ++i) {
-    box3i bound = *(blockBounds->beginAs<box3i>()+i);
-    int level = *(blockLevel->beginAs<int>()+i);
-    int cellWidth = (1<<level);
-    bricks[i].lower.x = bound.lower.x*cellWidth;
-    bricks[i].lower.y = bound.lower.y*cellWidth;
-    bricks[i].lower.z = bound.lower.z*cellWidth;
-    bricks[i].size.x = (bound.upper.x-bound.lower.x)+1;
-    bricks[i].size.y = (bound.upper.y-bound.lower.y)+1;
-    bricks[i].size.z = (bound.upper.z-bound.lower.z)+1;
-    bricks[i].level = level;
-    bricks[i].begin = 0;
-    if (i>0) {
-      bricks[i].begin = bricks[i-1].size.x*bricks[i-1].size.y*bricks[i-1].size.z;
-    }
+  const size_t numBlocks = blockBounds->totalSize();
+  if (blockLevel->totalSize() != numBlocks || blockData->totalSize() != numBlocks) {
+    std::cerr << "SpatialField::commit(): block.bounds, block.level, and block.data "
+              << "must have the same size\n";
+    return;
   }
 
-  // convert to flat array
-  size_t numCells = bricks.back().begin+volume(bricks.back().size);
-  std::vector<float> scalars(numCells);
-  for (size_t i=0; i<blockData->totalSize(); ++i) {
+  // The renderer converts the blocks to bricks (in parallel, w/ a
+  // prefix sum over the block sizes); if the app's arrays are laid
+  // out back to back it references them instead of copying. We hold
+  // references to the arrays, and shared arrays notify us when they
+  // get privatized, so we're re-committed with the private copies
+  const box3i *bounds = blockBounds->beginAs<box3i>();
+  const int *levels = blockLevel->beginAs<int>();
+  std::vector<OWLRenderer::BlockData> data(numBlocks);
+  for (size_t i=0; i<numBlocks; ++i) {
     const Array3D &bd = *((const Array3D *)blockData->handlesBegin()[i]);
-    // assume stride=1..
-    for (unsigned z=0;z<bd.size().z;++z) {
-      for (unsigned y=0;y<bd.size().y;++y) {
-        for (unsigned x=0;x<bd.size().x;++x) {
-          size_t index = z*size_t(bd.size().x)*bd.size().y
-                       + y*bd.size().x
-                       + x;
-          scalars[bricks[i].begin+index] = bd.dataAs<float>()[index];
-        }
-      }
-    }
+    data[i].size = vec3i((int)bd.size().x,(int)bd.size().y,(int)bd.size().z);
+    data[i].data = bd.dataAs<float>(); // assume stride=1..
   }
 
   deviceState()->owlRenderer
-    = std::make_shared<OWLRenderer>(bricks.data(),
-                                    scalars.data(),
-                                    bricks.size());
+    = std::make_shared<OWLRenderer>(bounds,
+                                    levels,
+                                    data.data(),
+                                    numBlocks);
+
+  observeBlocks(true);
 
   markUpdated();
 }
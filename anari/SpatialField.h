@@ -12,8 +12,12 @@ struct SpatialField : Object
 {
   static SpatialField *createInstance(std::string_view subtype, ExaStitchGlobalState *d);
   SpatialField(ExaStitchGlobalState *s);
+  ~SpatialField();
   virtual void commit() override;
 private:
+  // the renderer may reference the blocks' memory, get notified
+  // when that changes (e.g., shared arrays being privatized)
+  void observeBlocks(bool observe);
 
   // only supported field type is "amr"
   helium::IntrusivePtr<Array1D> blockBounds;
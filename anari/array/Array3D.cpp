@@ -45,6 +45,8 @@ anari::uint3 Array3D::size() const
 void Array3D::privatize()
 {
   makePrivatizedCopy(size(0) * size(1) * size(2));
+  // observers might have referenced the app's memory
+  notifyCommitObservers();
 }
 
 } // namespace exa
@@ -55,6 +55,7 @@ typedef owl::interval<float> range1f;
 #define EXABRICK_KDTREE_TRAVERSAL  3
 #define EXABRICK_BVH_TRAVERSAL     4
 #define EXABRICK_EXT_BVH_TRAVERSAL 5
+#define EXABRICK_ADAPTIVE_GRID_TRAVERSAL 6
 
 namespace exa {
   typedef int SamplingMode;
@@ -66,6 +67,22 @@ namespace exa {
     return (1.f-x)*val1+x*val2;
   }
 
+  //! volume of a box, zero if it is empty
+  inline __both__
+  float volume(const box3f &box)
+  {
+    const vec3f s = max(box.size(),vec3f(0.f));
+    return s.x*s.y*s.z;
+  }
+
+  //! half the surface area of a box, for SAH costs; zero if it is empty
+  inline __both__
+  float halfArea(const box3f &box)
+  {
+    const vec3f s = max(box.size(),vec3f(0.f));
+    return s.x*s.y+s.y*s.z+s.z*s.x;
+  }
+
   inline void printGPUMemory(std::string str)
   {
     size_t free, total;
@@ -422,8 +422,7 @@ namespace exa {
     auto integrate = [=,&pixelColor](const int leafID, float t0, float t1) {
       const float global_dt = lp.render.dt;
 
-      const ABR &abr = lp.abrBuffer[leafID];
-      const float dt = global_dt * abr.finestLevelCellWidth;
+      const float dt = global_dt * getABRFinestLevelCellWidth(lp.abrBuffer,leafID);
 
       int i0 = int(ceilf((t0-dt*ils_t0) / dt));
       float t_i = (ils_t0 + i0) * dt;
@@ -440,8 +439,8 @@ namespace exa {
 
         const vec3f pos = ray.origin + t_sample * ray.direction;
 
-        const int *childList  = &lp.abrLeafListBuffer[abr.leafListBegin];
-        const int  childCount = abr.leafListSize;
+        const int *childList  = &lp.abrLeafListBuffer[getABRLeafListBegin(lp.abrBuffer,leafID)];
+        const int  childCount = getABRLeafListSize(lp.abrBuffer,leafID);
         float sumWeightedValues = 0.f;
         float sumWeights = 0.f;
         for (int childID=0;childID<childCount;childID++) {
@@ -512,7 +511,7 @@ namespace exa {
                                             int primID,
                                             float tmin, float tmax,
                                             KDTreeHitRec &hitRec) {
-      const ExaBrick &brick = optixLaunchParams.sampler.ebs.brickBuffer[primID];
+      const ExaBrick &brick = getBrick(optixLaunchParams.sampler.ebs.brickBuffer,primID);
       const box3f bounds = brick.getBounds(); // use strict domain
 
       float t0 = 1e30f, t1 = -1e30f;
@@ -524,6 +523,13 @@ namespace exa {
     });
   }
 
+  template <typename Func>
+  inline __device__
+  void traverse(const AdaptiveGridTraversable &grid, Ray ray, const Func &func)
+  {
+    traverse(grid,ray.origin,ray.direction,ray.tmin,ray.tmax,func);
+  }
+
   template <typename Func>
   inline __device__
   void traverse(const GridTraversableHandle &grid, Ray ray, const Func &func)
@@ -1382,6 +1388,8 @@ namespace exa {
     renderFrame_SelectIntegrator<Default>(lp.majorantGrid,lp.sampler.ebs);
 #elif EXA_STITCH_EXA_BRICK_TRAVERSAL_MODE == EXABRICK_KDTREE_TRAVERSAL
     renderFrame_SelectIntegrator<Default>(lp.majorantKDTree,lp.sampler.ebs);
+#elif EXA_STITCH_EXA_BRICK_TRAVERSAL_MODE == EXABRICK_ADAPTIVE_GRID_TRAVERSAL
+    renderFrame_SelectIntegrator<Default>(lp.majorantAdaptiveGrid,lp.sampler.ebs);
 #else
     renderFrame_SelectIntegrator<Default>(lp.majorantBVH,lp.sampler.ebs);
 #endif
@@ -272,6 +272,7 @@ namespace exa {
     double t0 = getCurrentTime();
     this->value.clear();
     leafList.clear();
+    arrays = ABRArrays();
     std::mutex mutex;
     box3f bounds;
     std::vector<std::pair<box3f,int>> buildPrims;
@@ -330,6 +331,37 @@ namespace exa {
     std::cout << "stat: avg bricks/region (by volume): " << (stat_volumeWeightedNumBrickInRegion/stat_totalVolumeInRegions) << std::endl;
     std::cout << "stat: brick/region MAX : " << stat_maxBricksPerRegion << std::endl;
   }
+
+  void ABRs::buildSoA()
+  {
+    arrays.build(value.data(),value.size());
+  }
+
+  void ABRArrays::build(const ABR *abrs, size_t numABRs)
+  {
+    domain.resize(numABRs);
+    valueRange.resize(numABRs);
+    leafListBegin.resize(numABRs);
+    leafListSize.resize(numABRs);
+    finestLevelCellWidth.resize(numABRs);
+    parallel_for_blocked(0ull,numABRs,1<<14,[&](size_t first,size_t last){
+        for (size_t i=first;i<last;i++) {
+          domain[i]               = abrs[i].domain;
+          valueRange[i]           = abrs[i].valueRange;
+          leafListBegin[i]        = abrs[i].leafListBegin;
+          leafListSize[i]         = abrs[i].leafListSize;
+          finestLevelCellWidth[i] = abrs[i].finestLevelCellWidth;
+        }
+      });
+  }
+
+  size_t ABRArrays::bytes() const
+  {
+    return domain.size()*sizeof(domain[0]) + valueRange.size()*sizeof(valueRange[0])
+        + leafListBegin.size()*sizeof(leafListBegin[0])
+        + leafListSize.size()*sizeof(leafListSize[0])
+        + finestLevelCellWidth.size()*sizeof(finestLevelCellWidth[0]);
+  }
   
 } // ::exa
 
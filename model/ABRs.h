@@ -74,6 +74,91 @@ namespace exa {
     float   finestLevelCellWidth;
   };
 
+  // ==================================================================
+  // Structure-of-arrays layouts
+  // ==================================================================
+
+  /*! Hot/cold split view of ABRs (see ABRArrays): point location and
+      stepping to neighboring ABRs only read the domains, the other
+      arrays are only touched for the ABR that contains the sample */
+  struct ABRSoA {
+    const box3f   *domain;
+    const range1f *valueRange;
+    const int     *leafListBegin;
+    const int     *leafListSize;
+    const float   *finestLevelCellWidth;
+  };
+
+  /*! Accessors that code templated on the layout (e.g., the samplers'
+      brickBuffer and abrBuffer) uses to read bricks and ABRs, both
+      from plain (AoS) arrays and from the SoA views. Bricks stay AoS:
+      sampling reads all of a brick's fields at once, so splitting them
+      only spreads one brick over more cache lines */
+  inline __both__
+  const ExaBrick &getBrick(const ExaBrick *bricks, int brickID)
+  { return bricks[brickID]; }
+
+  inline __both__
+  const box3f &getABRDomain(const ABR *abrs, int abrID)
+  { return abrs[abrID].domain; }
+
+  inline __both__
+  const box3f &getABRDomain(const ABRSoA &abrs, int abrID)
+  { return abrs.domain[abrID]; }
+
+  inline __both__
+  const range1f &getABRValueRange(const ABR *abrs, int abrID)
+  { return abrs[abrID].valueRange; }
+
+  inline __both__
+  const range1f &getABRValueRange(const ABRSoA &abrs, int abrID)
+  { return abrs.valueRange[abrID]; }
+
+  inline __both__
+  int getABRLeafListBegin(const ABR *abrs, int abrID)
+  { return abrs[abrID].leafListBegin; }
+
+  inline __both__
+  int getABRLeafListBegin(const ABRSoA &abrs, int abrID)
+  { return abrs.leafListBegin[abrID]; }
+
+  inline __both__
+  int getABRLeafListSize(const ABR *abrs, int abrID)
+  { return abrs[abrID].leafListSize; }
+
+  inline __both__
+  int getABRLeafListSize(const ABRSoA &abrs, int abrID)
+  { return abrs.leafListSize[abrID]; }
+
+  inline __both__
+  float getABRFinestLevelCellWidth(const ABR *abrs, int abrID)
+  { return abrs[abrID].finestLevelCellWidth; }
+
+  inline __both__
+  float getABRFinestLevelCellWidth(const ABRSoA &abrs, int abrID)
+  { return abrs.finestLevelCellWidth[abrID]; }
+
+  /*! Host storage for ABRSoA */
+  struct ABRArrays {
+    std::vector<box3f>   domain;
+    std::vector<range1f> valueRange;
+    std::vector<int>     leafListBegin;
+    std::vector<int>     leafListSize;
+    std::vector<float>   finestLevelCellWidth;
+
+    void build(const ABR *abrs, size_t numABRs);
+
+    ABRSoA view() const
+    {
+      return {domain.data(),valueRange.data(),leafListBegin.data(),
+              leafListSize.data(),finestLevelCellWidth.data()};
+    }
+
+    bool empty() const { return domain.empty(); }
+
+    size_t bytes() const;
+  };
+
   /*! helper class that allows for keeping track which bricks overlap
       in which basis-function region */
   struct ABRs {
@@ -89,10 +174,15 @@ namespace exa {
                            const ExaBrick *bricks,
                            const float *scalarFields);
     
+    /*! (re-)build the optional SoA copy of value, in arrays */
+    void buildSoA();
+
     std::mutex mutex;
     std::vector<ABR> value;
     /*! offset in parent's leaflist class where our leaf list starst */
     std::vector<int> leafList;
+    /*! SoA copy of value, empty unless buildSoA() was called */
+    ABRArrays        arrays;
   };
   
 } // ::exa
@@ -14,11 +14,15 @@
 // limitations under the License.                                           //
 // ======================================================================== //
 
-#include <fstream>
+#include <cstring>
+#include <owl/common/parallel/parallel_for.h>
 #include "AMRCellModel.h"
+#include "ParallelReduce.h"
+#include "ScalarFile.h"
 
 namespace exa {
 
+  bool AMRCellModel::zeroCopy = false;
 
   AMRCellModel::SP AMRCellModel::load(const std::string cellFileName,
                                       const std::string scalarFileName)
@@ -30,48 +34,76 @@ namespace exa {
     box3f &cellBounds           = result->cellBounds;
     range1f &valueRange         = result->valueRange;
 
-    std::ifstream scalarFile(scalarFileName, std::ios::binary | std::ios::ate);
-    if (scalarFile.good()) {
-      size_t numBytes = scalarFile.tellg();
-      scalarFile.close();
-      scalarFile.open(scalarFileName, std::ios::binary);
-      if (scalarFile.good()) {
-        scalars.resize(numBytes/sizeof(float));
-        scalarFile.read((char *)scalars.data(),scalars.size()*sizeof(float));
-      }
-    }
+    // raw or compressed scalar file, chunks are decoded in parallel
+    if (!ScalarFile::read(scalarFileName,scalars))
+      scalars.clear();
 
     // ==================================================================
     // AMR cells
     // ==================================================================
 
-    std::ifstream amrCellFile(cellFileName, std::ios::binary | std::ios::ate);
-    if (amrCellFile.good()) {
-      size_t numBytes = amrCellFile.tellg();
-      amrCellFile.close();
-      amrCellFile.open(cellFileName, std::ios::binary);
-      if (amrCellFile.good()) {
-        cells.resize(numBytes/sizeof(AMRCell));
-        amrCellFile.read((char *)cells.data(),cells.size()*sizeof(AMRCell));
+    double t0 = getCurrentTime();
+
+    MappedFile::SP cellFile = MappedFile::open(cellFileName);
+    if (cellFile) {
+      // the file is just a flat array of AMRCell's, so we can use it
+      // in place as long as our struct has no padding
+      static_assert(sizeof(AMRCell) == 4*sizeof(int), "unexpected AMRCell layout");
+
+      if (zeroCopy) {
+        result->mappedCells = cellFile;
+      } else {
+        cells.resize(cellFile->count<AMRCell>());
+        const AMRCell *src = cellFile->as<AMRCell>();
+        parallel_for_blocked(0ull,cells.size(),1024*1024,[&](size_t begin,size_t end){
+            memcpy(cells.data()+begin,src+begin,(end-begin)*sizeof(AMRCell));
+          });
       }
     }
 
-    for (size_t i=0; i<cells.size(); ++i) {
-      box3f bounds(vec3f(cells[i].pos),
-                   vec3f(cells[i].pos+vec3i(1<<cells[i].level)));
-      cellBounds.extend(bounds.lower);
-      cellBounds.extend(bounds.upper);
-      if (i < scalars.size())
-        valueRange.extend(scalars[i]);
-    }
+    const AMRCell *cellData = result->cellData();
+    const size_t numCells   = result->numCells();
+
+    cellBounds = parallelBounds(numCells,[cellData](size_t i) {
+      return box3f(vec3f(cellData[i].pos),
+                   vec3f(cellData[i].pos+vec3i(1<<cellData[i].level)));
+    });
+
+    valueRange = parallelValueRange(scalars.data(),std::min(numCells,scalars.size()));
+
+    double t1 = getCurrentTime();
+    std::cout << "#exa: loaded " << prettyDouble((double)numCells) << " AMR cells"
+              << (result->mappedCells ? " (zero-copy)" : "") << " in "
+              << prettyDouble(t1-t0) << "s\n";
 
     return result; 
   }
 
+  void AMRCellModel::getGridStatistics(GridResolution &res) const
+  {
+    const AMRCell *cellData = this->cellData();
+    const size_t numCells   = std::min(this->numCells(),scalars.size());
+
+    res.bounds = cellBounds;
+    res.domains.resize(numCells);
+    res.valueRanges.resize(numCells);
+    parallel_for_blocked(0ull,numCells,4096,[&](size_t begin, size_t end) {
+      for (size_t i=begin; i<end; ++i) {
+        res.domains[i] = box3f(vec3f(cellData[i].pos),
+                               vec3f(cellData[i].pos+vec3i(1<<cellData[i].level)));
+        res.valueRanges[i] = range1f(scalars[i],scalars[i]);
+      }
+    });
+
+    res.cellsPerLevel = parallelHistogram(numCells,[cellData](size_t i) {
+      return std::make_pair(cellData[i].level,size_t(1));
+    });
+  }
+
   void AMRCellModel::memStats(size_t &cellsBytes, size_t &scalarsBytes)
   {
-    cellsBytes = cells.empty()   ? 0 : cells.size()*sizeof(cells[0]);
-    scalarsBytes = cells.empty() ? 0 : scalars.size()*sizeof(scalars[0]);
+    cellsBytes = numCells()*sizeof(AMRCell);
+    scalarsBytes = numCells() == 0 ? 0 : scalars.size()*sizeof(scalars[0]);
   }
 
 } // ::exa
@@ -19,6 +19,7 @@
 #include <vector>
 #include <common.h>
 #include "Model.h"
+#include "MappedFile.h"
 
 namespace exa {
 
@@ -37,6 +38,23 @@ namespace exa {
     std::vector<AMRCell> cells;
     std::vector<float>   scalars;
 
+    /*! if loaded zero-copy, the cells vector stays empty and the cells
+      live in the memory-mapped file instead; use these accessors to
+      be agnostic of that */
+    const AMRCell *cellData() const
+    { return mappedCells ? mappedCells->as<AMRCell>() : cells.data(); }
+
+    size_t numCells() const
+    { return mappedCells ? mappedCells->count<AMRCell>() : cells.size(); }
+
+    MappedFile::SP mappedCells;
+
+    /*! reference the mapped cell file instead of copying it */
+    static bool zeroCopy;
+
+    //! cells and their widths, see GridResolution
+    void getGridStatistics(GridResolution &res) const override;
+
     // Statistics
     void memStats(size_t &cellsBytes, size_t &scalarsBytes);
   };
@@ -0,0 +1,204 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include <fstream>
+#include <stdexcept>
+#include "AccelFile.h"
+#include "Hash.h"
+
+namespace exa {
+
+  inline uint64_t alignUp(uint64_t offset, uint64_t alignment)
+  {
+    return (offset+alignment-1)/alignment*alignment;
+  }
+
+  inline uint64_t byteSwap(uint64_t value)
+  {
+    uint64_t result = 0;
+    for (int i=0; i<8; ++i) {
+      result = (result<<8) | (value&0xff);
+      value >>= 8;
+    }
+    return result;
+  }
+
+  bool AccelFile::isAccelFile(const std::string fileName)
+  {
+    std::ifstream in(fileName, std::ios::binary);
+    uint64_t m = 0;
+    in.read((char *)&m,sizeof(m));
+    return in.good() && (m == magic || m == byteSwap(magic));
+  }
+
+  AccelFile::SP AccelFile::open(const std::string fileName,
+                                std::string &error,
+                                bool verifyChecksums)
+  {
+    AccelFile::SP result = std::make_shared<AccelFile>();
+    result->fileName = fileName;
+    result->mapped = MappedFile::open(fileName);
+
+    if (!result->mapped) {
+      error = "cannot open "+fileName;
+      return nullptr;
+    }
+
+    const size_t fileSize = result->mapped->size();
+    if (fileSize >= sizeof(Header) && result->header().magic == byteSwap(magic)) {
+      error = fileName+" was written on a machine with different endianness";
+      return nullptr;
+    }
+
+    if (fileSize < sizeof(Header) || result->header().magic != magic) {
+      error = fileName+" is not an accel file";
+      return nullptr;
+    }
+
+    const Header &header = result->header();
+    if (header.endianness != endianness) {
+      error = fileName+" was written on a machine with different endianness";
+      return nullptr;
+    }
+
+    if (header.version != version) {
+      error = fileName+": unsupported version "+std::to_string(header.version)
+            + " (expected "+std::to_string(version)+")";
+      return nullptr;
+    }
+
+    if (header.fileSize != fileSize) {
+      error = fileName+" is truncated ("+std::to_string(fileSize)+" of "
+            + std::to_string(header.fileSize)+" bytes)";
+      return nullptr;
+    }
+
+    if (sizeof(Header)+header.numSections*sizeof(Section) > fileSize) {
+      error = fileName+": section table exceeds the file";
+      return nullptr;
+    }
+
+    const Section *sections = result->sections();
+    for (uint32_t i=0; i<header.numSections; ++i) {
+      const Section &s = sections[i];
+      const std::string name = std::string(sectionName(s.type));
+
+      // guard against overflow before checking the extent
+      if (s.elemSize == 0 || s.elemSize%4 != 0 || s.count > fileSize/s.elemSize ||
+          s.offset%alignment != 0 || s.offset > fileSize ||
+          s.count*s.elemSize > fileSize-s.offset) {
+        error = fileName+": section "+name+" is corrupt or exceeds the file";
+        return nullptr;
+      }
+
+      if (verifyChecksums) {
+        const char *data = result->mapped->as<char>()+s.offset;
+        if (hashArray(data,s.count*s.elemSize,fnvOffsetBasis) != s.checksum) {
+          error = fileName+": checksum mismatch in section "+name;
+          return nullptr;
+        }
+      }
+    }
+
+    return result;
+  }
+
+  bool AccelFile::write(const std::string fileName,
+                        const owl::box3f &bounds,
+                        const std::vector<SectionData> &sectionData)
+  {
+    Header header{};
+    header.magic       = magic;
+    header.version     = version;
+    header.endianness  = endianness;
+    header.bounds      = bounds;
+    header.numSections = (uint32_t)sectionData.size();
+
+    std::vector<Section> sections(sectionData.size());
+    uint64_t offset = alignUp(sizeof(Header)+sections.size()*sizeof(Section),alignment);
+    for (size_t i=0; i<sectionData.size(); ++i) {
+      const SectionData &sd = sectionData[i];
+      const uint64_t numBytes = sd.count*sd.elemSize;
+      if (sd.elemSize%4 != 0) {
+        throw std::runtime_error("AccelFile: element size must be a multiple of 4");
+      }
+      sections[i].type     = sd.type;
+      sections[i].elemSize = sd.elemSize;
+      sections[i].count    = sd.count;
+      sections[i].offset   = offset;
+      sections[i].checksum = hashArray(sd.data,numBytes,fnvOffsetBasis);
+      offset = alignUp(offset+numBytes,alignment);
+    }
+    header.fileSize = offset;
+
+    std::ofstream out(fileName, std::ios::binary);
+    if (!out.good())
+      return false;
+
+    const char padding[alignment] = {};
+    auto pad = [&]() {
+      const uint64_t pos = (uint64_t)out.tellp();
+      out.write(padding,alignUp(pos,alignment)-pos);
+    };
+
+    out.write((const char *)&header,sizeof(header));
+    out.write((const char *)sections.data(),sections.size()*sizeof(Section));
+    pad();
+
+    for (size_t i=0; i<sectionData.size(); ++i) {
+      out.write((const char *)sectionData[i].data,sections[i].count*sections[i].elemSize);
+      pad();
+    }
+
+    return out.good();
+  }
+
+  const AccelFile::Section *AccelFile::findSection(SectionType type) const
+  {
+    for (uint32_t i=0; i<header().numSections; ++i) {
+      if (sections()[i].type == (uint32_t)type)
+        return &sections()[i];
+    }
+    return nullptr;
+  }
+
+  void AccelFile::checkElemSize(const Section &section, size_t elemSize) const
+  {
+    if (section.elemSize != elemSize) {
+      throw std::runtime_error(fileName+": section "+sectionName(section.type)
+                               +" has elements of "+std::to_string(section.elemSize)
+                               +" bytes, expected "+std::to_string(elemSize));
+    }
+  }
+
+  const char *AccelFile::sectionName(uint32_t type)
+  {
+    switch (type) {
+      case KDTREE_NODES:       return "kd-tree nodes";
+      case KDTREE_PRIM_REFS:   return "kd-tree primRefs";
+      case MAJORANT_DOMAINS:   return "majorant domains";
+      case VALUE_RANGE_NODES:  return "value range tree nodes";
+      case ABR_BVH_KEY:        return "ABR BVH key";
+      case ABR_BVH_NODES:      return "ABR BVH nodes";
+      case ABR_BVH_PRIM_ORDER: return "ABR BVH primitive order";
+      default:                 return "unknown";
+    }
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
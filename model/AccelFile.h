@@ -0,0 +1,140 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <owl/common/math/box.h>
+#include "MappedFile.h"
+
+namespace exa {
+
+  /*! Container for acceleration structures built offline: kd-tree
+    nodes and primRefs, majorant domains, value range trees, and the
+    ABR BVH of ExaBrickSamplerCPU. The header holds the model bounds
+    the contents were built for, followed by a table of sections;
+    each section records its element type and size, count, and an
+    FNV-1a checksum, and starts at a 64-byte aligned offset so that
+    it can be referenced in place in the memory-mapped file. Files
+    are validated when opened (magic, version, endianness, section
+    extents and checksums), so corrupt or stale files are rejected
+    up front */
+  struct AccelFile
+  {
+    typedef std::shared_ptr<AccelFile> SP;
+
+    enum SectionType {
+      KDTREE_NODES       = 1, // KDTreeNode
+      KDTREE_PRIM_REFS   = 2, // PrimRef
+      MAJORANT_DOMAINS   = 3, // std::pair<box3f,float> (domain, majorant)
+      VALUE_RANGE_NODES  = 4, // ValueRangeNode
+      ABR_BVH_KEY        = 5, // uint64_t, hash of the ABRs (ExaBrickSamplerCPU)
+      ABR_BVH_NODES      = 6, // visionaray::bvh_node
+      ABR_BVH_PRIM_ORDER = 7, // uint32_t, ABR ID per primitive slot
+    };
+
+    static const uint64_t magic      = 0x6c63616178657831ull; // "1xexaacl"
+    static const uint32_t version    = 1;
+    static const uint32_t endianness = 0x01020304u;
+    static const uint64_t alignment  = 64;
+
+    struct Header {
+      uint64_t   magic;
+      uint32_t   version;
+      uint32_t   endianness; // as written, byte-swapped if foreign
+      uint64_t   fileSize;
+      owl::box3f bounds;     // of the model the contents were built for
+      uint32_t   numSections;
+      uint32_t   reserved;
+    };
+
+    struct Section {
+      uint32_t type;
+      uint32_t elemSize;
+      uint64_t count;
+      uint64_t offset;   // in bytes, from the beginning of the file
+      uint64_t checksum; // FNV-1a over the section's bytes
+    };
+
+    //! Section to write; data is count elements of elemSize bytes
+    struct SectionData {
+      uint32_t    type;
+      uint32_t    elemSize;
+      uint64_t    count;
+      const void *data;
+    };
+
+    /*! true if the file starts with the container's magic, in either
+      byte order (open() rejects foreign endianness) */
+    static bool isAccelFile(const std::string fileName);
+
+    /*! map and validate; on failure, returns nullptr and sets error */
+    static AccelFile::SP open(const std::string fileName,
+                              std::string &error,
+                              bool verifyChecksums = true);
+
+    static bool write(const std::string fileName,
+                      const owl::box3f &bounds,
+                      const std::vector<SectionData> &sections);
+
+    const Header &header() const { return *mapped->as<Header>(); }
+
+    const Section *sections() const
+    { return (const Section *)(mapped->as<char>()+sizeof(Header)); }
+
+    //! nullptr if there's no such section
+    const Section *findSection(SectionType type) const;
+
+    /*! elements of section type, referencing the mapping; nullptr (and
+      count 0) if there's no such section, throws if the element
+      size doesn't match T */
+    template <typename T>
+    const T *get(SectionType type, size_t &count) const
+    {
+      count = 0;
+      const Section *section = findSection(type);
+      if (!section)
+        return nullptr;
+      checkElemSize(*section,sizeof(T));
+      count = section->count;
+      return (const T *)(mapped->as<char>()+section->offset);
+    }
+
+    template <typename T>
+    std::vector<T> read(SectionType type) const
+    {
+      size_t count = 0;
+      const T *data = get<T>(type,count);
+      return std::vector<T>(data,data+count);
+    }
+
+    static const char *sectionName(uint32_t type);
+
+  private:
+    void checkElemSize(const Section &section, size_t elemSize) const;
+
+    MappedFile::SP mapped;
+    std::string    fileName;
+  };
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
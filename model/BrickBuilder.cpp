@@ -0,0 +1,322 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include <owl/common/parallel/parallel_for.h>
+#include "BrickBuilder.h"
+
+namespace exa {
+
+  // floor division, cell positions may be negative
+  inline int floorDiv(int a, int b)
+  {
+    return a >= 0 ? a/b : -((-a+b-1)/b);
+  }
+
+  inline vec3i floorDiv(const vec3i a, int b)
+  {
+    return vec3i(floorDiv(a.x,b),floorDiv(a.y,b),floorDiv(a.z,b));
+  }
+
+  // tile of maxBrickSize^3 cells on a given level; cells are sorted
+  // by tile so that [begin,end) indexes into the sorted cell list
+  struct Tile {
+    int    level;
+    vec3i  coord;
+    size_t begin, end;
+    // output
+    std::vector<ExaBrick> bricks;
+    std::vector<int>      cellIDs;
+  };
+
+  static void buildTile(Tile &tile,
+                        const std::vector<std::pair<uint64_t,int>> &sorted,
+                        const AMRCell *cells,
+                        int S)
+  {
+    const int cellWidth = 1<<tile.level;
+    const vec3i tileOrigin = tile.coord*S;
+
+    std::vector<int> grid(size_t(S)*S*S,-1);
+    auto index = [S](int x, int y, int z) { return x+size_t(S)*(y+size_t(S)*z); };
+
+    for (size_t i=tile.begin; i<tile.end; ++i) {
+      int cellID = sorted[i].second;
+      vec3i p = floorDiv(cells[cellID].pos,cellWidth)-tileOrigin;
+      int &slot = grid[index(p.x,p.y,p.z)];
+      if (slot < 0) // ignore duplicates
+        slot = cellID;
+    }
+
+    for (int z=0; z<S; ++z) {
+      for (int y=0; y<S; ++y) {
+        for (int x=0; x<S; ++x) {
+          if (grid[index(x,y,z)] < 0)
+            continue;
+
+          // grow along x..
+          int nx = 1;
+          while (x+nx < S && grid[index(x+nx,y,z)] >= 0)
+            nx++;
+
+          // ..then by whole rows along y..
+          auto rowFull = [&](int yy, int zz) {
+            for (int xx=x; xx<x+nx; ++xx)
+              if (grid[index(xx,yy,zz)] < 0) return false;
+            return true;
+          };
+
+          int ny = 1;
+          while (y+ny < S && rowFull(y+ny,z))
+            ny++;
+
+          // ..then by whole slabs along z
+          auto slabFull = [&](int zz) {
+            for (int yy=y; yy<y+ny; ++yy)
+              if (!rowFull(yy,zz)) return false;
+            return true;
+          };
+
+          int nz = 1;
+          while (z+nz < S && slabFull(z+nz))
+            nz++;
+
+          ExaBrick brick;
+          brick.lower = (tileOrigin+vec3i(x,y,z))*cellWidth;
+          brick.size  = vec3i(nx,ny,nz);
+          brick.level = tile.level;
+          brick.begin = (uint32_t)tile.cellIDs.size(); // local, fixed up later
+
+          // same linear order as ExaBrick::getIndexIndex()
+          for (int zz=z; zz<z+nz; ++zz) {
+            for (int yy=y; yy<y+ny; ++yy) {
+              for (int xx=x; xx<x+nx; ++xx) {
+                int &slot = grid[index(xx,yy,zz)];
+                tile.cellIDs.push_back(slot);
+                slot = -1;
+              }
+            }
+          }
+          tile.bricks.push_back(brick);
+        }
+      }
+    }
+  }
+
+  void BrickBuilder::build(const AMRCell *cells,
+                           const float *scalarsIN,
+                           size_t numCells,
+                           int maxBrickSize)
+  {
+    if (maxBrickSize <= 0)
+      throw std::runtime_error("brick builder: invalid max brick size");
+
+    if (numCells > UINT_MAX)
+      throw std::runtime_error("brick builder: too many cells for 32-bit brick offsets");
+
+    double t0 = getCurrentTime();
+
+    const int S = maxBrickSize;
+
+    bricks.clear();
+    scalars.clear();
+    cellIDs.clear();
+    stats = Stats();
+
+    if (numCells == 0)
+      return;
+
+    // -------------------------------------------------------
+    // bin cells by level
+    // -------------------------------------------------------
+
+    int maxLevel = 0;
+    for (size_t i=0; i<numCells; ++i) {
+      if (cells[i].level < 0 || cells[i].level > 30)
+        throw std::runtime_error("brick builder: invalid AMR level");
+      maxLevel = std::max(maxLevel,cells[i].level);
+    }
+
+    const int numLevels = maxLevel+1;
+    std::vector<std::vector<int>> cellsPerLevel(numLevels);
+    for (size_t i=0; i<numCells; ++i) {
+      cellsPerLevel[cells[i].level].push_back((int)i);
+    }
+
+    // -------------------------------------------------------
+    // per level: sort cells by tile, then gather tile ranges
+    // -------------------------------------------------------
+
+    std::vector<std::vector<std::pair<uint64_t,int>>> sortedPerLevel(numLevels);
+    std::vector<std::vector<Tile>> tilesPerLevel(numLevels);
+
+    parallel_for(numLevels,[&](int level) {
+      const std::vector<int> &ids = cellsPerLevel[level];
+      if (ids.empty())
+        return;
+
+      const int cellWidth = 1<<level;
+
+      vec3i minTile(INT_MAX), maxTile(INT_MIN);
+      for (int cellID : ids) {
+        vec3i t = floorDiv(floorDiv(cells[cellID].pos,cellWidth),S);
+        minTile = min(minTile,t);
+        maxTile = max(maxTile,t);
+      }
+
+      const vec3i extent = maxTile-minTile;
+      if (extent.x >= (1<<21) || extent.y >= (1<<21) || extent.z >= (1<<21))
+        throw std::runtime_error("brick builder: domain too large, increase max brick size");
+
+      std::vector<std::pair<uint64_t,int>> &sorted = sortedPerLevel[level];
+      sorted.resize(ids.size());
+      for (size_t i=0; i<ids.size(); ++i) {
+        vec3i t = floorDiv(floorDiv(cells[ids[i]].pos,cellWidth),S)-minTile;
+        uint64_t key = uint64_t(t.x) | (uint64_t(t.y)<<21) | (uint64_t(t.z)<<42);
+        sorted[i] = {key,ids[i]};
+      }
+      std::sort(sorted.begin(),sorted.end());
+
+      std::vector<Tile> &tiles = tilesPerLevel[level];
+      for (size_t i=0; i<sorted.size();) {
+        size_t j = i+1;
+        while (j < sorted.size() && sorted[j].first == sorted[i].first)
+          ++j;
+        const uint64_t key = sorted[i].first;
+        Tile tile;
+        tile.level = level;
+        tile.coord = minTile+vec3i(int(key&0x1fffff),
+                                   int((key>>21)&0x1fffff),
+                                   int((key>>42)&0x1fffff));
+        tile.begin = i;
+        tile.end   = j;
+        tiles.push_back(tile);
+        i = j;
+      }
+    });
+
+    // -------------------------------------------------------
+    // merge cells to bricks, tiles of all levels in parallel
+    // -------------------------------------------------------
+
+    std::vector<Tile *> tiles;
+    for (int level=0; level<numLevels; ++level) {
+      for (Tile &tile : tilesPerLevel[level]) {
+        tiles.push_back(&tile);
+      }
+    }
+
+    parallel_for(tiles.size(),[&](size_t tileID) {
+      Tile &tile = *tiles[tileID];
+      buildTile(tile,sortedPerLevel[tile.level],cells,S);
+    });
+
+    // -------------------------------------------------------
+    // compact, in deterministic (level,tile) order
+    // -------------------------------------------------------
+
+    std::vector<size_t> brickOffsets(tiles.size()+1,0);
+    std::vector<size_t> cellOffsets(tiles.size()+1,0);
+    for (size_t i=0; i<tiles.size(); ++i) {
+      brickOffsets[i+1] = brickOffsets[i]+tiles[i]->bricks.size();
+      cellOffsets[i+1]  = cellOffsets[i]+tiles[i]->cellIDs.size();
+    }
+
+    bricks.resize(brickOffsets.back());
+    cellIDs.resize(cellOffsets.back());
+
+    parallel_for(tiles.size(),[&](size_t tileID) {
+      Tile &tile = *tiles[tileID];
+      for (size_t i=0; i<tile.bricks.size(); ++i) {
+        ExaBrick brick = tile.bricks[i];
+        brick.begin += (uint32_t)cellOffsets[tileID];
+        bricks[brickOffsets[tileID]+i] = brick;
+      }
+      std::copy(tile.cellIDs.begin(),tile.cellIDs.end(),
+                cellIDs.begin()+cellOffsets[tileID]);
+    });
+
+    if (scalarsIN) {
+      scalars.resize(cellIDs.size());
+      parallel_for_blocked(0ull,cellIDs.size(),1024*1024,[&](size_t begin,size_t end){
+        for (size_t i=begin;i<end;i++) {
+          scalars[i] = scalarsIN[cellIDs[i]];
+        }
+      });
+    }
+
+    double t1 = getCurrentTime();
+
+    stats.numCells    = cellIDs.size();
+    stats.numBricks   = bricks.size();
+    stats.numLevels   = numLevels;
+    stats.cellsBytes  = numCells*(sizeof(AMRCell)+sizeof(float));
+    stats.bricksBytes = bricks.size()*sizeof(ExaBrick)+cellIDs.size()*sizeof(float);
+    stats.buildTime   = t1-t0;
+  }
+
+  ExaBrickModel::SP BrickBuilder::makeModel(const AMRCellModel::SP &model,
+                                            int maxBrickSize)
+  {
+    BrickBuilder builder;
+    builder.build(model,maxBrickSize);
+    builder.printStats();
+
+    if (builder.bricks.empty() || builder.scalars.empty())
+      return nullptr;
+
+    return ExaBrickModel::load(builder.bricks.data(),
+                               builder.scalars.data(),
+                               builder.bricks.size());
+  }
+
+  bool BrickBuilder::save(const std::string brickFileName) const
+  {
+    std::ofstream out(brickFileName, std::ios::binary);
+    if (!out.good())
+      return false;
+
+    for (size_t i=0; i<bricks.size(); ++i) {
+      const ExaBrick &brick = bricks[i];
+      out.write((const char *)&brick.size,sizeof(brick.size));
+      out.write((const char *)&brick.lower,sizeof(brick.lower));
+      out.write((const char *)&brick.level,sizeof(brick.level));
+      out.write((const char *)(cellIDs.data()+brick.begin),
+                brick.numCells()*sizeof(cellIDs[0]));
+    }
+
+    return out.good();
+  }
+
+  void BrickBuilder::printStats() const
+  {
+    std::cout << "#exa: built " << prettyDouble((double)stats.numBricks)
+              << " bricks from " << prettyDouble((double)stats.numCells)
+              << " cells on " << stats.numLevels << " level(s) in "
+              << prettyDouble(stats.buildTime) << "s\n";
+    std::cout << "#exa: avg cells/brick: "
+              << (stats.numBricks ? stats.numCells/double(stats.numBricks) : 0.0)
+              << ", memory: " << prettyBytes(stats.cellsBytes) << " (cells) -> "
+              << prettyBytes(stats.bricksBytes) << " (bricks), reduction: "
+              << (stats.bricksBytes ? stats.cellsBytes/double(stats.bricksBytes) : 0.0)
+              << "x\n";
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
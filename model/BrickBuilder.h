@@ -0,0 +1,79 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <vector>
+#include "ABRs.h"
+#include "AMRCellModel.h"
+#include "ExaBrickModel.h"
+
+namespace exa {
+
+  /*! Builds ExaBricks from AMR cells by greedily merging same-level
+    cells into axis-aligned bricks (first along x, then whole rows
+    along y, then whole slabs along z). Space is partitioned into
+    tiles of maxBrickSize^3 cells per level so that tiles, and hence
+    levels, are processed in parallel; bricks never cross tiles */
+  struct BrickBuilder
+  {
+    struct Stats {
+      size_t numCells  = 0;
+      size_t numBricks = 0;
+      int    numLevels = 0;
+      size_t cellsBytes  = 0; // AMRCell's + scalars
+      size_t bricksBytes = 0; // ExaBrick's + scalars
+      double buildTime = 0.0;
+    };
+
+    /*! bricks, ready for ExaBrickModel::load(bricks,scalars,numBricks) */
+    std::vector<ExaBrick> bricks;
+    /*! scalars in brick order (addressed by ExaBrick::begin) */
+    std::vector<float>    scalars;
+    /*! for each brick cell the index of the AMR cell it came from;
+      that's what the .bricks file format stores */
+    std::vector<int>      cellIDs;
+    Stats                 stats;
+
+    /*! build from raw arrays; scalars may be null, in which case only
+      the bricks and cellIDs are generated */
+    void build(const AMRCell *cells,
+               const float *scalars,
+               size_t numCells,
+               int maxBrickSize = 32);
+
+    void build(const AMRCellModel::SP &model, int maxBrickSize = 32)
+    {
+      const bool haveScalars = model->scalars.size() >= model->numCells();
+      build(model->cellData(),
+            haveScalars ? model->scalars.data() : nullptr,
+            model->numCells(),
+            maxBrickSize);
+    }
+
+    /*! convenience: build and create the ExaBrickModel right away */
+    static ExaBrickModel::SP makeModel(const AMRCellModel::SP &model,
+                                       int maxBrickSize = 32);
+
+    /*! write bricks and cellIDs in the .bricks file format */
+    bool save(const std::string brickFileName) const;
+
+    void printStats() const;
+  };
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
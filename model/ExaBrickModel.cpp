@@ -17,6 +17,8 @@
 #include <fstream>
 #include <owl/common/parallel/parallel_for.h>
 #include "ExaBrickModel.h"
+#include "ParallelReduce.h"
+#include "ScalarFile.h"
 #include <cstring>
 
 namespace exa {
@@ -39,16 +41,9 @@ namespace exa {
     std::vector<float> orderedScalars;
     std::vector<int> indices;
 
-    std::ifstream scalarFile(scalarFileName, std::ios::binary | std::ios::ate);
-    if (scalarFile.good()) {
-      size_t numBytes = scalarFile.tellg();
-      scalarFile.close();
-      scalarFile.open(scalarFileName, std::ios::binary);
-      if (scalarFile.good()) {
-        orderedScalars.resize(numBytes/sizeof(float));
-        scalarFile.read((char *)orderedScalars.data(),orderedScalars.size()*sizeof(float));
-      }
-    }
+    // raw or compressed scalar file, chunks are decoded in parallel
+    if (!ScalarFile::read(scalarFileName,orderedScalars))
+      orderedScalars.clear();
 
     // -------------------------------------------------------
     // create brick and index buffers
@@ -100,11 +95,27 @@ namespace exa {
     if (!kdTreeFileName.empty()) {
       result->kdtree = KDTree::load(kdTreeFileName);
       std::vector<box3f> leaves(bricks.size());
+      box3f bounds;
       for (uint64_t i = 0; i < bricks.size(); ++i) {
         leaves[i] = bricks[i].getBounds();
+        bounds.extend(leaves[i]);
+      }
+
+      // legacy files don't store the bounds
+      const box3f &treeBounds = result->kdtree->getModelBounds();
+      if (!treeBounds.empty() &&
+          (treeBounds.lower != bounds.lower || treeBounds.upper != bounds.upper)) {
+        throw std::runtime_error("kd-tree "+kdTreeFileName+" was built for different bricks");
+      }
+
+      std::string error;
+      if (!result->kdtree->validate(bricks.size(),error)) {
+        throw std::runtime_error("invalid kd-tree "+kdTreeFileName+": "+error);
       }
-      result->kdtree->setLeaves(leaves);
-      result->kdtree->setModelBounds(cellBounds);
+
+      if (!result->kdtree->hasPrimRefs())
+        result->kdtree->setLeaves(leaves);
+      result->kdtree->setModelBounds(bounds);
     }
 
     result->init();
@@ -114,7 +125,8 @@ namespace exa {
 
   ExaBrickModel::SP ExaBrickModel::load(const ExaBrick *bricksIN,
                                         const float *scalarsIN,
-                                        size_t numBricks)
+                                        size_t numBricks,
+                                        bool copyScalars)
   {
     ExaBrickModel::SP result = std::make_shared<ExaBrickModel>();
 
@@ -129,12 +141,17 @@ namespace exa {
     memcpy(bricks.data(),bricksIN,sizeof(bricksIN[0])*numBricks);
 
     // -------------------------------------------------------
-    // copy cellIDs
+    // copy (or reference) scalars
     // -------------------------------------------------------
 
     size_t numCells = bricks.back().begin+volume(bricks.back().size);
-    scalars.resize(numCells);
-    memcpy(scalars.data(),scalarsIN,numCells*sizeof(scalarsIN[0]));
+    if (copyScalars) {
+      scalars.resize(numCells);
+      memcpy(scalars.data(),scalarsIN,numCells*sizeof(scalarsIN[0]));
+    } else {
+      result->externalScalars = scalarsIN;
+      result->numExternalScalars = numCells;
+    }
 
     result->init();
 
@@ -149,21 +166,38 @@ namespace exa {
 
     abrs.buildFrom(bricks.data(),
                    bricks.size(),
-                   scalars.data());
+                   scalarData());
 
 
     // -------------------------------------------------------
     // Global cellBounds and valueRange
     // -------------------------------------------------------
 
-    for (size_t i=0; i<bricks.size(); ++i) {
-      const ExaBrick &brick = bricks[i];
-      cellBounds.extend(brick.getBounds());
-    }
+    cellBounds = parallelBounds(bricks.size(),[this](size_t i) {
+      return bricks[i].getBounds();
+    });
+
+    valueRange = parallelValueRange(abrs.value.size(),[this](size_t i) {
+      return abrs.value[i].valueRange;
+    });
+
+    // -------------------------------------------------------
+    // kd-tree over bricks, unless one was loaded from file
+    // -------------------------------------------------------
+
+    if (traversalMode == EXABRICK_KDTREE_TRAVERSAL && !kdtree) {
+      std::vector<box3f> boxes(bricks.size());
+      std::vector<int> levels(bricks.size());
+      for (size_t i=0; i<bricks.size(); ++i) {
+        boxes[i]  = bricks[i].getBounds();
+        levels[i] = bricks[i].level;
+      }
+      kdtree = KDTree::build(boxes.size(),boxes.data(),levels.data());
+      kdtree->printStats();
 
-    for (size_t i=0; i<abrs.value.size(); ++i) {
-      const ABR &abr = abrs.value[i];
-      valueRange.extend(abr.valueRange);
+      std::string error;
+      if (!kdtree->validate(bricks.size(),error))
+        throw std::runtime_error("invalid kd-tree: "+error);
     }
 
     // -------------------------------------------------------
@@ -214,13 +248,38 @@ namespace exa {
     }
   }
 
+  void ExaBrickModel::buildSoA()
+  {
+    abrs.buildSoA();
+  }
+
+  void ExaBrickModel::getGridStatistics(GridResolution &res) const
+  {
+    res.bounds = cellBounds;
+    res.domains.resize(abrs.value.size());
+    res.valueRanges.resize(abrs.value.size());
+    parallel_for_blocked(0ull,abrs.value.size(),4096,[&](size_t begin, size_t end) {
+      for (size_t i=begin; i<end; ++i) {
+        res.domains[i]     = abrs.value[i].domain;
+        res.valueRanges[i] = abrs.value[i].valueRange;
+      }
+    });
+
+    res.cellsPerLevel.clear();
+    for (const ExaBrick &brick : bricks) {
+      if (brick.level >= (int)res.cellsPerLevel.size())
+        res.cellsPerLevel.resize(brick.level+1,0);
+      res.cellsPerLevel[brick.level] += brick.numCells();
+    }
+  }
+
   void ExaBrickModel::memStats(size_t &bricksBytes,
                                size_t &scalarsBytes,
                                size_t &abrsBytes,
                                size_t &abrLeafListBytes)
   {
     bricksBytes = bricks.empty()   ? 0 : bricks.size()*sizeof(bricks[0]);
-    scalarsBytes = scalars.empty() ? 0 : scalars.size()*sizeof(scalars[0]);
+    scalarsBytes = numScalars()*sizeof(float);
     abrsBytes = abrs.value.empty() ? 0 : abrs.value.size()*sizeof(abrs.value[0]);
     abrLeafListBytes = abrs.leafList.empty() ? 0 : abrs.leafList.size()*sizeof(abrs.leafList[0]);
   }
@@ -32,14 +32,33 @@ namespace exa {
                                   const std::string scalarFileName,
                                   const std::string kdTreeFileName);
 
+    /*! if copyScalars is false, the model references scalarsIN
+      (which must then outlive the model) instead of copying them */
     static ExaBrickModel::SP load(const ExaBrick *bricksIN,
                                   const float *scalarsIN,
-                                  size_t numBricks);
+                                  size_t numBricks,
+                                  bool copyScalars = true);
 
     void init();
 
+    /*! (re-)build the optional hot/cold split copy of the ABRs
+      (abrs.arrays); the AoS arrays remain the primary representation */
+    void buildSoA();
+
+    //! ABRs and brick cell widths, see GridResolution
+    void getGridStatistics(GridResolution &res) const override;
+
+    //! Scalars, regardless if owned or referenced
+    const float *scalarData() const
+    { return externalScalars ? externalScalars : scalars.data(); }
+
+    size_t numScalars() const
+    { return externalScalars ? numExternalScalars : scalars.size(); }
+
     std::vector<ExaBrick> bricks;
     std::vector<float>    scalars;
+    const float          *externalScalars = nullptr; // not owned, see load()
+    size_t                numExternalScalars = 0;
     ABRs                  abrs;
     KDTree::SP            kdtree; // optional kd-tree over bricks
     std::vector<std::vector<int>> adjacentBricks; // adjacency list to splat majorants into neighboring bricks
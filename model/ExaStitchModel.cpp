@@ -14,12 +14,17 @@
 // limitations under the License.                                           //
 // ======================================================================== //
 
+#include <cmath>
 #include <fstream>
 #include "umesh/UMesh.h"
 #include "ExaStitchModel.h"
+#include "ParallelReduce.h"
+#include "ScalarFile.h"
 
 namespace exa {
 
+  UElemCache::Level ExaStitchModel::uelemCacheLevel = UElemCache::NONE;
+  size_t ExaStitchModel::uelemCacheBudget = size_t(-1);
 
   ExaStitchModel::SP ExaStitchModel::load(const std::string umeshFileName,
                                           const std::string gridsFileName,
@@ -43,16 +48,9 @@ namespace exa {
     // Load scalars
     std::vector<float> scalars;
 
-    std::ifstream scalarFile(scalarFileName, std::ios::binary | std::ios::ate);
-    if (scalarFile.good()) {
-      size_t numBytes = scalarFile.tellg();
-      scalarFile.close();
-      scalarFile.open(scalarFileName, std::ios::binary);
-      if (scalarFile.good()) {
-        scalars.resize(numBytes/sizeof(float));
-        scalarFile.read((char *)scalars.data(),scalars.size()*sizeof(float));
-      }
-    }
+    // raw or compressed scalar file, chunks are decoded in parallel
+    if (!ScalarFile::read(scalarFileName,scalars))
+      scalars.clear();
 
     unsigned numElems = 0;
 
@@ -179,6 +177,20 @@ namespace exa {
         }
       }
     }
+#else
+    if (uelemCacheBudget != size_t(-1)) {
+      const UElemCache::Counts counts = UElemCache::countElems(indices.data(),indices.size()/8);
+      uelemCacheLevel = UElemCache::levelForBudget(counts,uelemCacheBudget);
+      std::cout << "#exa: element cache budget " << prettyBytes(uelemCacheBudget)
+                << " -> level " << UElemCache::levelName(uelemCacheLevel) << '\n';
+    }
+
+    if (uelemCacheLevel != UElemCache::NONE && !indices.empty()) {
+      result->uelemCache.build(indices.data(),vertices.data(),indices.size()/8,
+                               uelemCacheLevel);
+      std::cout << "#exa: element cache (" << UElemCache::levelName(uelemCacheLevel)
+                << "): " << prettyBytes(result->uelemCache.bytes()) << '\n';
+    }
 #endif
 
     // ==================================================================
@@ -256,6 +268,54 @@ namespace exa {
     return result; 
   }
 
+  void ExaStitchModel::getGridStatistics(GridResolution &res) const
+  {
+    // gridlets first, then elements
+    const size_t numGridlets = gridlets.size();
+    const size_t numElems    = indices.size()/8;
+
+    res.bounds = cellBounds;
+    res.domains.resize(numGridlets+numElems);
+    res.valueRanges.resize(numGridlets+numElems);
+
+    parallel_for_blocked(0ull,numGridlets,256,[&](size_t begin, size_t end) {
+      for (size_t gridletID=begin; gridletID<end; ++gridletID) {
+        const Gridlet &gridlet = gridlets[gridletID];
+        const size_t numScalars = (gridlet.dims.x+1)
+                          * (size_t(gridlet.dims.y)+1)
+                                * (gridlet.dims.z+1);
+        range1f valueRange;
+        for (size_t i=0; i<numScalars; ++i) {
+          const float value = gridletScalars[gridlet.begin+i];
+          if (!std::isnan(value))
+            valueRange.extend(value);
+        }
+        res.domains[gridletID] = gridlet.getBounds();
+        res.valueRanges[gridletID] = valueRange;
+      }
+    });
+
+    parallel_for_blocked(0ull,numElems,4096,[&](size_t begin, size_t end) {
+      for (size_t elemID=begin; elemID<end; ++elemID) {
+        box3f domain;
+        range1f valueRange;
+        for (size_t j=0; j<8 && indices[elemID*8+j] >= 0; ++j) {
+          const vec4f v = vertices[indices[elemID*8+j]];
+          domain.extend(vec3f(v));
+          valueRange.extend(v.w);
+        }
+        res.domains[numGridlets+elemID] = domain;
+        res.valueRanges[numGridlets+elemID] = valueRange;
+      }
+    });
+
+    res.cellsPerLevel = parallelHistogram(numGridlets,[this](size_t i) {
+      const Gridlet &gridlet = gridlets[i];
+      return std::make_pair(gridlet.level,
+                            gridlet.dims.x*size_t(gridlet.dims.y)*gridlet.dims.z);
+    });
+  }
+
   void ExaStitchModel::memStats(size_t &elemVertexBytes,
                                 size_t &elemIndexBytes,
                                 size_t &gridletBytes,
@@ -20,6 +20,7 @@
 #include <common.h>
 #include <Gridlet.h>
 #include "Model.h"
+#include "UElemCache.h"
 
 namespace exa {
 
@@ -44,6 +45,19 @@ namespace exa {
     // are stored in the respectivep vertices w coordinate
     std::vector<float>   gridletScalars;
 
+    /*! Level of the geometry cache load() builds for the elements
+      (NONE: no cache); only used w/ the combined index buffer, not
+      with EXA_STITCH_SEPARATE_INDEX_BUFFERS_PER_UELEM */
+    static UElemCache::Level uelemCacheLevel;
+
+    /*! If set (not size_t(-1)), load() overrides uelemCacheLevel with
+      the highest level whose cache fits into this many bytes */
+    static size_t uelemCacheBudget;
+    UElemCache uelemCache;
+
+    //! gridlets and elements, see GridResolution
+    void getGridStatistics(GridResolution &res) const override;
+
     // Statistics
     size_t numScalarsTotal;
     size_t numEmptyScalars;
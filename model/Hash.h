@@ -0,0 +1,80 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <owl/common/parallel/parallel_for.h>
+
+namespace exa {
+
+  static const uint64_t fnvOffsetBasis = 0xcbf29ce484222325ull;
+
+  //! FNV-1a over 32-bit words
+  inline uint64_t hashWords(const uint32_t *words, size_t count, uint64_t hash)
+  {
+    for (size_t i=0; i<count; ++i) {
+      hash ^= words[i];
+      hash *= 0x100000001b3ull;
+    }
+    return hash;
+  }
+
+  //! FNV-1a step over a 64-bit value, low word first
+  inline uint64_t hashWord64(uint64_t value, uint64_t hash)
+  {
+    const uint32_t words[2] = { uint32_t(value), uint32_t(value>>32) };
+    return hashWords(words,2,hash);
+  }
+
+  /*! hash blocks in parallel, then the block hashes in order; numBytes
+    must be a multiple of 4 */
+  inline uint64_t hashArray(const void *data, size_t numBytes, uint64_t hash)
+  {
+    const char *bytes = (const char *)data;
+    const size_t numWords = numBytes/sizeof(uint32_t);
+    const size_t blockSize = 1<<20;
+    const size_t numBlocks = (numWords+blockSize-1)/blockSize;
+
+    std::vector<uint64_t> blockHashes(numBlocks);
+    parallel_for(numBlocks,[&](size_t blockID) {
+      const size_t begin = blockID*blockSize;
+      const size_t end = std::min(begin+blockSize,numWords);
+      uint64_t blockHash = fnvOffsetBasis;
+      for (size_t i=begin; i<end; ++i) {
+        uint32_t word; // data is typically float/int structs, don't alias
+        std::memcpy(&word,bytes+i*sizeof(word),sizeof(word));
+        blockHash = hashWords(&word,1,blockHash);
+      }
+      blockHashes[blockID] = blockHash;
+    });
+
+    hash = hashWord64(numBytes,hash);
+    hash = hashWord64(numBlocks,hash);
+    for (size_t i=0; i<numBlocks; ++i) {
+      hash = hashWord64(blockHashes[i],hash);
+    }
+    return hash;
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,82 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "MappedFile.h"
+
+namespace exa {
+
+  MappedFile::SP MappedFile::open(const std::string fileName)
+  {
+    MappedFile::SP result = std::make_shared<MappedFile>();
+
+#ifndef _WIN32
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+      return nullptr;
+
+    struct stat st;
+    if (fstat(fd,&st) != 0) {
+      ::close(fd);
+      return nullptr;
+    }
+
+    result->numBytes = (size_t)st.st_size;
+    if (result->numBytes > 0) {
+      void *ptr = mmap(nullptr,result->numBytes,PROT_READ,MAP_PRIVATE,fd,0);
+      if (ptr == MAP_FAILED) {
+        ::close(fd);
+        return nullptr;
+      }
+      // loaders touch the whole file anyway, start reading ahead
+      madvise(ptr,result->numBytes,MADV_WILLNEED);
+      result->ptr = ptr;
+    }
+    // the mapping stays valid after closing the descriptor
+    ::close(fd);
+#else
+    std::ifstream in(fileName, std::ios::binary | std::ios::ate);
+    if (!in.good())
+      return nullptr;
+
+    result->numBytes = in.tellg();
+    in.seekg(0);
+    result->fallback.resize(result->numBytes);
+    in.read(result->fallback.data(),result->numBytes);
+    result->ptr = result->fallback.data();
+#endif
+
+    return result;
+  }
+
+  MappedFile::~MappedFile()
+  {
+#ifndef _WIN32
+    if (ptr)
+      munmap((void *)ptr,numBytes);
+#endif
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
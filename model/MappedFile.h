@@ -0,0 +1,56 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace exa {
+
+  /*! Read-only, memory-mapped file. Pages are faulted in on demand,
+    so models can either copy out of the mapping (in parallel) or
+    keep the mapping alive and reference the data directly. On
+    platforms w/o mmap the file is read into a heap buffer instead */
+  struct MappedFile
+  {
+    typedef std::shared_ptr<MappedFile> SP;
+
+    /*! returns nullptr if the file cannot be opened or mapped */
+    static MappedFile::SP open(const std::string fileName);
+
+    ~MappedFile();
+
+    const void *data() const { return ptr; }
+    size_t size() const { return numBytes; }
+
+    template <typename T>
+    const T *as() const { return (const T *)ptr; }
+
+    template <typename T>
+    size_t count() const { return numBytes/sizeof(T); }
+
+  private:
+    const void *ptr = nullptr;
+    size_t numBytes = 0;
+    std::vector<char> fallback;
+  };
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
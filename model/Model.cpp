@@ -22,6 +22,8 @@ namespace exa {
   {
   }
 
+  const vec3i Model::autoNumGridCells = vec3i(-1);
+
   void Model::setNumGridCells(const vec3i numMCs)
   {
     if (grid != nullptr) {
@@ -30,6 +32,15 @@ namespace exa {
 
     grid = std::make_shared<Grid>();
     grid->dims = numMCs;
+
+    if (numMCs == autoNumGridCells) {
+      GridResolution res;
+      getGridStatistics(res);
+      grid->dims = res.choose();
+      res.printStats();
+    }
+
+    numGridCells = grid->dims;
   }
 
   void Model::setVoxelSpaceTransform(const box3f remap_from, const box3f remap_to)
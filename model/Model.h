@@ -22,6 +22,7 @@
 #include <owl/owl.h>
 #include "common.h"
 #include "Grid.h"
+#include "GridResolution.h"
 #include "KDTree.h"
 
 namespace exa {
@@ -40,8 +41,21 @@ namespace exa {
     }
 
     // Set the number of macro cells; the grid is built on Sampler::build() (!)
+    // vec3i(0) means no grid, autoNumGridCells chooses the resolution
+    // from getGridStatistics()
     void setNumGridCells(const vec3i numMCs);
 
+    static const vec3i autoNumGridCells;
+
+    /*! resolution set w/ setNumGridCells(), as chosen for autoNumGridCells;
+      also what the adaptive grid derives its resolution from */
+    vec3i numGridCells = vec3i(0);
+
+    /*! primitives (domains with value ranges) and cell width histogram
+      to choose the grid resolution from; leaves res empty if the
+      model doesn't provide them */
+    virtual void getGridStatistics(GridResolution &res) const {}
+
     void setVoxelSpaceTransform(const box3f remap_from, const box3f remap_to);
 
     /*! optional grid for space skipping */
@@ -0,0 +1,114 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <owl/common/parallel/parallel_for.h>
+#include <common.h>
+
+namespace exa {
+
+  /*! Blocked parallel reduction over [0,numItems): mapBlock(begin,end)
+    reduces a block to a partial result, partials are then combined
+    in block order, so the result does not depend on scheduling */
+  template <typename T, typename MapBlock, typename Combine>
+  inline T parallelReduce(size_t numItems,
+                          const T &identity,
+                          const MapBlock &mapBlock,
+                          const Combine &combine,
+                          size_t blockSize = 1<<16)
+  {
+    const size_t numBlocks = (numItems+blockSize-1)/blockSize;
+    std::vector<T> partials(numBlocks,identity);
+    parallel_for(numBlocks,[&](size_t blockID) {
+      const size_t begin = blockID*blockSize;
+      const size_t end = std::min(numItems,begin+blockSize);
+      partials[blockID] = mapBlock(begin,end);
+    });
+
+    T result = identity;
+    for (const T &p : partials)
+      result = combine(result,p);
+    return result;
+  }
+
+  /*! bounds of numItems boxes, boundsOf(i) returns the i-th box */
+  template <typename BoundsOf>
+  inline box3f parallelBounds(size_t numItems, const BoundsOf &boundsOf)
+  {
+    return parallelReduce(numItems,box3f(),
+      [&](size_t begin, size_t end) {
+        box3f bounds;
+        for (size_t i=begin; i<end; ++i)
+          bounds.extend(boundsOf(i));
+        return bounds;
+      },
+      [](box3f a, const box3f &b) { return a.extend(b); });
+  }
+
+  /*! value range of numItems ranges, rangeOf(i) returns the i-th range */
+  template <typename RangeOf>
+  inline range1f parallelValueRange(size_t numItems, const RangeOf &rangeOf)
+  {
+    return parallelReduce(numItems,range1f(),
+      [&](size_t begin, size_t end) {
+        range1f range;
+        for (size_t i=begin; i<end; ++i)
+          range.extend(rangeOf(i));
+        return range;
+      },
+      [](range1f a, const range1f &b) { return a.extend(b); });
+  }
+
+  /*! histogram over numItems; binOf(i) returns the i-th item's
+    (bin,count), the result has as many bins as needed */
+  template <typename BinOf>
+  inline std::vector<size_t> parallelHistogram(size_t numItems, const BinOf &binOf)
+  {
+    return parallelReduce(numItems,std::vector<size_t>(),
+      [&](size_t begin, size_t end) {
+        std::vector<size_t> bins;
+        for (size_t i=begin; i<end; ++i) {
+          const std::pair<int,size_t> bc = binOf(i);
+          if (bc.first >= (int)bins.size())
+            bins.resize(bc.first+1,0);
+          bins[bc.first] += bc.second;
+        }
+        return bins;
+      },
+      [](std::vector<size_t> a, const std::vector<size_t> &b) {
+        if (b.size() > a.size())
+          a.resize(b.size(),0);
+        for (size_t i=0; i<b.size(); ++i)
+          a[i] += b[i];
+        return a;
+      });
+  }
+
+  /*! min/max of a plain float array */
+  inline range1f parallelValueRange(const float *values, size_t numValues)
+  {
+    return parallelValueRange(numValues,[values](size_t i) {
+      return range1f(values[i],values[i]);
+    });
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,374 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <climits>
+#include <stdexcept>
+#include <owl/common/parallel/parallel_for.h>
+#include "umesh/UMesh.h"
+#include "SpaceFillingCurves.h"
+#include "ParallelReduce.h"
+#include "QuickClustersBuilder.h"
+#include "RadixSort.h"
+
+namespace exa {
+
+  inline box4f elementBounds(const vec4f *vertices, const int *indices, size_t elemID)
+  {
+    box4f bounds;
+    for (int i=0; i<8; ++i) {
+      const int idx = indices[elemID*8+i];
+      if (idx >= 0)
+        bounds.extend(vertices[idx]);
+    }
+    return bounds;
+  }
+
+  // avg. distance between the centroids of elements order[i-1] and order[i]
+  static double avgNeighborDistance(const std::vector<vec4f> &centroids,
+                                    const uint32_t *order)
+  {
+    const size_t numElements = centroids.size();
+    if (numElements < 2)
+      return 0.0;
+
+    auto centroid = [&](size_t i) {
+      return vec3f(centroids[order ? order[i] : i]);
+    };
+
+    const double sum = parallelReduce(numElements-1,0.0,
+      [&](size_t begin, size_t end) {
+        double result = 0.0;
+        for (size_t i=begin; i<end; ++i)
+          result += length(centroid(i+1)-centroid(i));
+        return result;
+      },
+      [](double a, double b) { return a+b; });
+
+    return sum/(numElements-1);
+  }
+
+  // parallel inclusive prefix sum
+  static void inclusiveScan(const std::vector<uint32_t> &in,
+                            std::vector<uint32_t> &out,
+                            size_t blockSize = 1<<16)
+  {
+    const size_t numItems = in.size();
+    const size_t numBlocks = (numItems+blockSize-1)/blockSize;
+    std::vector<uint32_t> blockOffsets(numBlocks+1,0);
+
+    parallel_for(numBlocks,[&](size_t blockID) {
+      const size_t begin = blockID*blockSize;
+      const size_t end = std::min(numItems,begin+blockSize);
+      uint32_t sum = 0;
+      for (size_t i=begin; i<end; ++i)
+        sum += in[i];
+      blockOffsets[blockID+1] = sum;
+    });
+
+    for (size_t i=0; i<numBlocks; ++i)
+      blockOffsets[i+1] += blockOffsets[i];
+
+    parallel_for(numBlocks,[&](size_t blockID) {
+      const size_t begin = blockID*blockSize;
+      const size_t end = std::min(numItems,begin+blockSize);
+      uint32_t sum = blockOffsets[blockID];
+      for (size_t i=begin; i<end; ++i) {
+        sum += in[i];
+        out[i] = sum;
+      }
+    });
+  }
+
+  void QuickClustersBuilder::sortElements(const vec4f *vertices,
+                                          const int *indices,
+                                          size_t numElements,
+                                          Curve curve)
+  {
+    if (numElements > UINT_MAX)
+      throw std::runtime_error("QuickClustersBuilder: too many elements for 32-bit element IDs");
+
+    double t0 = getCurrentTime();
+
+    stats = Stats();
+    stats.numElements = numElements;
+
+    // ==================================================================
+    // centroids (of the xyz+value bounds) and their bounds
+    // ==================================================================
+
+    std::vector<vec4f> centroids(numElements);
+    parallel_for_blocked(0ull,numElements,1<<14,[&](size_t begin,size_t end){
+        for (size_t i=begin;i<end;i++) {
+          const box4f bounds = elementBounds(vertices,indices,i);
+          centroids[i] = vec4f((bounds.upper.x+bounds.lower.x)*.5f,
+                               (bounds.upper.y+bounds.lower.y)*.5f,
+                               (bounds.upper.z+bounds.lower.z)*.5f,
+                               (bounds.upper.w+bounds.lower.w)*.5f);
+        }
+      });
+
+    // isotropic in xyz, like computeCentroidBounds() on the GPU
+    const box4f centroidBounds = parallelReduce(numElements,box4f(),
+      [&](size_t begin, size_t end) {
+        box4f bounds;
+        for (size_t i=begin; i<end; ++i) {
+          const vec4f pt = centroids[i];
+          const float mn = std::min(pt.x,std::min(pt.y,pt.z));
+          const float mx = std::max(pt.x,std::max(pt.y,pt.z));
+          bounds.extend(vec4f(mn,mn,mn,pt.w));
+          bounds.extend(vec4f(mx,mx,mx,pt.w));
+        }
+        return bounds;
+      },
+      [](box4f a, const box4f &b) { return a.extend(b); });
+
+    // ==================================================================
+    // codes, same projection as assignCodes() on the GPU
+    // ==================================================================
+
+    sortedCodes.resize(numElements);
+    sortedElementIDs.resize(numElements);
+    parallel_for_blocked(0ull,numElements,1<<14,[&](size_t begin,size_t end){
+        const vec4f center = centroidBounds.center();
+        const vec4f size = centroidBounds.size();
+        for (size_t i=begin;i<end;i++) {
+          vec4f pt = centroids[i];
+          pt -= center;
+          pt = (pt + size * .5f) / size;
+
+          if (size.x == 0.f) pt.x = 0.f;
+          if (size.y == 0.f) pt.y = 0.f;
+          if (size.z == 0.f) pt.z = 0.f;
+
+          sortedCodes[i] = curve == HILBERT
+              ? hilbert64_encode3D(pt.x,pt.y,pt.z)
+              : morton64_encode3D(pt.x,pt.y,pt.z);
+          sortedElementIDs[i] = (uint32_t)i;
+        }
+      });
+
+    radixSortPairs(sortedCodes,sortedElementIDs);
+
+    double t1 = getCurrentTime();
+    stats.sortTime = t1-t0;
+
+    stats.avgNeighborDistanceBefore = avgNeighborDistance(centroids,nullptr);
+    stats.avgNeighborDistanceAfter = avgNeighborDistance(centroids,sortedElementIDs.data());
+  }
+
+  void QuickClustersBuilder::reorderElements(const int *indices, int *sortedIndices) const
+  {
+    parallel_for_blocked(0ull,sortedElementIDs.size(),1<<14,[&](size_t begin,size_t end){
+        for (size_t newID=begin;newID<end;newID++) {
+          const size_t oldID = sortedElementIDs[newID];
+          for (int i=0; i<8; ++i) {
+            sortedIndices[newID*8+i] = indices[oldID*8+i];
+          }
+        }
+      });
+  }
+
+  void QuickClustersBuilder::buildClusters(uint32_t maxNumClusters,
+                                           uint32_t maxElementsPerCluster)
+  {
+    if (maxNumClusters == 0 && maxElementsPerCluster == 0)
+      throw std::runtime_error("One of 'maxNumClusters' and 'maxElementsPerCluster' must be non-zero.");
+    if (maxNumClusters != 0 && maxElementsPerCluster != 0)
+      throw std::runtime_error("Only one of 'maxNumClusters' and 'maxElementsPerCluster' can be non-zero.");
+
+    double t0 = getCurrentTime();
+
+    const size_t numElements = sortedElementIDs.size();
+    const uint32_t maxCount = maxElementsPerCluster > 0 ? maxElementsPerCluster : (uint32_t)numElements;
+
+    // cluster starts
+    std::vector<uint32_t> flags(numElements,1);
+    std::vector<uint32_t> elementsInClusters;
+    sortedIndexToCluster.resize(numElements);
+
+    uint32_t numClusters = 0;
+    uint32_t prevNumClusters = 0;
+    while (numElements > 0) {
+      // cluster IDs: inclusive sum of the flags, minus one
+      inclusiveScan(flags,sortedIndexToCluster);
+      parallel_for_blocked(0ull,numElements,1<<16,[&](size_t begin,size_t end){
+          for (size_t i=begin;i<end;i++) {
+            sortedIndexToCluster[i] -= 1;
+          }
+        });
+
+      // cluster IDs are consecutive, so the run lengths are just the
+      // distances between cluster starts
+      numClusters = sortedIndexToCluster.back()+1;
+      elementsInClusters.assign(numClusters,0);
+      parallel_for_blocked(0ull,numElements,1<<16,[&](size_t begin,size_t end){
+          for (size_t i=begin;i<end;i++) {
+            if (flags[i]) {
+              size_t next = i+1;
+              while (next < numElements && !flags[next])
+                next++;
+              elementsInClusters[sortedIndexToCluster[i]] = uint32_t(next-i);
+            }
+          }
+        });
+
+      if (prevNumClusters == numClusters) break; // can't merge any more
+      prevNumClusters = numClusters;
+
+      // merge odd clusters into their (even) predecessors, if they fit
+      parallel_for_blocked(1ull,numElements,1<<16,[&](size_t begin,size_t end){
+          for (size_t i=begin;i<end;i++) {
+            if (!flags[i])
+              continue;
+            const uint32_t clusterID = sortedIndexToCluster[i];
+            if ((clusterID % 2) != 1)
+              continue;
+            const uint32_t count = elementsInClusters[clusterID];
+            const uint32_t prevCount = elementsInClusters[clusterID-1];
+            if (count + prevCount <= maxCount)
+              flags[i] = 0;
+          }
+        });
+
+      if (maxNumClusters > 0 && numClusters < maxNumClusters) break;
+    }
+
+    double t1 = getCurrentTime();
+    stats.numClusters = numClusters;
+    stats.clusterTime = t1-t0;
+  }
+
+  std::vector<box4f> QuickClustersBuilder::clusterBounds(const vec4f *vertices,
+                                                          const int *indices) const
+  {
+    const size_t numElements = sortedElementIDs.size();
+    std::vector<box4f> result(stats.numClusters);
+    if (numElements == 0)
+      return result;
+
+    // elements of a cluster are consecutive in curve order
+    parallel_for_blocked(0ull,numElements,1<<14,[&](size_t begin,size_t end){
+        // skip the cluster that started in the previous block..
+        while (begin > 0 && begin < end &&
+               sortedIndexToCluster[begin] == sortedIndexToCluster[begin-1])
+          begin++;
+        // ..and finish the one that goes beyond this block
+        while (end < numElements &&
+               sortedIndexToCluster[end] == sortedIndexToCluster[end-1])
+          end++;
+        for (size_t i=begin;i<end;i++) {
+          result[sortedIndexToCluster[i]].extend(
+              elementBounds(vertices,indices,sortedElementIDs[i]));
+        }
+      });
+
+    return result;
+  }
+
+  void QuickClustersBuilder::build(QuickClustersModel::SP model, Curve curve)
+  {
+    std::vector<int> &indices = model->indices;
+    const size_t numElements = indices.size()/8;
+
+    sortElements(model->vertices.data(),indices.data(),numElements,curve);
+
+    double t0 = getCurrentTime();
+    std::vector<int> sortedIndices(indices.size());
+    reorderElements(indices.data(),sortedIndices.data());
+    indices.swap(sortedIndices);
+    double t1 = getCurrentTime();
+    stats.reorderTime = t1-t0;
+  }
+
+  bool QuickClustersBuilder::save(const QuickClustersModel::SP &model,
+                                  const std::string umeshFileName,
+                                  bool reorderVertices)
+  {
+    const std::vector<int> &indices = model->indices;
+    const std::vector<vec4f> &vertices = model->vertices;
+
+    std::vector<int> newVertexID(vertices.size(),-1);
+    int numVertices = 0;
+    if (reorderVertices) {
+      for (size_t i=0; i<indices.size(); ++i) {
+        if (indices[i] >= 0 && newVertexID[indices[i]] < 0)
+          newVertexID[indices[i]] = numVertices++;
+      }
+    }
+    // unreferenced vertices (or all of them) keep their relative order
+    for (size_t i=0; i<vertices.size(); ++i) {
+      if (newVertexID[i] < 0)
+        newVertexID[i] = numVertices++;
+    }
+
+    umesh::UMesh::SP mesh = std::make_shared<umesh::UMesh>();
+    mesh->vertices.resize(vertices.size());
+    mesh->perVertex = std::make_shared<umesh::Attribute>(vertices.size());
+    for (size_t i=0; i<vertices.size(); ++i) {
+      const vec4f v = vertices[i];
+      mesh->vertices[newVertexID[i]] = umesh::vec3f(v.x,v.y,v.z);
+      mesh->perVertex->values[newVertexID[i]] = v.w;
+    }
+
+    auto addElem = [&](auto &elems, size_t elemID) {
+      typename std::decay<decltype(elems[0])>::type elem;
+      for (int j=0; j<elem.numVertices; ++j) {
+        elem[j] = newVertexID[indices[elemID*8+j]];
+      }
+      elems.push_back(elem);
+    };
+
+    // same classification as ExaStitchModel
+    for (size_t i=0; i<indices.size()/8; ++i) {
+      const int *elem = indices.data()+i*8;
+      if (elem[3] >= 0 && elem[4] < 0)
+        addElem(mesh->tets,i);
+      else if (elem[4] >= 0 && elem[5] < 0)
+        addElem(mesh->pyrs,i);
+      else if (elem[5] >= 0 && elem[6] < 0)
+        addElem(mesh->wedges,i);
+      else if (elem[6] >= 0)
+        addElem(mesh->hexes,i);
+    }
+
+    try {
+      mesh->finalize();
+      mesh->saveTo(umeshFileName);
+    } catch (const std::exception &e) {
+      std::cerr << "#exa: could not write " << umeshFileName << ": " << e.what() << '\n';
+      return false;
+    }
+    return true;
+  }
+
+  void QuickClustersBuilder::printStats() const
+  {
+    std::cout << "#exa: sorted " << prettyNumber(stats.numElements) << " elements in "
+              << prettyDouble(stats.sortTime) << "s, reordered in "
+              << prettyDouble(stats.reorderTime) << "s\n";
+    std::cout << "#exa: avg. distance between consecutive element centroids: "
+              << stats.avgNeighborDistanceBefore << " -> "
+              << stats.avgNeighborDistanceAfter << '\n';
+    if (stats.numClusters > 0) {
+      std::cout << "#exa: built " << prettyNumber(stats.numClusters) << " clusters in "
+                << prettyDouble(stats.clusterTime) << "s, avg. elements/cluster: "
+                << stats.numElements/double(stats.numClusters) << '\n';
+    }
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
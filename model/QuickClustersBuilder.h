@@ -0,0 +1,95 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "QuickClustersModel.h"
+
+namespace exa {
+
+  /*! Host version of the element sorting and clustering that
+    QuickClustersSampler does w/ cub on the GPU: elements (8 indices
+    each, -1 padded) are sorted along a space-filling curve through
+    their centroids, and consecutive elements are (optionally) merged
+    into clusters. Centroids, centroid bounds, codes and the (stable)
+    sort are the same as on the GPU, so the reordered indices are
+    too; that way the reordering can be done offline and checked w/o
+    a GPU */
+  struct QuickClustersBuilder
+  {
+    enum Curve { MORTON, HILBERT };
+
+    struct Stats {
+      size_t   numElements = 0;
+      uint32_t numClusters = 0;
+      // avg. distance between consecutive element centroids
+      double   avgNeighborDistanceBefore = 0.0;
+      double   avgNeighborDistanceAfter = 0.0;
+      double   sortTime = 0.0;
+      double   reorderTime = 0.0;
+      double   clusterTime = 0.0;
+    };
+
+    //! Space-filling curve codes, sorted
+    std::vector<uint64_t> sortedCodes;
+    //! Element IDs in curve order (sortedElementIDs[newID] == oldID)
+    std::vector<uint32_t> sortedElementIDs;
+    //! Cluster of each element, in curve order; set by buildClusters()
+    std::vector<uint32_t> sortedIndexToCluster;
+    Stats                 stats;
+
+    /*! like sortElements() in QuickClustersSampler.cu (the GPU path
+      uses the Hilbert curve) */
+    void sortElements(const vec4f *vertices,
+                      const int *indices,
+                      size_t numElements,
+                      Curve curve = HILBERT);
+
+    /*! write the indices of the elements in curve order to
+      sortedIndices (numElements*8 ints); requires sortElements() */
+    void reorderElements(const int *indices, int *sortedIndices) const;
+
+    /*! like buildClusters() in QuickClustersSampler.cu: pairs of
+      neighboring clusters are merged until either maxNumClusters is
+      undercut or no more merging is possible w/o exceeding
+      maxElementsPerCluster; exactly one of them must be non-zero.
+      Requires sortElements() */
+    void buildClusters(uint32_t maxNumClusters,
+                       uint32_t maxElementsPerCluster);
+
+    /*! bounds (xyz + value range) of each cluster; requires
+      buildClusters() and the *original* (unsorted) indices */
+    std::vector<box4f> clusterBounds(const vec4f *vertices,
+                                     const int *indices) const;
+
+    /*! convenience: sort and reorder the model's indices in place */
+    void build(QuickClustersModel::SP model, Curve curve = HILBERT);
+
+    /*! write the model as a umesh, elements in index order (grouped by
+      type, as umesh stores them); if reorderVertices is set, vertices
+      are renumbered in the order they are first referenced */
+    static bool save(const QuickClustersModel::SP &model,
+                     const std::string umeshFileName,
+                     bool reorderVertices = false);
+
+    void printStats() const;
+  };
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,100 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <owl/common/parallel/parallel_for.h>
+#include "ParallelReduce.h"
+
+namespace exa {
+
+  /*! Parallel LSD radix sort of (key,value) pairs by (unsigned) key,
+    8 bits per pass. Stable, like cub::DeviceRadixSort::SortPairs, so
+    equal keys keep their input order. Passes over digits that are the
+    same for all keys are skipped */
+  template <typename Key, typename Value>
+  inline void radixSortPairs(std::vector<Key> &keys,
+                             std::vector<Value> &values,
+                             size_t blockSize = 1<<16)
+  {
+    enum { RADIX_BITS = 8, RADIX = 1<<RADIX_BITS };
+
+    const size_t numItems = keys.size();
+    if (numItems < 2)
+      return;
+
+    // bits that differ between any two keys
+    const Key first = keys[0];
+    const Key varyingBits = parallelReduce(numItems,Key(0),
+      [&](size_t begin, size_t end) {
+        Key bits = 0;
+        for (size_t i=begin; i<end; ++i)
+          bits |= keys[i]^first;
+        return bits;
+      },
+      [](Key a, Key b) { return Key(a|b); });
+
+    const size_t numBlocks = (numItems+blockSize-1)/blockSize;
+    std::vector<size_t> offsets(numBlocks*RADIX);
+    std::vector<Key> tmpKeys(numItems);
+    std::vector<Value> tmpValues(numItems);
+
+    for (unsigned shift=0; shift<sizeof(Key)*8; shift+=RADIX_BITS) {
+      if (((varyingBits>>shift)&(RADIX-1)) == 0)
+        continue;
+
+      // per-block histograms..
+      parallel_for(numBlocks,[&](size_t blockID) {
+        size_t *counts = offsets.data()+blockID*RADIX;
+        std::fill(counts,counts+RADIX,size_t(0));
+        const size_t begin = blockID*blockSize;
+        const size_t end = std::min(numItems,begin+blockSize);
+        for (size_t i=begin; i<end; ++i)
+          counts[(keys[i]>>shift)&(RADIX-1)]++;
+      });
+
+      // ..to output offsets, digit-major, then in block order
+      size_t sum = 0;
+      for (unsigned digit=0; digit<RADIX; ++digit) {
+        for (size_t blockID=0; blockID<numBlocks; ++blockID) {
+          size_t &offset = offsets[blockID*RADIX+digit];
+          const size_t count = offset;
+          offset = sum;
+          sum += count;
+        }
+      }
+
+      parallel_for(numBlocks,[&](size_t blockID) {
+        size_t *offset = offsets.data()+blockID*RADIX;
+        const size_t begin = blockID*blockSize;
+        const size_t end = std::min(numItems,begin+blockSize);
+        for (size_t i=begin; i<end; ++i) {
+          const size_t dst = offset[(keys[i]>>shift)&(RADIX-1)]++;
+          tmpKeys[dst] = keys[i];
+          tmpValues[dst] = values[i];
+        }
+      });
+
+      keys.swap(tmpKeys);
+      values.swap(tmpValues);
+    }
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,409 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <owl/common/parallel/parallel_for.h>
+#include "common.h"
+#include "ScalarFile.h"
+
+namespace exa {
+
+  // ==================================================================
+  // LZ stage; a byte-oriented LZ77 variant (similar to LZ4's block
+  // format): sequences of [token][literals][offset][match length],
+  // the last sequence only has literals
+  // ==================================================================
+
+  namespace lz {
+
+    enum { MinMatch = 4, HashBits = 16, MaxOffset = 65535 };
+
+    inline uint32_t read32(const uint8_t *p)
+    {
+      uint32_t v;
+      memcpy(&v,p,sizeof(v));
+      return v;
+    }
+
+    inline uint32_t hash(uint32_t v)
+    {
+      return (v*2654435761u) >> (32-HashBits);
+    }
+
+    inline void writeLength(std::vector<uint8_t> &out, size_t len)
+    {
+      while (len >= 255) {
+        out.push_back(255);
+        len -= 255;
+      }
+      out.push_back((uint8_t)len);
+    }
+
+    inline void writeSequence(std::vector<uint8_t> &out,
+                              const uint8_t *literals,
+                              size_t numLiterals,
+                              size_t offset,
+                              size_t matchLength)
+    {
+      const size_t ml = matchLength ? matchLength-MinMatch : 0;
+      const uint8_t token = uint8_t((std::min<size_t>(numLiterals,15)<<4)
+                                  | std::min<size_t>(ml,15));
+      out.push_back(token);
+      if (numLiterals >= 15)
+        writeLength(out,numLiterals-15);
+      out.insert(out.end(),literals,literals+numLiterals);
+      if (matchLength) {
+        out.push_back(uint8_t(offset&0xff));
+        out.push_back(uint8_t(offset>>8));
+        if (ml >= 15)
+          writeLength(out,ml-15);
+      }
+    }
+
+    void compress(const uint8_t *src, size_t numBytes, std::vector<uint8_t> &out)
+    {
+      out.clear();
+      out.reserve(numBytes+numBytes/255+16);
+
+      std::vector<int64_t> table(size_t(1)<<HashBits,-1);
+
+      const uint8_t *ip     = src;
+      const uint8_t *anchor = src;
+      const uint8_t *iend   = src+numBytes;
+
+      while (ip+MinMatch <= iend) {
+        const uint32_t h = hash(read32(ip));
+        const int64_t ref = table[h];
+        table[h] = ip-src;
+
+        if (ref >= 0 && (ip-src)-ref <= MaxOffset && read32(src+ref) == read32(ip)) {
+          const uint8_t *m = src+ref+MinMatch;
+          const uint8_t *p = ip+MinMatch;
+          while (p < iend && *p == *m) { ++p; ++m; }
+          writeSequence(out,anchor,ip-anchor,(ip-src)-ref,p-ip);
+          ip = anchor = p;
+        } else {
+          ++ip;
+        }
+      }
+
+      writeSequence(out,anchor,iend-anchor,0,0);
+    }
+
+    bool decompress(const uint8_t *src, size_t numBytes, uint8_t *dst, size_t dstBytes)
+    {
+      const uint8_t *ip   = src;
+      const uint8_t *iend = src+numBytes;
+      uint8_t *op   = dst;
+      uint8_t *oend = dst+dstBytes;
+
+      auto readLength = [&](size_t &len) {
+        uint8_t b;
+        do {
+          if (ip >= iend) return false;
+          b = *ip++;
+          len += b;
+        } while (b == 255);
+        return true;
+      };
+
+      while (ip < iend) {
+        const uint8_t token = *ip++;
+
+        size_t numLiterals = token>>4;
+        if (numLiterals == 15 && !readLength(numLiterals))
+          return false;
+        if (numLiterals > size_t(iend-ip) || numLiterals > size_t(oend-op))
+          return false;
+        memcpy(op,ip,numLiterals);
+        ip += numLiterals;
+        op += numLiterals;
+
+        if (ip == iend)
+          break; // last sequence
+
+        if (iend-ip < 2)
+          return false;
+        const size_t offset = ip[0] | (size_t(ip[1])<<8);
+        ip += 2;
+
+        size_t matchLength = token&15;
+        if (matchLength == 15 && !readLength(matchLength))
+          return false;
+        matchLength += MinMatch;
+
+        if (offset == 0 || offset > size_t(op-dst) || matchLength > size_t(oend-op))
+          return false;
+
+        // may overlap, copy byte by byte
+        const uint8_t *m = op-offset;
+        for (size_t i=0; i<matchLength; ++i)
+          *op++ = *m++;
+      }
+
+      return op == oend;
+    }
+
+  } // ::lz
+
+  // ==================================================================
+  // Filters; operate on the 32-bit patterns of the floats
+  // ==================================================================
+
+  static void encodeChunk(const float *scalars,
+                          size_t count,
+                          uint32_t filter,
+                          std::vector<uint8_t> &bytes)
+  {
+    std::vector<uint32_t> bits(count);
+    memcpy(bits.data(),scalars,count*sizeof(float));
+
+    if (filter & ScalarFile::FILTER_XOR_DELTA) {
+      for (size_t i=count; i>1; --i)
+        bits[i-1] ^= bits[i-2];
+    }
+
+    bytes.resize(count*sizeof(float));
+    if (filter & ScalarFile::FILTER_SHUFFLE) {
+      for (size_t i=0; i<count; ++i) {
+        bytes[i]         = uint8_t(bits[i]);
+        bytes[count+i]   = uint8_t(bits[i]>>8);
+        bytes[2*count+i] = uint8_t(bits[i]>>16);
+        bytes[3*count+i] = uint8_t(bits[i]>>24);
+      }
+    } else {
+      memcpy(bytes.data(),bits.data(),bytes.size());
+    }
+  }
+
+  static void decodeChunk(const uint8_t *bytes,
+                          size_t count,
+                          uint32_t filter,
+                          float *scalars)
+  {
+    uint32_t *bits = (uint32_t *)scalars;
+
+    if (filter & ScalarFile::FILTER_SHUFFLE) {
+      for (size_t i=0; i<count; ++i) {
+        bits[i] = uint32_t(bytes[i])
+                | (uint32_t(bytes[count+i])<<8)
+                | (uint32_t(bytes[2*count+i])<<16)
+                | (uint32_t(bytes[3*count+i])<<24);
+      }
+    } else {
+      memcpy(bits,bytes,count*sizeof(float));
+    }
+
+    if (filter & ScalarFile::FILTER_XOR_DELTA) {
+      for (size_t i=1; i<count; ++i)
+        bits[i] ^= bits[i-1];
+    }
+  }
+
+  // ==================================================================
+  // ScalarFile
+  // ==================================================================
+
+  static bool readHeader(std::ifstream &in, ScalarFile::Header &header)
+  {
+    in.read((char *)&header,sizeof(header));
+    return in.good() && header.magic == ScalarFile::magic;
+  }
+
+  bool ScalarFile::isCompressed(const std::string fileName)
+  {
+    std::ifstream in(fileName, std::ios::binary);
+    Header header;
+    return readHeader(in,header);
+  }
+
+  size_t ScalarFile::numScalars(const std::string fileName)
+  {
+    std::ifstream in(fileName, std::ios::binary | std::ios::ate);
+    if (!in.good())
+      return 0;
+
+    size_t numBytes = in.tellg();
+    in.seekg(0);
+
+    Header header;
+    if (readHeader(in,header))
+      return header.numScalars;
+
+    return numBytes/sizeof(float);
+  }
+
+  bool ScalarFile::read(const std::string fileName, std::vector<float> &dst)
+  {
+    dst.resize(numScalars(fileName));
+    return read(fileName,dst.data(),dst.size());
+  }
+
+  bool ScalarFile::read(const std::string fileName, float *dst, size_t numScalars)
+  {
+    std::ifstream in(fileName, std::ios::binary | std::ios::ate);
+    if (!in.good())
+      return false;
+
+    const size_t fileSize = in.tellg();
+    in.seekg(0);
+
+    Header header;
+    std::atomic<bool> ok(true);
+
+    if (!readHeader(in,header)) {
+      // raw file; read in parallel blocks, each with its own stream
+      if (fileSize/sizeof(float) < numScalars) {
+        std::cerr << "#exa: truncated scalar file: " << fileName << " ("
+                  << fileSize/sizeof(float) << " of " << numScalars << " scalars)\n";
+        return false;
+      }
+      const size_t numBytes = numScalars*sizeof(float);
+      const size_t blockSize = size_t(64)<<20;
+      const size_t numBlocks = (numBytes+blockSize-1)/blockSize;
+      parallel_for(numBlocks,[&](size_t blockID){
+        const size_t begin = blockID*blockSize;
+        const size_t end   = std::min(begin+blockSize,numBytes);
+        std::ifstream blockFile(fileName, std::ios::binary);
+        blockFile.seekg(begin);
+        blockFile.read((char *)dst+begin,end-begin);
+        if (!blockFile.good()) ok = false;
+      });
+      return ok;
+    }
+
+    if (header.version != version || header.chunkSize == 0 ||
+        header.numChunks != (header.numScalars+header.chunkSize-1)/header.chunkSize) {
+      std::cerr << "#exa: corrupt scalar file header: " << fileName << '\n';
+      return false;
+    }
+
+    if (numScalars < header.numScalars) {
+      std::cerr << "#exa: destination too small for scalar file: " << fileName << '\n';
+      return false;
+    }
+
+    std::vector<Chunk> chunks(header.numChunks);
+    in.read((char *)chunks.data(),chunks.size()*sizeof(chunks[0]));
+    if (!in.good())
+      return false;
+
+    parallel_for(chunks.size(),[&](size_t chunkID){
+      const Chunk &chunk = chunks[chunkID];
+      const size_t begin = chunkID*header.chunkSize;
+      const size_t count = std::min<size_t>(header.chunkSize,header.numScalars-begin);
+
+      if (chunk.offset+chunk.numBytes > fileSize) {
+        ok = false;
+        return;
+      }
+
+      std::vector<uint8_t> compressed(chunk.numBytes);
+      std::ifstream chunkFile(fileName, std::ios::binary);
+      chunkFile.seekg(chunk.offset);
+      chunkFile.read((char *)compressed.data(),compressed.size());
+      if (!chunkFile.good()) {
+        ok = false;
+        return;
+      }
+
+      if (!chunk.compressed) {
+        if (compressed.size() != count*sizeof(float)) {
+          ok = false;
+          return;
+        }
+        decodeChunk(compressed.data(),count,header.filter,dst+begin);
+        return;
+      }
+
+      std::vector<uint8_t> bytes(count*sizeof(float));
+      if (!lz::decompress(compressed.data(),compressed.size(),bytes.data(),bytes.size())) {
+        ok = false;
+        return;
+      }
+      decodeChunk(bytes.data(),count,header.filter,dst+begin);
+    });
+
+    if (!ok)
+      std::cerr << "#exa: corrupt chunk(s) in scalar file: " << fileName << '\n';
+
+    return ok;
+  }
+
+  bool ScalarFile::write(const std::string fileName,
+                         const float *scalars,
+                         size_t numScalars,
+                         uint32_t filter,
+                         size_t chunkSize)
+  {
+    if (chunkSize == 0 || chunkSize*sizeof(float) > UINT32_MAX)
+      throw std::runtime_error("invalid scalar file chunk size");
+
+    Header header;
+    header.magic      = magic;
+    header.version    = version;
+    header.filter     = filter;
+    header.numScalars = numScalars;
+    header.chunkSize  = chunkSize;
+    header.numChunks  = (numScalars+chunkSize-1)/chunkSize;
+
+    std::vector<Chunk> chunks(header.numChunks);
+    std::vector<std::vector<uint8_t>> data(header.numChunks);
+
+    parallel_for(chunks.size(),[&](size_t chunkID){
+      const size_t begin = chunkID*chunkSize;
+      const size_t count = std::min(chunkSize,numScalars-begin);
+
+      std::vector<uint8_t> bytes;
+      encodeChunk(scalars+begin,count,filter,bytes);
+      lz::compress(bytes.data(),bytes.size(),data[chunkID]);
+
+      if (data[chunkID].size() >= bytes.size()) {
+        // incompressible, store filtered bytes as is
+        data[chunkID].swap(bytes);
+        chunks[chunkID].compressed = 0;
+      } else {
+        chunks[chunkID].compressed = 1;
+      }
+      chunks[chunkID].numBytes = (uint32_t)data[chunkID].size();
+    });
+
+    uint64_t offset = sizeof(header)+chunks.size()*sizeof(chunks[0]);
+    for (auto &chunk : chunks) {
+      chunk.offset = offset;
+      offset += chunk.numBytes;
+    }
+
+    std::ofstream out(fileName, std::ios::binary);
+    if (!out.good())
+      return false;
+
+    out.write((const char *)&header,sizeof(header));
+    out.write((const char *)chunks.data(),chunks.size()*sizeof(chunks[0]));
+    for (const auto &d : data)
+      out.write((const char *)d.data(),d.size());
+
+    return out.good();
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,81 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace exa {
+
+  /*! Reader/writer for float32 scalar files. Besides raw (headerless)
+    .scalars files we support a chunked, losslessly compressed
+    container: each chunk is XOR-delta'd and/or byte-shuffled and
+    then LZ-compressed, so that chunks can be decompressed in
+    parallel directly into the destination array. Readers detect
+    the container by its magic number, raw files are read as-is */
+  struct ScalarFile
+  {
+    enum Filter {
+      FILTER_NONE      = 0,
+      FILTER_SHUFFLE   = 1, // group bytes of same significance
+      FILTER_XOR_DELTA = 2, // xor each float's bits with its predecessor
+    };
+
+    static const uint64_t magic   = 0x7a61786531ull; // "1exaz"
+    static const uint32_t version = 1;
+
+    struct Header {
+      uint64_t magic;
+      uint32_t version;
+      uint32_t filter;
+      uint64_t numScalars;
+      uint64_t chunkSize; // in floats
+      uint64_t numChunks;
+    };
+
+    struct Chunk {
+      uint64_t offset; // in bytes, from the beginning of the file
+      uint32_t numBytes;
+      uint32_t compressed; // 0 if stored as is (e.g., incompressible)
+    };
+
+    /*! true if the file starts with the compressed container's magic */
+    static bool isCompressed(const std::string fileName);
+
+    /*! number of scalars stored in the file, regardless of encoding */
+    static size_t numScalars(const std::string fileName);
+
+    /*! read numScalars floats into dst (must be large enough);
+      returns false if the file could not be opened or is corrupt */
+    static bool read(const std::string fileName, float *dst, size_t numScalars);
+
+    /*! resize dst to hold all scalars in the file and read them */
+    static bool read(const std::string fileName, std::vector<float> &dst);
+
+    /*! write the compressed container */
+    static bool write(const std::string fileName,
+                      const float *scalars,
+                      size_t numScalars,
+                      uint32_t filter = FILTER_SHUFFLE|FILTER_XOR_DELTA,
+                      size_t chunkSize = 1<<20);
+  };
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
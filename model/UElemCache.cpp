@@ -0,0 +1,144 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <owl/common/parallel/parallel_for.h>
+#include "UElemCache.h"
+
+namespace exa {
+
+  UElemCache::Counts UElemCache::countElems(const int *indices, size_t numElems)
+  {
+    Counts counts;
+    for (size_t i=0; i<numElems; ++i) {
+      switch (numElemVerts(indices+i*8)) {
+        case 4: counts.numTets++; break;
+        case 5: counts.numPyrs++; break;
+        case 6: counts.numWedges++; break;
+        case 8: counts.numHexes++; break;
+      }
+    }
+    return counts;
+  }
+
+  size_t UElemCache::bytesRequired(Level level, const Counts &counts)
+  {
+    const size_t numElems = counts.numTets+counts.numPyrs+counts.numWedges+counts.numHexes;
+    const size_t numNewton = counts.numPyrs+counts.numWedges;
+
+    if (level == BOUNDS)
+      return numElems*sizeof(int) + numNewton*sizeof(box3f);
+    else if (level == FULL)
+      return numElems*sizeof(int) + counts.numTets*sizeof(TetBarycentrics)
+          + numNewton*sizeof(UElemGuess);
+    else
+      return 0;
+  }
+
+  UElemCache::Level UElemCache::levelForBudget(const Counts &counts, size_t budgetBytes)
+  {
+    if (bytesRequired(FULL,counts) <= budgetBytes)
+      return FULL;
+    else if (bytesRequired(BOUNDS,counts) <= budgetBytes)
+      return BOUNDS;
+    else
+      return NONE;
+  }
+
+  const char *UElemCache::levelName(Level level)
+  {
+    if (level == BOUNDS)
+      return "BOUNDS";
+    else if (level == FULL)
+      return "FULL";
+    else
+      return "NONE";
+  }
+
+  void UElemCache::build(const int *indices,
+                         const vec4f *vertices,
+                         size_t numElems,
+                         Level level)
+  {
+    this->level = level;
+    slots.clear();
+    tets.clear();
+    bounds.clear();
+    guesses.clear();
+
+    if (level == NONE)
+      return;
+
+    // assign slots serially, fill in parallel
+    slots.resize(numElems,-1);
+    size_t numTets = 0, numNewton = 0;
+    for (size_t i=0; i<numElems; ++i) {
+      const int numVerts = numElemVerts(indices+i*8);
+      if (numVerts == 4 && level == FULL)
+        slots[i] = (int)numTets++;
+      else if (numVerts == 5 || numVerts == 6)
+        slots[i] = (int)numNewton++;
+    }
+
+    tets.resize(numTets);
+    if (level == FULL)
+      guesses.resize(numNewton);
+    else
+      bounds.resize(numNewton);
+
+    parallel_for_blocked(0ull,numElems,4096,[&](size_t begin,size_t end){
+        for (size_t i=begin;i<end;i++) {
+          const int slot = slots[i];
+          if (slot < 0)
+            continue;
+
+          const int *idx = indices+i*8;
+          const int numVerts = numElemVerts(idx);
+          vec4f v[6];
+          for (int j=0; j<numVerts; ++j) {
+            v[j] = vertices[idx[j]];
+          }
+
+          if (numVerts == 4) {
+            TetBarycentrics tet = makeTetBarycentrics(vec3f(v[0]),vec3f(v[1]),
+                                                      vec3f(v[2]),vec3f(v[3]));
+            tets[slot] = tet;
+          } else if (level == BOUNDS) {
+            box3f bbox;
+            for (int j=0; j<numVerts; ++j) {
+              bbox.extend(vec3f(v[j]));
+            }
+            bounds[slot] = bbox;
+          } else if (numVerts == 5) {
+            guesses[slot] = makePyrGuess(v[0],v[1],v[2],v[3],v[4]);
+          } else {
+            guesses[slot] = makeWedgeGuess(v[0],v[1],v[2],v[3],v[4],v[5]);
+          }
+        }
+      });
+  }
+
+  size_t UElemCache::bytes() const
+  {
+    return slots.size()*sizeof(slots[0])
+        + tets.size()*sizeof(tets[0])
+        + bounds.size()*sizeof(bounds[0])
+        + guesses.size()*sizeof(guesses[0]);
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
+
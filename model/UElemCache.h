@@ -0,0 +1,162 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <common.h>
+#include <Plane.h>
+#include <UElems.h>
+
+namespace exa {
+
+  /*! Host- or device-side view of a UElemCache */
+  struct UElemCacheView {
+    int                    level; // UElemCache::Level
+    const int             *slots;
+    const TetBarycentrics *tets;
+    const box3f           *bounds;
+    const UElemGuess      *guesses;
+  };
+
+  /*! Optional precomputed geometry for point location in unstructured
+    elements (indices as in ExaStitchModel: 8 per element, padded w/
+    -1). Levels trade memory for speed:
+      NONE:   nothing cached, same as the uncached intersect*() calls
+      BOUNDS: bounding boxes of pyramids and wedges, to skip the Newton
+              iteration for candidates that can't contain the point
+      FULL:   barycentric transforms for tets, and bounds plus initial
+              parametric guesses for pyramids and wedges
+    Hexes are never cached */
+  struct UElemCache
+  {
+    typedef std::shared_ptr<UElemCache> SP;
+
+    enum Level { NONE, BOUNDS, FULL };
+
+    struct Counts {
+      size_t numTets = 0, numPyrs = 0, numWedges = 0, numHexes = 0;
+    };
+
+    static Counts countElems(const int *indices, size_t numElems);
+
+    //! Memory footprint of a given level
+    static size_t bytesRequired(Level level, const Counts &counts);
+
+    //! Highest level that fits into budgetBytes
+    static Level levelForBudget(const Counts &counts, size_t budgetBytes);
+
+    static const char *levelName(Level level);
+
+    void build(const int *indices,
+               const vec4f *vertices,
+               size_t numElems,
+               Level level);
+
+    size_t bytes() const;
+
+    UElemCacheView view() const
+    { return {level,slots.data(),tets.data(),bounds.data(),guesses.data()}; }
+
+    //! Point location in element elemID
+    inline bool intersect(float &value,
+                          const vec3f &P,
+                          size_t elemID,
+                          const int *indices,
+                          const vec4f *vertices) const;
+
+    Level level = NONE;
+
+    /*! per element index into tets (tets), or bounds/guesses (pyramids
+      and wedges, by level); -1 if not cached */
+    std::vector<int> slots;
+    std::vector<TetBarycentrics> tets;
+    std::vector<box3f> bounds;
+    std::vector<UElemGuess> guesses;
+  };
+
+  inline __both__
+  int numElemVerts(const int *elemIndices)
+  {
+    int numVerts = 0;
+    while (numVerts < 8 && elemIndices[numVerts] >= 0)
+      numVerts++;
+    return numVerts;
+  }
+
+  /*! Point location in element elemID (indices: 8 per element, padded
+    w/ -1), using what the cache holds for the element */
+  inline __both__
+  bool intersectUElem(float &value,
+                      const vec3f &P,
+                      size_t elemID,
+                      const int *indices,
+                      const vec4f *vertices,
+                      const UElemCacheView &cache)
+  {
+    const int *idx = indices+elemID*8;
+    const int numVerts = numElemVerts(idx);
+    const int slot = cache.level == UElemCache::NONE ? -1 : cache.slots[elemID];
+
+    // reject by bounds before touching the vertices
+    if (slot >= 0 && (numVerts == 5 || numVerts == 6)) {
+      const box3f &elemBounds = cache.level == UElemCache::FULL
+          ? cache.guesses[slot].bounds : cache.bounds[slot];
+      if (!elemBounds.contains(P))
+        return false;
+    }
+
+    vec4f v[8];
+    for (int i=0; i<numVerts; ++i) {
+      v[i] = vertices[idx[i]];
+    }
+
+    if (numVerts == 4) {
+      if (slot >= 0)
+        return intersectTet(value,P,cache.tets[slot],v[0].w,v[1].w,v[2].w,v[3].w);
+      return intersectTet(value,P,v[0],v[1],v[2],v[3]);
+    }
+    else if (numVerts == 5) {
+      if (slot >= 0 && cache.level == UElemCache::FULL)
+        return intersectPyrEXT(value,P,cache.guesses[slot],v[0],v[1],v[2],v[3],v[4]);
+      return intersectPyrEXT(value,P,v[0],v[1],v[2],v[3],v[4]);
+    }
+    else if (numVerts == 6) {
+      if (slot >= 0 && cache.level == UElemCache::FULL)
+        return intersectWedgeEXT(value,P,cache.guesses[slot],v[0],v[1],v[2],v[3],v[4],v[5]);
+      return intersectWedgeEXT(value,P,v[0],v[1],v[2],v[3],v[4],v[5]);
+    }
+    else if (numVerts == 8) {
+      return intersectHexEXT(value,P,v[0],v[1],v[2],v[3],v[4],v[5],v[6],v[7]);
+    }
+
+    return false;
+  }
+
+  inline bool UElemCache::intersect(float &value,
+                                    const vec3f &P,
+                                    size_t elemID,
+                                    const int *indices,
+                                    const vec4f *vertices) const
+  {
+    return intersectUElem(value,P,elemID,indices,vertices,view());
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
+
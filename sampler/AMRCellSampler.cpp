@@ -38,7 +38,8 @@ namespace exa {
     if (!model)
       return false;
 
-    std::vector<AMRCell> &cells   = model->cells;
+    const AMRCell        *cells   = model->cellData();
+    const size_t         numCells = model->numCells();
     std::vector<float>   &scalars = model->scalars;
     Grid::SP             &grid    = model->grid;
     box3f &cellBounds = model->cellBounds;
@@ -46,7 +47,7 @@ namespace exa {
     owl4x3f &mirrorTransform = model->mirrorTransform;
 #endif
 
-    if (!cells.empty()) {
+    if (numCells > 0) {
       geomType = owlGeomTypeCreate(context,
                                    OWL_GEOM_USER,
                                    sizeof(AMRCellGeom),
@@ -62,11 +63,11 @@ namespace exa {
                                "AMRCellGeomCH");
 
       OWLGeom geom = owlGeomCreate(context, geomType);
-      owlGeomSetPrimCount(geom, cells.size());
+      owlGeomSetPrimCount(geom, numCells);
 
       cellBuffer = owlDeviceBufferCreate(context, OWL_USER_TYPE(AMRCell),
-                                         cells.size(),
-                                         cells.data());
+                                         numCells,
+                                         cells);
 
       scalarBuffer = owlDeviceBufferCreate(context, OWL_FLOAT,
                                            scalars.size(),
@@ -121,6 +122,17 @@ namespace exa {
     model->grid->computeMaxOpacities(owl,colorMap,xfRange);
   }
 
+  MajorantUpdateStats AMRCellSampler::updateMaxOpacities(OWLContext owl,
+                                                         OWLBuffer colorMap,
+                                                         range1f xfRange,
+                                                         range1f changedValues)
+  {
+    if (!model->grid || model->grid->dims==vec3i(0))
+      return {};
+
+    return model->grid->updateMaxOpacities(owl,colorMap,xfRange,changedValues);
+  }
+
   std::vector<OWLVarDecl> AMRCellSampler::getLPVariables()
   {
     std::vector<OWLVarDecl> vars
@@ -42,6 +42,11 @@ namespace exa {
 
     void computeMaxOpacities(OWLContext owl, OWLBuffer colorMap, range1f xfRange);
 
+    MajorantUpdateStats updateMaxOpacities(OWLContext owl,
+                                           OWLBuffer colorMap,
+                                           range1f xfRange,
+                                           range1f changedValues);
+
     std::vector<OWLVarDecl> getLPVariables();
 
     void setLPs(OWLParams lp);
@@ -0,0 +1,183 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <climits>
+#include <stdexcept>
+#include <owl/common/parallel/parallel_for.h>
+#include "model/ParallelReduce.h"
+#include "AMRCellSamplerCPU.h"
+
+namespace exa {
+
+  enum { MAX_LEVELS = 31 };
+
+  struct LevelStats {
+    size_t numCells[MAX_LEVELS];
+    vec3i  minCoord[MAX_LEVELS];
+    vec3i  maxCoord[MAX_LEVELS];
+
+    LevelStats()
+    {
+      for (int i=0; i<MAX_LEVELS; ++i) {
+        numCells[i] = 0;
+        minCoord[i] = vec3i(INT_MAX);
+        maxCoord[i] = vec3i(INT_MIN);
+      }
+    }
+  };
+
+  bool AMRCellSamplerCPU::build(AMRCellModel::SP model)
+  {
+    this->model = model;
+    levels.clear();
+
+    if (!model)
+      return false;
+
+    const AMRCell *cells = model->cellData();
+    const size_t numCells = model->numCells();
+
+    if (numCells == 0 || model->scalars.size() < numCells)
+      return false;
+
+    if (numCells > UINT_MAX)
+      throw std::runtime_error("AMRCellSamplerCPU: too many cells for 32-bit cell IDs");
+
+    cellBuffer = cells;
+    scalarBuffer = model->scalars.data();
+
+    // -------------------------------------------------------
+    // cells and coordinate bounds per level
+    // -------------------------------------------------------
+
+    LevelStats stats = parallelReduce(numCells,LevelStats(),
+      [&](size_t begin, size_t end) {
+        LevelStats s;
+        for (size_t i=begin; i<end; ++i) {
+          const int level = cells[i].level;
+          if (level < 0 || level >= MAX_LEVELS)
+            throw std::runtime_error("AMRCellSamplerCPU: invalid AMR level");
+          const vec3i coord = cells[i].pos>>level;
+          s.numCells[level]++;
+          s.minCoord[level] = min(s.minCoord[level],coord);
+          s.maxCoord[level] = max(s.maxCoord[level],coord);
+        }
+        return s;
+      },
+      [](LevelStats a, const LevelStats &b) {
+        for (int i=0; i<MAX_LEVELS; ++i) {
+          a.numCells[i] += b.numCells[i];
+          a.minCoord[i] = min(a.minCoord[i],b.minCoord[i]);
+          a.maxCoord[i] = max(a.maxCoord[i],b.maxCoord[i]);
+        }
+        return a;
+      });
+
+    // -------------------------------------------------------
+    // allocate tables, load factor <= .25 (the 2x2x2 blocks cluster)
+    // -------------------------------------------------------
+
+    std::vector<int> tableOfLevel(MAX_LEVELS,-1);
+    for (int level=0; level<MAX_LEVELS; ++level) {
+      if (stats.numCells[level] == 0)
+        continue;
+
+      const vec3i extent = stats.maxCoord[level]-stats.minCoord[level];
+      if (extent.x >= (1<<21) || extent.y >= (1<<21) || extent.z >= (1<<21))
+        throw std::runtime_error("AMRCellSamplerCPU: level too large for 21-bit cell keys");
+
+      unsigned log2Capacity = 4;
+      while ((1ull<<log2Capacity) < 4*stats.numCells[level])
+        log2Capacity++;
+
+      tableOfLevel[level] = (int)levels.size();
+      levels.emplace_back();
+      LevelTable &table = levels.back();
+      table.level    = level;
+      table.origin   = stats.minCoord[level];
+      table.size     = extent+vec3i(1);
+      table.shift    = 64-log2Capacity;
+      table.mask     = (1ull<<log2Capacity)-1;
+      table.numCells = stats.numCells[level];
+      table.keys     = std::vector<std::atomic<uint64_t>>(1ull<<log2Capacity);
+      table.cellIDs.resize(1ull<<log2Capacity);
+
+      parallel_for_blocked(0ull,table.keys.size(),1<<16,[&](size_t begin,size_t end){
+          for (size_t i=begin;i<end;i++) {
+            table.keys[i].store(EMPTY_KEY,std::memory_order_relaxed);
+          }
+        });
+    }
+
+    // -------------------------------------------------------
+    // insert all cells in parallel
+    // -------------------------------------------------------
+
+    parallel_for_blocked(0ull,numCells,1<<14,[&](size_t begin,size_t end){
+        for (size_t i=begin;i<end;i++) {
+          LevelTable &table = levels[tableOfLevel[cells[i].level]];
+          const uint64_t key = packCellKey((cells[i].pos>>table.level)-table.origin);
+          for (uint64_t slot=hashCellKey(key,table.shift);; slot=(slot+1)&table.mask) {
+            uint64_t expected = EMPTY_KEY;
+            if (table.keys[slot].compare_exchange_strong(expected,key)) {
+              table.cellIDs[slot] = (uint32_t)i;
+              break;
+            }
+            if (expected == key) // duplicate cell, first one wins
+              break;
+          }
+        }
+      });
+
+    return true;
+  }
+
+  size_t AMRCellSamplerCPU::bytes() const
+  {
+    size_t result = 0;
+    for (const LevelTable &table : levels) {
+      result += table.keys.size()*(sizeof(uint64_t)+sizeof(uint32_t));
+    }
+    return result;
+  }
+
+  void AMRCellSamplerCPU::printStats() const
+  {
+    for (const LevelTable &table : levels) {
+      std::cout << "#exa: level " << table.level << ": "
+                << prettyNumber(table.numCells) << " cells, table capacity "
+                << prettyNumber(table.keys.size()) << '\n';
+    }
+    std::cout << "#exa: hash tables: " << prettyBytes(bytes()) << '\n';
+  }
+
+  void sampleBatch(const AMRCellSamplerCPU &sampler,
+                   const vec3f *positions,
+                   float *values,
+                   size_t count)
+  {
+    SpatialDomain sd;
+    parallel_for_blocked(0ull,count,4096,[&](size_t begin,size_t end){
+        for (size_t i=begin;i<end;i++) {
+          values[i] = sample(sampler,sd,positions[i]).value;
+        }
+      });
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
+
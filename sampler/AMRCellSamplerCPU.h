@@ -0,0 +1,159 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "model/AMRCellModel.h"
+#include "Sampler.h"
+
+namespace exa {
+
+  /*! Host sampler for AMRCellModel: instead of a BVH over all cells,
+    every refinement level gets a hash table over the (level-local)
+    cell coordinates. A point is located by probing, per level, the
+    2x2x2 cells whose basis functions can overlap it; the reconstruction
+    is the same as that of AMRCellSampler (tent basis functions over
+    the dual cells) */
+  class AMRCellSamplerCPU {
+  public:
+    typedef std::shared_ptr<AMRCellSamplerCPU> SP;
+
+    enum { EMPTY_KEY = ~0ull };
+
+    //! Open addressing (linear probing) table of one level
+    struct LevelTable {
+      int      level = 0;
+      vec3i    origin;    // min. cell coordinate on this level
+      vec3i    size;      // max.-min.+1, probes outside are rejected early
+      unsigned shift = 0; // 64-log2(capacity)
+      uint64_t mask = 0;  // capacity-1
+      size_t   numCells = 0;
+      // written concurrently during build, plain loads afterwards
+      std::vector<std::atomic<uint64_t>> keys;
+      std::vector<uint32_t> cellIDs;
+    };
+
+    bool build(AMRCellModel::SP model);
+
+    void printStats() const;
+
+    size_t bytes() const;
+
+    AMRCellModel::SP model = nullptr;
+
+    const AMRCell *cellBuffer = nullptr;
+    const float *scalarBuffer = nullptr;
+
+    //! Non-empty levels only, finest first
+    std::vector<LevelTable> levels;
+  };
+
+  inline __host__
+  uint64_t packCellKey(const vec3i cellCoord)
+  {
+    return uint64_t(cellCoord.x) | (uint64_t(cellCoord.y)<<21) | (uint64_t(cellCoord.z)<<42);
+  }
+
+  /*! Fibonacci hashing of the 2x2x2 block a cell belongs to; the
+    cells of a block go to consecutive slots, so that the 8 probes
+    per level in sample() mostly hit the same few cache lines */
+  inline __host__
+  uint64_t hashCellKey(const uint64_t key, const unsigned shift)
+  {
+    const uint64_t lowBits = 1ull | (1ull<<21) | (1ull<<42);
+    const uint64_t blockKey = key & ~lowBits;
+    const uint64_t child = (key&1) | ((key>>20)&2) | ((key>>40)&4);
+    return (((blockKey*0x9E3779B97F4A7C15ull)>>(shift+3))<<3) | child;
+  }
+
+  //! Cell ID of the cell at (level-local) cellCoord, -1 if none
+  inline __host__
+  int findCell(const AMRCellSamplerCPU::LevelTable &table, vec3i cellCoord)
+  {
+    cellCoord = cellCoord-table.origin;
+    if (cellCoord.x < 0 || cellCoord.y < 0 || cellCoord.z < 0 ||
+        cellCoord.x >= table.size.x || cellCoord.y >= table.size.y || cellCoord.z >= table.size.z)
+      return -1;
+
+    const uint64_t key = packCellKey(cellCoord);
+    for (uint64_t slot=hashCellKey(key,table.shift);; slot=(slot+1)&table.mask) {
+      const uint64_t k = table.keys[slot].load(std::memory_order_relaxed);
+      if (k == key)
+        return (int)table.cellIDs[slot];
+      if (k == AMRCellSamplerCPU::EMPTY_KEY)
+        return -1;
+    }
+  }
+
+  inline __host__
+  Sample sample(const AMRCellSamplerCPU &sampler,
+                const SpatialDomain &domain,
+                const vec3f pos)
+  {
+    float sumWeightedValues = 0.f;
+    float sumWeights = 0.f;
+    int bestCellID = -1;
+    float bestWeight = 0.f;
+
+    for (const AMRCellSamplerCPU::LevelTable &table : sampler.levels) {
+      const float cellWidth = float(1<<table.level);
+      // basis functions are centered on the cells and 2 cells wide:
+      // only the cells w/ floor(p/w-.5)+{0,1} can overlap pos
+      const vec3f p = pos/cellWidth-vec3f(.5f);
+      const vec3i base(floorf(p.x),floorf(p.y),floorf(p.z));
+      const vec3f frac = p-vec3f(base);
+
+      for (int i=0; i<8; ++i) {
+        const vec3i offset(i&1,(i>>1)&1,i>>2);
+        const float weight = (offset.x ? frac.x : 1.f-frac.x)
+                           * (offset.y ? frac.y : 1.f-frac.y)
+                           * (offset.z ? frac.z : 1.f-frac.z);
+        if (weight <= 0.f)
+          continue;
+
+        const int cellID = findCell(table,base+offset);
+        if (cellID < 0)
+          continue;
+
+        sumWeights += weight;
+        sumWeightedValues += sampler.scalarBuffer[cellID]*weight;
+        if (weight > bestWeight) {
+          bestWeight = weight;
+          bestCellID = cellID;
+        }
+      }
+    }
+
+    if (sumWeights > 0.f)
+      return {0,bestCellID,sumWeightedValues/sumWeights};
+    else
+      return {-1,-1,0.f};
+  }
+
+  /*! Batched queries, positions are processed in parallel; positions
+    outside the model yield 0 */
+  void sampleBatch(const AMRCellSamplerCPU &sampler,
+                   const vec3f *positions,
+                   float *values,
+                   size_t count);
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
+
@@ -43,6 +43,9 @@ namespace exa {
                                                         nullptr);
     bmSampler->buildMacroCells((range1f*)owlBufferGetPointer(bmModel->grid->valueRanges,0),
                                bmModel->grid->dims, bmModel->grid->worldBounds);
+#if EXA_STITCH_GRID_RANGE_BITS < 32
+    bmModel->grid->quantizeValueRanges(owl);
+#endif
 
 #ifdef EXA_STITCH_MIRROR_EXAJET
     owl4x3f &mirrorTransform = model->mirrorTransform;
@@ -0,0 +1,276 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+#include "model/ABRs.h"
+
+namespace exa {
+
+  /*! Host-side, batched counterpart of addBasisFunctions(): evaluates
+    the tent basis functions of one brick for a batch of positions
+    given as SoA (px,py,pz), accumulating into sumWeightedValues and
+    sumWeights. Instead of the branch cascade, all 8 neighbors are
+    evaluated with a validity mask and fetched with masked gathers.
+    Uses AVX-512 (16 wide) or AVX2 (8 wide) if the compiler targets
+    those (e.g., EXA_STITCH_HOST_NATIVE), a portable loop otherwise.
+    Corners are accumulated in the same order as the scalar version */
+  struct BasisBatch
+  {
+    const float *px;
+    const float *py;
+    const float *pz;
+    float *sumWeightedValues;
+    float *sumWeights;
+    size_t count;
+  };
+
+  //! Name of the code path compiled in, for benchmarks/logging
+  inline const char *basisBatchISA()
+  {
+#if defined(__AVX512F__)
+    return "AVX-512";
+#elif defined(__AVX2__)
+    return "AVX2";
+#else
+    return "portable";
+#endif
+  }
+
+  namespace detail {
+
+    // portable, branch-free version; also handles the SIMD remainders
+    inline void addBasisFunctionsBatchScalar(const ExaBrick &brick,
+                                             const float *scalars,
+                                             const BasisBatch &batch,
+                                             size_t begin, size_t end)
+    {
+      const float invCellWidth = 1.f/(1<<brick.level); // exact, power of two
+      const vec3f lower(brick.lower);
+
+      for (size_t i=begin; i<end; ++i) {
+        const vec3f localPos
+          = (vec3f(batch.px[i],batch.py[i],batch.pz[i]) - lower) * invCellWidth
+          - vec3f(0.5f);
+        vec3i lo(floorf(localPos.x),floorf(localPos.y),floorf(localPos.z));
+        lo = max(vec3i(-1),lo);
+        const vec3f frac = localPos - vec3f(lo);
+        const vec3f negFrac = vec3f(1.f) - frac;
+
+        float sumW = batch.sumWeights[i];
+        float sumWV = batch.sumWeightedValues[i];
+        for (int dz=0; dz<2; ++dz) {
+          const int iz = lo.z+dz;
+          const float wz = dz ? frac.z : negFrac.z;
+          const bool vz = iz >= 0 && iz < brick.size.z;
+          for (int dy=0; dy<2; ++dy) {
+            const int iy = lo.y+dy;
+            const float wzy = wz * (dy ? frac.y : negFrac.y);
+            const bool vy = vz && iy >= 0 && iy < brick.size.y;
+            for (int dx=0; dx<2; ++dx) {
+              const int ix = lo.x+dx;
+              const bool valid = vy && ix >= 0 && ix < brick.size.x;
+              if (valid) {
+                const float weight = wzy * (dx ? frac.x : negFrac.x);
+                const float scalar
+                  = scalars[ix + brick.size.x*(iy + brick.size.y*iz)];
+                sumW += weight;
+                sumWV += weight*scalar;
+              }
+            }
+          }
+        }
+        batch.sumWeights[i] = sumW;
+        batch.sumWeightedValues[i] = sumWV;
+      }
+    }
+
+#if defined(__AVX512F__)
+    inline size_t addBasisFunctionsBatchSIMD(const ExaBrick &brick,
+                                             const float *scalars,
+                                             const BasisBatch &batch)
+    {
+      const __m512 invCellWidth = _mm512_set1_ps(1.f/(1<<brick.level));
+      const __m512 lowerX = _mm512_set1_ps((float)brick.lower.x);
+      const __m512 lowerY = _mm512_set1_ps((float)brick.lower.y);
+      const __m512 lowerZ = _mm512_set1_ps((float)brick.lower.z);
+      const __m512 half   = _mm512_set1_ps(0.5f);
+      const __m512 one    = _mm512_set1_ps(1.f);
+      const __m512 minusOne = _mm512_set1_ps(-1.f);
+      const __m512i zero  = _mm512_setzero_si512();
+      const __m512i sizeX = _mm512_set1_epi32(brick.size.x);
+      const __m512i sizeY = _mm512_set1_epi32(brick.size.y);
+      const __m512i sizeZ = _mm512_set1_epi32(brick.size.z);
+      const __m512i one_i = _mm512_set1_epi32(1);
+
+      const size_t simdEnd = batch.count & ~size_t(15);
+      for (size_t i=0; i<simdEnd; i+=16) {
+        const __m512 lx = _mm512_sub_ps(_mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(batch.px+i),lowerX),invCellWidth),half);
+        const __m512 ly = _mm512_sub_ps(_mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(batch.py+i),lowerY),invCellWidth),half);
+        const __m512 lz = _mm512_sub_ps(_mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(batch.pz+i),lowerZ),invCellWidth),half);
+
+        const __m512 flx = _mm512_max_ps(_mm512_roundscale_ps(lx,_MM_FROUND_TO_NEG_INF),minusOne);
+        const __m512 fly = _mm512_max_ps(_mm512_roundscale_ps(ly,_MM_FROUND_TO_NEG_INF),minusOne);
+        const __m512 flz = _mm512_max_ps(_mm512_roundscale_ps(lz,_MM_FROUND_TO_NEG_INF),minusOne);
+
+        const __m512 fracX = _mm512_sub_ps(lx,flx), negFracX = _mm512_sub_ps(one,fracX);
+        const __m512 fracY = _mm512_sub_ps(ly,fly), negFracY = _mm512_sub_ps(one,fracY);
+        const __m512 fracZ = _mm512_sub_ps(lz,flz), negFracZ = _mm512_sub_ps(one,fracZ);
+
+        const __m512i loX = _mm512_cvtps_epi32(flx), hiX = _mm512_add_epi32(loX,one_i);
+        const __m512i loY = _mm512_cvtps_epi32(fly), hiY = _mm512_add_epi32(loY,one_i);
+        const __m512i loZ = _mm512_cvtps_epi32(flz), hiZ = _mm512_add_epi32(loZ,one_i);
+
+        // lo may be -1 (or beyond the brick), hi is always >= 0
+        const __mmask16 vLoX = _mm512_cmpge_epi32_mask(loX,zero) & _mm512_cmplt_epi32_mask(loX,sizeX);
+        const __mmask16 vHiX = _mm512_cmplt_epi32_mask(hiX,sizeX);
+        const __mmask16 vLoY = _mm512_cmpge_epi32_mask(loY,zero) & _mm512_cmplt_epi32_mask(loY,sizeY);
+        const __mmask16 vHiY = _mm512_cmplt_epi32_mask(hiY,sizeY);
+        const __mmask16 vLoZ = _mm512_cmpge_epi32_mask(loZ,zero) & _mm512_cmplt_epi32_mask(loZ,sizeZ);
+        const __mmask16 vHiZ = _mm512_cmplt_epi32_mask(hiZ,sizeZ);
+
+        __m512 sumW  = _mm512_loadu_ps(batch.sumWeights+i);
+        __m512 sumWV = _mm512_loadu_ps(batch.sumWeightedValues+i);
+
+        for (int dz=0; dz<2; ++dz) {
+          const __m512i iz = dz ? hiZ : loZ;
+          const __m512 wz = dz ? fracZ : negFracZ;
+          const __mmask16 vz = dz ? vHiZ : vLoZ;
+          for (int dy=0; dy<2; ++dy) {
+            const __m512i iy = dy ? hiY : loY;
+            const __m512 wzy = _mm512_mul_ps(wz,dy ? fracY : negFracY);
+            const __mmask16 vzy = vz & (dy ? vHiY : vLoY);
+            const __m512i rowOffset = _mm512_mullo_epi32(_mm512_add_epi32(iy,_mm512_mullo_epi32(sizeY,iz)),sizeX);
+            for (int dx=0; dx<2; ++dx) {
+              const __mmask16 valid = vzy & (dx ? vHiX : vLoX);
+              const __m512i index = _mm512_add_epi32(rowOffset,dx ? hiX : loX);
+              const __m512 weight = _mm512_mul_ps(wzy,dx ? fracX : negFracX);
+              const __m512 scalar = _mm512_mask_i32gather_ps(_mm512_setzero_ps(),valid,index,scalars,4);
+              sumW  = _mm512_mask_add_ps(sumW,valid,sumW,weight);
+              sumWV = _mm512_mask_add_ps(sumWV,valid,sumWV,_mm512_mul_ps(weight,scalar));
+            }
+          }
+        }
+
+        _mm512_storeu_ps(batch.sumWeights+i,sumW);
+        _mm512_storeu_ps(batch.sumWeightedValues+i,sumWV);
+      }
+      return simdEnd;
+    }
+#elif defined(__AVX2__)
+    inline size_t addBasisFunctionsBatchSIMD(const ExaBrick &brick,
+                                             const float *scalars,
+                                             const BasisBatch &batch)
+    {
+      const __m256 invCellWidth = _mm256_set1_ps(1.f/(1<<brick.level));
+      const __m256 lowerX = _mm256_set1_ps((float)brick.lower.x);
+      const __m256 lowerY = _mm256_set1_ps((float)brick.lower.y);
+      const __m256 lowerZ = _mm256_set1_ps((float)brick.lower.z);
+      const __m256 half   = _mm256_set1_ps(0.5f);
+      const __m256 one    = _mm256_set1_ps(1.f);
+      const __m256 minusOne = _mm256_set1_ps(-1.f);
+      const __m256i minusOne_i = _mm256_set1_epi32(-1);
+      const __m256i sizeX = _mm256_set1_epi32(brick.size.x);
+      const __m256i sizeY = _mm256_set1_epi32(brick.size.y);
+      const __m256i sizeZ = _mm256_set1_epi32(brick.size.z);
+      const __m256i one_i = _mm256_set1_epi32(1);
+
+      // a < b for ints, as a mask
+      auto lt = [](__m256i a, __m256i b) { return _mm256_cmpgt_epi32(b,a); };
+
+      const size_t simdEnd = batch.count & ~size_t(7);
+      for (size_t i=0; i<simdEnd; i+=8) {
+        const __m256 lx = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(batch.px+i),lowerX),invCellWidth),half);
+        const __m256 ly = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(batch.py+i),lowerY),invCellWidth),half);
+        const __m256 lz = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(batch.pz+i),lowerZ),invCellWidth),half);
+
+        const __m256 flx = _mm256_max_ps(_mm256_floor_ps(lx),minusOne);
+        const __m256 fly = _mm256_max_ps(_mm256_floor_ps(ly),minusOne);
+        const __m256 flz = _mm256_max_ps(_mm256_floor_ps(lz),minusOne);
+
+        const __m256 fracX = _mm256_sub_ps(lx,flx), negFracX = _mm256_sub_ps(one,fracX);
+        const __m256 fracY = _mm256_sub_ps(ly,fly), negFracY = _mm256_sub_ps(one,fracY);
+        const __m256 fracZ = _mm256_sub_ps(lz,flz), negFracZ = _mm256_sub_ps(one,fracZ);
+
+        const __m256i loX = _mm256_cvtps_epi32(flx), hiX = _mm256_add_epi32(loX,one_i);
+        const __m256i loY = _mm256_cvtps_epi32(fly), hiY = _mm256_add_epi32(loY,one_i);
+        const __m256i loZ = _mm256_cvtps_epi32(flz), hiZ = _mm256_add_epi32(loZ,one_i);
+
+        // lo may be -1 (or beyond the brick), hi is always >= 0
+        const __m256i vLoX = _mm256_and_si256(_mm256_cmpgt_epi32(loX,minusOne_i),lt(loX,sizeX));
+        const __m256i vHiX = lt(hiX,sizeX);
+        const __m256i vLoY = _mm256_and_si256(_mm256_cmpgt_epi32(loY,minusOne_i),lt(loY,sizeY));
+        const __m256i vHiY = lt(hiY,sizeY);
+        const __m256i vLoZ = _mm256_and_si256(_mm256_cmpgt_epi32(loZ,minusOne_i),lt(loZ,sizeZ));
+        const __m256i vHiZ = lt(hiZ,sizeZ);
+
+        __m256 sumW  = _mm256_loadu_ps(batch.sumWeights+i);
+        __m256 sumWV = _mm256_loadu_ps(batch.sumWeightedValues+i);
+
+        for (int dz=0; dz<2; ++dz) {
+          const __m256i iz = dz ? hiZ : loZ;
+          const __m256 wz = dz ? fracZ : negFracZ;
+          const __m256i vz = dz ? vHiZ : vLoZ;
+          for (int dy=0; dy<2; ++dy) {
+            const __m256i iy = dy ? hiY : loY;
+            const __m256 wzy = _mm256_mul_ps(wz,dy ? fracY : negFracY);
+            const __m256i vzy = _mm256_and_si256(vz,dy ? vHiY : vLoY);
+            const __m256i rowOffset = _mm256_mullo_epi32(_mm256_add_epi32(iy,_mm256_mullo_epi32(sizeY,iz)),sizeX);
+            for (int dx=0; dx<2; ++dx) {
+              const __m256 valid = _mm256_castsi256_ps(_mm256_and_si256(vzy,dx ? vHiX : vLoX));
+              const __m256i index = _mm256_add_epi32(rowOffset,dx ? hiX : loX);
+              const __m256 weight = _mm256_and_ps(_mm256_mul_ps(wzy,dx ? fracX : negFracX),valid);
+              const __m256 scalar = _mm256_mask_i32gather_ps(_mm256_setzero_ps(),scalars,index,valid,4);
+              sumW  = _mm256_add_ps(sumW,weight);
+              sumWV = _mm256_add_ps(sumWV,_mm256_mul_ps(weight,scalar));
+            }
+          }
+        }
+
+        _mm256_storeu_ps(batch.sumWeights+i,sumW);
+        _mm256_storeu_ps(batch.sumWeightedValues+i,sumWV);
+      }
+      return simdEnd;
+    }
+#else
+    inline size_t addBasisFunctionsBatchSIMD(const ExaBrick &,
+                                             const float *,
+                                             const BasisBatch &)
+    {
+      return 0;
+    }
+#endif
+  } // ::detail
+
+  /*! scalarBuffer is the model's full scalar array */
+  inline void addBasisFunctionsBatch(const ExaBrick &brick,
+                                     const float *scalarBuffer,
+                                     const BasisBatch &batch)
+  {
+    // gather relative to the brick, so indices fit into 32 bits
+    const float *scalars = scalarBuffer + brick.begin;
+    const size_t simdEnd = detail::addBasisFunctionsBatchSIMD(brick,scalars,batch);
+    detail::addBasisFunctionsBatchScalar(brick,scalars,batch,simdEnd,batch.count);
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -16,6 +16,7 @@
 
 #include "ExaBrickSampler.h"
 #include <owl/helper/cuda.h>
+#include "model/ParallelReduce.h"
 
 extern "C" char embedded_ExaBrickSampler[];
 
@@ -23,6 +24,7 @@ namespace exa {
 
   int ExaBrickSampler::traversalMode = EXA_STITCH_EXA_BRICK_TRAVERSAL_MODE;
   int ExaBrickSampler::samplerMode   = EXA_STITCH_EXA_BRICK_SAMPLER_MODE;
+  int ExaBrickSampler::adaptiveGridRefinement = 4;
 
   bool ExaBrickSampler::build(OWLContext context, Model::SP mod)
   {
@@ -46,7 +48,7 @@ namespace exa {
       return false;
 
     std::vector<ExaBrick> &bricks  = model->bricks;
-    std::vector<float>    &scalars = model->scalars;
+    const float           *scalars = model->scalarData();
     ABRs                  &abrs    = model->abrs;
     KDTree::SP            &kdtree  = model->kdtree;
     Grid::SP              &grid    = model->grid;
@@ -64,7 +66,7 @@ namespace exa {
     // ==================================================================
 
     brickBuffer       = owlDeviceBufferCreate(context, OWL_USER_TYPE(ExaBrick), bricks.size(), bricks.data());
-    scalarBuffer      = owlDeviceBufferCreate(context, OWL_FLOAT, scalars.size(), scalars.data());
+    scalarBuffer      = owlDeviceBufferCreate(context, OWL_FLOAT, model->numScalars(), scalars);
 
     if (traversalMode == EXABRICK_ABR_TRAVERSAL || samplerMode == EXA_BRICK_SAMPLER_ABR_BVH) {
       if (abrs.value.empty())
@@ -211,6 +213,35 @@ namespace exa {
 #endif
     }
 
+    if (traversalMode == EXABRICK_ADAPTIVE_GRID_TRAVERSAL) {
+#ifdef EXA_STITCH_MIRROR_EXAJET
+      throw std::runtime_error("adaptive grid traversal does not support mirroring");
+#endif
+      // the uniform grid isn't built, only its resolution is used
+      if (model->numGridCells==vec3i(0))
+        return false;
+
+      // built over the ABRs, like the uniform grid
+      std::vector<box3f> domains(abrs.value.size());
+      std::vector<range1f> valueRanges(abrs.value.size());
+      parallel_for_blocked(0ull,abrs.value.size(),4096,[&](size_t begin, size_t end) {
+        for (size_t i=begin; i<end; ++i) {
+          domains[i]     = abrs.value[i].domain;
+          valueRanges[i] = abrs.value[i].valueRange;
+        }
+      });
+      const box3f bounds = parallelBounds(domains.size(),
+                                          [&](size_t i) { return domains[i]; });
+      const vec3i coarseDims = max(vec3i(1),model->numGridCells/adaptiveGridRefinement);
+
+      adaptiveGrid = std::make_shared<AdaptiveGrid>();
+      adaptiveGrid->build(domains.data(),valueRanges.data(),domains.size(),
+                          bounds,coarseDims,adaptiveGridRefinement);
+      adaptiveGrid->printStats();
+      adaptiveGrid->initGPU(context);
+      adaptiveGridUpdater = MajorantUpdater();
+    }
+
 
     if (samplerMode == EXA_BRICK_SAMPLER_EXT_BVH ||
         traversalMode == EXABRICK_BVH_TRAVERSAL ||
@@ -256,9 +287,20 @@ namespace exa {
       }
 
       owlBufferRelease(brickValueRanges);
+#if EXA_STITCH_GRID_RANGE_BITS < 32
+      std::vector<QuantizedRange<GridRangeCode>> codes;
+      brickRangeQuantizer = quantizeRanges(hValueRanges,codes);
+      brickValueRanges = owlDeviceBufferCreate(context, OWL_USER_TYPE(QuantizedRange<GridRangeCode>),
+                                               codes.size(),
+                                               codes.data());
+      std::cout << "#exa: brick value ranges quantized to " << EXA_STITCH_GRID_RANGE_BITS
+                << " bits: " << prettyBytes(hValueRanges.size()*sizeof(range1f)) << " -> "
+                << prettyBytes(codes.size()*sizeof(codes[0])) << '\n';
+#else
       brickValueRanges = owlDeviceBufferCreate(context, OWL_USER_TYPE(range1f),
                                                hValueRanges.size(),
                                                hValueRanges.data());
+#endif
     }
 
     // Set the sampling accel
@@ -328,6 +370,7 @@ namespace exa {
     Sampler::majorantAccel.bvh = NULL;
     Sampler::majorantAccel.grid = NULL;
     Sampler::majorantAccel.kdtree = NULL;
+    Sampler::majorantAccel.adaptiveGrid = NULL;
 
     // Set the majorant traversal accel and majorants buffer
     switch (traversalMode) {
@@ -368,6 +411,12 @@ namespace exa {
         break;
       }
 
+      case EXABRICK_ADAPTIVE_GRID_TRAVERSAL: {
+        Sampler::majorantAccel.adaptiveGrid = adaptiveGrid;
+        Sampler::maxOpacities = adaptiveGrid->maxOpacityBuffer;
+        break;
+      }
+
       default: throw std::runtime_error("wrong traversal mode?!");
         break;
     }
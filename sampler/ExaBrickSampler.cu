@@ -24,72 +24,57 @@ namespace exa {
     return (a + b - 1) / b;
   }
 
-  __global__ void computeMaxOpacitiesForBricks(float         *exaBrickMaxOpacities,
-                                               const range1f *brickValueRanges,
-                                               const vec4f   *colorMap,
-                                               size_t         numBricks,
-                                               size_t         numColors,
-                                               range1f        xfRange)
+  template <typename Ranges>
+  __global__ void computeMaxOpacitiesForBricks(float                 *exaBrickMaxOpacities,
+                                               Ranges                 brickValueRanges,
+                                               TFRangeMaxTraversable  xfRangeMax,
+                                               size_t                 numBricks,
+                                               range1f                xfRange)
   {
     size_t threadID = blockIdx.x * size_t(blockDim.x) + threadIdx.x;
     if (threadID >= numBricks)
       return;
 
-    range1f valueRange = brickValueRanges[threadID];
-
-    if (valueRange.upper < valueRange.lower) {
-      exaBrickMaxOpacities[threadID] = 0.f;
-      return;
-    }
-
-    valueRange.lower -= xfRange.lower;
-    valueRange.lower /= xfRange.upper-xfRange.lower;
-    valueRange.upper -= xfRange.lower;
-    valueRange.upper /= xfRange.upper-xfRange.lower;
-
-    int lo = clamp(int(valueRange.lower*(numColors-1)),  0,(int)numColors-1);
-    int hi = clamp(int(valueRange.upper*(numColors-1))+1,0,(int)numColors-1);
-
-    float maxOpacity = 0.f;
-    for (int i=lo; i<=hi; ++i) {
-      maxOpacity = fmaxf(maxOpacity,colorMap[i].w);
-    }
-
-    exaBrickMaxOpacities[threadID] = maxOpacity;
+    exaBrickMaxOpacities[threadID] = maxOpacity(brickValueRanges[threadID],xfRangeMax,xfRange);
   }
 
-  __global__ void computeMaxOpacitiesForABRs(float       *abrMaxOpacities,
-                                             const ABR   *abrs,
-                                             const vec4f *colorMap,
-                                             size_t       numABRs,
-                                             size_t       numColors,
-                                             range1f      xfRange)
+  __global__ void computeMaxOpacitiesForABRs(float                 *abrMaxOpacities,
+                                             const ABR             *abrs,
+                                             TFRangeMaxTraversable  xfRangeMax,
+                                             size_t                 numABRs,
+                                             range1f                xfRange)
   {
     size_t threadID = blockIdx.x * size_t(blockDim.x) + threadIdx.x;
     if (threadID >= numABRs) return;
 
-    const ABR &abr = abrs[threadID];
-    range1f valueRange = abr.valueRange;
-
-    if (valueRange.upper < valueRange.lower) {
-      abrMaxOpacities[threadID] = 0.f;
-      return;
-    }
-
-    valueRange.lower -= xfRange.lower;
-    valueRange.lower /= xfRange.upper-xfRange.lower;
-    valueRange.upper -= xfRange.lower;
-    valueRange.upper /= xfRange.upper-xfRange.lower;
+    abrMaxOpacities[threadID] = maxOpacity(abrs[threadID].valueRange,xfRangeMax,xfRange);
+  }
 
-    int lo = clamp(int(valueRange.lower*(numColors-1)),  0,(int)numColors-1);
-    int hi = clamp(int(valueRange.upper*(numColors-1))+1,0,(int)numColors-1);
+  GridValueRanges ExaBrickSampler::deviceBrickValueRanges() const
+  {
+#if EXA_STITCH_GRID_RANGE_BITS < 32
+    return {(const QuantizedRange<GridRangeCode> *)owlBufferGetPointer(brickValueRanges,0),
+            brickRangeQuantizer};
+#else
+    return {(const range1f *)owlBufferGetPointer(brickValueRanges,0),sizeof(range1f)};
+#endif
+  }
 
-    float maxOpacity = 0.f;
-    for (int i=lo; i<=hi; ++i) {
-      maxOpacity = fmaxf(maxOpacity,colorMap[i].w);
+  std::vector<range1f> ExaBrickSampler::hostBrickValueRanges() const
+  {
+    std::vector<range1f> result(model->bricks.size());
+#if EXA_STITCH_GRID_RANGE_BITS < 32
+    std::vector<QuantizedRange<GridRangeCode>> codes(result.size());
+    cudaMemcpy(codes.data(),owlBufferGetPointer(brickValueRanges,0),
+               codes.size()*sizeof(codes[0]),cudaMemcpyDeviceToHost);
+    for (size_t i=0; i<result.size(); ++i) {
+      result[i] = brickRangeQuantizer.decode(codes[i]);
     }
-
-    abrMaxOpacities[threadID] = maxOpacity;
+#else
+    cudaMemcpy(result.data(),owlBufferGetPointer(brickValueRanges,0),
+               result.size()*sizeof(range1f),cudaMemcpyDeviceToHost);
+#endif
+    return result;
   }
 
   void ExaBrickSampler::computeMaxOpacities(OWLContext owl,
@@ -103,16 +88,17 @@ namespace exa {
       model->grid->computeMaxOpacities(owl,colorMap,xfRange);
     }
 
+    xfRangeMax.build(owl,colorMap);
+
     if (samplerMode == EXA_BRICK_SAMPLER_ABR_BVH || traversalMode == EXABRICK_ABR_TRAVERSAL) {
       size_t numABRs = owlBufferSizeInBytes(abrBuffer)/sizeof(ABR);
-      size_t numColors = owlBufferSizeInBytes(colorMap)/sizeof(vec4f);
 
       size_t numThreads = 1024;
       computeMaxOpacitiesForABRs<<<(uint32_t)iDivUp(numABRs, numThreads), (uint32_t)numThreads>>>(
         (float *)owlBufferGetPointer(abrMaxOpacities,0),
         (const ABR *)owlBufferGetPointer(abrBuffer,0),
-        (const vec4f *)owlBufferGetPointer(colorMap,0),
-        numABRs,numColors,xfRange);
+        xfRangeMax.traversable(),
+        numABRs,xfRange);
 
       owlGroupBuildAccel(abrBlas);
       owlGroupBuildAccel(abrTlas);
@@ -123,14 +109,12 @@ namespace exa {
         traversalMode == EXABRICK_EXT_BVH_TRAVERSAL ||
         traversalMode == EXABRICK_KDTREE_TRAVERSAL) {
 
-      size_t numColors = owlBufferSizeInBytes(colorMap)/sizeof(vec4f);
-
       size_t numThreads = 1024;
       computeMaxOpacitiesForBricks<<<(uint32_t)iDivUp(model->bricks.size(), numThreads), (uint32_t)numThreads>>>(
         (float *)owlBufferGetPointer(brickMaxOpacities,0),
-        (const range1f *)owlBufferGetPointer(brickValueRanges,0),
-        (const vec4f *)owlBufferGetPointer(colorMap,0),
-        model->bricks.size(),numColors,xfRange);
+        deviceBrickValueRanges(),
+        xfRangeMax.traversable(),
+        model->bricks.size(),xfRange);
 
       if (traversalMode == EXABRICK_EXT_BVH_TRAVERSAL ||
           samplerMode == EXA_BRICK_SAMPLER_EXT_BVH) {
@@ -143,6 +127,97 @@ namespace exa {
         owlGroupBuildAccel(brickTlas);
       }
     }
+
+    if (traversalMode == EXABRICK_ADAPTIVE_GRID_TRAVERSAL) {
+      // per-leaf value ranges, same as per-brick ones
+      size_t numThreads = 1024;
+      computeMaxOpacitiesForBricks<<<(uint32_t)iDivUp(adaptiveGrid->numLeaves(), numThreads), (uint32_t)numThreads>>>(
+        (float *)owlBufferGetPointer(adaptiveGrid->maxOpacityBuffer,0),
+        (const range1f *)owlBufferGetPointer(adaptiveGrid->valueRangeBuffer,0),
+        xfRangeMax.traversable(),
+        adaptiveGrid->numLeaves(),xfRange);
+    }
+  }
+
+  MajorantUpdateStats ExaBrickSampler::updateMaxOpacities(OWLContext owl,
+                                                          OWLBuffer colorMap,
+                                                          range1f xfRange,
+                                                          range1f changedValues)
+  {
+    MajorantUpdateStats stats;
+
+    if (traversalMode == MC_DDA_TRAVERSAL || traversalMode == MC_BVH_TRAVERSAL) {
+      if (!model->grid || model->grid->dims==vec3i(0))
+        return stats;
+
+      stats += model->grid->updateMaxOpacities(owl,colorMap,xfRange,changedValues);
+    }
+
+    xfRangeMax.build(owl,colorMap);
+
+    if (samplerMode == EXA_BRICK_SAMPLER_ABR_BVH || traversalMode == EXABRICK_ABR_TRAVERSAL) {
+      if (!abrUpdater.index.built) {
+        const std::vector<ABR> &abrs = model->abrs.value;
+        abrUpdater.index.build(abrs.empty() ? nullptr : &abrs[0].valueRange,
+                               abrs.size(),sizeof(ABR));
+      }
+
+      const ABR *abrs = (const ABR *)owlBufferGetPointer(abrBuffer,0);
+      MajorantUpdateStats abrStats = abrUpdater.update(owl,
+        (float *)owlBufferGetPointer(abrMaxOpacities,0),
+        &abrs[0].valueRange,sizeof(ABR),
+        xfRangeMax.traversable(),xfRange,changedValues);
+
+      if (abrStats.numUpdated > 0) {
+        owlGroupBuildAccel(abrBlas);
+        owlGroupBuildAccel(abrTlas);
+      }
+      stats += abrStats;
+    }
+
+    if (samplerMode == EXA_BRICK_SAMPLER_EXT_BVH ||
+        traversalMode == EXABRICK_BVH_TRAVERSAL ||
+        traversalMode == EXABRICK_EXT_BVH_TRAVERSAL ||
+        traversalMode == EXABRICK_KDTREE_TRAVERSAL) {
+
+      if (!brickUpdater.index.built) {
+        std::vector<range1f> hValueRanges = hostBrickValueRanges();
+        brickUpdater.index.build(hValueRanges.data(),hValueRanges.size());
+      }
+
+      MajorantUpdateStats brickStats = brickUpdater.update(owl,
+        (float *)owlBufferGetPointer(brickMaxOpacities,0),
+        deviceBrickValueRanges(),
+        xfRangeMax.traversable(),xfRange,changedValues);
+
+      if (brickStats.numUpdated > 0) {
+        if (traversalMode == EXABRICK_EXT_BVH_TRAVERSAL ||
+            samplerMode == EXA_BRICK_SAMPLER_EXT_BVH) {
+          owlGroupBuildAccel(extBlas);
+          owlGroupBuildAccel(extTlas);
+        }
+
+        if (traversalMode == EXABRICK_BVH_TRAVERSAL) {
+          owlGroupBuildAccel(brickBlas);
+          owlGroupBuildAccel(brickTlas);
+        }
+      }
+      stats += brickStats;
+    }
+
+    if (traversalMode == EXABRICK_ADAPTIVE_GRID_TRAVERSAL) {
+      if (!adaptiveGridUpdater.index.built) {
+        adaptiveGridUpdater.index.build(adaptiveGrid->valueRanges.data(),
+                                        adaptiveGrid->numLeaves());
+      }
+
+      stats += adaptiveGridUpdater.update(owl,
+        (float *)owlBufferGetPointer(adaptiveGrid->maxOpacityBuffer,0),
+        (const range1f *)owlBufferGetPointer(adaptiveGrid->valueRangeBuffer,0),
+        sizeof(range1f),xfRangeMax.traversable(),xfRange,changedValues);
+    }
+
+    return stats;
   }
 } // ::exa
 
@@ -36,6 +36,11 @@ namespace exa {
     static int traversalMode;
     static int samplerMode;
 
+    /*! With EXABRICK_ADAPTIVE_GRID_TRAVERSAL, the model's grid
+      resolution is that of the fine cells; the coarse grid has
+      1/adaptiveGridRefinement as many cells per dimension */
+    static int adaptiveGridRefinement;
+
     // Launch params associated with sampler
     struct LP {
       ExaBrick *brickBuffer;
@@ -56,6 +61,11 @@ namespace exa {
 
     void computeMaxOpacities(OWLContext owl, OWLBuffer colorMap, range1f xfRange);
 
+    MajorantUpdateStats updateMaxOpacities(OWLContext owl,
+                                           OWLBuffer colorMap,
+                                           range1f xfRange,
+                                           range1f changedValues);
+
     std::vector<OWLVarDecl> getLPVariables();
 
     void setLPs(OWLParams lp);
@@ -81,9 +91,27 @@ namespace exa {
     OWLGroup    brickTlas;
 
     OWLBuffer   abrMaxOpacities{ 0 };
-    OWLBuffer   brickValueRanges{ 0 };
     OWLBuffer   brickMaxOpacities{ 0 };
 
+    // per-brick value ranges the brick majorants are computed from;
+    // quantized like the grid's w/ EXA_STITCH_GRID_RANGE_BITS < 32
+    OWLBuffer   brickValueRanges{ 0 };
+#if EXA_STITCH_GRID_RANGE_BITS < 32
+    RangeQuantizer<GridRangeCode> brickRangeQuantizer;
+#endif
+
+    // Device-side accessor for brickValueRanges, quantized or not
+    GridValueRanges deviceBrickValueRanges() const;
+
+    // Host copy of the (decoded) brick value ranges
+    std::vector<range1f> hostBrickValueRanges() const;
+
+    MajorantUpdater abrUpdater;
+    MajorantUpdater brickUpdater;
+
+    AdaptiveGrid::SP adaptiveGrid{ 0 };
+    MajorantUpdater  adaptiveGridUpdater;
+
   public: // for grid
     OWLBuffer   abrBuffer{ 0 };
   private:
@@ -98,12 +126,13 @@ namespace exa {
     void initTraversal();
   };
 
+  // Sampler::brickBuffer is read through the accessors in ABRs.h
   template <typename Sampler>
   inline __both__ float getScalar(const Sampler &self,
                                   const int brickID,
                                   const int ix, const int iy, const int iz)
   {
-    const ExaBrick &brick = self.brickBuffer[brickID];
+    const ExaBrick &brick = getBrick(self.brickBuffer,brickID);
     const int idx
       = brick.begin
       + ix
@@ -119,7 +148,7 @@ namespace exa {
                                          const int brickID,
                                          const vec3f pos)
   {
-    const ExaBrick &brick    = self.brickBuffer[brickID];
+    const ExaBrick &brick    = getBrick(self.brickBuffer,brickID);
     const float cellWidth = (1<<brick.level);
     //const float invCellWidth = 1.f/cellWidth;
     const vec3f localPos = (pos - vec3f(brick.lower)) / vec3f(cellWidth) - vec3f(0.5f);
@@ -210,15 +239,15 @@ namespace exa {
     EXA_STITCH_EXA_BRICK_SAMPLER_MODE == EXA_BRICK_SAMPLER_ABR_BVH
     if (domain.domainID != -1) {
 
-    const ABR &abr = lp.abrBuffer[domain.domainID];
+    const int abrID = domain.domainID;
 
 #ifdef EXA_STITCH_MIRROR_EXAJET
-    if (!abr.domain.contains(pos)) {
+    if (!getABRDomain(lp.abrBuffer,abrID).contains(pos)) {
       pos = xfmPoint(lp.mirrorInvTransform,pos);
     }
 #endif
-    const int *childList  = &lp.abrLeafListBuffer[abr.leafListBegin];
-    const int  childCount = abr.leafListSize;
+    const int *childList  = &lp.abrLeafListBuffer[getABRLeafListBegin(lp.abrBuffer,abrID)];
+    const int  childCount = getABRLeafListSize(lp.abrBuffer,abrID);
     float sumWeightedValues = 0.f;
     float sumWeights = 0.f;
     for (int childID=0;childID<childCount;childID++) {
@@ -14,36 +14,395 @@
 // limitations under the License.                                           //
 // ======================================================================== //
 
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <owl/common/parallel/parallel_for.h>
+#include "SpaceFillingCurves.h"
+#include "ExaBrickBasisSIMD.h"
+#include "ParallelBVHBuilder.h"
 #include "ExaBrickSamplerCPU.h"
+#include "model/AccelFile.h"
+#include "model/Hash.h"
+#include "model/RadixSort.h"
 
 namespace exa {
 
+  static ABRPrimitive makeABRPrimitive(const ABRs &abrs, unsigned abrID)
+  {
+    ABRPrimitive prim;
+    prim.prim_id = abrID;
+    prim.domain = abrs.value[abrID].domain;
+    prim.valueRange = abrs.value[abrID].valueRange;
+    prim.leafListBegin = abrs.value[abrID].leafListBegin;
+    prim.leafListSize = abrs.value[abrID].leafListSize;
+    prim.finestLevelCellWidth = abrs.value[abrID].finestLevelCellWidth;
+    return prim;
+  }
+
   bool ExaBrickSamplerCPU::build(ExaBrickModel::SP model)
   {
     using namespace visionaray;
 
     this->model = model;
     brickBuffer = model->bricks.data();
-    scalarBuffer = model->scalars.data();
+    scalarBuffer = model->scalarData();
+
+    if (layout == LAYOUT_SOA) {
+      if (model->abrs.arrays.empty())
+        model->buildSoA();
+      abrSoA = model->abrs.arrays.view();
+    }
+
+    const size_t numPrims = model->abrs.value.size();
 
-    std::vector<ABRPrimitive> prims(model->abrs.value.size());
+    if (!bvhCacheFileName.empty() && loadBVH(bvhCacheFileName)) {
+      std::cout << "#exa: loaded ABR BVH from " << bvhCacheFileName << '\n';
+    } else {
+      std::vector<ABRPrimitive> prims(numPrims);
 
-    for (unsigned i=0; i<prims.size(); ++i) {
-      prims[i].prim_id = i;
-      prims[i].domain = model->abrs.value[i].domain;
-      prims[i].valueRange = model->abrs.value[i].valueRange;
-      prims[i].leafListBegin = model->abrs.value[i].leafListBegin;
-      prims[i].leafListSize = model->abrs.value[i].leafListSize;
-      prims[i].finestLevelCellWidth = model->abrs.value[i].finestLevelCellWidth;
+      parallel_for_blocked(0ull,numPrims,1<<14,[&](size_t begin,size_t end){
+          for (size_t i=begin;i<end;i++) {
+            prims[i] = makeABRPrimitive(model->abrs,(unsigned)i);
+          }
+        });
+
+      if (bvhBuilder == BVH_BUILDER_VISIONARAY) {
+        binned_sah_builder builder;
+        builder.enable_spatial_splits(false);
+        abrBVH = builder.build(index_bvh<ABRPrimitive>{}, prims.data(), prims.size());
+      } else {
+        ParallelBVHBuilder builder;
+        abrBVH = builder.build(prims.data(), prims.size());
+      }
+
+      if (!bvhCacheFileName.empty()) {
+        if (saveBVH(bvhCacheFileName))
+          std::cout << "#exa: wrote ABR BVH to " << bvhCacheFileName << '\n';
+        else
+          std::cerr << "#exa: could not write ABR BVH to " << bvhCacheFileName << '\n';
+      }
     }
 
-    binned_sah_builder builder;
-    builder.enable_spatial_splits(false);
-    abrBVH = builder.build(index_bvh<ABRPrimitive>{}, prims.data(), prims.size());
+    if (withABRNeighbors)
+      buildABRNeighbors();
 
     return true;
   }
 
+  // ABR neighbors: ABRs whose (closed) domains touch
+  void ExaBrickSamplerCPU::buildABRNeighbors()
+  {
+    using namespace visionaray;
+
+    const size_t numPrims = model->abrs.value.size();
+
+    std::vector<std::vector<int>> neighbors(numPrims);
+    parallel_for_blocked(0ull,numPrims,1024,[&](size_t begin, size_t end) {
+      // grows as needed, the BVH depth isn't bounded
+      std::vector<unsigned> traversalStack;
+      for (size_t abrID=begin; abrID<end; ++abrID) {
+        const box3f domain = model->abrs.value[abrID].domain;
+        const aabb query({domain.lower.x,domain.lower.y,domain.lower.z},
+                         {domain.upper.x,domain.upper.y,domain.upper.z});
+
+        traversalStack.clear();
+        traversalStack.push_back(0); // root
+
+        while (!traversalStack.empty()) {
+          auto node = abrBVH.node(traversalStack.back());
+          traversalStack.pop_back();
+
+          if (intersect(node.get_bounds(),query).invalid())
+            continue;
+
+          if (is_inner(node)) {
+            traversalStack.push_back(node.get_child(0));
+            traversalStack.push_back(node.get_child(1));
+          } else {
+            for (unsigned i=node.get_indices().first; i<node.get_indices().last; ++i) {
+              const ABRPrimitive &abr = abrBVH.primitive(i);
+              if (abr.prim_id != abrID && abr.domain.overlaps(domain))
+                neighbors[abrID].push_back((int)abr.prim_id);
+            }
+          }
+        }
+      }
+    });
+
+    abrNeighborsBegin.resize(numPrims+1);
+    abrNeighborsBegin[0] = 0;
+    for (size_t i=0; i<numPrims; ++i) {
+      abrNeighborsBegin[i+1] = abrNeighborsBegin[i]+(int)neighbors[i].size();
+    }
+
+    abrNeighbors.resize(abrNeighborsBegin.back());
+    parallel_for(numPrims,[&](size_t i) {
+      std::copy(neighbors[i].begin(),neighbors[i].end(),
+                abrNeighbors.begin()+abrNeighborsBegin[i]);
+    });
+  }
+
+  // ==================================================================
+  // ABR BVH cache
+  // ==================================================================
+
+  uint64_t ExaBrickSamplerCPU::hashABRs(const ABRs &abrs)
+  {
+    static_assert(sizeof(ABR)%sizeof(uint32_t) == 0, "ABR must consist of 32-bit words");
+
+    uint64_t hash = fnvOffsetBasis;
+    hash = hashArray(abrs.value.data(),abrs.value.size()*sizeof(ABR),hash);
+    hash = hashArray(abrs.leafList.data(),abrs.leafList.size()*sizeof(int),hash);
+    return hash;
+  }
+
+  /*! The cache is an AccelFile with three sections: the hash of the
+    ABRs the BVH was built for, the BVH nodes (stored as-is, the
+    section's element size guards against layout changes), and for
+    each primitive slot the ID of the ABR stored there */
+  bool ExaBrickSamplerCPU::saveBVH(const std::string fileName) const
+  {
+    using namespace visionaray;
+
+    const size_t numPrims = model->abrs.value.size();
+
+    std::vector<bvh_node> nodes(abrBVH.num_nodes());
+    for (size_t i=0; i<nodes.size(); ++i) {
+      nodes[i] = abrBVH.node(i);
+    }
+
+    std::vector<uint32_t> order(numPrims);
+    for (size_t i=0; i<numPrims; ++i) {
+      order[i] = abrBVH.primitive(i).prim_id;
+    }
+
+    const uint64_t abrsHash = hashABRs(model->abrs);
+
+    return AccelFile::write(fileName,model->cellBounds,{
+      {AccelFile::ABR_BVH_KEY,sizeof(abrsHash),1,&abrsHash},
+      {AccelFile::ABR_BVH_NODES,sizeof(bvh_node),nodes.size(),nodes.data()},
+      {AccelFile::ABR_BVH_PRIM_ORDER,sizeof(uint32_t),order.size(),order.data()},
+    });
+  }
+
+  bool ExaBrickSamplerCPU::loadBVH(const std::string fileName)
+  {
+    using namespace visionaray;
+
+    if (!AccelFile::isAccelFile(fileName))
+      return false;
+
+    std::string error;
+    AccelFile::SP file = AccelFile::open(fileName,error);
+    if (!file) {
+      std::cerr << "#exa: " << error << '\n';
+      return false;
+    }
+
+    const AccelFile::Section *nodeSection = file->findSection(AccelFile::ABR_BVH_NODES);
+    const size_t numPrims = model->abrs.value.size();
+
+    size_t numKeys = 0, numOrder = 0;
+    const uint64_t *abrsHash = file->get<uint64_t>(AccelFile::ABR_BVH_KEY,numKeys);
+    file->get<uint32_t>(AccelFile::ABR_BVH_PRIM_ORDER,numOrder);
+    if (!nodeSection || nodeSection->elemSize != sizeof(bvh_node) ||
+        numKeys != 1 || numOrder != numPrims || *abrsHash != hashABRs(model->abrs)) {
+      std::cout << "#exa: ABR BVH in " << fileName << " is outdated, rebuilding\n";
+      return false;
+    }
+
+    std::vector<bvh_node> nodes = file->read<bvh_node>(AccelFile::ABR_BVH_NODES);
+    std::vector<uint32_t> order = file->read<uint32_t>(AccelFile::ABR_BVH_PRIM_ORDER);
+
+    if (nodes.empty() != (numPrims == 0) || nodes.size() > 2*numPrims) {
+      std::cerr << "#exa: corrupt ABR BVH file: " << fileName << '\n';
+      return false;
+    }
+
+    // don't trust indices that'll later be used for traversal: child
+    // and primitive indices must be in range, and every node must be
+    // reached exactly once from the root (no cycles, no shared children)
+    std::vector<bool> reached(nodes.size(),false);
+    std::vector<size_t> stack;
+    if (!nodes.empty())
+      stack.push_back(0);
+    while (!stack.empty()) {
+      const size_t nodeID = stack.back();
+      stack.pop_back();
+
+      if (nodeID >= nodes.size() || reached[nodeID]) {
+        std::cerr << "#exa: corrupt ABR BVH file: " << fileName << '\n';
+        return false;
+      }
+      reached[nodeID] = true;
+
+      const bvh_node &node = nodes[nodeID];
+      if (is_inner(node)) {
+        stack.push_back(node.get_child(0));
+        stack.push_back(node.get_child(1));
+      } else if (node.get_indices().first > node.get_indices().last ||
+                 node.get_indices().last > numPrims) {
+        std::cerr << "#exa: corrupt ABR BVH file: " << fileName << '\n';
+        return false;
+      }
+    }
+
+    std::vector<ABRPrimitive> prims(numPrims);
+    for (size_t i=0; i<numPrims; ++i) {
+      if (order[i] >= numPrims) {
+        std::cerr << "#exa: corrupt ABR BVH file: " << fileName << '\n';
+        return false;
+      }
+      prims[i] = makeABRPrimitive(model->abrs,order[i]);
+    }
+
+    // primitives stored in cache order, so indices are the identity
+    index_bvh<ABRPrimitive> tree(prims.data(),prims.size());
+    tree.nodes().resize(nodes.size());
+    std::copy(nodes.begin(),nodes.end(),tree.nodes().begin());
+    tree.indices().resize(numPrims);
+    for (size_t i=0; i<numPrims; ++i) {
+      tree.indices()[i] = (unsigned)i;
+    }
+
+    abrBVH = std::move(tree);
+    return true;
+  }
+
+  // permutation of [0..count) that sorts positions along the curve
+  static std::vector<unsigned> sortAlongCurve(const vec3f *positions,
+                                              size_t count,
+                                              const box3f &bounds,
+                                              SampleOrder curve)
+  {
+    std::vector<uint64_t> codes(count);
+    std::vector<unsigned> perm(count);
+    parallel_for_blocked(0ull,count,4096,[&](size_t begin,size_t end){
+        for (size_t i=begin;i<end;i++) {
+          const vec3f pt = sfcNormalize(positions[i],bounds);
+          codes[i] = curve == SAMPLE_ORDER_HILBERT
+              ? hilbert64_encode3D(pt.x,pt.y,pt.z)
+              : morton64_encode3D(pt.x,pt.y,pt.z);
+          perm[i] = (unsigned)i;
+        }
+      });
+    radixSortPairs(codes,perm);
+    return perm;
+  }
+
+  //! Add the ABR's basis functions for all positions of the batch
+  template <typename ABRLayout>
+  static void addBasisFunctionsBatch(const ExaBrickSamplerCPU &sampler,
+                                     const ABRLayout &abrs,
+                                     const int abrID,
+                                     BasisBatch &batch)
+  {
+    const int *childList  = &sampler.model->abrs.leafList[getABRLeafListBegin(abrs,abrID)];
+    const int  childCount = getABRLeafListSize(abrs,abrID);
+    for (int childID=0; childID<childCount; ++childID) {
+      addBasisFunctionsBatch(getBrick(sampler,childList[childID]),sampler.scalarBuffer,batch);
+    }
+  }
+
+  void sampleBatch(const ExaBrickSamplerCPU &sampler,
+                   const vec3f *positions,
+                   float *values,
+                   size_t count,
+                   SampleOrder curve)
+  {
+    if (count > UINT_MAX)
+      throw std::runtime_error("sampleBatch: too many positions");
+
+    // positions in processing order, and their ABRs
+    std::vector<unsigned> order;
+    if (curve != SAMPLE_ORDER_INPUT) {
+      order = sortAlongCurve(positions,count,sampler.model->cellBounds,curve);
+    } else {
+      order.resize(count);
+      std::iota(order.begin(),order.end(),0u);
+    }
+
+    std::vector<int> abrIDs(count);
+    parallel_for_blocked(0ull,count,4096,[&](size_t begin,size_t end){
+        for (size_t i=begin;i<end;i++) {
+          abrIDs[i] = findABR(sampler,positions[order[i]]);
+        }
+      });
+
+    // in input order, positions of an ABR are scattered, so they're
+    // grouped by ABR (stable, keeping input order within the group);
+    // along a curve, consecutive positions share ABRs, and the runs
+    // of equal ABRs are the groups, so the curve order is kept
+    if (curve == SAMPLE_ORDER_INPUT) {
+      std::vector<uint32_t> keys(count);
+      parallel_for_blocked(0ull,count,4096,[&](size_t begin,size_t end){
+          for (size_t i=begin;i<end;i++) {
+            keys[i] = uint32_t(abrIDs[i]+1); // outside (-1) first
+          }
+        });
+      radixSortPairs(keys,order);
+      parallel_for_blocked(0ull,count,4096,[&](size_t begin,size_t end){
+          for (size_t i=begin;i<end;i++) {
+            abrIDs[i] = int(keys[i])-1;
+          }
+        });
+    }
+
+    std::vector<std::pair<size_t,size_t>> groups;
+    for (size_t i=0; i<count;) {
+      size_t j = i+1;
+      while (j < count && abrIDs[j] == abrIDs[i])
+        ++j;
+      groups.push_back({i,j});
+      i = j;
+    }
+
+    parallel_for(groups.size(),[&](size_t groupID) {
+      const size_t begin = groups[groupID].first;
+      const size_t end = groups[groupID].second;
+      const int abrID = abrIDs[begin];
+
+      if (abrID < 0) {
+        for (size_t i=begin; i<end; ++i)
+          values[order[i]] = 0.f;
+        return;
+      }
+
+      const size_t n = end-begin;
+      std::vector<float> soa(5*n,0.f);
+      BasisBatch batch;
+      batch.px = soa.data();
+      batch.py = soa.data()+n;
+      batch.pz = soa.data()+2*n;
+      batch.sumWeightedValues = soa.data()+3*n;
+      batch.sumWeights = soa.data()+4*n;
+      batch.count = n;
+
+      for (size_t i=0; i<n; ++i) {
+        const vec3f pos = positions[order[begin+i]];
+        soa[i] = pos.x;
+        soa[n+i] = pos.y;
+        soa[2*n+i] = pos.z;
+      }
+
+      if (sampler.layout == ExaBrickSamplerCPU::LAYOUT_SOA)
+        addBasisFunctionsBatch(sampler,sampler.abrSoA,abrID,batch);
+      else
+        addBasisFunctionsBatch(sampler,sampler.model->abrs.value.data(),abrID,batch);
+
+      for (size_t i=0; i<n; ++i) {
+        const float sumWeights = batch.sumWeights[i];
+        values[order[begin+i]]
+          = sumWeights != 0.f ? batch.sumWeightedValues[i]/sumWeights : 0.f;
+      }
+    });
+  }
+
 } // ::exa
 
 // vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <cstdint>
+#include <string>
 #include <visionaray/bvh.h>
 #include <visionaray/traverse.h>
 #include "ExaBrickSampler.h"
@@ -75,18 +77,78 @@ namespace exa {
 
     bool build(ExaBrickModel::SP model);
 
+    /*! Builder used for abrBVH: the multi-threaded binned SAH builder
+      from ParallelBVHBuilder.h, or visionaray's (single-threaded)
+      binned_sah_builder */
+    enum BVHBuilder { BVH_BUILDER_PARALLEL, BVH_BUILDER_VISIONARAY };
+    BVHBuilder bvhBuilder = BVH_BUILDER_PARALLEL;
+
+    /*! If set, build() tries to load abrBVH from this file first; if
+      that fails (no such file, or it was built for other ABRs), the
+      BVH is built and then written to the file, so that subsequent
+      runs on the same data skip the build */
+    std::string bvhCacheFileName = "";
+
+    /*! Write abrBVH (nodes and primitive order) to fileName as an
+      AccelFile, keyed by the hash of the ABRs it was built for */
+    bool saveBVH(const std::string fileName) const;
+
+    /*! Load abrBVH from fileName; fails if the file was written for
+      ABRs other than model->abrs, or if its nodes don't form a tree */
+    bool loadBVH(const std::string fileName);
+
+    //! Hash over the ABRs' domains, value ranges, and leaf lists
+    static uint64_t hashABRs(const ABRs &abrs);
+
     visionaray::index_bvh<ABRPrimitive> abrBVH;
 
     ExaBrickModel::SP model = nullptr;
 
     ExaBrick *brickBuffer = nullptr;
-    float *scalarBuffer = nullptr;
+    const float *scalarBuffer = nullptr;
+
+    /*! Layout the sampling functions read ABRs from; with LAYOUT_SOA,
+      build() creates the model's hot/cold split copy of the ABRs (see
+      ExaBrickModel::buildSoA()) and sets abrSoA. Bricks are always
+      read from brickBuffer */
+    enum Layout { LAYOUT_AOS, LAYOUT_SOA };
+    Layout layout = LAYOUT_AOS;
+
+    ABRSoA abrSoA;
+
+    /*! If set, build() also computes abrNeighbors; only worth it when
+      sampling through a SampleCursor, which otherwise falls back to
+      traversing the BVH whenever it leaves its ABR */
+    bool withABRNeighbors = false;
+
+    //! (Re-)compute abrNeighbors from abrBVH
+    void buildABRNeighbors();
+
+    /*! ABRs touching each ABR (CSR: abrNeighbors[abrNeighborsBegin[i]..
+      abrNeighborsBegin[i+1]]), used by SampleCursor to step from one
+      ABR to the next w/o traversing the BVH */
+    std::vector<int> abrNeighborsBegin;
+    std::vector<int> abrNeighbors;
+  };
+
+  /*! Sampling state for coherent sample sequences (e.g., marching a
+    ray): remembers the last ABR, so that the BVH is only traversed
+    when the position left the ABR and none of its neighbors contains
+    it either. The CPU counterpart to CACHING in the device code */
+  struct SampleCursor
+  {
+    int   abrID = -1;
+    box3f domain;
+
+    // Statistics
+    size_t numSamples = 0;
+    size_t numNeighborSteps = 0;
+    size_t numTraversals = 0;
   };
 
+  //! Locate the ABR containing pos, -1 if none
   inline __host__
-  Sample sample(const ExaBrickSamplerCPU &sampler,
-                const SpatialDomain &domain,
-                vec3f pos)
+  int findABR(const ExaBrickSamplerCPU &sampler, const vec3f pos)
   {
     visionaray::basic_ray<float> r;
     r.ori = visionaray::vec3(pos.x,pos.y,pos.z);
@@ -94,26 +156,145 @@ namespace exa {
     r.tmin = 0.f;
     r.tmax = 0.f;
     auto abrBVH = sampler.abrBVH.ref();
-    std::vector<decltype(abrBVH)> refs;
-    refs.push_back(abrBVH);
-    auto hr = visionaray::closest_hit(r,refs.begin(),refs.end());
-
-    if (hr.hit) {
-      const ABR &abr = sampler.model->abrs.value[hr.prim_id];
-      const int *childList  = &sampler.model->abrs.leafList[abr.leafListBegin];
-      const int  childCount = abr.leafListSize;
-      float sumWeightedValues = 0.f;
-      float sumWeights = 0.f;
-      for (int childID=0;childID<childCount;childID++) {
-        const int brickID = childList[childID];
-        addBasisFunctions(sampler, sumWeightedValues, sumWeights, brickID, pos);
+    auto hr = visionaray::closest_hit(r,&abrBVH,&abrBVH+1);
+    return hr.hit ? (int)hr.prim_id : -1;
+  }
+
+  //! Brick of the sampler (always AoS, see Layout)
+  inline __host__
+  const ExaBrick &getBrick(const ExaBrickSamplerCPU &sampler, const int brickID)
+  {
+    return getBrick(sampler.brickBuffer,brickID);
+  }
+
+  //! ABR domain of the sampler's layout
+  inline __host__
+  const box3f &getABRDomain(const ExaBrickSamplerCPU &sampler, const int abrID)
+  {
+    if (sampler.layout == ExaBrickSamplerCPU::LAYOUT_SOA)
+      return getABRDomain(sampler.abrSoA,abrID);
+    else
+      return getABRDomain(sampler.model->abrs.value.data(),abrID);
+  }
+
+  /*! Bricks and scalars the way addBasisFunctions() expects them */
+  template <typename Bricks>
+  struct BrickAccess {
+    Bricks       brickBuffer;
+    const float *scalarBuffer;
+  };
+
+  //! Sample inside a given ABR (that must contain pos), for either layout
+  template <typename Bricks, typename ABRLayout>
+  inline __host__
+  Sample sampleABR(const BrickAccess<Bricks> &bricks,
+                   const ABRLayout &abrs,
+                   const int *leafList,
+                   const int abrID,
+                   const vec3f pos)
+  {
+    const int *childList  = &leafList[getABRLeafListBegin(abrs,abrID)];
+    const int  childCount = getABRLeafListSize(abrs,abrID);
+    float sumWeightedValues = 0.f;
+    float sumWeights = 0.f;
+    for (int childID=0;childID<childCount;childID++) {
+      const int brickID = childList[childID];
+      addBasisFunctions(bricks, sumWeightedValues, sumWeights, brickID, pos);
+    }
+
+    return {0,-1,sumWeights!=0.f?sumWeightedValues/sumWeights:0.f};
+  }
+
+  //! Sample inside a given ABR (that must contain pos)
+  inline __host__
+  Sample sampleABR(const ExaBrickSamplerCPU &sampler,
+                   const int abrID,
+                   const vec3f pos)
+  {
+    const int *leafList = sampler.model->abrs.leafList.data();
+    const BrickAccess<const ExaBrick *> bricks{sampler.brickBuffer,sampler.scalarBuffer};
+    if (sampler.layout == ExaBrickSamplerCPU::LAYOUT_SOA)
+      return sampleABR(bricks,sampler.abrSoA,leafList,abrID,pos);
+    else
+      return sampleABR(bricks,sampler.model->abrs.value.data(),leafList,abrID,pos);
+  }
+
+  inline __host__
+  Sample sample(const ExaBrickSamplerCPU &sampler,
+                const SpatialDomain &domain,
+                vec3f pos)
+  {
+    const int abrID = findABR(sampler,pos);
+
+    if (abrID >= 0) {
+      return sampleABR(sampler,abrID,pos);
+    } else {
+      return {-1,-1,0.f};
+    }
+  }
+
+  inline __host__
+  Sample sample(const ExaBrickSamplerCPU &sampler,
+                SampleCursor &cursor,
+                vec3f pos)
+  {
+    cursor.numSamples++;
+
+    if (cursor.abrID < 0 || !cursor.domain.contains(pos)) {
+      int abrID = -1;
+
+      if (cursor.abrID >= 0 && !sampler.abrNeighborsBegin.empty()) {
+        const int begin = sampler.abrNeighborsBegin[cursor.abrID];
+        const int end   = sampler.abrNeighborsBegin[cursor.abrID+1];
+        for (int i=begin; i<end; ++i) {
+          const int neighborID = sampler.abrNeighbors[i];
+          if (getABRDomain(sampler,neighborID).contains(pos)) {
+            abrID = neighborID;
+            cursor.numNeighborSteps++;
+            break;
+          }
+        }
       }
 
-      return {0,-1,sumWeights!=0.f?sumWeightedValues/sumWeights:0.f};
+      if (abrID < 0) {
+        abrID = findABR(sampler,pos);
+        cursor.numTraversals++;
+      }
+
+      cursor.abrID = abrID;
+      cursor.domain = abrID >= 0 ? getABRDomain(sampler,abrID) : box3f();
+    }
+
+    if (cursor.abrID >= 0) {
+      return sampleABR(sampler,cursor.abrID,pos);
     } else {
       return {-1,-1,0.f};
     }
   }
+
+  /*! Order in which sampleBatch() processes the positions; with
+    MORTON/HILBERT, positions are first sorted along the space-filling
+    curve (over the model bounds), so that BVH traversals and brick
+    accesses of consecutive positions hit the same cache lines */
+  enum SampleOrder {
+    SAMPLE_ORDER_INPUT,
+    SAMPLE_ORDER_MORTON,
+    SAMPLE_ORDER_HILBERT,
+  };
+
+  /*! Batched sampling: positions are located in the ABR BVH, grouped
+    by ABR, and each of the ABR's bricks is then evaluated for all of
+    the group's positions at once using the SIMD basis-function kernel
+    (see ExaBrickBasisSIMD.h), for either ABR layout. In input order,
+    all positions of an ABR form one group; along a curve, groups are
+    runs of consecutive positions in the same ABR, so processing
+    follows the curve. Results are always written in input order.
+    Positions outside the model yield 0 */
+  void sampleBatch(const ExaBrickSamplerCPU &sampler,
+                   const vec3f *positions,
+                   float *values,
+                   size_t count,
+                   SampleOrder order = SAMPLE_ORDER_INPUT);
 } // ::exa
 
 // vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
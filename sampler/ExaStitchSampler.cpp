@@ -38,6 +38,7 @@ namespace exa {
        { "indexBuffer",  OWL_BUFPTR, OWL_OFFSETOF(StitchGeom,indexBuffer)},
        { "vertexBuffer",  OWL_BUFPTR, OWL_OFFSETOF(StitchGeom,vertexBuffer)},
        { "maxOpacities", OWL_BUFPTR, OWL_OFFSETOF(StitchGeom,maxOpacities)},
+       { "uelemCache", OWL_USER_TYPE(UElemCacheView), OWL_OFFSETOF(StitchGeom,uelemCache)},
        { nullptr /* sentinel to mark end of list */ }
     };
 
@@ -240,6 +241,23 @@ namespace exa {
       owlGeomSetBuffer(geom,"indexBuffer",indexBuffer);
       owlGeomSetBuffer(geom,"maxOpacities",umeshMaxOpacities);
 
+      // element geometry cache, if the model built one
+      const UElemCache &cache = model->uelemCache;
+      auto upload = [&](OWLBuffer &buffer, const auto &values) {
+        typedef typename std::decay<decltype(values)>::type::value_type T;
+        if (values.empty())
+          return (const T *)nullptr;
+        buffer = owlDeviceBufferCreate(context,OWL_USER_TYPE(T),values.size(),values.data());
+        return (const T *)owlBufferGetPointer(buffer,0);
+      };
+      UElemCacheView cacheView;
+      cacheView.level   = cache.level;
+      cacheView.slots   = upload(uelemCacheBuffers.slots,cache.slots);
+      cacheView.tets    = upload(uelemCacheBuffers.tets,cache.tets);
+      cacheView.bounds  = upload(uelemCacheBuffers.bounds,cache.bounds);
+      cacheView.guesses = upload(uelemCacheBuffers.guesses,cache.guesses);
+      owlGeomSetRaw(geom,"uelemCache",&cacheView);
+
       owlBuildPrograms(context);
 
       stitchGeom.blas = owlUserGeomGroupCreate(context, 1, &geom);
@@ -141,48 +141,26 @@ namespace exa {
     atomicMax(&valueRanges[gridletID].upper,valueRange.upper);
   }
 
-  static __global__ void computeGridletMaxOpacitiesGPU(float         *maxOpacities,
-                                                       const range1f *valueRanges,
-                                                       const vec4f   *colorMap,
-                                                       size_t         numValueRanges,
-                                                       size_t         numColors,
-                                                       range1f        xfRange)
+  static __global__ void computeGridletMaxOpacitiesGPU(float                 *maxOpacities,
+                                                       const range1f         *valueRanges,
+                                                       TFRangeMaxTraversable  xfRangeMax,
+                                                       size_t                 numValueRanges,
+                                                       range1f                xfRange)
   {
     size_t threadID = blockIdx.x * size_t(blockDim.x) + threadIdx.x;
     if (threadID >= numValueRanges)
       return;
 
-    range1f valueRange = valueRanges[threadID];
-
-    if (valueRange.upper < valueRange.lower) {
-      maxOpacities[threadID] = 0.f;
-      return;
-    }
-
-    valueRange.lower -= xfRange.lower;
-    valueRange.lower /= xfRange.upper-xfRange.lower;
-    valueRange.upper -= xfRange.lower;
-    valueRange.upper /= xfRange.upper-xfRange.lower;
-
-    int lo = clamp(int(valueRange.lower*(numColors-1)),  0,(int)numColors-1);
-    int hi = clamp(int(valueRange.upper*(numColors-1))+1,0,(int)numColors-1);
-
-    float maxOpacity = 0.f;
-    for (int i=lo; i<=hi; ++i) {
-      maxOpacity = fmaxf(maxOpacity,colorMap[i].w);
-    }
-
-    maxOpacities[threadID] = maxOpacity;
+    maxOpacities[threadID] = maxOpacity(valueRanges[threadID],xfRangeMax,xfRange);
   }
 
   template <int NumVertsMax=8>
-  static __global__ void computeUmeshMaxOpacitiesGPU(float       *maxOpacities,
-                                                     const vec4f *vertices,
-                                                     const int   *indices,
-                                                     size_t       numElements,
-                                                     const vec4f *colorMap,
-                                                     size_t       numColors,
-                                                     range1f      xfRange)
+  static __global__ void computeUmeshMaxOpacitiesGPU(float                 *maxOpacities,
+                                                     const vec4f           *vertices,
+                                                     const int             *indices,
+                                                     size_t                 numElements,
+                                                     TFRangeMaxTraversable  xfRangeMax,
+                                                     range1f                xfRange)
   {
     size_t threadID = blockIdx.x * size_t(blockDim.x) + threadIdx.x;
     if (threadID >= numElements)
@@ -205,25 +183,7 @@ namespace exa {
       valueRange.upper = max(valueRange.upper,v[i].w);
     }
 
-    if (valueRange.upper < valueRange.lower) {
-      maxOpacities[threadID] = 0.f;
-      return;
-    }
-
-    valueRange.lower -= xfRange.lower;
-    valueRange.lower /= xfRange.upper-xfRange.lower;
-    valueRange.upper -= xfRange.lower;
-    valueRange.upper /= xfRange.upper-xfRange.lower;
-
-    int lo = clamp(int(valueRange.lower*(numColors-1)),  0,(int)numColors-1);
-    int hi = clamp(int(valueRange.upper*(numColors-1))+1,0,(int)numColors-1);
-
-    float maxOpacity = 0.f;
-    for (int i=lo; i<=hi; ++i) {
-      maxOpacity = fmaxf(maxOpacity,colorMap[i].w);
-    }
-
-    maxOpacities[threadID] = maxOpacity;
+    maxOpacities[threadID] = maxOpacity(valueRange,xfRangeMax,xfRange);
   }
 
   void ExaStitchSampler::computeGridletValueRanges(OWLContext owl)
@@ -283,16 +243,17 @@ namespace exa {
 
     model->grid->computeMaxOpacities(owl,colorMap,xfRange);
 
+    xfRangeMax.build(owl,colorMap);
+
     if (!model->gridlets.empty())
     {
-      size_t numColors = owlBufferSizeInBytes(colorMap)/sizeof(vec4f);
       size_t numThreads = 1024;
 
       computeGridletMaxOpacitiesGPU<<<(uint32_t)iDivUp(model->gridlets.size(), numThreads), (uint32_t)numThreads>>>(
         (float *)owlBufferGetPointer(gridletMaxOpacities,0),
         (const range1f *)owlBufferGetPointer(gridletValueRanges,0),
-        (const vec4f *)owlBufferGetPointer(colorMap,0),
-        model->gridlets.size(),numColors,xfRange);
+        xfRangeMax.traversable(),
+        model->gridlets.size(),xfRange);
 
       owlGroupBuildAccel(gridletGeom.blas);
       owlGroupBuildAccel(tlas);
@@ -312,7 +273,6 @@ namespace exa {
         continue;
       }
 
-      size_t numColors = owlBufferSizeInBytes(colorMap)/sizeof(vec4f);
       size_t numThreads = 1024;
 
       if (type==TET) {std::cout << indices[type]->size()/4 << '\n';
@@ -321,8 +281,8 @@ namespace exa {
           (const vec4f *)owlBufferGetPointer(vertexBuffer,0),
           (const int *)owlBufferGetPointer(indexBuffers[type],0),
           indices[type]->size()/4,
-          (const vec4f *)owlBufferGetPointer(colorMap,0),
-          numColors,xfRange);
+          xfRangeMax.traversable(),
+          xfRange);
       }
       else if (type==PYR) {
         computeUmeshMaxOpacitiesGPU<5><<<iDivUp(indices[type]->size()/5, numThreads), numThreads>>>(
@@ -330,8 +290,8 @@ namespace exa {
           (const vec4f *)owlBufferGetPointer(vertexBuffer,0),
           (const int *)owlBufferGetPointer(indexBuffers[type],0),
           indices[type]->size()/5,
-          (const vec4f *)owlBufferGetPointer(colorMap,0),
-          numColors,xfRange);
+          xfRangeMax.traversable(),
+          xfRange);
       }
       else if (type==WEDGE) {
         computeUmeshMaxOpacitiesGPU<6><<<iDivUp(indices[type]->size()/6, numThreads), numThreads>>>(
@@ -339,8 +299,8 @@ namespace exa {
           (const vec4f *)owlBufferGetPointer(vertexBuffer,0),
           (const int *)owlBufferGetPointer(indexBuffers[type],0),
           indices[type]->size()/6,
-          (const vec4f *)owlBufferGetPointer(colorMap,0),
-          numColors,xfRange);
+          xfRangeMax.traversable(),
+          xfRange);
       }
       else if (type==HEX) {
         computeUmeshMaxOpacitiesGPU<8><<<iDivUp(indices[type]->size()/8, numThreads), numThreads>>>(
@@ -348,8 +308,8 @@ namespace exa {
           (const vec4f *)owlBufferGetPointer(vertexBuffer,0),
           (const int *)owlBufferGetPointer(indexBuffers[type],0),
           indices[type]->size()/8,
-          (const vec4f *)owlBufferGetPointer(colorMap,0),
-          numColors,xfRange);
+          xfRangeMax.traversable(),
+          xfRange);
       }
 
       owlGroupBuildAccel(stitchGeom[type].blas);
@@ -358,7 +318,6 @@ namespace exa {
 #else
     if (!model->indices.empty())
     {
-      size_t numColors = owlBufferSizeInBytes(colorMap)/sizeof(vec4f);
       size_t numThreads = 1024;
 
       computeUmeshMaxOpacitiesGPU<8><<<iDivUp(model->indices.size()/8, numThreads), numThreads>>>(
@@ -366,8 +325,8 @@ namespace exa {
         (const vec4f *)owlBufferGetPointer(vertexBuffer,0),
         (const int *)owlBufferGetPointer(indexBuffer,0),
         model->indices.size()/8,
-        (const vec4f *)owlBufferGetPointer(colorMap,0),
-        numColors,xfRange);
+        xfRangeMax.traversable(),
+        xfRange);
 
       owlGroupBuildAccel(stitchGeom.blas);
       owlGroupBuildAccel(tlas);
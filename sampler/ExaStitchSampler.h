@@ -32,6 +32,7 @@ namespace exa {
     int   *indexBuffer;
     vec4f *vertexBuffer;
     float *maxOpacities;
+    UElemCacheView uelemCache; // level NONE if the model has none
   };
 
   class ExaStitchSampler : public Sampler {
@@ -94,6 +95,14 @@ namespace exa {
     OWLBuffer gridletScalarBuffer{ 0 };
   private:
 
+    // see UElemCache
+    struct {
+      OWLBuffer slots{ 0 };
+      OWLBuffer tets{ 0 };
+      OWLBuffer bounds{ 0 };
+      OWLBuffer guesses{ 0 };
+    } uelemCacheBuffers;
+
     OWLBuffer gridletValueRanges{ 0 };
     OWLBuffer gridletMaxOpacities{ 0 };
 #ifdef EXA_STITCH_SEPARATE_INDEX_BUFFERS_PER_UELEM
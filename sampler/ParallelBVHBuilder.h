@@ -0,0 +1,620 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <owl/common/parallel/parallel_for.h>
+#include <visionaray/bvh.h>
+#include "model/ParallelReduce.h"
+
+namespace exa {
+
+  /*! Multi-threaded binned SAH builder for visionaray index BVHs, a
+    drop-in replacement for visionaray::binned_sah_builder (w/o
+    spatial splits). The top of the tree is split w/ parallel binning
+    and partitioning until there are enough independent subtrees to
+    keep all threads busy; these are then built in parallel. Nodes are
+    laid out depth-first (the two children of a node are adjacent, the
+    left child's subtree directly follows them), and the primitives
+    are stored in leaf order so that indices() is the identity */
+  struct ParallelBVHBuilder
+  {
+    enum { NUM_BINS = 16 };
+
+    int maxLeafSize = 4;
+    //! SAH traversal cost, relative to intersecting a primitive
+    float traversalCost = 1.f;
+
+    template <typename P>
+    visionaray::index_bvh<P> build(const P *prims, size_t count) const;
+
+    // ================================================================
+    // internals
+    // ================================================================
+
+    struct Bin {
+      box3f  bounds;
+      size_t count = 0;
+    };
+
+    struct BinSet {
+      Bin bins[3][NUM_BINS];
+
+      BinSet &extend(const BinSet &other)
+      {
+        for (int axis=0; axis<3; ++axis) {
+          for (int i=0; i<NUM_BINS; ++i) {
+            bins[axis][i].bounds.extend(other.bins[axis][i].bounds);
+            bins[axis][i].count += other.bins[axis][i].count;
+          }
+        }
+        return *this;
+      }
+    };
+
+    //! Primitive range, and the bounds of the primitives and centroids
+    struct Task {
+      size_t begin, end;
+      box3f  bounds;
+      box3f  centroidBounds;
+    };
+
+    struct Split {
+      int    axis = -1; // -1: make a leaf
+      int    bin  = 0;  // first bin on the right
+      float  cost = 0.f;
+      box3f  leftBounds, rightBounds;
+      size_t leftCount = 0;
+    };
+
+    //! Node in build order; children are either other (top) nodes or
+    //! subtrees that are built later
+    struct TmpNode {
+      box3f    bounds;
+      int      axis = 0;
+      int      child[2] = {-1,-1}; // >=0: TmpNode, <0: -1-subtreeID
+    };
+
+    //! Shared build state
+    struct State {
+      std::vector<box3f>    primBounds;
+      std::vector<vec3f>    centroids;
+      std::vector<uint32_t> ids; // permuted in place
+      std::vector<uint32_t> tmpIDs;
+    };
+
+    //! Maps centroids to bins along an axis
+    struct Binner {
+      float lower[3];
+      float scale[3]; // 0 if the centroids don't extend along the axis
+
+      Binner(const box3f &centroidBounds)
+      {
+        for (int axis=0; axis<3; ++axis) {
+          const float extent = centroidBounds.upper[axis]-centroidBounds.lower[axis];
+          lower[axis] = centroidBounds.lower[axis];
+          scale[axis] = extent > 0.f ? NUM_BINS/extent : 0.f;
+        }
+      }
+
+      inline int operator()(int axis, const vec3f &centroid) const
+      {
+        const int bin = int((centroid[axis]-lower[axis])*scale[axis]);
+        return std::max(0,std::min(int(NUM_BINS)-1,bin));
+      }
+    };
+
+    inline static float halfArea(const box3f &box)
+    {
+      const vec3f d = box.upper-box.lower;
+      return d.x*d.y+d.y*d.z+d.z*d.x;
+    }
+
+    inline static visionaray::aabb toAABB(const box3f &box)
+    {
+      return {{box.lower.x,box.lower.y,box.lower.z},
+              {box.upper.x,box.upper.y,box.upper.z}};
+    }
+
+    inline void binRange(const State &state, const Task &task,
+                         size_t begin, size_t end, BinSet &result) const
+    {
+      const Binner binner(task.centroidBounds);
+      for (size_t i=begin; i<end; ++i) {
+        const uint32_t id = state.ids[i];
+        const box3f &primBounds = state.primBounds[id];
+        const vec3f &centroid = state.centroids[id];
+        for (int axis=0; axis<3; ++axis) {
+          if (binner.scale[axis] == 0.f)
+            continue;
+          Bin &bin = result.bins[axis][binner(axis,centroid)];
+          bin.bounds.extend(primBounds);
+          bin.count++;
+        }
+      }
+    }
+
+    inline Split findSplit(const Task &task, const BinSet &binSet) const
+    {
+      const size_t count = task.end-task.begin;
+
+      Split best;
+      best.cost = float(count); // cost of making a leaf
+
+      const float rcpArea = 1.f/std::max(halfArea(task.bounds),1e-30f);
+
+      for (int axis=0; axis<3; ++axis) {
+        if (task.centroidBounds.upper[axis] <= task.centroidBounds.lower[axis])
+          continue;
+
+        const Bin *bins = binSet.bins[axis];
+
+        // sweep from the right, then evaluate from the left
+        float rightCost[NUM_BINS];
+        size_t rightCount[NUM_BINS];
+        box3f accum;
+        size_t accumCount = 0;
+        for (int i=NUM_BINS-1; i>0; --i) {
+          accum.extend(bins[i].bounds);
+          accumCount += bins[i].count;
+          rightCost[i] = halfArea(accum)*accumCount;
+          rightCount[i] = accumCount;
+        }
+
+        int bestBin = -1;
+        accum = box3f();
+        accumCount = 0;
+        for (int i=1; i<NUM_BINS; ++i) {
+          accum.extend(bins[i-1].bounds);
+          accumCount += bins[i-1].count;
+          if (accumCount == 0 || rightCount[i] == 0)
+            continue;
+
+          const float cost = traversalCost
+              + (halfArea(accum)*accumCount+rightCost[i])*rcpArea;
+          if (cost < best.cost) {
+            best.cost = cost;
+            bestBin = i;
+          }
+        }
+
+        if (bestBin >= 0) {
+          best.axis = axis;
+          best.bin = bestBin;
+          best.leftBounds = best.rightBounds = box3f();
+          for (int i=0; i<bestBin; ++i)
+            best.leftBounds.extend(bins[i].bounds);
+          for (int i=bestBin; i<NUM_BINS; ++i)
+            best.rightBounds.extend(bins[i].bounds);
+          best.leftCount = size_t(-1); // set by partition
+        }
+      }
+
+      return best;
+    }
+
+    /*! split primitives in half at the object median along the widest
+      centroid axis; used when SAH says "leaf" but there are too many
+      primitives, or all centroids coincide */
+    inline Split medianSplit(State &state, const Task &task) const
+    {
+      const vec3f extent = task.centroidBounds.upper-task.centroidBounds.lower;
+      const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+      const size_t mid = (task.begin+task.end)/2;
+      std::nth_element(state.ids.begin()+task.begin,
+                       state.ids.begin()+mid,
+                       state.ids.begin()+task.end,
+                       [&](uint32_t a, uint32_t b) {
+                         return state.centroids[a][axis] < state.centroids[b][axis];
+                       });
+      Split split;
+      split.axis = axis;
+      split.bin = -1; // partitioned already
+      split.leftCount = mid-task.begin;
+      return split;
+    }
+
+    //! Partition serially; fills in the children's bounds
+    inline void partition(State &state, const Task &task, Split &split,
+                          Task &left, Task &right) const
+    {
+      const bool binned = split.bin >= 0;
+      if (binned) {
+        const Binner binner(task.centroidBounds);
+        auto mid = std::partition(state.ids.begin()+task.begin,
+                                  state.ids.begin()+task.end,
+                                  [&](uint32_t id) {
+                                    return binner(split.axis,state.centroids[id]) < split.bin;
+                                  });
+        split.leftCount = size_t(mid-state.ids.begin())-task.begin;
+      }
+
+      left.begin = task.begin;
+      left.end = right.begin = task.begin+split.leftCount;
+      right.end = task.end;
+      left.centroidBounds = right.centroidBounds = box3f();
+      if (binned) {
+        left.bounds = split.leftBounds;
+        right.bounds = split.rightBounds;
+      } else {
+        left.bounds = right.bounds = box3f();
+      }
+
+      for (size_t i=left.begin; i<left.end; ++i) {
+        if (!binned)
+          left.bounds.extend(state.primBounds[state.ids[i]]);
+        left.centroidBounds.extend(state.centroids[state.ids[i]]);
+      }
+      for (size_t i=right.begin; i<right.end; ++i) {
+        if (!binned)
+          right.bounds.extend(state.primBounds[state.ids[i]]);
+        right.centroidBounds.extend(state.centroids[state.ids[i]]);
+      }
+    }
+
+    //! Partition w/ all threads (stable, through tmpIDs)
+    inline void parallelPartition(State &state, const Task &task, const Split &split,
+                                  Task &left, Task &right) const
+    {
+      const size_t blockSize = 1<<16;
+      const size_t count = task.end-task.begin;
+      const size_t numBlocks = (count+blockSize-1)/blockSize;
+
+      struct BlockInfo {
+        size_t numLeft = 0;
+        box3f  centroidBounds[2];
+      };
+      std::vector<BlockInfo> blocks(numBlocks);
+
+      const Binner binner(task.centroidBounds);
+      auto isLeft = [&](uint32_t id) {
+        return binner(split.axis,state.centroids[id]) < split.bin;
+      };
+
+      parallel_for(numBlocks,[&](size_t blockID) {
+        const size_t begin = task.begin+blockID*blockSize;
+        const size_t end = std::min(task.end,begin+blockSize);
+        BlockInfo &info = blocks[blockID];
+        for (size_t i=begin; i<end; ++i) {
+          const uint32_t id = state.ids[i];
+          const bool l = isLeft(id);
+          info.numLeft += l;
+          info.centroidBounds[l?0:1].extend(state.centroids[id]);
+        }
+      });
+
+      std::vector<size_t> leftOffsets(numBlocks), rightOffsets(numBlocks);
+      size_t numLeft = 0;
+      for (size_t i=0; i<numBlocks; ++i) {
+        leftOffsets[i] = numLeft;
+        numLeft += blocks[i].numLeft;
+      }
+      size_t numRight = 0;
+      for (size_t i=0; i<numBlocks; ++i) {
+        rightOffsets[i] = numLeft+numRight;
+        numRight += (std::min(count,(i+1)*blockSize)-i*blockSize)-blocks[i].numLeft;
+      }
+
+      parallel_for(numBlocks,[&](size_t blockID) {
+        const size_t begin = task.begin+blockID*blockSize;
+        const size_t end = std::min(task.end,begin+blockSize);
+        size_t l = task.begin+leftOffsets[blockID];
+        size_t r = task.begin+rightOffsets[blockID];
+        for (size_t i=begin; i<end; ++i) {
+          const uint32_t id = state.ids[i];
+          if (isLeft(id))
+            state.tmpIDs[l++] = id;
+          else
+            state.tmpIDs[r++] = id;
+        }
+      });
+
+      parallel_for(numBlocks,[&](size_t blockID) {
+        const size_t begin = task.begin+blockID*blockSize;
+        const size_t end = std::min(task.end,begin+blockSize);
+        std::copy(state.tmpIDs.begin()+begin,state.tmpIDs.begin()+end,state.ids.begin()+begin);
+      });
+
+      left.begin = task.begin;
+      left.end = right.begin = task.begin+numLeft;
+      right.end = task.end;
+      left.bounds = split.leftBounds;
+      right.bounds = split.rightBounds;
+      left.centroidBounds = right.centroidBounds = box3f();
+      for (const BlockInfo &info : blocks) {
+        left.centroidBounds.extend(info.centroidBounds[0]);
+        right.centroidBounds.extend(info.centroidBounds[1]);
+      }
+    }
+
+    //! Serial recursive build of a subtree in depth-first layout;
+    //! nodes[nodeID] must exist, child pairs are appended
+    inline void buildSubtree(State &state, const Task &task,
+                             std::vector<visionaray::bvh_node> &nodes,
+                             size_t nodeID) const
+    {
+      const size_t count = task.end-task.begin;
+
+      Split split;
+      if (count > 1) {
+        BinSet binSet;
+        binRange(state,task,task.begin,task.end,binSet);
+        split = findSplit(task,binSet);
+        if (split.axis < 0 && count > (size_t)maxLeafSize)
+          split = medianSplit(state,task);
+      }
+
+      if (split.axis < 0) {
+        nodes[nodeID].set_leaf(toAABB(task.bounds),(unsigned)task.begin,(unsigned)count);
+        return;
+      }
+
+      Task left, right;
+      partition(state,task,split,left,right);
+
+      const size_t firstChild = nodes.size();
+      nodes.resize(nodes.size()+2);
+      nodes[nodeID].set_inner(toAABB(task.bounds),(unsigned)firstChild,
+                              (unsigned char)split.axis,0);
+      buildSubtree(state,left,nodes,firstChild);
+      buildSubtree(state,right,nodes,firstChild+1);
+    }
+  };
+
+  template <typename P>
+  visionaray::index_bvh<P> ParallelBVHBuilder::build(const P *prims, size_t count) const
+  {
+    using namespace visionaray;
+
+    if (count == 0)
+      return {};
+
+    // ==================================================================
+    // primitive bounds and centroids
+    // ==================================================================
+
+    State state;
+    state.primBounds.resize(count);
+    state.centroids.resize(count);
+    state.ids.resize(count);
+    state.tmpIDs.resize(count);
+
+    parallel_for_blocked(0ull,count,1<<14,[&](size_t begin,size_t end){
+        for (size_t i=begin;i<end;i++) {
+          const aabb b = get_bounds(prims[i]);
+          state.primBounds[i] = box3f(owl::vec3f(b.min.x,b.min.y,b.min.z),
+                                      owl::vec3f(b.max.x,b.max.y,b.max.z));
+          state.centroids[i] = state.primBounds[i].center();
+          state.ids[i] = (uint32_t)i;
+        }
+      });
+
+    Task root;
+    root.begin = 0;
+    root.end = count;
+    root.bounds = parallelBounds(count,[&](size_t i) { return state.primBounds[i]; });
+    root.centroidBounds = parallelBounds(count,[&](size_t i) {
+      return box3f(state.centroids[i],state.centroids[i]);
+    });
+
+    // ==================================================================
+    // top of the tree: parallel binning and partitioning, breadth
+    // first, until tasks are small enough to become subtrees
+    // ==================================================================
+
+    const size_t numThreads = std::max(1u,std::thread::hardware_concurrency());
+    const size_t subtreeSize = std::max(size_t(1)<<12,count/(numThreads*8));
+
+    std::vector<TmpNode> topNodes;
+    std::vector<Task> subtrees;
+
+    struct OpenTask {
+      Task task;
+      int  parent;
+      int  side;
+    };
+    std::vector<OpenTask> open{ {root,-1,0} };
+
+    auto addSubtree = [&](const OpenTask &ot) {
+      if (ot.parent >= 0)
+        topNodes[ot.parent].child[ot.side] = -1-(int)subtrees.size();
+      subtrees.push_back(ot.task);
+    };
+
+    while (!open.empty()) {
+      std::vector<OpenTask> next;
+      for (const OpenTask &ot : open) {
+        const Task &task = ot.task;
+        const size_t n = task.end-task.begin;
+        if (n <= subtreeSize) {
+          addSubtree(ot);
+          continue;
+        }
+
+        const BinSet binSet = parallelReduce(n,BinSet(),
+          [&](size_t begin, size_t end) {
+            BinSet result;
+            binRange(state,task,task.begin+begin,task.begin+end,result);
+            return result;
+          },
+          [](BinSet a, const BinSet &b) { return a.extend(b); });
+
+        Split split = findSplit(task,binSet);
+        if (split.axis < 0) {
+          // SAH wants a leaf, or coinciding centroids: build serially
+          addSubtree(ot);
+          continue;
+        }
+
+        Task left, right;
+        parallelPartition(state,task,split,left,right);
+
+        const int nodeID = (int)topNodes.size();
+        topNodes.emplace_back();
+        topNodes[nodeID].bounds = task.bounds;
+        topNodes[nodeID].axis = split.axis;
+        if (ot.parent >= 0)
+          topNodes[ot.parent].child[ot.side] = nodeID;
+
+        next.push_back({left,nodeID,0});
+        next.push_back({right,nodeID,1});
+      }
+      open.swap(next);
+    }
+
+    // ==================================================================
+    // subtrees in parallel, each in depth-first layout w/ root at 0
+    // ==================================================================
+
+    std::vector<std::vector<bvh_node>> subtreeNodes(subtrees.size());
+    parallel_for(subtrees.size(),[&](size_t subtreeID) {
+      std::vector<bvh_node> &nodes = subtreeNodes[subtreeID];
+      nodes.reserve(2*(subtrees[subtreeID].end-subtrees[subtreeID].begin));
+      nodes.resize(1);
+      buildSubtree(state,subtrees[subtreeID],nodes,0);
+    });
+
+    // ==================================================================
+    // final depth-first layout: top nodes first (serial, there are
+    // few), then each subtree's nodes after its root's slot
+    // ==================================================================
+
+    struct Placement {
+      size_t rootSlot;  // where the subtree root goes
+      size_t restBegin; // where its other nodes go
+    };
+    std::vector<Placement> placements(subtrees.size());
+    std::vector<std::pair<size_t,bvh_node>> placedTopNodes;
+
+    size_t numNodes = 1;
+    std::function<void(int,size_t)> place = [&](int ref, size_t slot) {
+      if (ref < 0) {
+        const int subtreeID = -1-ref;
+        placements[subtreeID].rootSlot = slot;
+        placements[subtreeID].restBegin = numNodes;
+        numNodes += subtreeNodes[subtreeID].size()-1;
+        return;
+      }
+      const size_t firstChild = numNodes;
+      numNodes += 2;
+      bvh_node node;
+      node.set_inner(toAABB(topNodes[ref].bounds),(unsigned)firstChild,
+                     (unsigned char)topNodes[ref].axis,0);
+      placedTopNodes.push_back({slot,node});
+      place(topNodes[ref].child[0],firstChild);
+      place(topNodes[ref].child[1],firstChild+1);
+    };
+    place(topNodes.empty() ? -1 : 0,0);
+
+    index_bvh<P> tree(prims,count);
+    tree.nodes().resize(numNodes);
+    tree.indices().resize(count);
+
+    for (const auto &placed : placedTopNodes) {
+      tree.nodes()[placed.first] = placed.second;
+    }
+
+    parallel_for(subtrees.size(),[&](size_t subtreeID) {
+      const std::vector<bvh_node> &nodes = subtreeNodes[subtreeID];
+      const Placement &pl = placements[subtreeID];
+      auto remap = [&](unsigned local) {
+        return unsigned(local == 0 ? pl.rootSlot : pl.restBegin+local-1);
+      };
+      for (size_t i=0; i<nodes.size(); ++i) {
+        bvh_node node = nodes[i];
+        if (is_inner(node))
+          node.set_inner(node.get_bounds(),remap(node.get_child(0)),
+                         node.ordered_traversal_axis,node.ordered_traversal_sign);
+        tree.nodes()[remap((unsigned)i)] = node;
+      }
+    });
+
+    // primitives in leaf order, so that leaves access them linearly
+    parallel_for_blocked(0ull,count,1<<14,[&](size_t begin,size_t end){
+        for (size_t i=begin;i<end;i++) {
+          tree.primitives()[i] = prims[state.ids[i]];
+          tree.indices()[i] = (unsigned)i;
+        }
+      });
+
+    return tree;
+  }
+
+  /*! Quality metrics of a visionaray BVH */
+  struct BVHStats {
+    size_t numNodes = 0;
+    size_t numLeaves = 0;
+    int    maxDepth = 0;
+    float  avgLeafSize = 0.f;
+    //! SAH cost w/ unit traversal and intersection costs, relative to
+    //! the root's surface area
+    float  sahCost = 0.f;
+  };
+
+  template <typename BVH>
+  inline BVHStats computeBVHStats(const BVH &bvh, float traversalCost = 1.f)
+  {
+    BVHStats stats;
+    if (bvh.num_nodes() == 0)
+      return stats;
+
+    auto halfArea = [](const visionaray::aabb &box) {
+      const float dx = box.max.x-box.min.x;
+      const float dy = box.max.y-box.min.y;
+      const float dz = box.max.z-box.min.z;
+      return dx*dy+dy*dz+dz*dx;
+    };
+
+    const float rootArea = std::max(halfArea(bvh.node(0).get_bounds()),1e-30f);
+
+    double cost = 0.0;
+    size_t numPrims = 0;
+    std::vector<std::pair<unsigned,int>> stack{ {0u,0} };
+    while (!stack.empty()) {
+      const unsigned addr = stack.back().first;
+      const int depth = stack.back().second;
+      stack.pop_back();
+
+      auto node = bvh.node(addr);
+      const float relArea = halfArea(node.get_bounds())/rootArea;
+
+      stats.numNodes++;
+      stats.maxDepth = std::max(stats.maxDepth,depth);
+
+      if (is_inner(node)) {
+        cost += traversalCost*relArea;
+        stack.push_back({node.get_child(0),depth+1});
+        stack.push_back({node.get_child(1),depth+1});
+      } else {
+        const size_t n = node.get_indices().last-node.get_indices().first;
+        cost += relArea*n;
+        numPrims += n;
+        stats.numLeaves++;
+      }
+    }
+
+    stats.avgLeafSize = stats.numLeaves ? float(numPrims)/stats.numLeaves : 0.f;
+    stats.sahCost = (float)cost;
+    return stats;
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -4,7 +4,7 @@
 
 #include <cub/cub.cuh>
 
-#include <hilbert.h>
+#include "SpaceFillingCurves.h"
 
 namespace exa {
   
@@ -36,63 +36,6 @@ namespace exa {
       return __int_as_float(ret);
   }
 
-  //-------------------------------------------------------------------------------------------------
-  // space filling curves
-  //-------------------------------------------------------------------------------------------------
-
-  __host__ __device__
-  inline uint64_t morton64_encode4D(uint64_t x, uint64_t y, uint64_t z, uint64_t w)            
-  {                                                                                          
-      auto separate_bits = [](uint64_t n)                                                    
-      {                                                                                      
-          n &= 0b1111111111111111ull;                                                        
-          n = (n ^ (n << 24)) & 0b0000000000000000000000001111111100000000000000000000000011111111ull;
-          n = (n ^ (n << 12)) & 0b0000000000001111000000000000111100000000000011110000000000001111ull;
-          n = (n ^ (n <<  6)) & 0b0000001100000011000000110000001100000011000000110000001100000011ull;
-          n = (n ^ (n <<  3)) & 0b0001000100010001000100010001000100010001000100010001000100010001ull;
-                                                                                             
-          return n;                                                                          
-      };                                                                                     
-                                                                                             
-      uint64_t xb = separate_bits(x);                                                        
-      uint64_t yb = separate_bits(y) << 1;                                                   
-      uint64_t zb = separate_bits(z) << 2;                                                   
-      uint64_t wb = separate_bits(w) << 3;
-      uint64_t code = xb | yb | zb | wb;                                                     
-                                                                                             
-      return code;                                                                           
-  } 
-
-  __host__ __device__
-  inline uint64_t morton64_encode3D(float x, float y, float z)
-  {
-    x = x * (float)(1 << 16);
-    y = y * (float)(1 << 16);
-    z = z * (float)(1 << 16);
-    auto separate_bits = [](uint64_t n)
-    {
-        n &= 0b1111111111111111111111ull;
-        n = (n ^ (n << 32)) & 0b1111111111111111000000000000000000000000000000001111111111111111ull;
-        n = (n ^ (n << 16)) & 0b0000000011111111000000000000000011111111000000000000000011111111ull;
-        n = (n ^ (n <<  8)) & 0b1111000000001111000000001111000000001111000000001111000000001111ull;
-        n = (n ^ (n <<  4)) & 0b0011000011000011000011000011000011000011000011000011000011000011ull;
-        n = (n ^ (n <<  2)) & 0b1001001001001001001001001001001001001001001001001001001001001001ull;
-        return n;
-    };  
-
-    return separate_bits(x) | (separate_bits(y) << 1) | (separate_bits(z) << 2); 
-  }
-
-  __host__ __device__
-  inline uint64_t hilbert64_encode3D(float x, float y, float z)
-  {
-    x = x * (float)(1 << 16);
-    y = y * (float)(1 << 16);
-    z = z * (float)(1 << 16);
-    const bitmask_t coord[3] = {bitmask_t(x), bitmask_t(y), bitmask_t(z)};
-    return hilbert_c2i(3, 16, coord);
-  }
-
   // #include "owl/common/math/random.h"
   // typedef owl::common::LCG<4> Random;
   //   __host__ __device__
@@ -166,8 +109,7 @@ namespace exa {
                                                      float       * __restrict__ maxOpacities,
                                                      const vec4f * __restrict__ vertices,
                                                      const int   * __restrict__ indices,
-                                                     const vec4f * __restrict__ colorMap,
-                                                     const size_t  numColors,
+                                                     const TFRangeMaxTraversable xfRangeMax,
                                                      const range1f xfRange)
   {
     const size_t threadID = blockIdx.x * size_t(blockDim.x) + threadIdx.x;
@@ -186,25 +128,7 @@ namespace exa {
       }
     }
 
-    if (valueRange.upper < valueRange.lower) {
-      maxOpacities[threadID] = 0.f;
-      return;
-    }
-
-    valueRange.lower -= xfRange.lower;
-    valueRange.lower /= xfRange.upper-xfRange.lower;
-    valueRange.upper -= xfRange.lower;
-    valueRange.upper /= xfRange.upper-xfRange.lower;
-
-    int lo = clamp(int(valueRange.lower*(numColors-1)),  0,(int)numColors-1);
-    int hi = clamp(int(valueRange.upper*(numColors-1))+1,0,(int)numColors-1);
-
-    float maxOpacity = 0.f;
-    for (int i=lo; i<=hi; ++i) {
-      maxOpacity = fmaxf(maxOpacity,colorMap[i].w);
-    }
-
-    maxOpacities[threadID] = maxOpacity;
+    maxOpacities[threadID] = maxOpacity(valueRange,xfRangeMax,xfRange);
   }
 
   void QuickClustersSampler::computeMaxOpacities(OWLContext owl, OWLBuffer colorMap, range1f xfRange)
@@ -213,14 +137,14 @@ namespace exa {
       return;
 
     model->grid->computeMaxOpacities(owl,colorMap,xfRange);
+    xfRangeMax.build(owl,colorMap);
     {
       linear_kernel(computeUmeshMaxOpacitiesGPU,
         model->indices.size()/8,
         (float       *)owlBufferGetPointer(umeshMaxOpacities,0),
         (const vec4f *)owlBufferGetPointer(vertexBuffer,0),
         (const int   *)owlBufferGetPointer(indexBuffer,0),
-        (const vec4f *)owlBufferGetPointer(colorMap,0),
-        owlBufferSizeInBytes(colorMap)/sizeof(vec4f), xfRange);
+        xfRangeMax.traversable(), xfRange);
 
       // const uint32_t numColors = (uint32_t)owlBufferSizeInBytes(colorMap)/sizeof(vec4f);
       // const uint32_t numThreads = 1024; // it seems CUDA kernel launch only accepts uint32_t, so no need for uint64_t
@@ -31,6 +31,18 @@ namespace exa {
   {
   }
 
+  MajorantUpdateStats Sampler::updateMaxOpacities(OWLContext owl,
+                                                  OWLBuffer colorMap,
+                                                  range1f xfRange,
+                                                  range1f changedValues)
+  {
+    computeMaxOpacities(owl,colorMap,xfRange);
+
+    MajorantUpdateStats stats;
+    stats.full = true;
+    return stats;
+  }
+
 } // ::exa
 
 // vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -22,6 +22,8 @@
 #include <owl/owl.h>
 #include "../model/Model.h"
 #include "../common.h"
+#include "../AdaptiveGrid.h"
+#include "../TFRangeMax.h"
 
 namespace exa {
 
@@ -41,6 +43,14 @@ namespace exa {
     virtual bool build(OWLContext owl, Model::SP model);
 
     virtual void computeMaxOpacities(OWLContext owl, OWLBuffer colorMap, range1f xfRange);
+
+    /*! after a color map edit that only changed alpha for values in
+      changedValues (xfRange unchanged), recompute the majorants that
+      depend on those; by default, that's all of them */
+    virtual MajorantUpdateStats updateMaxOpacities(OWLContext owl,
+                                                   OWLBuffer colorMap,
+                                                   range1f xfRange,
+                                                   range1f changedValues);
     
     /*! return vector of the variables that this sampler has to set on
       the LPs */
@@ -60,12 +70,17 @@ namespace exa {
       OWLGroup bvh{ 0 };
       Grid::SP grid{ 0 };
       KDTree::SP kdtree{ 0 };
+      AdaptiveGrid::SP adaptiveGrid{ 0 };
     } majorantAccel;
 
     /*! majorants/max opacities; these are set by the model classes,
       e.g., when initGPU is called */
     OWLBuffer maxOpacities{ 0 };
 
+    /*! range-max table over the color map's alphas, (re-)built in
+      computeMaxOpacities() so that majorants are O(1) per primitive */
+    TFRangeMaxGPU xfRangeMax;
+
   };
 
 
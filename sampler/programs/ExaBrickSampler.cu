@@ -35,8 +35,7 @@ namespace exa {
       result.lower = vec3f(+1e30f);
       result.upper = vec3f(-1e30f);
     } else {
-      const ABR &abr = self.abrBuffer[leafID];
-      result = abr.domain;
+      result = getABRDomain(self.abrBuffer,leafID);
     }
   }
 
@@ -49,8 +48,7 @@ namespace exa {
                  optixGetObjectRayDirection(),
                  optixGetRayTmin(),
                  optixGetRayTmax());
-    const ABR &abr = self.abrBuffer[leafID];
-    const box3f bounds = abr.domain;
+    const box3f bounds = getABRDomain(self.abrBuffer,leafID);
 
     float t0 = ray.tmin, t1 = ray.tmax;
     if (!boxTest(ray,bounds,t0,t1))
@@ -73,8 +71,7 @@ namespace exa {
                  optixGetObjectRayDirection(),
                  optixGetRayTmin(),
                  optixGetRayTmax());
-    const ABR &abr = self.abrBuffer[leafID];
-    const box3f bounds = abr.domain;
+    const box3f bounds = getABRDomain(self.abrBuffer,leafID);
 
     if (!bounds.contains(ray.origin))
       return;
@@ -83,8 +80,8 @@ namespace exa {
       auto& sample = owl::getPRD<BasisPRD>();
       float sumWeightedValues = 0.f;
       float sumWeights = 0.f;
-      const int *childList  = &self.abrLeafListBuffer[abr.leafListBegin];
-      const int  childCount = abr.leafListSize;
+      const int *childList  = &self.abrLeafListBuffer[getABRLeafListBegin(self.abrBuffer,leafID)];
+      const int  childCount = getABRLeafListSize(self.abrBuffer,leafID);
       for (int childID=0;childID<childCount;childID++) {
         const int brickID = childList[childID];
         addBasisFunctions(self,sumWeightedValues,sumWeights,brickID,ray.origin);
@@ -106,7 +103,7 @@ namespace exa {
       result.lower = vec3f(+1e30f);
       result.upper = vec3f(-1e30f);
     } else {
-      const ExaBrick &brick = self.brickBuffer[leafID];
+      const ExaBrick &brick = getBrick(self.brickBuffer,leafID);
       result = brick.getDomain();
     }
   }
@@ -119,7 +116,7 @@ namespace exa {
                  optixGetObjectRayDirection(),
                  optixGetRayTmin(),
                  optixGetRayTmax());
-    const ExaBrick &brick = self.brickBuffer[leafID];
+    const ExaBrick &brick = getBrick(self.brickBuffer,leafID);
     const box3f bounds = brick.getBounds(); // use strict domain here
 
     float t0 = ray.tmin, t1 = ray.tmax;
@@ -142,7 +139,7 @@ namespace exa {
                  optixGetObjectRayDirection(),
                  optixGetRayTmin(),
                  optixGetRayTmax());
-    const ExaBrick &brick = self.brickBuffer[leafID];
+    const ExaBrick &brick = getBrick(self.brickBuffer,leafID);
     const box3f bounds = brick.getDomain();
 
     if (!bounds.contains(ray.origin))
@@ -164,7 +161,7 @@ namespace exa {
       result.lower = vec3f(+1e30f);
       result.upper = vec3f(-1e30f);
     } else {
-      const ExaBrick &brick = self.brickBuffer[leafID];
+      const ExaBrick &brick = getBrick(self.brickBuffer,leafID);
       result = brick.getBounds();
     }
   }
@@ -177,7 +174,7 @@ namespace exa {
                  optixGetObjectRayDirection(),
                  optixGetRayTmin(),
                  optixGetRayTmax());
-    const ExaBrick &brick = self.brickBuffer[leafID];
+    const ExaBrick &brick = getBrick(self.brickBuffer,leafID);
     const box3f bounds = brick.getBounds(); // use strict domain here
 
     float t0 = ray.tmin, t1 = ray.tmax;
@@ -137,6 +137,17 @@ namespace exa {
     vec3f pos = optixGetObjectRayOrigin();
     float value = 0.f;
 
+    if (self.uelemCache.level != UElemCache::NONE) {
+      if (intersectUElem(value,pos,primID,self.indexBuffer,self.vertexBuffer,self.uelemCache) &&
+          optixReportIntersection(0.f,0)) {
+        Sample& sample = owl::getPRD<Sample>();
+        sample.value = value;
+        sample.primID = primID;
+        sample.cellID = -1; // not a gridlet -> -1
+      }
+      return;
+    }
+
     vec4f v[8];
     int numVerts = 0;
     for (int i=0; i<8; ++i) {
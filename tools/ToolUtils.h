@@ -0,0 +1,222 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "model/AMRCellModel.h"
+
+/* helpers shared by the tools and benchmarks: timing, synthetic AMR
+  test models, and reading TF files as written by the viewer */
+namespace exa {
+
+  //! best (shortest) time of numRuns calls to func, in seconds
+  template <typename Func>
+  inline double bestOf(int numRuns, const Func &func)
+  {
+    double best = 1e30;
+    for (int i=0; i<numRuns; ++i) {
+      double t0 = getCurrentTime();
+      func();
+      double t1 = getCurrentTime();
+      best = std::min(best,t1-t0);
+    }
+    return best;
+  }
+
+  // level-1 cells everywhere, refined (level 0) in the center
+  inline AMRCellModel::SP makeCenterRefinedModel(int dims)
+  {
+    AMRCellModel::SP model = std::make_shared<AMRCellModel>();
+    const int lo = dims/2, hi = dims+dims/2; // in finest level cells
+    for (int z=0; z<dims; ++z) {
+      for (int y=0; y<dims; ++y) {
+        for (int x=0; x<dims; ++x) {
+          const vec3i pos = vec3i(x,y,z)*2;
+          if (pos.x >= lo && pos.x < hi && pos.y >= lo && pos.y < hi && pos.z >= lo && pos.z < hi) {
+            for (int i=0; i<8; ++i) {
+              const vec3i fine = pos+vec3i(i&1,(i>>1)&1,i>>2);
+              model->cells.push_back({fine,0});
+              model->scalars.push_back(sinf(fine.x*.1f)*cosf(fine.y*.07f)+fine.z*.01f);
+            }
+          } else {
+            model->cells.push_back({pos,1});
+            model->scalars.push_back(sinf(pos.x*.1f)*cosf(pos.y*.07f)+pos.z*.01f);
+          }
+        }
+      }
+    }
+    return model;
+  }
+
+  // three levels, randomly refined, so that there are many ABRs
+  inline AMRCellModel::SP makeRandomlyRefinedModel(int dims)
+  {
+    AMRCellModel::SP model = std::make_shared<AMRCellModel>();
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist;
+    auto addCell = [&](vec3i pos, int level) {
+      model->cells.push_back({pos,level});
+      model->scalars.push_back(sinf(pos.x*.1f)*cosf(pos.y*.07f)+pos.z*.01f);
+    };
+    for (int z=0; z<dims; ++z) {
+      for (int y=0; y<dims; ++y) {
+        for (int x=0; x<dims; ++x) {
+          const vec3i pos = vec3i(x,y,z)*4;
+          if (dist(rng) < .7f) {
+            addCell(pos,2);
+            continue;
+          }
+          for (int i=0; i<8; ++i) {
+            const vec3i pos1 = pos+vec3i(i&1,(i>>1)&1,i>>2)*2;
+            if (dist(rng) < .5f) {
+              addCell(pos1,1);
+              continue;
+            }
+            for (int j=0; j<8; ++j) {
+              addCell(pos1+vec3i(j&1,(j>>1)&1,j>>2),0);
+            }
+          }
+        }
+      }
+    }
+    return model;
+  }
+
+  // three levels, refined where the field has structure
+  inline AMRCellModel::SP makeFeatureRefinedModel(int dims)
+  {
+    AMRCellModel::SP model = std::make_shared<AMRCellModel>();
+    auto value = [&](vec3f pos) {
+      const vec3f p = pos/float(dims*4)-vec3f(.5f);
+      return sinf(p.x*20.f)*cosf(p.y*14.f)*expf(-8.f*dot(p,p));
+    };
+    auto addCell = [&](vec3i pos, int level) {
+      model->cells.push_back({pos,level});
+      model->scalars.push_back(value(vec3f(pos)+vec3f((1<<level)*.5f)));
+    };
+    for (int z=0; z<dims; ++z) {
+      for (int y=0; y<dims; ++y) {
+        for (int x=0; x<dims; ++x) {
+          const vec3i pos = vec3i(x,y,z)*4;
+          const vec3f p = vec3f(pos)/float(dims*4)-vec3f(.5f);
+          if (dot(p,p) > .1f) {
+            addCell(pos,2);
+            continue;
+          }
+          for (int i=0; i<8; ++i) {
+            const vec3i pos1 = pos+vec3i(i&1,(i>>1)&1,i>>2)*2;
+            if (dot(p,p) > .03f) {
+              addCell(pos1,1);
+              continue;
+            }
+            for (int j=0; j<8; ++j) {
+              addCell(pos1+vec3i(j&1,(j>>1)&1,j>>2),0);
+            }
+          }
+        }
+      }
+    }
+    return model;
+  }
+
+  //! TF file as written by the viewer
+  struct TFFile {
+    std::vector<vec4f> colorMap;
+    range1f            absDomain;
+    range1f            relDomain; // in percent of the value range
+    float              opacityScale = 1.f;
+
+    //! the part of valueRange the color map is applied to
+    range1f domain(const range1f valueRange) const
+    {
+      return {
+        valueRange.lower + (relDomain.lower/100.f) * (valueRange.upper-valueRange.lower),
+        valueRange.lower + (relDomain.upper/100.f) * (valueRange.upper-valueRange.lower),
+      };
+    }
+  };
+
+  inline TFFile readTF(const std::string fileName)
+  {
+    std::ifstream xfFile(fileName, std::ios::binary);
+
+    if (!xfFile.good()) {
+      throw std::runtime_error("Could not open TF: "+fileName);
+    }
+
+    static const size_t xfFileFormatMagic = 0x1235abc000;
+    size_t magic;
+    xfFile.read((char*)&magic,sizeof(xfFileFormatMagic));
+    if (magic != xfFileFormatMagic) {
+      throw std::runtime_error("Not a valid TF file: "+fileName);
+    }
+
+    TFFile xf;
+    xfFile.read((char*)&xf.opacityScale,sizeof(xf.opacityScale));
+
+    xfFile.read((char*)&xf.absDomain.lower,sizeof(xf.absDomain.lower));
+    xfFile.read((char*)&xf.absDomain.upper,sizeof(xf.absDomain.upper));
+
+    xfFile.read((char*)&xf.relDomain,sizeof(xf.relDomain));
+
+    int numColorMapValues;
+    xfFile.read((char*)&numColorMapValues,sizeof(numColorMapValues));
+    xf.colorMap.resize(numColorMapValues);
+    xfFile.read((char*)xf.colorMap.data(),xf.colorMap.size()*sizeof(xf.colorMap[0]));
+
+    if (!xfFile.good()) {
+      throw std::runtime_error("Could not read TF: "+fileName);
+    }
+
+    return xf;
+  }
+
+  /*! color map of the TF, returns the part of the model's valueRange
+    it is applied to */
+  inline range1f loadTF(const std::string fileName,
+                        const range1f valueRange,
+                        std::vector<vec4f> &colorMap)
+  {
+    const TFFile xf = readTF(fileName);
+    colorMap = xf.colorMap;
+    return xf.domain(valueRange);
+  }
+
+  inline std::vector<std::string> string_split(std::string s, char delim)
+  {
+    std::vector<std::string> result;
+
+    std::istringstream stream(s);
+
+    for (std::string token; std::getline(stream, token, delim); )
+    {
+      result.push_back(token);
+    }
+
+    return result;
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,174 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "model/BrickBuilder.h"
+#include "sampler/ExaBrickSamplerCPU.h"
+#include "sampler/ParallelBVHBuilder.h"
+#include "ToolUtils.h"
+
+/* benchmark for the ABR BVH builders of ExaBrickSamplerCPU: build
+  time, SAH cost and point location throughput of visionaray's
+  binned_sah_builder vs. ParallelBVHBuilder */
+namespace exa {
+
+  struct {
+    std::string brickFileName = "";
+    std::string scalarFileName = "";
+    size_t numQueries = 1<<22;
+    int    dims = 64; // coarsest cells per dimension (synthetic model)
+    int    numRuns = 3;
+  } cmdline;
+
+  template <typename BVH>
+  static int findABR(const BVH &bvh, const vec3f pos)
+  {
+    visionaray::basic_ray<float> r;
+    r.ori = visionaray::vec3(pos.x,pos.y,pos.z);
+    r.dir = visionaray::vec3(1.f,1.f,1.f);
+    r.tmin = 0.f;
+    r.tmax = 0.f;
+    auto ref = bvh.ref();
+    auto hr = visionaray::closest_hit(r,&ref,&ref+1);
+    return hr.hit ? (int)hr.prim_id : -1;
+  }
+
+  static void printStats(const char *name, double buildTime, const BVHStats &stats)
+  {
+    std::cout << "  " << name << prettyDouble(buildTime) << "s, "
+              << prettyNumber(stats.numNodes) << " nodes, "
+              << prettyNumber(stats.numLeaves) << " leaves (avg. size "
+              << stats.avgLeafSize << "), max. depth " << stats.maxDepth
+              << ", SAH cost " << stats.sahCost << '\n';
+  }
+
+  extern "C" int main(int argc, char** argv)
+  {
+    for (int i=1;i<argc;i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "-bricks") {
+        cmdline.brickFileName = argv[++i];
+      }
+      else if (arg == "-scalar" || arg == "-scalars") {
+        cmdline.scalarFileName = argv[++i];
+      }
+      else if (arg == "-n") {
+        cmdline.numQueries = std::stoull(argv[++i]);
+      }
+      else if (arg == "-dims") {
+        cmdline.dims = std::stoi(argv[++i]);
+      }
+      else if (arg == "-runs") {
+        cmdline.numRuns = std::stoi(argv[++i]);
+      }
+    }
+
+    ExaBrickModel::SP model;
+    if (!cmdline.brickFileName.empty()) {
+      model = ExaBrickModel::load(cmdline.brickFileName,cmdline.scalarFileName,"");
+    } else {
+      model = BrickBuilder::makeModel(makeRandomlyRefinedModel(cmdline.dims),4);
+    }
+
+    if (!model) {
+      throw std::runtime_error("Could not create model");
+    }
+
+    // same primitives as ExaBrickSamplerCPU::build()
+    std::vector<ABRPrimitive> prims(model->abrs.value.size());
+    for (size_t i=0; i<prims.size(); ++i) {
+      (ABR &)prims[i] = model->abrs.value[i];
+      prims[i].prim_id = (unsigned)i;
+    }
+
+    std::cout << "#exa: " << prettyNumber(model->bricks.size()) << " bricks, "
+              << prettyNumber(prims.size()) << " ABRs, "
+              << std::thread::hardware_concurrency() << " threads\n";
+
+    // ==================================================================
+    // build
+    // ==================================================================
+
+    visionaray::index_bvh<ABRPrimitive> refBVH, parallelBVH;
+
+    double refTime = bestOf(cmdline.numRuns,[&]() {
+      visionaray::binned_sah_builder builder;
+      builder.enable_spatial_splits(false);
+      refBVH = builder.build(visionaray::index_bvh<ABRPrimitive>{}, prims.data(), prims.size());
+    });
+
+    double parallelTime = bestOf(cmdline.numRuns,[&]() {
+      ParallelBVHBuilder builder;
+      parallelBVH = builder.build(prims.data(), prims.size());
+    });
+
+    std::cout << "#exa: build\n";
+    printStats("binned_sah_builder: ",refTime,computeBVHStats(refBVH));
+    printStats("ParallelBVHBuilder: ",parallelTime,computeBVHStats(parallelBVH));
+    std::cout << "  speedup: " << prettyDouble(refTime/parallelTime) << "x\n";
+
+    // ==================================================================
+    // point location
+    // ==================================================================
+
+    const box3f bounds = model->cellBounds;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> ux(bounds.lower.x,bounds.upper.x);
+    std::uniform_real_distribution<float> uy(bounds.lower.y,bounds.upper.y);
+    std::uniform_real_distribution<float> uz(bounds.lower.z,bounds.upper.z);
+    std::vector<vec3f> positions(cmdline.numQueries);
+    for (size_t i=0; i<positions.size(); ++i) {
+      positions[i] = vec3f(ux(rng),uy(rng),uz(rng));
+    }
+
+    const size_t N = positions.size();
+    std::vector<int> refIDs(N), parallelIDs(N);
+
+    double refQueryTime = bestOf(cmdline.numRuns,[&]() {
+      for (size_t i=0; i<N; ++i)
+        refIDs[i] = findABR(refBVH,positions[i]);
+    });
+
+    double parallelQueryTime = bestOf(cmdline.numRuns,[&]() {
+      for (size_t i=0; i<N; ++i)
+        parallelIDs[i] = findABR(parallelBVH,positions[i]);
+    });
+
+    size_t numMismatches = 0;
+    for (size_t i=0; i<N; ++i) {
+      // ABRs may share faces, a position on a face may go either way
+      if (refIDs[i] != parallelIDs[i] &&
+          (parallelIDs[i] < 0 || !model->abrs.value[parallelIDs[i]].domain.contains(positions[i])))
+        numMismatches++;
+    }
+
+    std::cout << "#exa: point location, " << N << " positions (serial)\n";
+    std::cout << "  binned_sah_builder: " << prettyDouble(refQueryTime/N*1e9) << "ns/query\n";
+    std::cout << "  ParallelBVHBuilder: " << prettyDouble(parallelQueryTime/N*1e9) << "ns/query ("
+              << prettyDouble(refQueryTime/parallelQueryTime) << "x), mismatches: "
+              << numMismatches << '\n';
+
+    return 0;
+  }
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
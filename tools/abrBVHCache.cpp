@@ -0,0 +1,95 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "model/ExaBrickModel.h"
+#include "sampler/ExaBrickSamplerCPU.h"
+
+/* tool to precompute the ABR BVH of ExaBrickSamplerCPU for a given
+  ExaBricks model; pass the output file to kdtreeBuilder (-bvh-cache)
+  so that it skips the build */
+namespace exa {
+
+  struct {
+    std::string scalarFileName = "";
+    std::string exaBrickFileName = "";
+    std::string outFileName = "";
+    bool visionaray = false;
+  } cmdline;
+
+  extern "C" int main(int argc, char** argv)
+  {
+    for (int i=1;i<argc;i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "-scalar" || arg == "-scalars") {
+        cmdline.scalarFileName = argv[++i];
+      }
+      else if (arg == "-bricks") {
+        cmdline.exaBrickFileName = argv[++i];
+      }
+      else if (arg == "-o") {
+        cmdline.outFileName = argv[++i];
+      }
+      else if (arg == "-visionaray") {
+        cmdline.visionaray = true;
+      }
+    }
+
+    if (cmdline.scalarFileName.empty()) {
+      throw std::runtime_error("No scalar file given");
+    }
+
+    if (cmdline.exaBrickFileName.empty()) {
+      throw std::runtime_error("No exabrick file given");
+    }
+
+    if (cmdline.outFileName.empty()) {
+      cmdline.outFileName = cmdline.exaBrickFileName+".bvh";
+    }
+
+    ExaBrickModel::SP model = ExaBrickModel::load(cmdline.exaBrickFileName,
+                                                  cmdline.scalarFileName,
+                                                  ""/*kdtree file, empty*/);
+
+    if (!model) {
+      throw std::runtime_error("Could not load exabrick model");
+    }
+
+    ExaBrickSamplerCPU sampler;
+    if (cmdline.visionaray)
+      sampler.bvhBuilder = ExaBrickSamplerCPU::BVH_BUILDER_VISIONARAY;
+
+    double t0 = getCurrentTime();
+    sampler.build(model);
+    double t1 = getCurrentTime();
+
+    std::cout << "#exa: built ABR BVH (" << prettyNumber(sampler.abrBVH.num_nodes())
+              << " nodes, " << prettyNumber(model->abrs.value.size()) << " ABRs) in "
+              << prettyDouble(t1-t0) << "s\n";
+
+    if (!sampler.saveBVH(cmdline.outFileName)) {
+      throw std::runtime_error("Could not write "+cmdline.outFileName);
+    }
+
+    std::cout << "#exa: ABR BVH written to " << cmdline.outFileName << '\n';
+    return 0;
+  }
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
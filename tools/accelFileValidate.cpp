@@ -0,0 +1,181 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "model/AccelFile.h"
+#include "KDTree.h"
+#include "ValueRangeTree.h"
+
+/* tool to validate AccelFiles (kd-trees, majorant domains and value
+  range trees): header, section extents and checksums, and that the
+  contents are usable for traversal; exits with 1 if any of the files
+  is invalid */
+namespace exa {
+
+  struct {
+    std::vector<std::string> fileNames;
+    bool verifyChecksums = true;
+  } cmdline;
+
+  static bool validateKDTree(const std::string fileName, const AccelFile &file)
+  {
+    size_t numNodes = 0, numPrimRefs = 0;
+    file.get<KDTreeNode>(AccelFile::KDTREE_NODES,numNodes);
+    const PrimRef *primRefs = file.get<PrimRef>(AccelFile::KDTREE_PRIM_REFS,numPrimRefs);
+
+    if (numNodes == 0)
+      return true;
+
+    if (numPrimRefs == 0) {
+      std::cout << "#exa:   no primRefs, leaf indices are not checked\n";
+      return true;
+    }
+
+    // primRefs are in leaf order, and boxes may be referenced more
+    // than once; the boxes themselves are not stored
+    const box3f &bounds = file.header().bounds;
+    size_t numPrims = 0;
+    for (size_t i=0; i<numPrimRefs; ++i) {
+      const box3f &box = primRefs[i].box;
+      if (box.empty() || !bounds.contains(box.lower) || !bounds.contains(box.upper)) {
+        std::cerr << "#exa:   primRef " << i << ' ' << box << " is empty or outside "
+                  << bounds << '\n';
+        return false;
+      }
+      numPrims = std::max(numPrims,size_t(primRefs[i].primID)+1);
+    }
+
+    std::string error;
+    KDTree::SP kdtree = KDTree::load(fileName);
+    if (!kdtree->validate(numPrims,error)) {
+      std::cerr << "#exa:   invalid kd-tree: " << error << '\n';
+      return false;
+    }
+    return true;
+  }
+
+  static bool validateMajorants(const AccelFile &file)
+  {
+    size_t numDomains = 0;
+    const std::pair<box3f,float> *domains
+        = file.get<std::pair<box3f,float>>(AccelFile::MAJORANT_DOMAINS,numDomains);
+
+    const box3f &bounds = file.header().bounds;
+    for (size_t i=0; i<numDomains; ++i) {
+      const box3f &domain = domains[i].first;
+      const float majorant = domains[i].second;
+      if (!std::isfinite(majorant) || majorant < 0.f) {
+        std::cerr << "#exa:   domain " << i << " has invalid majorant " << majorant << '\n';
+        return false;
+      }
+      // domains may extend past the cell bounds by the reconstruction
+      // filter's support (as ABRs do), but must overlap the model
+      if (domain.empty() ||
+          reduce_min(domain.upper-bounds.lower) <= 0.f ||
+          reduce_min(bounds.upper-domain.lower) <= 0.f) {
+        std::cerr << "#exa:   domain " << i << ' ' << domain << " is empty or outside "
+                  << bounds << '\n';
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static bool validateValueRangeTree(const std::string fileName, const AccelFile &file)
+  {
+    if (!file.findSection(AccelFile::VALUE_RANGE_NODES))
+      return true;
+
+    // load() validates
+    ValueRangeTree::SP tree = ValueRangeTree::load(fileName);
+    tree->printStats();
+    return true;
+  }
+
+  static bool validate(const std::string fileName)
+  {
+    std::cout << "#exa: " << fileName << '\n';
+
+    if (!AccelFile::isAccelFile(fileName)) {
+      std::cerr << "#exa:   not an accel file (legacy files can't be validated)\n";
+      return false;
+    }
+
+    std::string error;
+    AccelFile::SP file = AccelFile::open(fileName,error,cmdline.verifyChecksums);
+    if (!file) {
+      std::cerr << "#exa:   " << error << '\n';
+      return false;
+    }
+
+    const AccelFile::Header &header = file->header();
+    std::cout << "#exa:   version " << header.version << ", "
+              << prettyBytes(header.fileSize) << ", bounds: " << header.bounds << '\n';
+
+    for (uint32_t i=0; i<header.numSections; ++i) {
+      const AccelFile::Section &s = file->sections()[i];
+      std::cout << "#exa:   " << AccelFile::sectionName(s.type) << ": "
+                << prettyNumber(s.count) << " x " << s.elemSize << " bytes at offset "
+                << s.offset << '\n';
+    }
+
+    try {
+      if (!validateKDTree(fileName,*file) ||
+          !validateMajorants(*file) ||
+          !validateValueRangeTree(fileName,*file))
+        return false;
+    } catch (const std::runtime_error &e) {
+      std::cerr << "#exa:   " << e.what() << '\n';
+      return false;
+    }
+
+    std::cout << "#exa:   OK\n";
+    return true;
+  }
+
+  extern "C" int main(int argc, char** argv)
+  {
+    for (int i=1;i<argc;i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "-no-checksums") {
+        cmdline.verifyChecksums = false;
+      }
+      else {
+        cmdline.fileNames.push_back(arg);
+      }
+    }
+
+    if (cmdline.fileNames.empty()) {
+      throw std::runtime_error("No file given");
+    }
+
+    bool valid = true;
+    for (const std::string &fileName : cmdline.fileNames) {
+      valid &= validate(fileName);
+    }
+
+    return valid ? 0 : 1;
+  }
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
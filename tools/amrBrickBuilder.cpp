@@ -0,0 +1,105 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include "model/AMRCellModel.h"
+#include "model/BrickBuilder.h"
+#include "KDTree.h"
+
+/* tool to convert AMR cells into an ExaBricks .bricks file; the
+  scalar file stays as is, the bricks reference it via cell IDs.
+  Optionally also writes a kd-tree over the bricks (-kdtree) */
+namespace exa {
+
+  struct {
+    std::string cellFileName = "";
+    std::string scalarFileName = "";
+    std::string outFileName = "out.bricks";
+    std::string kdtreeFileName = "";
+    KDTree::BuildMode kdtreeMode = KDTree::SAH;
+    int maxBrickSize = 32;
+  } cmdline;
+
+  extern "C" int main(int argc, char** argv)
+  {
+    for (int i=1;i<argc;i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "-cells") {
+        cmdline.cellFileName = argv[++i];
+      }
+      else if (arg == "-scalar" || arg == "-scalars") {
+        cmdline.scalarFileName = argv[++i];
+      }
+      else if (arg == "-o") {
+        cmdline.outFileName = argv[++i];
+      }
+      else if (arg == "-max-brick-size") {
+        cmdline.maxBrickSize = std::stoi(argv[++i]);
+      }
+      else if (arg == "-kdtree") {
+        cmdline.kdtreeFileName = argv[++i];
+      }
+      else if (arg == "-kdtree-median") {
+        cmdline.kdtreeMode = KDTree::Median;
+      }
+    }
+
+    if (cmdline.cellFileName.empty()) {
+      throw std::runtime_error("No AMR cell file given");
+    }
+
+    // scalars are optional here, they're only used for the stats
+    AMRCellModel::zeroCopy = true;
+    AMRCellModel::SP model = AMRCellModel::load(cmdline.cellFileName,
+                                                cmdline.scalarFileName);
+
+    if (!model || model->numCells() == 0) {
+      throw std::runtime_error("Could not load AMR cell model");
+    }
+
+    BrickBuilder builder;
+    builder.build(model,cmdline.maxBrickSize);
+    builder.printStats();
+
+    std::cout << "Writing to file: " << cmdline.outFileName << '\n';
+    if (!builder.save(cmdline.outFileName)) {
+      throw std::runtime_error("Could not write "+cmdline.outFileName);
+    }
+
+    if (!cmdline.kdtreeFileName.empty()) {
+      std::vector<box3f> boxes(builder.bricks.size());
+      std::vector<int> levels(builder.bricks.size());
+      for (size_t i=0; i<builder.bricks.size(); ++i) {
+        boxes[i]  = builder.bricks[i].getBounds();
+        levels[i] = builder.bricks[i].level;
+      }
+
+      KDTree::SP kdtree = KDTree::build(boxes.size(),boxes.data(),levels.data(),
+                                        cmdline.kdtreeMode);
+      kdtree->printStats();
+
+      std::cout << "Writing to file: " << cmdline.kdtreeFileName << '\n';
+      if (!kdtree->save(cmdline.kdtreeFileName)) {
+        throw std::runtime_error("Could not write "+cmdline.kdtreeFileName);
+      }
+    }
+  }
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,293 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <visionaray/bvh.h>
+#include "model/AMRCellModel.h"
+#include "model/ParallelReduce.h"
+#include "sampler/AMRCellSamplerCPU.h"
+#include "ToolUtils.h"
+
+/* benchmark for CPU point location in AMR cell data: per-level hash
+  tables (AMRCellSamplerCPU) vs. a BVH over the basis function
+  supports of all cells (that's what AMRCellSampler does on the GPU) */
+namespace exa {
+
+  struct {
+    std::string cellFileName = "";
+    std::string scalarFileName = "";
+    size_t numSamples = 1<<22;
+    int    dims = 64; // coarse cells per dimension (synthetic model)
+    int    numRuns = 5;
+    bool   noBVH = false;
+  } cmdline;
+
+  // ================================================================
+  // reference: BVH over cell basis functions
+  // ================================================================
+
+  struct CellPrimitive : visionaray::primitive<unsigned>
+  {
+    box3f support;
+  };
+
+  inline visionaray::aabb get_bounds(const CellPrimitive &cell)
+  {
+    return {{cell.support.lower.x,cell.support.lower.y,cell.support.lower.z},
+            {cell.support.upper.x,cell.support.upper.y,cell.support.upper.z}};
+  }
+
+  inline void split_primitive(visionaray::aabb& L, visionaray::aabb& R,
+                              float plane, int axis, const CellPrimitive &cell)
+  {
+    VSNRAY_UNUSED(L);
+    VSNRAY_UNUSED(R);
+    VSNRAY_UNUSED(plane);
+    VSNRAY_UNUSED(axis);
+    VSNRAY_UNUSED(cell);
+  }
+
+  struct CellBVH
+  {
+    visionaray::index_bvh<CellPrimitive> bvh;
+    const AMRCell *cells = nullptr;
+    const float *scalars = nullptr;
+
+    void build(const AMRCellModel::SP &model)
+    {
+      using namespace visionaray;
+
+      cells = model->cellData();
+      scalars = model->scalars.data();
+
+      std::vector<CellPrimitive> prims(model->numCells());
+      parallel_for_blocked(0ull,prims.size(),1<<16,[&](size_t begin,size_t end){
+          for (size_t i=begin;i<end;i++) {
+            const float cellWidth = float(1<<cells[i].level);
+            prims[i].prim_id = (unsigned)i;
+            prims[i].support = box3f(owl::vec3f(cells[i].pos)-owl::vec3f(cellWidth*.5f),
+                                     owl::vec3f(cells[i].pos)+owl::vec3f(cellWidth*1.5f));
+          }
+        });
+
+      binned_sah_builder builder;
+      builder.enable_spatial_splits(false);
+      bvh = builder.build(index_bvh<CellPrimitive>{}, prims.data(), prims.size());
+    }
+
+    size_t bytes() const
+    {
+      return bvh.num_nodes()*sizeof(visionaray::bvh_node)
+           + bvh.num_primitives()*(sizeof(CellPrimitive)+sizeof(unsigned));
+    }
+
+    // same as AMRCellSampler: accumulate all basis functions overlapping pos
+    float sample(const vec3f pos) const
+    {
+      using namespace visionaray;
+
+      const vec3 P(pos.x,pos.y,pos.z);
+      float sumWeightedValues = 0.f;
+      float sumWeights = 0.f;
+
+      // overlapping supports can make the BVH arbitrarily deep, entries
+      // beyond the fixed-size stack spill to the heap
+      enum { STACK_SIZE = 128 };
+      unsigned traversalStack[STACK_SIZE];
+      unsigned stackPtr = 0;
+      std::vector<unsigned> spill;
+
+      auto push = [&](unsigned nodeID) {
+        if (stackPtr < STACK_SIZE)
+          traversalStack[stackPtr++] = nodeID;
+        else
+          spill.push_back(nodeID);
+      };
+
+      auto pop = [&]() {
+        if (spill.empty())
+          return traversalStack[--stackPtr];
+        const unsigned nodeID = spill.back();
+        spill.pop_back();
+        return nodeID;
+      };
+
+      push(0); // root
+
+      while (stackPtr) {
+        auto node = bvh.node(pop());
+
+        const aabb bounds = node.get_bounds();
+        if (P.x < bounds.min.x || P.y < bounds.min.y || P.z < bounds.min.z ||
+            P.x > bounds.max.x || P.y > bounds.max.y || P.z > bounds.max.z)
+          continue;
+
+        if (is_inner(node)) {
+          push(node.get_child(0));
+          push(node.get_child(1));
+        } else {
+          for (unsigned i=node.get_indices().first; i<node.get_indices().last; ++i) {
+            const CellPrimitive &prim = bvh.primitive(i);
+            if (!prim.support.contains(pos))
+              continue;
+            const AMRCell &cell = cells[prim.prim_id];
+            const float cellWidth = float(1<<cell.level);
+            const owl::vec3f center = owl::vec3f(cell.pos)+owl::vec3f(cellWidth*.5f);
+            const owl::vec3f d = owl::vec3f(1.f)-abs(pos-center)/cellWidth;
+            const float weight = d.x*d.y*d.z;
+            if (weight <= 0.f)
+              continue;
+            sumWeights += weight;
+            sumWeightedValues += scalars[prim.prim_id]*weight;
+          }
+        }
+      }
+
+      return sumWeights > 0.f ? sumWeightedValues/sumWeights : 0.f;
+    }
+  };
+
+  extern "C" int main(int argc, char** argv)
+  {
+    for (int i=1;i<argc;i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "-cells") {
+        cmdline.cellFileName = argv[++i];
+      }
+      else if (arg == "-scalar" || arg == "-scalars") {
+        cmdline.scalarFileName = argv[++i];
+      }
+      else if (arg == "-n") {
+        cmdline.numSamples = std::stoull(argv[++i]);
+      }
+      else if (arg == "-dims") {
+        cmdline.dims = std::stoi(argv[++i]);
+      }
+      else if (arg == "-runs") {
+        cmdline.numRuns = std::stoi(argv[++i]);
+      }
+      else if (arg == "-no-bvh") {
+        cmdline.noBVH = true;
+      }
+    }
+
+    AMRCellModel::SP model;
+    if (!cmdline.cellFileName.empty()) {
+      AMRCellModel::zeroCopy = true;
+      model = AMRCellModel::load(cmdline.cellFileName,cmdline.scalarFileName);
+    } else {
+      model = makeCenterRefinedModel(cmdline.dims);
+    }
+
+    if (!model || model->numCells() == 0) {
+      throw std::runtime_error("Could not load AMR cell model");
+    }
+
+    const AMRCell *cells = model->cellData();
+    const box3f bounds = parallelBounds(model->numCells(),[&](size_t i) {
+      return box3f(vec3f(cells[i].pos),vec3f(cells[i].pos+vec3i(1<<cells[i].level)));
+    });
+
+    double t0 = getCurrentTime();
+    AMRCellSamplerCPU sampler;
+    if (!sampler.build(model)) {
+      throw std::runtime_error("Could not build AMRCellSamplerCPU (scalars missing?)");
+    }
+    double t1 = getCurrentTime();
+
+    std::cout << "#exa: " << prettyNumber(model->numCells()) << " cells, hash tables built in "
+              << prettyDouble(t1-t0) << "s\n";
+    sampler.printStats();
+
+    std::mt19937 rng(0);
+    const size_t N = cmdline.numSamples;
+
+    std::vector<vec3f> positions(N);
+    std::uniform_real_distribution<float> ux(bounds.lower.x,bounds.upper.x);
+    std::uniform_real_distribution<float> uy(bounds.lower.y,bounds.upper.y);
+    std::uniform_real_distribution<float> uz(bounds.lower.z,bounds.upper.z);
+    for (size_t i=0; i<N; ++i) {
+      positions[i] = vec3f(ux(rng),uy(rng),uz(rng));
+    }
+
+    // ==================================================================
+    // hash tables: single queries (serial) and batched (parallel)
+    // ==================================================================
+
+    std::vector<float> scalarValues(N), batchValues(N);
+    SpatialDomain sd;
+    double sampleTime = bestOf(cmdline.numRuns,[&]() {
+      for (size_t i=0; i<N; ++i) {
+        scalarValues[i] = sample(sampler,sd,positions[i]).value;
+      }
+    });
+
+    double sampleBatchTime = bestOf(cmdline.numRuns,[&]() {
+      sampleBatch(sampler,positions.data(),batchValues.data(),N);
+    });
+
+    float maxDiff = 0.f;
+    for (size_t i=0; i<N; ++i) {
+      maxDiff = std::max(maxDiff,fabsf(scalarValues[i]-batchValues[i]));
+    }
+
+    std::cout << "#exa: hash tables, " << N << " positions\n";
+    std::cout << "  sample():      " << prettyDouble(sampleTime/N*1e9) << "ns/sample (serial)\n";
+    std::cout << "  sampleBatch(): " << prettyDouble(sampleBatchTime/N*1e9) << "ns/sample (parallel, "
+              << prettyDouble(sampleTime/sampleBatchTime) << "x), max diff: " << maxDiff << '\n';
+
+    if (cmdline.noBVH)
+      return 0;
+
+    // ==================================================================
+    // reference: BVH over basis function supports
+    // ==================================================================
+
+    t0 = getCurrentTime();
+    CellBVH cellBVH;
+    cellBVH.build(model);
+    t1 = getCurrentTime();
+
+    std::cout << "#exa: cell BVH built in " << prettyDouble(t1-t0) << "s, "
+              << prettyBytes(cellBVH.bytes()) << " (hash tables: "
+              << prettyBytes(sampler.bytes()) << ")\n";
+
+    std::vector<float> bvhValues(N);
+    double bvhTime = bestOf(cmdline.numRuns,[&]() {
+      for (size_t i=0; i<N; ++i) {
+        bvhValues[i] = cellBVH.sample(positions[i]);
+      }
+    });
+
+    maxDiff = 0.f;
+    for (size_t i=0; i<N; ++i) {
+      maxDiff = std::max(maxDiff,fabsf(scalarValues[i]-bvhValues[i]));
+    }
+
+    std::cout << "  BVH sample():  " << prettyDouble(bvhTime/N*1e9) << "ns/sample (serial, hash tables are "
+              << prettyDouble(bvhTime/sampleTime) << "x faster), max diff: " << maxDiff << '\n';
+
+    return 0;
+  }
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
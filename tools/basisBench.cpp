@@ -0,0 +1,387 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "model/BrickBuilder.h"
+#include "sampler/ExaBrickBasisSIMD.h"
+#include "sampler/ExaBrickSamplerCPU.h"
+#include "ToolUtils.h"
+
+/* micro benchmarks for the CPU ExaBrick sampler (scalar vs. batched
+  basis-function kernels, ray marching w/ and w/o SampleCursor, batch
+  sampling in input vs. space-filling curve order, AoS vs. SoA ABR
+  layout), on a synthetic two-level AMR data set */
+namespace exa {
+
+  struct {
+    size_t numSamples = 1<<22;
+    int    dims = 64; // coarse cells per dimension
+    int    numRuns = 5;
+  } cmdline;
+
+  /*! Cache misses of the calling thread, via Linux perf events;
+    unavailable (valid() == false) on other platforms, or if the
+    kernel doesn't allow it (perf_event_paranoid) */
+  struct CacheMissCounter
+  {
+    CacheMissCounter()
+    {
+#ifdef __linux__
+      perf_event_attr attr;
+      memset(&attr,0,sizeof(attr));
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof(attr);
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      fd = (int)syscall(__NR_perf_event_open,&attr,0,-1,-1,0);
+#endif
+    }
+
+    ~CacheMissCounter()
+    {
+#ifdef __linux__
+      if (fd >= 0)
+        close(fd);
+#endif
+    }
+
+    bool valid() const { return fd >= 0; }
+
+    void start()
+    {
+#ifdef __linux__
+      if (fd >= 0) {
+        ioctl(fd,PERF_EVENT_IOC_RESET,0);
+        ioctl(fd,PERF_EVENT_IOC_ENABLE,0);
+      }
+#endif
+    }
+
+    long long stop()
+    {
+      long long count = 0;
+#ifdef __linux__
+      if (fd >= 0) {
+        ioctl(fd,PERF_EVENT_IOC_DISABLE,0);
+        if (read(fd,&count,sizeof(count)) != sizeof(count))
+          count = 0;
+      }
+#endif
+      return count;
+    }
+
+    int fd = -1;
+  };
+
+  extern "C" int main(int argc, char** argv)
+  {
+    for (int i=1;i<argc;i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "-n") {
+        cmdline.numSamples = std::stoull(argv[++i]);
+      }
+      else if (arg == "-dims") {
+        cmdline.dims = std::stoi(argv[++i]);
+      }
+      else if (arg == "-runs") {
+        cmdline.numRuns = std::stoi(argv[++i]);
+      }
+    }
+
+    ExaBrickModel::SP model = BrickBuilder::makeModel(makeCenterRefinedModel(cmdline.dims),16);
+    if (!model) {
+      throw std::runtime_error("Could not create test model");
+    }
+
+    ExaBrickSamplerCPU sampler;
+    sampler.withABRNeighbors = true;
+    sampler.build(model);
+
+    std::cout << "#exa: batch kernel ISA: " << basisBatchISA() << '\n';
+
+    std::mt19937 rng(0);
+    const size_t N = cmdline.numSamples;
+
+    // ==================================================================
+    // kernel only: all positions against a single brick
+    // ==================================================================
+
+    size_t biggest = 0;
+    for (size_t i=0; i<model->bricks.size(); ++i) {
+      if (model->bricks[i].numCells() > model->bricks[biggest].numCells())
+        biggest = i;
+    }
+    const ExaBrick &brick = model->bricks[biggest];
+    const box3f domain = brick.getDomain();
+
+    std::vector<float> px(N), py(N), pz(N);
+    std::uniform_real_distribution<float> dx(domain.lower.x,domain.upper.x);
+    std::uniform_real_distribution<float> dy(domain.lower.y,domain.upper.y);
+    std::uniform_real_distribution<float> dz(domain.lower.z,domain.upper.z);
+    for (size_t i=0; i<N; ++i) {
+      px[i] = dx(rng); py[i] = dy(rng); pz[i] = dz(rng);
+    }
+
+    std::vector<float> scalarWV(N), scalarW(N), batchWV(N), batchW(N);
+
+    double scalarTime = bestOf(cmdline.numRuns,[&]() {
+      for (size_t i=0; i<N; ++i) {
+        scalarWV[i] = scalarW[i] = 0.f;
+        addBasisFunctions(sampler,scalarWV[i],scalarW[i],(int)biggest,vec3f(px[i],py[i],pz[i]));
+      }
+    });
+
+    BasisBatch batch{px.data(),py.data(),pz.data(),batchWV.data(),batchW.data(),N};
+    double batchTime = bestOf(cmdline.numRuns,[&]() {
+      std::fill(batchWV.begin(),batchWV.end(),0.f);
+      std::fill(batchW.begin(),batchW.end(),0.f);
+      addBasisFunctionsBatch(brick,sampler.scalarBuffer,batch);
+    });
+
+    float maxDiff = 0.f;
+    for (size_t i=0; i<N; ++i) {
+      maxDiff = std::max(maxDiff,fabsf(scalarWV[i]-batchWV[i]));
+      maxDiff = std::max(maxDiff,fabsf(scalarW[i]-batchW[i]));
+    }
+
+    std::cout << "#exa: kernel, brick " << brick.size << ", " << N << " positions\n";
+    std::cout << "  scalar: " << prettyDouble(scalarTime/N*1e9) << "ns/sample\n";
+    std::cout << "  batch:  " << prettyDouble(batchTime/N*1e9) << "ns/sample ("
+              << prettyDouble(scalarTime/batchTime) << "x), max diff: " << maxDiff << '\n';
+
+    // ==================================================================
+    // full sampler: locate ABRs, all bricks per ABR
+    // ==================================================================
+
+    const box3f bounds = model->cellBounds;
+    std::vector<vec3f> positions(N);
+    std::uniform_real_distribution<float> ux(bounds.lower.x,bounds.upper.x);
+    std::uniform_real_distribution<float> uy(bounds.lower.y,bounds.upper.y);
+    std::uniform_real_distribution<float> uz(bounds.lower.z,bounds.upper.z);
+    for (size_t i=0; i<N; ++i) {
+      positions[i] = vec3f(ux(rng),uy(rng),uz(rng));
+    }
+
+    std::vector<float> scalarValues(N), batchValues(N);
+    SpatialDomain sd;
+    double sampleTime = bestOf(cmdline.numRuns,[&]() {
+      for (size_t i=0; i<N; ++i) {
+        scalarValues[i] = sample(sampler,sd,positions[i]).value;
+      }
+    });
+
+    double sampleBatchTime = bestOf(cmdline.numRuns,[&]() {
+      sampleBatch(sampler,positions.data(),batchValues.data(),N);
+    });
+
+    maxDiff = 0.f;
+    for (size_t i=0; i<N; ++i) {
+      maxDiff = std::max(maxDiff,fabsf(scalarValues[i]-batchValues[i]));
+    }
+
+    std::cout << "#exa: sampler, " << model->bricks.size() << " bricks, "
+              << model->abrs.value.size() << " ABRs\n";
+    std::cout << "  sample():      " << prettyDouble(sampleTime/N*1e9) << "ns/sample (serial)\n";
+    std::cout << "  sampleBatch(): " << prettyDouble(sampleBatchTime/N*1e9) << "ns/sample (parallel, "
+              << prettyDouble(sampleTime/sampleBatchTime) << "x), max diff: " << maxDiff << '\n';
+
+    // ==================================================================
+    // ray marching: BVH descent per step vs. SampleCursor
+    // ==================================================================
+
+    const int numRays = 4096;
+    const float dt = 0.5f; // half a finest-level cell
+    std::vector<vec3f> origins(numRays), dirs(numRays);
+    for (int i=0; i<numRays; ++i) {
+      origins[i] = vec3f(ux(rng),uy(rng),uz(rng));
+      std::normal_distribution<float> nd;
+      dirs[i] = normalize(vec3f(nd(rng),nd(rng),nd(rng)));
+    }
+
+    auto march = [&](int rayID, const std::function<float(vec3f)> &sampleFunc) {
+      float sum = 0.f;
+      size_t numSteps = 0;
+      vec3f pos = origins[rayID];
+      while (bounds.contains(pos)) {
+        sum += sampleFunc(pos);
+        pos = pos + dirs[rayID]*dt;
+        numSteps++;
+      }
+      return std::make_pair(sum,numSteps);
+    };
+
+    size_t totalSteps = 0;
+    float plainSum = 0.f;
+    double plainTime = bestOf(1,[&]() {
+      totalSteps = 0; plainSum = 0.f;
+      for (int i=0; i<numRays; ++i) {
+        auto res = march(i,[&](vec3f pos) { return sample(sampler,sd,pos).value; });
+        plainSum += res.first;
+        totalSteps += res.second;
+      }
+    });
+
+    SampleCursor stats;
+    float cursorSum = 0.f;
+    double cursorTime = bestOf(1,[&]() {
+      cursorSum = 0.f;
+      for (int i=0; i<numRays; ++i) {
+        SampleCursor cursor;
+        auto res = march(i,[&](vec3f pos) { return sample(sampler,cursor,pos).value; });
+        cursorSum += res.first;
+        stats.numSamples += cursor.numSamples;
+        stats.numNeighborSteps += cursor.numNeighborSteps;
+        stats.numTraversals += cursor.numTraversals;
+      }
+    });
+
+    std::cout << "#exa: ray marching, " << numRays << " rays, " << totalSteps << " steps\n";
+    std::cout << "  w/o cursor: " << prettyDouble(plainTime/totalSteps*1e9) << "ns/step\n";
+    std::cout << "  w/ cursor:  " << prettyDouble(cursorTime/totalSteps*1e9) << "ns/step ("
+              << prettyDouble(plainTime/cursorTime) << "x), BVH traversals/step: "
+              << double(stats.numTraversals)/stats.numSamples << ", neighbor steps/step: "
+              << double(stats.numNeighborSteps)/stats.numSamples
+              << (plainSum == cursorSum ? "" : " (RESULTS DIFFER!)") << '\n';
+
+    // ==================================================================
+    // sampleBatch(): input order vs. sorted along Morton/Hilbert curve
+    // ==================================================================
+
+    // ray-coherent pattern: consecutive positions march along rays
+    std::vector<vec3f> rayPositions;
+    for (int i=0; rayPositions.size()<N; i=(i+1)%numRays) {
+      vec3f pos = origins[i];
+      while (bounds.contains(pos) && rayPositions.size()<N) {
+        rayPositions.push_back(pos);
+        pos = pos + dirs[i]*dt;
+      }
+    }
+
+    auto benchOrder = [&](const char *pattern, const std::vector<vec3f> &P) {
+      std::vector<float> reference(P.size()), values(P.size());
+      double inputTime = bestOf(cmdline.numRuns,[&]() {
+        sampleBatch(sampler,P.data(),reference.data(),P.size(),SAMPLE_ORDER_INPUT);
+      });
+      std::cout << "#exa: sampleBatch(), " << pattern << ", " << P.size() << " positions\n";
+      std::cout << "  input order: " << prettyDouble(inputTime/P.size()*1e9) << "ns/sample\n";
+
+      const std::pair<SampleOrder,const char *> orders[] = {
+        { SAMPLE_ORDER_MORTON,  "morton:     " },
+        { SAMPLE_ORDER_HILBERT, "hilbert:    " },
+      };
+      for (auto o : orders) {
+        double sortedTime = bestOf(cmdline.numRuns,[&]() {
+          sampleBatch(sampler,P.data(),values.data(),P.size(),o.first);
+        });
+        float maxDiff = 0.f;
+        for (size_t i=0; i<P.size(); ++i) {
+          maxDiff = std::max(maxDiff,fabsf(reference[i]-values[i]));
+        }
+        std::cout << "  " << o.second << " " << prettyDouble(sortedTime/P.size()*1e9)
+                  << "ns/sample (" << prettyDouble(inputTime/sortedTime)
+                  << "x, incl. sorting), max diff: " << maxDiff << '\n';
+      }
+    };
+
+    benchOrder("uniform random",positions);
+    benchOrder("ray coherent",rayPositions);
+
+    // ==================================================================
+    // AoS vs. SoA (hot/cold split) layout of ABRs
+    // ==================================================================
+
+    ExaBrickSamplerCPU soaSampler;
+    soaSampler.layout = ExaBrickSamplerCPU::LAYOUT_SOA;
+    soaSampler.withABRNeighbors = true;
+    soaSampler.build(model);
+
+    CacheMissCounter counter;
+    std::cout << "#exa: layout, ABRs: "
+              << prettyBytes(model->abrs.value.size()*sizeof(ABR)) << " (AoS) / "
+              << prettyBytes(model->abrs.arrays.bytes()) << " (SoA)"
+              << (counter.valid() ? "" : ", cache misses n/a") << '\n';
+
+    auto benchLayout = [&](const char *name, const ExaBrickSamplerCPU &s) {
+      std::vector<float> values(N);
+      long long misses = 0;
+      double randomTime = bestOf(cmdline.numRuns,[&]() {
+        counter.start();
+        for (size_t i=0; i<N; ++i) {
+          values[i] = sample(s,sd,positions[i]).value;
+        }
+        misses = counter.stop();
+      });
+
+      float maxDiff = 0.f;
+      for (size_t i=0; i<N; ++i) {
+        maxDiff = std::max(maxDiff,fabsf(scalarValues[i]-values[i]));
+      }
+
+      std::cout << "  " << name << " sample():     " << prettyDouble(randomTime/N*1e9) << "ns/sample";
+      if (counter.valid())
+        std::cout << ", " << double(misses)/N << " misses/sample";
+      std::cout << ", max diff: " << maxDiff << '\n';
+
+      float sum = 0.f;
+      double marchTime = bestOf(cmdline.numRuns,[&]() {
+        sum = 0.f;
+        counter.start();
+        for (int i=0; i<numRays; ++i) {
+          SampleCursor cursor;
+          sum += march(i,[&](vec3f pos) { return sample(s,cursor,pos).value; }).first;
+        }
+        misses = counter.stop();
+      });
+
+      std::cout << "  " << name << " w/ cursor:    " << prettyDouble(marchTime/totalSteps*1e9) << "ns/step";
+      if (counter.valid())
+        std::cout << ", " << double(misses)/totalSteps << " misses/step";
+      std::cout << (sum == cursorSum ? "" : " (RESULTS DIFFER!)") << '\n';
+
+      double batchTime = bestOf(cmdline.numRuns,[&]() {
+        sampleBatch(s,positions.data(),values.data(),N,SAMPLE_ORDER_HILBERT);
+      });
+
+      maxDiff = 0.f;
+      for (size_t i=0; i<N; ++i) {
+        maxDiff = std::max(maxDiff,fabsf(scalarValues[i]-values[i]));
+      }
+
+      std::cout << "  " << name << " sampleBatch(): " << prettyDouble(batchTime/N*1e9)
+                << "ns/sample (parallel, hilbert), max diff: " << maxDiff << '\n';
+    };
+
+    benchLayout("AoS",sampler);
+    benchLayout("SoA",soaSampler);
+  }
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -14,36 +14,53 @@
 // limitations under the License.                                           //
 // ======================================================================== //
 
-#include <fstream>
+#include "model/AccelFile.h"
 #include "model/ExaBrickModel.h"
 #include "common.h"
 #include "SAHBuilder.h"
 #include "SAHVolumeWrapper.h"
+#include "ToolUtils.h"
 
-/* tool to build a TF-dependent, majorant-optimized
-  kd-tree given an *ExaBricks* model */
+/* tool to build TF-dependent, majorant-optimized kd-trees given an
+  *ExaBricks* model; -xf takes a list of TFs, the builds for all of
+  them share the (TF-independent) value ranges of the candidate boxes;
+  -cache-size bounds how many of those are kept */
 namespace exa {
 
   struct {
     std::string scalarFileName = "";
     std::string exaBrickFileName = "";
-    std::string xfFileName = "";
+    std::vector<std::string> xfFileNames;
     std::string outFileName = "majorants.bin";
+    std::string bvhCacheFileName = "";
     std::vector<int> numLeaves;
+    size_t maxCachedRanges = size_t(1)<<20;
   } cmdline;
 
-  static std::vector<std::string> string_split(std::string s, char delim)
-  {
-    std::vector<std::string> result;
-
-    std::istringstream stream(s);
+  struct TransferFunction {
+    std::string        name; // to name the output files by
+    std::vector<float> colorMap;
+    range1f            absDomain;
+    range1f            relDomain;
+  };
 
-    for (std::string token; std::getline(stream, token, delim); )
-    {
-      result.push_back(token);
-    }
+  // file name w/o directory and extension
+  static std::string baseName(const std::string &fileName)
+  {
+    std::string result = fileName.substr(fileName.find_last_of("/\\")+1);
+    return result.substr(0,result.find_last_of('.'));
+  }
 
-    return result;
+  static TransferFunction loadNamedTF(const std::string &fileName)
+  {
+    const TFFile file = readTF(fileName);
+
+    TransferFunction xf;
+    xf.name = baseName(fileName);
+    xf.colorMap.assign(&file.colorMap.data()->x,&file.colorMap.data()->x+4*file.colorMap.size());
+    xf.absDomain = file.absDomain;
+    xf.relDomain = file.relDomain;
+    return xf;
   }
 
   extern "C" int main(int argc, char** argv)
@@ -59,7 +76,7 @@ namespace exa {
         cmdline.exaBrickFileName = argv[++i];
       }
       else if (arg == "-xf") {
-        cmdline.xfFileName = argv[++i];
+        cmdline.xfFileNames = string_split(argv[++i],',');
       }
       else if (arg == "-o") {
         cmdline.outFileName = argv[++i];
@@ -67,6 +84,12 @@ namespace exa {
       else if (arg == "-n") {
         numLeaves = argv[++i];
       }
+      else if (arg == "-bvh-cache") {
+        cmdline.bvhCacheFileName = argv[++i];
+      }
+      else if (arg == "-cache-size") {
+        cmdline.maxCachedRanges = std::stoull(argv[++i]);
+      }
     }
 
     if (cmdline.scalarFileName.empty()) {
@@ -77,8 +100,19 @@ namespace exa {
       throw std::runtime_error("No exabrick file given");
     }
 
-    if (cmdline.xfFileName.empty()) {
-      throw std::runtime_error("No transfer function file given");
+    if (cmdline.xfFileNames.empty()) {
+      throw std::runtime_error("No transfer function file given (-xf=XF1,XF2,...)");
+    }
+
+    // load all TFs up front, so bad files fail before hours of building
+    std::vector<TransferFunction> xfs;
+    for (const std::string &fileName : cmdline.xfFileNames) {
+      xfs.push_back(loadNamedTF(fileName));
+      for (size_t i=0; i+1<xfs.size(); ++i) {
+        if (xfs[i].name == xfs.back().name)
+          throw std::runtime_error("TF names must be distinct, output files are named by them: "
+                                   +xfs.back().name);
+      }
     }
 
     ExaBrickModel::SP model = ExaBrickModel::load(cmdline.exaBrickFileName,
@@ -93,79 +127,61 @@ namespace exa {
       throw std::runtime_error("No num leaves given (-n=N1,N2,N3,...)");
     }
 
-    // Load TF
-    std::ifstream xfFile(cmdline.xfFileName, std::ios::binary);
-
-    if (!xfFile.good()) {
-      throw std::runtime_error("Could not open TF");
-    }
-
-    static const size_t xfFileFormatMagic = 0x1235abc000;
-    size_t magic;
-    xfFile.read((char*)&magic,sizeof(xfFileFormatMagic));
-    if (magic != xfFileFormatMagic) {
-      throw std::runtime_error("Not a valid TF file");
-    }
-
-    float opacityScale;
-    xfFile.read((char*)&opacityScale,sizeof(opacityScale));
-
-    range1f absDomain;
-    xfFile.read((char*)&absDomain.lower,sizeof(absDomain.lower));
-    xfFile.read((char*)&absDomain.upper,sizeof(absDomain.upper));
-
-    range1f relDomain;
-    xfFile.read((char*)&relDomain,sizeof(relDomain));
-
-    std::vector<float> colorMap;
-    int numColorMapValues;
-    xfFile.read((char*)&numColorMapValues,sizeof(numColorMapValues));
-    colorMap.resize(numColorMapValues*4);
-    xfFile.read((char*)colorMap.data(),colorMap.size()*sizeof(colorMap[0]));
-
-    std::cout << "=== Color Map ===\n";
-    std::cout << "ABS range: " << absDomain << '\n';
-    std::cout << "REL range: " << relDomain << '\n';
-    std::cout << "Color map: " << numColorMapValues << " values\n";
-
-    std::cout << "Models value range is: " << model->valueRange << '\n';
-
-    // this happens twice in viewer.cpp, so we just do this here, too
-    // (and a 2nd time in the c'tor of SAHVolumeWrapper...)
-    range1f r{
-      model->valueRange.lower + (relDomain.lower/100.f) * (model->valueRange.upper-model->valueRange.lower),
-      model->valueRange.lower + (relDomain.upper/100.f) * (model->valueRange.upper-model->valueRange.lower),
-    };
-
     auto splt = string_split(numLeaves,',');
     for (auto s : splt) {
       cmdline.numLeaves.push_back(stoi(s));
     }
 
-    SAHVolumeWrapper vol(model,&colorMap,r,relDomain);
-    volkd::KDTree kdtree(vol,&colorMap,cmdline.numLeaves);
-
-    for (size_t i=0; i<kdtree.finalNodes.size(); ++i) {
-      int numLeaves = kdtree.finalNodes[i].size();
-      std::vector<std::pair<box3f,float>> domains;
-      while (!kdtree.finalNodes[i].empty()) {
-        volkd::Node node = kdtree.finalNodes[i].top();
-        kdtree.finalNodes[i].pop();
-        range1f tfRange = vol.min_max(node.domain,&colorMap);
-        std::cout << "Domain " << domains.size() << ": "
-                  << node.domain << ", majorant: " << tfRange.upper << '\n';
-        domains.push_back({node.domain,tfRange.upper});
+    std::cout << "Models value range is: " << model->valueRange << '\n';
+
+    // the TF domain is set per TF below
+    SAHVolumeWrapper vol(model,nullptr,{0.f,1.f},{0.f,100.f},cmdline.bvhCacheFileName);
+    vol.maxCachedRanges = cmdline.maxCachedRanges;
+
+    for (const TransferFunction &xf : xfs) {
+      std::cout << "=== Color Map " << xf.name << " ===\n";
+      std::cout << "ABS range: " << xf.absDomain << '\n';
+      std::cout << "REL range: " << xf.relDomain << '\n';
+      std::cout << "Color map: " << xf.colorMap.size()/4 << " values\n";
+
+      // this happens twice in viewer.cpp, so we just do this here, too
+      // (and a 2nd time in setXFDomain()...)
+      range1f r{
+        model->valueRange.lower + (xf.relDomain.lower/100.f) * (model->valueRange.upper-model->valueRange.lower),
+        model->valueRange.lower + (xf.relDomain.upper/100.f) * (model->valueRange.upper-model->valueRange.lower),
+      };
+
+      vol.setXFDomain(r,xf.relDomain);
+      volkd::KDTree kdtree(vol,&xf.colorMap,cmdline.numLeaves);
+
+      for (size_t i=0; i<kdtree.finalNodes.size(); ++i) {
+        int numLeaves = kdtree.finalNodes[i].size();
+        std::vector<std::pair<box3f,float>> domains;
+        while (!kdtree.finalNodes[i].empty()) {
+          volkd::Node node = kdtree.finalNodes[i].top();
+          kdtree.finalNodes[i].pop();
+          range1f tfRange = vol.min_max(node.domain,&xf.colorMap);
+          std::cout << "Domain " << domains.size() << ": "
+                    << node.domain << ", majorant: " << tfRange.upper << '\n';
+          domains.push_back({node.domain,tfRange.upper});
+        }
+
+        // w/ a single TF, the names remain as they were
+        std::string suffix = ".n"+std::to_string(numLeaves);
+        if (xfs.size() > 1)
+          suffix = "."+xf.name+suffix;
+        std::cout << "Writing to file: " << cmdline.outFileName+suffix << "\n\n";
+        if (!AccelFile::write(cmdline.outFileName+suffix,model->cellBounds,{
+              {AccelFile::MAJORANT_DOMAINS,sizeof(domains[0]),domains.size(),domains.data()}})) {
+          throw std::runtime_error("Could not write "+cmdline.outFileName+suffix);
+        }
       }
 
-      std::string suffix = ".n"+std::to_string(numLeaves);
-      std::cout << "Writing to file: " << cmdline.outFileName+suffix << "\n\n";
-      std::ofstream domainsFile(cmdline.outFileName+suffix, std::ios::binary);
-      uint64_t numDomains = domains.size();
-      domainsFile.write((char *)&numDomains,sizeof(numDomains));
-      domainsFile.write((char *)domains.data(),domains.size()*sizeof(domains[0]));
+      std::cout << "#exa: value range cache: " << prettyNumber(vol.cache.numHits) << " hits, "
+                << prettyNumber(vol.cache.numMisses) << " misses, "
+                << prettyNumber(vol.cache.numEvictions) << " shards cleared\n\n";
     }
   }
 } // ::exa
 
 // vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
-
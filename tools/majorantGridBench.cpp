@@ -0,0 +1,302 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "model/BrickBuilder.h"
+#include "model/ParallelReduce.h"
+#include "AdaptiveGrid.h"
+#include "GridResolution.h"
+#include "Quantization.h"
+#include "ToolUtils.h"
+
+/* compares a uniform majorant grid to an adaptive two-level one (see
+  AdaptiveGrid.h) built over the ABRs of an ExaBrick model: memory,
+  build time, and, for random rays, leaves visited, fraction of the
+  ray length skipped (majorant zero), avg. majorant (the lower, the
+  fewer null collisions delta tracking produces), and traversal cost;
+  also with value ranges and majorants quantized to 16 and 8 bits */
+namespace exa {
+
+  struct {
+    std::string brickFileName = "";
+    std::string scalarFileName = "";
+    std::string xfFileName = "";
+    size_t numRays = 1<<20;
+    int    dims = 64;      // coarsest cells per dimension (synthetic model)
+    int    uniformDims = 128;
+    int    coarseDims = 64;
+    int    refinement = 4;
+    float  threshold = 2.f;
+  } cmdline;
+
+  // transparent below 60% of the value range, opaque ramp above
+  static void makeTestTF(std::vector<vec4f> &colorMap)
+  {
+    colorMap.resize(128);
+    for (size_t i=0; i<colorMap.size(); ++i) {
+      const float x = i/float(colorMap.size()-1);
+      colorMap[i] = vec4f(vec3f(x),x < .6f ? 0.f : (x-.6f)/.4f);
+    }
+  }
+
+  struct RayStats {
+    double numLeaves = 0.0;
+    double length    = 0.0;
+    double skipped   = 0.0; // length with majorant zero
+  };
+
+  static void measure(const std::string name,
+                      const AdaptiveGrid &grid,
+                      const std::vector<vec3f> &orgs,
+                      const std::vector<vec3f> &dirs,
+                      size_t bytes)
+  {
+    const AdaptiveGridTraversable traversable = grid.traversable();
+    const float *maxOpacities = grid.maxOpacities.data();
+
+    RayStats stats = parallelReduce(orgs.size(),RayStats(),
+      [&](size_t begin, size_t end) {
+        RayStats result;
+        for (size_t i=begin; i<end; ++i) {
+          traverse(traversable,orgs[i],dirs[i],0.f,1e30f,
+            [&](int leafID, float t0, float t1) {
+              const float majorant = maxOpacities[leafID];
+              result.numLeaves += 1.0;
+              result.length += t1-t0;
+              result.skipped += majorant == 0.f ? t1-t0 : 0.f;
+              return true;
+            });
+        }
+        return result;
+      },
+      [](RayStats a, const RayStats &b) {
+        a.numLeaves += b.numLeaves;
+        a.length += b.length;
+        a.skipped += b.skipped;
+        return a;
+      });
+
+    // traversal only, accumulating the majorant like a tracker would
+    const double t0 = getCurrentTime();
+    const double majorant = parallelReduce(orgs.size(),0.0,
+      [&](size_t begin, size_t end) {
+        double result = 0.0;
+        for (size_t i=begin; i<end; ++i) {
+          traverse(traversable,orgs[i],dirs[i],0.f,1e30f,
+            [&](int leafID, float t0, float t1) {
+              result += maxOpacities[leafID]*(t1-t0);
+              return true;
+            });
+        }
+        return result;
+      },
+      [](double a, double b) { return a+b; });
+    const double t1 = getCurrentTime();
+
+    const double numRays = (double)orgs.size();
+    std::cout << name << prettyBytes(bytes) << ", built in "
+              << prettyDouble(grid.stats.buildTime) << "s, "
+              << prettyNumber(grid.numLeaves()) << " leaves\n";
+    std::cout << "  leaves/ray: " << stats.numLeaves/numRays
+              << ", skipped: " << (stats.length > 0.0 ? 100.0*stats.skipped/stats.length : 0.0)
+              << "% of ray length, avg. majorant: "
+              << (stats.length > 0.0 ? majorant/stats.length : 0.0)
+              << ", " << prettyDouble((t1-t0)/numRays*1e9) << "ns/ray\n";
+  }
+
+  /*! round-trip the grid's value ranges and majorants through T-bit
+    quantization (with one scale each), as a quantized grid would
+    store them; returns the number of non-conservative majorants
+    (should be zero) */
+  template <typename T>
+  static size_t quantize(AdaptiveGrid &grid,
+                         const std::vector<vec4f> &colorMap,
+                         range1f xfRange)
+  {
+    const std::vector<float> reference = grid.maxOpacities;
+
+    std::vector<QuantizedRange<T>> codes;
+    const RangeQuantizer<T> rq = quantizeRanges(grid.valueRanges,codes);
+    parallel_for_blocked(0ull,grid.valueRanges.size(),4096,[&](size_t begin, size_t end) {
+      for (size_t i=begin; i<end; ++i) {
+        grid.valueRanges[i] = rq.decode(codes[i]);
+      }
+    });
+
+    grid.computeMaxOpacities(colorMap.data(),colorMap.size(),xfRange);
+
+    const MajorantQuantizer<T> mq = MajorantQuantizer<T>::make();
+    size_t numViolations = 0;
+    for (size_t i=0; i<grid.maxOpacities.size(); ++i) {
+      grid.maxOpacities[i] = mq.decode(mq.encode(grid.maxOpacities[i]));
+      if (grid.maxOpacities[i] < reference[i]) numViolations++;
+    }
+    return numViolations;
+  }
+
+  template <typename T>
+  static size_t quantizedBytes(const AdaptiveGrid &grid)
+  {
+    return grid.cells.size()*sizeof(grid.cells[0])
+         + grid.numLeaves()*(sizeof(QuantizedRange<T>)+sizeof(T));
+  }
+
+  extern "C" int main(int argc, char** argv)
+  {
+    for (int i=1;i<argc;i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "-bricks") {
+        cmdline.brickFileName = argv[++i];
+      }
+      else if (arg == "-scalar" || arg == "-scalars") {
+        cmdline.scalarFileName = argv[++i];
+      }
+      else if (arg == "-xf") {
+        cmdline.xfFileName = argv[++i];
+      }
+      else if (arg == "-n") {
+        cmdline.numRays = std::stoull(argv[++i]);
+      }
+      else if (arg == "-dims") {
+        cmdline.dims = std::stoi(argv[++i]);
+      }
+      else if (arg == "-uniform") {
+        // "auto": as chosen by GridResolution
+        const std::string dims = argv[++i];
+        cmdline.uniformDims = dims == "auto" ? 0 : std::stoi(dims);
+      }
+      else if (arg == "-coarse") {
+        cmdline.coarseDims = std::stoi(argv[++i]);
+      }
+      else if (arg == "-refine") {
+        cmdline.refinement = std::stoi(argv[++i]);
+      }
+      else if (arg == "-threshold") {
+        cmdline.threshold = std::stof(argv[++i]);
+      }
+    }
+
+    ExaBrickModel::SP model;
+    if (!cmdline.brickFileName.empty()) {
+      model = ExaBrickModel::load(cmdline.brickFileName,cmdline.scalarFileName,"");
+    } else {
+      model = BrickBuilder::makeModel(makeFeatureRefinedModel(cmdline.dims),4);
+    }
+
+    if (!model) {
+      throw std::runtime_error("Could not create model");
+    }
+
+    std::vector<vec4f> colorMap;
+    range1f xfRange = model->valueRange;
+    if (!cmdline.xfFileName.empty()) {
+      xfRange = loadTF(cmdline.xfFileName,model->valueRange,colorMap);
+    } else {
+      makeTestTF(colorMap);
+    }
+
+    model->abrs.buildSoA();
+    const ABRArrays &abrs = model->abrs.arrays;
+    const box3f bounds = parallelBounds(abrs.domain.size(),
+                                        [&](size_t i) { return abrs.domain[i]; });
+
+    std::cout << "#exa: " << prettyNumber(abrs.domain.size()) << " ABRs, bounds: "
+              << bounds << ", value range: " << model->valueRange
+              << ", TF range: " << xfRange << '\n';
+
+    vec3i uniformDims(cmdline.uniformDims);
+    if (cmdline.uniformDims <= 0) {
+      GridResolution res;
+      model->getGridStatistics(res);
+      uniformDims = res.choose();
+      res.printStats();
+    }
+
+    AdaptiveGrid uniform;
+    uniform.build(abrs.domain.data(),abrs.valueRange.data(),abrs.domain.size(),
+                  bounds,uniformDims,1);
+    uniform.computeMaxOpacities(colorMap.data(),colorMap.size(),xfRange);
+
+    AdaptiveGrid adaptive;
+    adaptive.build(abrs.domain.data(),abrs.valueRange.data(),abrs.domain.size(),
+                   bounds,vec3i(cmdline.coarseDims),cmdline.refinement,
+                   cmdline.threshold);
+    adaptive.computeMaxOpacities(colorMap.data(),colorMap.size(),xfRange);
+    adaptive.printStats();
+
+    // rays from a sphere around the model through random interior points
+    std::vector<vec3f> orgs(cmdline.numRays), dirs(cmdline.numRays);
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist;
+    const vec3f center = bounds.center();
+    const float radius = length(bounds.size());
+    for (size_t i=0; i<orgs.size(); ++i) {
+      vec3f o;
+      do {
+        o = vec3f(dist(rng),dist(rng),dist(rng))*2.f-vec3f(1.f);
+      } while (dot(o,o) > 1.f || dot(o,o) < 1e-3f);
+      orgs[i] = center+normalize(o)*radius;
+      const vec3f target = bounds.lower+vec3f(dist(rng),dist(rng),dist(rng))*bounds.size();
+      dirs[i] = normalize(target-orgs[i]);
+    }
+
+    const std::string uniformName = "uniform "+std::to_string(uniformDims.x)+"x"
+                                  + std::to_string(uniformDims.y)+"x"
+                                  + std::to_string(uniformDims.z);
+    const std::string adaptiveName = "adaptive "+std::to_string(cmdline.coarseDims)+"^3 x "
+                                   + std::to_string(cmdline.refinement)+"^3";
+
+    std::cout << "#exa: " << prettyNumber(orgs.size()) << " rays\n";
+    measure(uniformName+": ",uniform,orgs,dirs,uniform.bytes());
+    measure(adaptiveName+": ",adaptive,orgs,dirs,adaptive.bytes());
+
+    for (int bits : {16,8}) {
+      AdaptiveGrid quantizedUniform = uniform, quantizedAdaptive = adaptive;
+      size_t numViolations = 0;
+      size_t uniformBytes = 0, adaptiveBytes = 0;
+      if (bits == 16) {
+        numViolations += quantize<uint16_t>(quantizedUniform,colorMap,xfRange);
+        numViolations += quantize<uint16_t>(quantizedAdaptive,colorMap,xfRange);
+        uniformBytes = quantizedBytes<uint16_t>(uniform);
+        adaptiveBytes = quantizedBytes<uint16_t>(adaptive);
+      } else {
+        numViolations += quantize<uint8_t>(quantizedUniform,colorMap,xfRange);
+        numViolations += quantize<uint8_t>(quantizedAdaptive,colorMap,xfRange);
+        uniformBytes = quantizedBytes<uint8_t>(uniform);
+        adaptiveBytes = quantizedBytes<uint8_t>(adaptive);
+      }
+
+      const std::string suffix = ", "+std::to_string(bits)+" bits: ";
+      measure(uniformName+suffix,quantizedUniform,orgs,dirs,uniformBytes);
+      measure(adaptiveName+suffix,quantizedAdaptive,orgs,dirs,adaptiveBytes);
+
+      if (numViolations > 0) {
+        std::cerr << "#exa: " << numViolations << " non-conservative majorants!\n";
+        return 1;
+      }
+    }
+
+    return 0;
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,187 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cuda_runtime.h>
+#include <owl/helper/cuda.h>
+#include "model/QuickClustersBuilder.h"
+
+/* tool to sort the elements of a umesh along a space-filling curve
+  on the host, the same way QuickClustersSampler does it on the GPU;
+  writes the reordered umesh. With -compare-gpu, the GPU path is run
+  too (if there's a device) and the reordered indices are compared */
+namespace exa {
+
+  // GPU path, QuickClustersSampler.cu
+  void sortElements(const size_t numElements,
+                    const vec4f *d_vertices,
+                    const int *d_indices,
+                    uint64_t **d_sortedElementCodes,
+                    uint32_t **d_sortedElementIDs);
+
+  void reorderElements(const size_t numElements,
+                       const uint32_t *d_sortedElementIDs,
+                       const vec4f *d_vertices,
+                       const int *d_indices,
+                       int **d_sortedIndices);
+
+  struct {
+    std::string umeshFileName = "";
+    std::string outFileName = "out.umesh";
+    QuickClustersBuilder::Curve curve = QuickClustersBuilder::HILBERT;
+    uint32_t maxNumClusters = 0;
+    uint32_t maxElementsPerCluster = 0;
+    bool reorderVertices = false;
+    bool compareGPU = false;
+  } cmdline;
+
+  /*! sort and reorder the indices w/ the GPU path; returns false if
+    there's no CUDA device */
+  static bool reorderOnGPU(const std::vector<vec4f> &vertices,
+                           const std::vector<int> &indices,
+                           std::vector<int> &sortedIndices)
+  {
+    int numDevices = 0;
+    if (cudaGetDeviceCount(&numDevices) != cudaSuccess || numDevices == 0)
+      return false;
+
+    const size_t numElements = indices.size()/8;
+
+    vec4f *d_vertices = nullptr;
+    int *d_indices = nullptr;
+    OWL_CUDA_CHECK(cudaMalloc((void **)&d_vertices,vertices.size()*sizeof(vec4f)));
+    OWL_CUDA_CHECK(cudaMalloc((void **)&d_indices,indices.size()*sizeof(int)));
+    OWL_CUDA_CHECK(cudaMemcpy(d_vertices,vertices.data(),vertices.size()*sizeof(vec4f),
+                              cudaMemcpyHostToDevice));
+    OWL_CUDA_CHECK(cudaMemcpy(d_indices,indices.data(),indices.size()*sizeof(int),
+                              cudaMemcpyHostToDevice));
+
+    uint64_t *d_sortedCodes = nullptr;
+    uint32_t *d_sortedElementIDs = nullptr;
+    sortElements(numElements,d_vertices,d_indices,&d_sortedCodes,&d_sortedElementIDs);
+    OWL_CUDA_SYNC_CHECK();
+
+    int *d_sortedIndices = nullptr;
+    reorderElements(numElements,d_sortedElementIDs,d_vertices,d_indices,&d_sortedIndices);
+    OWL_CUDA_SYNC_CHECK();
+
+    sortedIndices.resize(indices.size());
+    OWL_CUDA_CHECK(cudaMemcpy(sortedIndices.data(),d_sortedIndices,indices.size()*sizeof(int),
+                              cudaMemcpyDeviceToHost));
+
+    cudaFree(d_sortedIndices);
+    cudaFree(d_sortedElementIDs);
+    cudaFree(d_sortedCodes);
+    cudaFree(d_indices);
+    cudaFree(d_vertices);
+    return true;
+  }
+
+  extern "C" int main(int argc, char** argv)
+  {
+    for (int i=1;i<argc;i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "-umesh") {
+        cmdline.umeshFileName = argv[++i];
+      }
+      else if (arg == "-o") {
+        cmdline.outFileName = argv[++i];
+      }
+      else if (arg == "-morton") {
+        cmdline.curve = QuickClustersBuilder::MORTON;
+      }
+      else if (arg == "-hilbert") {
+        cmdline.curve = QuickClustersBuilder::HILBERT;
+      }
+      else if (arg == "-max-clusters") {
+        cmdline.maxNumClusters = std::stoul(argv[++i]);
+      }
+      else if (arg == "-max-elems-per-cluster") {
+        cmdline.maxElementsPerCluster = std::stoul(argv[++i]);
+      }
+      else if (arg == "-reorder-vertices") {
+        cmdline.reorderVertices = true;
+      }
+      else if (arg == "-compare-gpu") {
+        cmdline.compareGPU = true;
+      }
+      else {
+        cmdline.umeshFileName = arg;
+      }
+    }
+
+    if (cmdline.umeshFileName.empty()) {
+      throw std::runtime_error("No umesh file given");
+    }
+
+    QuickClustersModel::SP model = QuickClustersModel::load(cmdline.umeshFileName);
+
+    if (!model || model->indices.empty()) {
+      throw std::runtime_error("Could not load umesh");
+    }
+
+    if (cmdline.compareGPU && cmdline.curve != QuickClustersBuilder::HILBERT) {
+      throw std::runtime_error("-compare-gpu requires -hilbert (the GPU path's curve)");
+    }
+
+    // run before build(), which reorders the model's indices in place
+    std::vector<int> gpuIndices;
+    const bool haveGPU = cmdline.compareGPU
+        && reorderOnGPU(model->vertices,model->indices,gpuIndices);
+    if (cmdline.compareGPU && !haveGPU) {
+      std::cout << "#exa: no CUDA device, skipping the GPU comparison\n";
+    }
+
+    QuickClustersBuilder builder;
+    builder.build(model,cmdline.curve);
+
+    if (haveGPU) {
+      const std::vector<int> &indices = model->indices;
+      size_t numMismatches = 0, firstMismatch = 0;
+      for (size_t i=0; i<indices.size(); i+=8) {
+        if (!std::equal(indices.begin()+i,indices.begin()+i+8,gpuIndices.begin()+i)) {
+          if (numMismatches++ == 0)
+            firstMismatch = i/8;
+        }
+      }
+      if (numMismatches > 0) {
+        std::cerr << "#exa: CPU and GPU orderings differ in " << numMismatches
+                  << " of " << indices.size()/8 << " elements, first at element "
+                  << firstMismatch << '\n';
+        return 1;
+      }
+      std::cout << "#exa: CPU and GPU orderings match\n";
+    }
+
+    if (cmdline.maxNumClusters > 0 || cmdline.maxElementsPerCluster > 0) {
+      builder.buildClusters(cmdline.maxNumClusters,cmdline.maxElementsPerCluster);
+    }
+
+    builder.printStats();
+
+    std::cout << "Writing to file: " << cmdline.outFileName << '\n';
+    if (!QuickClustersBuilder::save(model,cmdline.outFileName,cmdline.reorderVertices)) {
+      throw std::runtime_error("Could not write "+cmdline.outFileName);
+    }
+  }
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
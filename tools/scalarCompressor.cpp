@@ -0,0 +1,160 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <owl/common/parallel/parallel_for.h>
+#include "model/ScalarFile.h"
+#include "common.h"
+
+/* tool to convert raw .scalars files into the chunked, compressed
+  container understood by the model loaders, and to compare read
+  bandwidth of the two */
+namespace exa {
+
+  struct {
+    std::string inFileName = "";
+    std::string outFileName = "";
+    size_t chunkSize = 1<<20;
+    uint32_t filter = ScalarFile::FILTER_SHUFFLE|ScalarFile::FILTER_XOR_DELTA;
+    int benchRuns = 0;
+  } cmdline;
+
+  static size_t fileSize(const std::string fileName)
+  {
+    std::ifstream in(fileName, std::ios::binary | std::ios::ate);
+    return in.good() ? (size_t)in.tellg() : 0;
+  }
+
+  // returns the best read time in seconds
+  static double benchRead(const std::string fileName,
+                          std::vector<float> &scalars,
+                          int numRuns)
+  {
+    double best = 1e30;
+    for (int i=0; i<numRuns; ++i) {
+      double t0 = getCurrentTime();
+      if (!ScalarFile::read(fileName,scalars))
+        throw std::runtime_error("Could not read "+fileName);
+      double t1 = getCurrentTime();
+      best = std::min(best,t1-t0);
+    }
+    return best;
+  }
+
+  extern "C" int main(int argc, char** argv)
+  {
+    for (int i=1;i<argc;i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "-o") {
+        cmdline.outFileName = argv[++i];
+      }
+      else if (arg == "-chunk") {
+        cmdline.chunkSize = std::stoull(argv[++i]);
+      }
+      else if (arg == "-filter") {
+        const std::string f = argv[++i];
+        if (f == "none")
+          cmdline.filter = ScalarFile::FILTER_NONE;
+        else if (f == "shuffle")
+          cmdline.filter = ScalarFile::FILTER_SHUFFLE;
+        else if (f == "xor")
+          cmdline.filter = ScalarFile::FILTER_XOR_DELTA;
+        else if (f == "xor+shuffle")
+          cmdline.filter = ScalarFile::FILTER_SHUFFLE|ScalarFile::FILTER_XOR_DELTA;
+        else
+          throw std::runtime_error("Unknown filter (none|shuffle|xor|xor+shuffle): "+f);
+      }
+      else if (arg == "-bench") {
+        cmdline.benchRuns = std::stoi(argv[++i]);
+      }
+      else if (arg[0] != '-') {
+        cmdline.inFileName = arg;
+      }
+      else {
+        throw std::runtime_error("Unknown option: "+arg);
+      }
+    }
+
+    if (cmdline.inFileName.empty()) {
+      throw std::runtime_error("No input scalar file given");
+    }
+
+    if (cmdline.outFileName.empty()) {
+      cmdline.outFileName = cmdline.inFileName+".exaz";
+    }
+
+    std::vector<float> scalars;
+    if (!ScalarFile::read(cmdline.inFileName,scalars)) {
+      throw std::runtime_error("Could not read scalar file "+cmdline.inFileName);
+    }
+
+    std::cout << "#exa: compressing " << scalars.size() << " scalars, chunk size: "
+              << cmdline.chunkSize << ", filter: " << cmdline.filter << '\n';
+
+    double t0 = getCurrentTime();
+    if (!ScalarFile::write(cmdline.outFileName,scalars.data(),scalars.size(),
+                           cmdline.filter,cmdline.chunkSize)) {
+      throw std::runtime_error("Could not write "+cmdline.outFileName);
+    }
+    double t1 = getCurrentTime();
+
+    size_t rawBytes = scalars.size()*sizeof(float);
+    size_t outBytes = fileSize(cmdline.outFileName);
+    std::cout << "#exa: wrote " << cmdline.outFileName << " ("
+              << prettyBytes(rawBytes) << " -> " << prettyBytes(outBytes)
+              << ", ratio: " << (outBytes ? double(rawBytes)/outBytes : 0.0)
+              << ") in " << prettyDouble(t1-t0) << "s\n";
+
+    if (cmdline.benchRuns <= 0)
+      return 0;
+
+    // write the raw reference so we compare like with like, even
+    // if the input already was a compressed container
+    const std::string rawFileName = cmdline.outFileName+".raw";
+    {
+      std::ofstream raw(rawFileName, std::ios::binary);
+      raw.write((const char *)scalars.data(),rawBytes);
+    }
+
+    std::vector<float> rawScalars, compressedScalars;
+    double rawTime = benchRead(rawFileName,rawScalars,cmdline.benchRuns);
+    double compressedTime = benchRead(cmdline.outFileName,compressedScalars,cmdline.benchRuns);
+
+    std::remove(rawFileName.c_str());
+
+    bool exact = compressedScalars.size() == scalars.size()
+        && memcmp(compressedScalars.data(),scalars.data(),rawBytes) == 0;
+
+    std::cout << "#exa: raw read:        " << prettyDouble(rawTime) << "s ("
+              << prettyDouble(rawBytes/rawTime/(1<<20)) << "MB/s)\n";
+    std::cout << "#exa: compressed read: " << prettyDouble(compressedTime) << "s ("
+              << prettyDouble(rawBytes/compressedTime/(1<<20)) << "MB/s effective, "
+              << prettyDouble(outBytes/compressedTime/(1<<20)) << "MB/s from disk)\n";
+    std::cout << "#exa: round trip is " << (exact ? "bit-exact" : "NOT bit-exact!") << '\n';
+
+    return exact ? 0 : 1;
+  }
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,146 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "SpaceFillingCurves.h"
+#include "ToolUtils.h"
+
+/* throughput of the space-filling curve encoders (Morton, Hilbert via
+  hilbert_c2i, table-driven Hilbert) and decoders, single-threaded;
+  also checks that the table-driven versions are bit-exact */
+namespace exa {
+
+  struct {
+    size_t numKeys = 1<<22;
+    unsigned numBits = 16;
+    int numRuns = 5;
+  } cmdline;
+
+  static void report(const std::string name, double seconds, size_t n, double reference = 0.0)
+  {
+    std::cout << "  " << name << prettyDouble(n/seconds) << " keys/s";
+    if (reference > 0.0)
+      std::cout << " (" << prettyDouble(reference/seconds) << "x)";
+    std::cout << '\n';
+  }
+
+  extern "C" int main(int argc, char** argv)
+  {
+    for (int i=1;i<argc;i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "-n") {
+        cmdline.numKeys = std::stoull(argv[++i]);
+      }
+      else if (arg == "-bits") {
+        cmdline.numBits = std::stoi(argv[++i]);
+      }
+      else if (arg == "-runs") {
+        cmdline.numRuns = std::stoi(argv[++i]);
+      }
+      else {
+        throw std::runtime_error("Unknown option: "+arg);
+      }
+    }
+
+    const size_t N = cmdline.numKeys;
+    const unsigned nBits = cmdline.numBits;
+
+    if (nBits < 1 || nBits > 21)
+      throw std::runtime_error("Number of bits must be in [1..21]");
+
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<uint32_t> dist(0,(1u<<nBits)-1);
+    std::vector<uint32_t> x(N), y(N), z(N);
+    std::vector<float> fx(N), fy(N), fz(N);
+    for (size_t i=0; i<N; ++i) {
+      x[i] = dist(rng); y[i] = dist(rng); z[i] = dist(rng);
+      fx[i] = x[i]/float(1<<nBits); fy[i] = y[i]/float(1<<nBits); fz[i] = z[i]/float(1<<nBits);
+    }
+
+    std::vector<uint64_t> reference(N), keys(N);
+
+    // ==================================================================
+    // encoders
+    // ==================================================================
+
+    std::cout << "#exa: encoding " << N << " keys, " << nBits << " bits/axis\n";
+
+    double mortonTime = bestOf(cmdline.numRuns,[&]() {
+      for (size_t i=0; i<N; ++i)
+        keys[i] = morton64_encode3D(fx[i],fy[i],fz[i]);
+    });
+
+    double c2iTime = bestOf(cmdline.numRuns,[&]() {
+      for (size_t i=0; i<N; ++i) {
+        const bitmask_t coord[3] = {x[i],y[i],z[i]};
+        reference[i] = hilbert_c2i(3,nBits,coord);
+      }
+    });
+
+    double lutTime = bestOf(cmdline.numRuns,[&]() {
+      for (size_t i=0; i<N; ++i)
+        keys[i] = hilbert3D_encode(x[i],y[i],z[i],nBits);
+    });
+    bool exact = keys == reference;
+
+    double lutBatchTime = bestOf(cmdline.numRuns,[&]() {
+      hilbert3D_encode(x.data(),y.data(),z.data(),keys.data(),N,nBits);
+    });
+    exact &= keys == reference;
+
+    report("morton64_encode3D:    ",mortonTime,N,c2iTime);
+    report("hilbert_c2i:          ",c2iTime,N);
+    report("hilbert3D_encode:     ",lutTime,N,c2iTime);
+    report("hilbert3D_encode (n): ",lutBatchTime,N,c2iTime);
+
+    // ==================================================================
+    // decoders
+    // ==================================================================
+
+    std::vector<uint32_t> dx(N), dy(N), dz(N);
+
+    double i2cTime = bestOf(cmdline.numRuns,[&]() {
+      for (size_t i=0; i<N; ++i) {
+        bitmask_t coord[3];
+        hilbert_i2c(3,nBits,reference[i],coord);
+        dx[i] = (uint32_t)coord[0]; dy[i] = (uint32_t)coord[1]; dz[i] = (uint32_t)coord[2];
+      }
+    });
+    exact &= dx == x && dy == y && dz == z;
+
+    double lutDecodeTime = bestOf(cmdline.numRuns,[&]() {
+      for (size_t i=0; i<N; ++i)
+        hilbert3D_decode(reference[i],dx[i],dy[i],dz[i],nBits);
+    });
+    exact &= dx == x && dy == y && dz == z;
+
+    std::cout << "#exa: decoding\n";
+    report("hilbert_i2c:          ",i2cTime,N);
+    report("hilbert3D_decode:     ",lutDecodeTime,N,i2cTime);
+
+    std::cout << "#exa: table-driven Hilbert curve is "
+              << (exact ? "bit-exact" : "NOT bit-exact!") << '\n';
+
+    return exact ? 0 : 1;
+  }
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,118 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <owl/common/parallel/parallel_for.h>
+#include "TFRangeMax.h"
+#include "ToolUtils.h"
+
+/* benchmark for per-cell majorant computation: scanning the color map
+  span a value range maps to vs. O(1) range-max queries on a sparse
+  table (TFRangeMax), for color maps of 256 to 64K entries */
+namespace exa {
+
+  struct {
+    size_t numRanges = 1<<20;
+    int    numRuns = 3;
+  } cmdline;
+
+  extern "C" int main(int argc, char** argv)
+  {
+    for (int i=1;i<argc;i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "-n") {
+        cmdline.numRanges = std::stoull(argv[++i]);
+      }
+      else if (arg == "-runs") {
+        cmdline.numRuns = std::stoi(argv[++i]);
+      }
+    }
+
+    const range1f xfRange(0.f,1.f);
+
+    // cell value ranges, widths log-uniformly distributed over
+    // [1e-4,1] of the TF range, like AMR cells up to coarse MCs
+    std::vector<range1f> valueRanges(cmdline.numRanges);
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist;
+    for (size_t i=0; i<valueRanges.size(); ++i) {
+      const float width = powf(10.f,-4.f*dist(rng));
+      const float lower = dist(rng)*(1.f-width);
+      valueRanges[i] = range1f(lower,lower+width);
+    }
+
+    std::cout << "#exa: " << prettyNumber(valueRanges.size()) << " value ranges\n";
+
+    for (size_t numColors=256; numColors<=(1<<16); numColors*=4) {
+      std::vector<vec4f> colorMap(numColors);
+      for (size_t i=0; i<numColors; ++i) {
+        colorMap[i] = vec4f(vec3f(i/float(numColors-1)),dist(rng)*dist(rng));
+      }
+
+      std::vector<float> reference(valueRanges.size());
+      std::vector<float> result(valueRanges.size());
+
+      double scanTime = bestOf(cmdline.numRuns,[&]() {
+        parallel_for_blocked(0ull,valueRanges.size(),4096,[&](size_t begin, size_t end) {
+          for (size_t i=begin; i<end; ++i) {
+            reference[i] = maxOpacity(valueRanges[i],colorMap.data(),numColors,xfRange);
+          }
+        });
+      });
+
+      TFRangeMax xfRangeMax;
+      double buildTime = bestOf(cmdline.numRuns,[&]() {
+        xfRangeMax.build(colorMap.data(),numColors);
+      });
+
+      const TFRangeMaxTraversable rm = xfRangeMax.traversable();
+      double queryTime = bestOf(cmdline.numRuns,[&]() {
+        parallel_for_blocked(0ull,valueRanges.size(),4096,[&](size_t begin, size_t end) {
+          for (size_t i=begin; i<end; ++i) {
+            result[i] = maxOpacity(valueRanges[i],rm,xfRange);
+          }
+        });
+      });
+
+      size_t numMismatches = 0;
+      for (size_t i=0; i<result.size(); ++i) {
+        if (result[i] != reference[i]) numMismatches++;
+      }
+
+      std::cout << "TF size " << numColors << ":\n"
+                << "  scan       : " << prettyDouble(scanTime) << "s ("
+                << prettyDouble(scanTime/valueRanges.size()*1e9) << "ns/range)\n"
+                << "  range-max  : " << prettyDouble(buildTime+queryTime) << "s ("
+                << prettyDouble(queryTime/valueRanges.size()*1e9) << "ns/range, build "
+                << prettyDouble(buildTime*1e3) << "ms, " << prettyBytes(xfRangeMax.bytes())
+                << "), speedup " << scanTime/(buildTime+queryTime) << "x\n";
+
+      if (numMismatches > 0) {
+        std::cerr << "#exa: " << numMismatches << " mismatches!\n";
+        return 1;
+      }
+    }
+
+    return 0;
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
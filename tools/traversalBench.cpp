@@ -0,0 +1,458 @@
+// ======================================================================== //
+// Copyright 2022-2022 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "model/BrickBuilder.h"
+#include "model/ParallelReduce.h"
+#include "sampler/ExaBrickSamplerCPU.h"
+#include "sampler/ParallelBVHBuilder.h"
+#include "AdaptiveGrid.h"
+#include "DDA.h"
+#include "GridResolution.h"
+#include "KDTree.cuh"
+#include "KDTree.h"
+#include "TFRangeMax.h"
+#include "ToolUtils.h"
+
+/* CPU comparison of the space skipping structures selectable with
+  EXA_STITCH_EXA_BRICK_TRAVERSAL_MODE: the uniform majorant grid
+  (dda3, MC_DDA_TRAVERSAL), the kd-tree over bricks (kd::traceRay-
+  Internal, EXABRICK_KDTREE_TRAVERSAL) and the ABR BVH (EXABRICK_ABR_-
+  TRAVERSAL), traversed the way the device code does, for random,
+  orthographic or pinhole ray sets. Reports steps (segments handed to
+  the tracker) per ray, the fraction of the ray length inside the
+  model that is skipped (majorant zero, or not covered at all), and
+  traversal throughput */
+namespace exa {
+
+  struct {
+    std::string brickFileName = "";
+    std::string scalarFileName = "";
+    std::string xfFileName = "";
+    std::string rays = "random"; // random, ortho, pinhole
+    size_t numRays = 1<<20;
+    int    dims = 64;            // coarsest cells per dimension (synthetic model)
+    int    gridDims = 0;         // 0: as chosen by GridResolution
+    int    numRuns = 3;
+  } cmdline;
+
+  struct HostRay {
+    vec3f origin;
+    vec3f direction;
+    float tmin;
+    float tmax;
+  };
+
+  struct RayStats {
+    double numSteps = 0.0;
+    double length   = 0.0;
+    double skipped  = 0.0; // length not covered by a non-zero majorant
+  };
+
+  // transparent below 60% of the value range, opaque ramp above
+  static void makeTestTF(std::vector<vec4f> &colorMap)
+  {
+    colorMap.resize(128);
+    for (size_t i=0; i<colorMap.size(); ++i) {
+      const float x = i/float(colorMap.size()-1);
+      colorMap[i] = vec4f(vec3f(x),x < .6f ? 0.f : (x-.6f)/.4f);
+    }
+  }
+
+  static bool clip(const HostRay &ray, const box3f &box, float &t0, float &t1)
+  {
+    const vec3f lo = (box.lower-ray.origin)/ray.direction;
+    const vec3f hi = (box.upper-ray.origin)/ray.direction;
+    t0 = fmaxf(ray.tmin,reduce_max(min(lo,hi)));
+    t1 = fminf(ray.tmax,reduce_min(max(lo,hi)));
+    return t0 < t1;
+  }
+
+  /*! rays of the given set, clipped to bounds like the renderer does
+    before traversal (origin moved to the entry point, tmax at the
+    exit); rays missing bounds are dropped */
+  static std::vector<HostRay> makeRays(const std::string set,
+                                       size_t numRays,
+                                       const box3f &bounds)
+  {
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist;
+    const vec3f center = bounds.center();
+    const float radius = length(bounds.size());
+
+    // view direction for ortho and pinhole, not axis-aligned
+    const vec3f viewDir = normalize(vec3f(-.6f,-.45f,-.66f));
+    const vec3f u = normalize(cross(viewDir,vec3f(0.f,1.f,0.f)));
+    const vec3f v = cross(u,viewDir);
+    const int imageSize = std::max(1,(int)sqrtf((float)numRays));
+
+    std::vector<HostRay> rays(set == "random" ? numRays : size_t(imageSize)*imageSize);
+    for (size_t i=0; i<rays.size(); ++i) {
+      const float x = ((i%imageSize)+.5f)/imageSize*2.f-1.f;
+      const float y = ((i/imageSize)+.5f)/imageSize*2.f-1.f;
+      HostRay &ray = rays[i];
+      if (set == "random") {
+        // from a sphere around the model through random interior points
+        vec3f o;
+        do {
+          o = vec3f(dist(rng),dist(rng),dist(rng))*2.f-vec3f(1.f);
+        } while (dot(o,o) > 1.f || dot(o,o) < 1e-3f);
+        ray.origin = center+normalize(o)*radius;
+        const vec3f target = bounds.lower+vec3f(dist(rng),dist(rng),dist(rng))*bounds.size();
+        ray.direction = normalize(target-ray.origin);
+      } else if (set == "ortho") {
+        ray.origin = center-viewDir*radius+(u*x+v*y)*(.5f*radius);
+        ray.direction = viewDir;
+      } else if (set == "pinhole") {
+        // 45 deg. field of view, from where the model fills the image
+        const float fovScale = tanf(22.5f*float(M_PI)/180.f);
+        ray.origin = center-viewDir*(.5f*radius/fovScale);
+        ray.direction = normalize(viewDir+(u*x+v*y)*fovScale);
+      } else {
+        throw std::runtime_error("Unknown ray set: "+set);
+      }
+      ray.tmin = 0.f;
+      ray.tmax = 1e30f;
+    }
+
+    std::vector<HostRay> result;
+    for (HostRay ray : rays) {
+      float t0, t1;
+      if (!clip(ray,bounds,t0,t1))
+        continue;
+      ray.origin = ray.origin+ray.direction*t0;
+      ray.tmin = 0.f;
+      ray.tmax = t1-t0;
+      result.push_back(ray);
+    }
+    return result;
+  }
+
+  /*! ABRs along the ray via the ABR BVH, children visited in order of
+    their entry distance; calls func(abrID,t0,t1) until it returns false */
+  template <typename Func>
+  static void traverse(const visionaray::index_bvh<ABRPrimitive> &bvh,
+                       const HostRay &ray,
+                       const Func &func)
+  {
+    auto nodeBounds = [&](unsigned nodeID) {
+      const visionaray::aabb &b = bvh.node(nodeID).get_bounds();
+      return box3f(vec3f(b.min.x,b.min.y,b.min.z),vec3f(b.max.x,b.max.y,b.max.z));
+    };
+
+    // the BVH's depth isn't bounded, entries beyond the fixed-size
+    // stack spill to the heap (these are pushed last, so popped first)
+    enum { STACK_SIZE = 64 };
+    unsigned stack[STACK_SIZE];
+    unsigned ptr = 0;
+    std::vector<unsigned> spill;
+
+    auto push = [&](unsigned nodeID) {
+      if (ptr < STACK_SIZE)
+        stack[ptr++] = nodeID;
+      else
+        spill.push_back(nodeID);
+    };
+
+    auto pop = [&]() {
+      if (spill.empty())
+        return stack[--ptr];
+      const unsigned nodeID = spill.back();
+      spill.pop_back();
+      return nodeID;
+    };
+
+    float t0, t1;
+    if (bvh.num_nodes() == 0 || !clip(ray,nodeBounds(0),t0,t1))
+      return;
+
+    push(0); // root
+
+    while (ptr) {
+      const visionaray::bvh_node &node = bvh.node(pop());
+
+      if (is_inner(node)) {
+        float near0, near1;
+        const bool hit0 = clip(ray,nodeBounds(node.get_child(0)),near0,t1);
+        const bool hit1 = clip(ray,nodeBounds(node.get_child(1)),near1,t1);
+        // far child first, so the near one is popped next
+        const unsigned first = hit0 && hit1 && near1 < near0 ? 1 : 0;
+        if (hit0 && hit1) {
+          push(node.get_child(1-first));
+          push(node.get_child(first));
+        } else if (hit0) {
+          push(node.get_child(0));
+        } else if (hit1) {
+          push(node.get_child(1));
+        }
+      } else {
+        for (unsigned i=node.get_indices().first; i<node.get_indices().last; ++i) {
+          const ABRPrimitive &abr = bvh.primitive(i);
+          if (clip(ray,abr.domain,t0,t1) && !func((int)abr.prim_id,t0,t1))
+            return;
+        }
+      }
+    }
+  }
+
+  /*! traverse(ray,visit) calls visit(majorant,t0,t1) per step; first a
+    pass that gathers statistics, then the timed traversal-only pass,
+    accumulating the majorant like a tracker would */
+  template <typename Traverse>
+  static void measure(const std::string name,
+                      const std::vector<HostRay> &rays,
+                      size_t bytes,
+                      double buildTime,
+                      const Traverse &traverse)
+  {
+    RayStats stats = parallelReduce(rays.size(),RayStats(),
+      [&](size_t begin, size_t end) {
+        RayStats result;
+        for (size_t i=begin; i<end; ++i) {
+          double active = 0.0;
+          traverse(rays[i],[&](float majorant, float t0, float t1) {
+            result.numSteps += 1.0;
+            active += majorant > 0.f ? fmaxf(t1-t0,0.f) : 0.f;
+            return true;
+          });
+          result.length += rays[i].tmax-rays[i].tmin;
+          result.skipped += std::max(0.0,(rays[i].tmax-rays[i].tmin)-active);
+        }
+        return result;
+      },
+      [](RayStats a, const RayStats &b) {
+        a.numSteps += b.numSteps;
+        a.length += b.length;
+        a.skipped += b.skipped;
+        return a;
+      },1024);
+
+    double majorant = 0.0;
+    const double time = bestOf(cmdline.numRuns,[&]() {
+      majorant = parallelReduce(rays.size(),0.0,
+        [&](size_t begin, size_t end) {
+          double result = 0.0;
+          for (size_t i=begin; i<end; ++i) {
+            traverse(rays[i],[&](float majorant, float t0, float t1) {
+              result += majorant*(t1-t0);
+              return true;
+            });
+          }
+          return result;
+        },
+        [](double a, double b) { return a+b; },1024);
+    });
+
+    const double numRays = (double)rays.size();
+    std::cout << name << prettyBytes(bytes) << ", built in "
+              << prettyDouble(buildTime) << "s\n";
+    std::cout << "  steps/ray: " << stats.numSteps/numRays
+              << ", skipped: " << (stats.length > 0.0 ? 100.0*stats.skipped/stats.length : 0.0)
+              << "% of ray length, avg. majorant: "
+              << (stats.length > 0.0 ? majorant/stats.length : 0.0)
+              << ", " << prettyNumber(size_t(numRays/time)) << " rays/s ("
+              << prettyDouble(time/numRays*1e9) << "ns/ray)\n";
+  }
+
+  extern "C" int main(int argc, char** argv)
+  {
+    for (int i=1;i<argc;i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "-bricks") {
+        cmdline.brickFileName = argv[++i];
+      }
+      else if (arg == "-scalar" || arg == "-scalars") {
+        cmdline.scalarFileName = argv[++i];
+      }
+      else if (arg == "-xf") {
+        cmdline.xfFileName = argv[++i];
+      }
+      else if (arg == "-rays") {
+        cmdline.rays = argv[++i];
+      }
+      else if (arg == "-n") {
+        cmdline.numRays = std::stoull(argv[++i]);
+      }
+      else if (arg == "-dims") {
+        cmdline.dims = std::stoi(argv[++i]);
+      }
+      else if (arg == "-grid") {
+        // "auto": as chosen by GridResolution
+        const std::string dims = argv[++i];
+        cmdline.gridDims = dims == "auto" ? 0 : std::stoi(dims);
+      }
+      else if (arg == "-runs") {
+        cmdline.numRuns = std::stoi(argv[++i]);
+      }
+    }
+
+    ExaBrickModel::SP model;
+    if (!cmdline.brickFileName.empty()) {
+      model = ExaBrickModel::load(cmdline.brickFileName,cmdline.scalarFileName,"");
+    } else {
+      model = BrickBuilder::makeModel(makeFeatureRefinedModel(cmdline.dims),4);
+    }
+
+    if (!model) {
+      throw std::runtime_error("Could not create model");
+    }
+
+    std::vector<vec4f> colorMap;
+    range1f xfRange = model->valueRange;
+    if (!cmdline.xfFileName.empty()) {
+      xfRange = loadTF(cmdline.xfFileName,model->valueRange,colorMap);
+    } else {
+      makeTestTF(colorMap);
+    }
+
+    TFRangeMax xfRangeMax;
+    xfRangeMax.build(colorMap.data(),colorMap.size());
+    const TFRangeMaxTraversable rm = xfRangeMax.traversable();
+
+    model->abrs.buildSoA();
+    const ABRArrays &abrs = model->abrs.arrays;
+    const box3f bounds = parallelBounds(abrs.domain.size(),
+                                        [&](size_t i) { return abrs.domain[i]; });
+
+    std::cout << "#exa: " << prettyNumber(model->bricks.size()) << " bricks, "
+              << prettyNumber(abrs.domain.size()) << " ABRs, bounds: "
+              << bounds << ", value range: " << model->valueRange
+              << ", TF range: " << xfRange << '\n';
+
+    const std::vector<HostRay> rays = makeRays(cmdline.rays,cmdline.numRays,bounds);
+    std::cout << "#exa: " << prettyNumber(rays.size()) << " " << cmdline.rays
+              << " rays hitting the model\n";
+
+    // ==================================================================
+    // uniform majorant grid, traversed w/ dda3
+    // ==================================================================
+
+    vec3i gridDims(cmdline.gridDims);
+    if (cmdline.gridDims <= 0) {
+      GridResolution res;
+      model->getGridStatistics(res);
+      gridDims = res.choose();
+    }
+
+    AdaptiveGrid grid;
+    grid.build(abrs.domain.data(),abrs.valueRange.data(),abrs.domain.size(),
+               bounds,gridDims,1);
+    grid.computeMaxOpacities(colorMap.data(),colorMap.size(),xfRange);
+    const AdaptiveGridTraversable gridTraversable = grid.traversable();
+    const float *gridMajorants = grid.maxOpacities.data();
+
+    measure("grid "+std::to_string(gridDims.x)+"x"+std::to_string(gridDims.y)+"x"
+            +std::to_string(gridDims.z)+" (dda3): ",rays,grid.bytes(),grid.stats.buildTime,
+      [&](const HostRay &ray, const auto &visit) {
+        dda3(ray,gridTraversable.dims,gridTraversable.bounds,
+          [&](size_t cellID, float t0, float t1) {
+            // refinement 1, cells are leaves
+            return visit(gridMajorants[gridTraversable.cells[cellID]],t0,t1);
+          });
+      });
+
+    // ==================================================================
+    // kd-tree over bricks; a brick's value range is the union of those
+    // of the ABRs it contributes to, which cover its domain
+    // ==================================================================
+
+    std::vector<box3f> brickBounds(model->bricks.size());
+    std::vector<int> brickLevels(model->bricks.size());
+    for (size_t i=0; i<model->bricks.size(); ++i) {
+      brickBounds[i] = model->bricks[i].getBounds();
+      brickLevels[i] = model->bricks[i].level;
+    }
+
+    std::vector<range1f> brickValueRanges(model->bricks.size());
+    for (size_t i=0; i<abrs.domain.size(); ++i) {
+      for (int j=0; j<abrs.leafListSize[i]; ++j) {
+        const int brickID = model->abrs.leafList[abrs.leafListBegin[i]+j];
+        brickValueRanges[brickID].extend(abrs.valueRange[i]);
+      }
+    }
+
+    std::vector<float> brickMajorants(model->bricks.size());
+    parallel_for_blocked(0ull,brickMajorants.size(),4096,[&](size_t begin, size_t end) {
+      for (size_t i=begin; i<end; ++i) {
+        brickMajorants[i] = maxOpacity(brickValueRanges[i],rm,xfRange);
+      }
+    });
+
+    KDTree::SP kdtree = KDTree::build(brickBounds.size(),brickBounds.data(),brickLevels.data());
+    const KDTreeTraversableHandle kdTraversable = kdtree->hostTraversable();
+    const size_t kdBytes = (kdtree->stats.numInnerNodes+kdtree->stats.numLeaves)*sizeof(KDTreeNode)
+                         + brickBounds.size()*sizeof(PrimRef);
+
+    measure("kd-tree, "+prettyNumber(kdtree->stats.numLeaves)+" leaves: ",rays,kdBytes,
+            kdtree->stats.buildTime,
+      [&](const HostRay &ray, const auto &visit) {
+        int prd = 0;
+        kd::traceRayInternal(kdTraversable,ray,prd,[&](const HostRay &ray, int &prd, int primID,
+                                                       float tmin, float tmax, KDTreeHitRec &hitRec) {
+          float t0 = 1e30f, t1 = -1e30f;
+          if (clip(ray,brickBounds[primID],t0,t1)) {
+            t0 = fmaxf(t0,tmin);
+            t1 = fminf(t1,tmax);
+            hitRec.hit = !visit(brickMajorants[primID],t0,t1);
+          }
+        });
+      });
+
+    // ==================================================================
+    // ABR BVH, built like ExaBrickSamplerCPU::build() does
+    // ==================================================================
+
+    std::vector<ABRPrimitive> prims(model->abrs.value.size());
+    for (size_t i=0; i<prims.size(); ++i) {
+      (ABR &)prims[i] = model->abrs.value[i];
+      prims[i].prim_id = (unsigned)i;
+    }
+
+    const double bvhTime0 = getCurrentTime();
+    ParallelBVHBuilder builder;
+    const visionaray::index_bvh<ABRPrimitive> abrBVH = builder.build(prims.data(),prims.size());
+    const double bvhTime1 = getCurrentTime();
+
+    std::vector<float> abrMajorants(abrs.domain.size());
+    parallel_for_blocked(0ull,abrMajorants.size(),4096,[&](size_t begin, size_t end) {
+      for (size_t i=begin; i<end; ++i) {
+        abrMajorants[i] = maxOpacity(abrs.valueRange[i],rm,xfRange);
+      }
+    });
+
+    const size_t bvhBytes = abrBVH.num_nodes()*sizeof(visionaray::bvh_node)
+                          + abrs.domain.size()*sizeof(ABRPrimitive);
+
+    measure("ABR BVH, "+prettyNumber(abrBVH.num_nodes())+" nodes: ",rays,bvhBytes,
+            bvhTime1-bvhTime0,
+      [&](const HostRay &ray, const auto &visit) {
+        traverse(abrBVH,ray,[&](int abrID, float t0, float t1) {
+          return visit(abrMajorants[abrID],t0,t1);
+        });
+      });
+
+    return 0;
+  }
+
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,281 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <owl/common/parallel/parallel_for.h>
+#include "model/ExaStitchModel.h"
+#include "model/UElemCache.h"
+#include "ToolUtils.h"
+
+/* throughput vs. memory of the unstructured element cache levels, on
+  a CPU sampler (uniform grid over the element bounds); the mesh is
+  either loaded from a umesh file or a jittered lattice of pyramids,
+  wedges, and tets */
+namespace exa {
+
+  struct {
+    std::string umeshFileName = "";
+    int    dims = 48; // synthetic mesh, cubes per dimension
+    size_t numSamples = 1<<22;
+    size_t budget = size_t(-1);
+    int    numRuns = 3;
+  } cmdline;
+
+  // cubes are split into 6 pyramids (w/ a center apex), 2 wedges, or
+  // 6 tets, alternating; vertices are jittered so elements aren't affine
+  static void makeTestMesh(int n, std::vector<int> &indices, std::vector<vec4f> &vertices)
+  {
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> jitter(-.15f,.15f);
+    auto value = [](vec3f p) { return sinf(p.x*.3f)*cosf(p.y*.2f)+p.z*.05f; };
+
+    const int N = n+1;
+    for (int z=0; z<N; ++z) {
+      for (int y=0; y<N; ++y) {
+        for (int x=0; x<N; ++x) {
+          vec3f p(x,y,z);
+          if (x>0 && x<n) p.x += jitter(rng);
+          if (y>0 && y<n) p.y += jitter(rng);
+          if (z>0 && z<n) p.z += jitter(rng);
+          vertices.push_back(vec4f(p,value(p)));
+        }
+      }
+    }
+
+    auto addElem = [&](std::initializer_list<int> elem) {
+      size_t first = indices.size();
+      indices.resize(first+8,-1);
+      std::copy(elem.begin(),elem.end(),indices.begin()+first);
+    };
+
+    for (int z=0; z<n; ++z) {
+      for (int y=0; y<n; ++y) {
+        for (int x=0; x<n; ++x) {
+          int c[8];
+          for (int i=0; i<8; ++i) {
+            c[i] = (x+(i&1)) + N*((y+((i>>1)&1)) + N*(z+(i>>2)));
+          }
+
+          const int type = (x+y+z)%3;
+          if (type == 0) {
+            vec3f center(0.f);
+            for (int i=0; i<8; ++i) center = center+vec3f(vertices[c[i]])*.125f;
+            const int apex = (int)vertices.size();
+            vertices.push_back(vec4f(center,value(center)));
+            addElem({c[0],c[1],c[3],c[2],apex});
+            addElem({c[4],c[6],c[7],c[5],apex});
+            addElem({c[0],c[4],c[5],c[1],apex});
+            addElem({c[2],c[3],c[7],c[6],apex});
+            addElem({c[0],c[2],c[6],c[4],apex});
+            addElem({c[1],c[5],c[7],c[3],apex});
+          } else if (type == 1) {
+            addElem({c[0],c[1],c[2],c[4],c[5],c[6]});
+            addElem({c[1],c[3],c[2],c[5],c[7],c[6]});
+          } else {
+            const int perms[6][3] = {{1,2,4},{1,4,2},{2,1,4},{2,4,1},{4,1,2},{4,2,1}};
+            for (auto &p : perms) {
+              addElem({c[0],c[p[0]],c[p[0]|p[1]],c[7]});
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // uniform grid over element bounds, CSR lists of element IDs
+  struct ElemGrid {
+    box3f bounds;
+    vec3i dims;
+    std::vector<int> cellBegin;
+    std::vector<int> elemIDs;
+
+    void build(const int *indices, const vec4f *vertices, size_t numElems)
+    {
+      std::vector<box3f> elemBounds(numElems);
+      bounds = box3f();
+      for (size_t i=0; i<numElems; ++i) {
+        for (int j=0; j<numElemVerts(indices+i*8); ++j) {
+          elemBounds[i].extend(vec3f(vertices[indices[i*8+j]]));
+        }
+        bounds.extend(elemBounds[i]);
+      }
+
+      const int res = std::max(1,(int)cbrtf(numElems/2.f));
+      dims = vec3i(res);
+
+      std::vector<std::vector<int>> cells(size_t(res)*res*res);
+      for (size_t i=0; i<numElems; ++i) {
+        const vec3i lo = cellCoord(elemBounds[i].lower);
+        const vec3i hi = cellCoord(elemBounds[i].upper);
+        for (int z=lo.z; z<=hi.z; ++z)
+          for (int y=lo.y; y<=hi.y; ++y)
+            for (int x=lo.x; x<=hi.x; ++x)
+              cells[x+size_t(dims.x)*(y+size_t(dims.y)*z)].push_back((int)i);
+      }
+
+      cellBegin.resize(cells.size()+1);
+      cellBegin[0] = 0;
+      for (size_t i=0; i<cells.size(); ++i) {
+        cellBegin[i+1] = cellBegin[i]+(int)cells[i].size();
+        elemIDs.insert(elemIDs.end(),cells[i].begin(),cells[i].end());
+      }
+    }
+
+    vec3i cellCoord(const vec3f P) const
+    {
+      const vec3f rel = (P-bounds.lower)/(bounds.upper-bounds.lower);
+      return clamp(vec3i(rel*vec3f(dims)),vec3i(0),dims-vec3i(1));
+    }
+
+    size_t cellIndex(const vec3f P) const
+    {
+      const vec3i c = cellCoord(P);
+      return c.x+size_t(dims.x)*(c.y+size_t(dims.y)*c.z);
+    }
+  };
+
+  extern "C" int main(int argc, char** argv)
+  {
+    for (int i=1;i<argc;i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "-umesh") {
+        cmdline.umeshFileName = argv[++i];
+      }
+      else if (arg == "-dims") {
+        cmdline.dims = std::stoi(argv[++i]);
+      }
+      else if (arg == "-n") {
+        cmdline.numSamples = std::stoull(argv[++i]);
+      }
+      else if (arg == "-budget") {
+        cmdline.budget = size_t(std::stod(argv[++i])*(1<<20));
+      }
+      else if (arg == "-runs") {
+        cmdline.numRuns = std::stoi(argv[++i]);
+      }
+      else {
+        throw std::runtime_error("Unknown option: "+arg);
+      }
+    }
+
+    std::vector<int> indices;
+    std::vector<vec4f> vertices;
+    if (!cmdline.umeshFileName.empty()) {
+      ExaStitchModel::SP model = ExaStitchModel::load(cmdline.umeshFileName,"","");
+      indices = model->indices;
+      vertices = model->vertices;
+    } else {
+      makeTestMesh(cmdline.dims,indices,vertices);
+    }
+
+    const size_t numElems = indices.size()/8;
+    const UElemCache::Counts counts = UElemCache::countElems(indices.data(),numElems);
+    std::cout << "#exa: " << numElems << " elements (" << counts.numTets << " tets, "
+              << counts.numPyrs << " pyramids, " << counts.numWedges << " wedges, "
+              << counts.numHexes << " hexes)\n";
+
+    const UElemCache::Level selected = UElemCache::levelForBudget(counts,cmdline.budget);
+    if (cmdline.budget != size_t(-1)) {
+      std::cout << "#exa: cache budget " << prettyBytes(cmdline.budget)
+                << " -> level " << UElemCache::levelName(selected) << '\n';
+    }
+
+    ElemGrid grid;
+    grid.build(indices.data(),vertices.data(),numElems);
+
+    const size_t N = cmdline.numSamples;
+    std::vector<vec3f> positions(N);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> ux(grid.bounds.lower.x,grid.bounds.upper.x);
+    std::uniform_real_distribution<float> uy(grid.bounds.lower.y,grid.bounds.upper.y);
+    std::uniform_real_distribution<float> uz(grid.bounds.lower.z,grid.bounds.upper.z);
+    for (size_t i=0; i<N; ++i) {
+      positions[i] = vec3f(ux(rng),uy(rng),uz(rng));
+    }
+
+    std::vector<float> reference;
+    std::vector<int> referenceHits;
+    double referenceTime = 0.0;
+
+    const UElemCache::Level levels[] = { UElemCache::NONE, UElemCache::BOUNDS, UElemCache::FULL };
+    for (UElemCache::Level level : levels) {
+      UElemCache cache;
+      double t0 = getCurrentTime();
+      cache.build(indices.data(),vertices.data(),numElems,level);
+      double t1 = getCurrentTime();
+
+      std::vector<float> values(N);
+      std::vector<int> hits(N);
+      double sampleTime = bestOf(cmdline.numRuns,[&]() {
+        parallel_for_blocked(0ull,N,4096,[&](size_t begin,size_t end){
+            for (size_t i=begin;i<end;i++) {
+              const size_t cellID = grid.cellIndex(positions[i]);
+              float value = 0.f;
+              int hit = 0;
+              for (int j=grid.cellBegin[cellID]; j<grid.cellBegin[cellID+1]; ++j) {
+                if (cache.intersect(value,positions[i],grid.elemIDs[j],
+                                    indices.data(),vertices.data())) {
+                  hit = 1;
+                  break;
+                }
+              }
+              values[i] = hit ? value : 0.f;
+              hits[i] = hit;
+            }
+          });
+      });
+
+      size_t numHits = 0;
+      for (size_t i=0; i<N; ++i) numHits += hits[i];
+
+      std::cout << "#exa: level " << UElemCache::levelName(level)
+                << (level == selected ? " (selected)" : "") << '\n';
+      std::cout << "  memory: " << prettyBytes(cache.bytes())
+                << " (" << prettyBytes(UElemCache::bytesRequired(level,counts)) << " predicted)"
+                << ", build: " << prettyDouble(t1-t0) << "s\n";
+      std::cout << "  " << prettyDouble(N/sampleTime) << " samples/s, hits: " << numHits;
+
+      if (level == UElemCache::NONE) {
+        reference = values;
+        referenceHits = hits;
+        referenceTime = sampleTime;
+        std::cout << '\n';
+      } else {
+        // the Newton iteration only converges to 1e-4, so points right
+        // on element faces may flip between neighbors (or gaps)
+        float maxDiff = 0.f;
+        size_t numFlipped = 0;
+        for (size_t i=0; i<N; ++i) {
+          if (hits[i] != referenceHits[i])
+            numFlipped++;
+          else
+            maxDiff = std::max(maxDiff,fabsf(values[i]-reference[i]));
+        }
+        std::cout << ", speedup: " << prettyDouble(referenceTime/sampleTime)
+                  << "x, max diff: " << maxDiff << ", hit/miss flipped: " << numFlipped << '\n';
+      }
+    }
+
+    return 0;
+  }
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
@@ -0,0 +1,135 @@
+// ======================================================================== //
+// Copyright 2022-2023 Stefan Zellmann                                      //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include <iostream>
+#include <stdexcept>
+#include "model/AccelFile.h"
+#include "model/ExaBrickModel.h"
+#include "common.h"
+#include "ValueRangeTree.h"
+#include "ToolUtils.h"
+
+/* tool to build a TF-independent value range tree over the ABRs of
+  an *ExaBricks* model; it's built once per data set, the renderer
+  derives majorant domains from it whenever the TF changes. With -xf
+  (and -n), TF-specific majorant files for the viewer's -majorants
+  option are cut from the tree, too, without rebuilding it */
+namespace exa {
+
+  struct {
+    std::string scalarFileName = "";
+    std::string exaBrickFileName = "";
+    std::string xfFileName = "";
+    std::string outFileName = "ranges.acl";
+    std::vector<int> numDomains;
+    int maxDepth = 64;
+  } cmdline;
+
+  extern "C" int main(int argc, char** argv)
+  {
+    for (int i=1;i<argc;i++) {
+      const std::string arg = argv[i];
+
+      if (arg == "-scalar" || arg == "-scalars") {
+        cmdline.scalarFileName = argv[++i];
+      }
+      else if (arg == "-bricks") {
+        cmdline.exaBrickFileName = argv[++i];
+      }
+      else if (arg == "-xf") {
+        cmdline.xfFileName = argv[++i];
+      }
+      else if (arg == "-o") {
+        cmdline.outFileName = argv[++i];
+      }
+      else if (arg == "-n") {
+        for (auto s : string_split(argv[++i],',')) {
+          cmdline.numDomains.push_back(stoi(s));
+        }
+      }
+      else if (arg == "-max-depth") {
+        cmdline.maxDepth = std::stoi(argv[++i]);
+      }
+    }
+
+    if (cmdline.scalarFileName.empty()) {
+      throw std::runtime_error("No scalar file given");
+    }
+
+    if (cmdline.exaBrickFileName.empty()) {
+      throw std::runtime_error("No exabrick file given");
+    }
+
+    if (!cmdline.xfFileName.empty() && cmdline.numDomains.empty()) {
+      throw std::runtime_error("No num domains given (-n=N1,N2,N3,...)");
+    }
+
+    ExaBrickModel::SP model = ExaBrickModel::load(cmdline.exaBrickFileName,
+                                                  cmdline.scalarFileName,
+                                                  ""/*kdtree file, empty*/);
+
+    if (!model) {
+      throw std::runtime_error("Could not load exabrick model");
+    }
+
+    ValueRangeTree::SP tree = ValueRangeTree::build(model->abrs,cmdline.maxDepth);
+    tree->setModelBounds(model->cellBounds);
+    tree->printStats();
+
+    std::cout << "Writing to file: " << cmdline.outFileName << '\n';
+    if (!tree->save(cmdline.outFileName)) {
+      throw std::runtime_error("Could not write "+cmdline.outFileName);
+    }
+
+    if (cmdline.xfFileName.empty())
+      return 0;
+
+    std::vector<vec4f> colorMap;
+    const range1f xfRange = loadTF(cmdline.xfFileName,model->valueRange,colorMap);
+
+    double t0 = getCurrentTime();
+    std::vector<float> majorants;
+    tree->computeMajorants(colorMap,xfRange,majorants);
+    std::cout << "Majorants for " << prettyNumber(majorants.size()) << " nodes computed in "
+              << prettyDouble(getCurrentTime()-t0) << "s\n";
+
+    for (int n : cmdline.numDomains) {
+      t0 = getCurrentTime();
+      std::vector<std::pair<box3f,float>> domains = tree->cut(majorants,n);
+
+      double cost = 0.0;
+      for (const auto &d : domains) {
+        const vec3f size = d.first.size();
+        cost += d.second*double(size.x)*size.y*size.z;
+      }
+
+      std::string suffix = ".n"+std::to_string(domains.size());
+      std::cout << "Cut " << domains.size() << " domains in "
+                << prettyDouble(getCurrentTime()-t0) << "s, sum of majorant x volume: "
+                << cost << '\n';
+      std::cout << "Writing to file: " << cmdline.outFileName+suffix << "\n";
+      if (!AccelFile::write(cmdline.outFileName+suffix,model->cellBounds,{
+            {AccelFile::MAJORANT_DOMAINS,sizeof(domains[0]),domains.size(),domains.data()}})) {
+        throw std::runtime_error("Could not write "+cmdline.outFileName+suffix);
+      }
+    }
+
+    return 0;
+  }
+} // ::exa
+
+// vim: sw=2:expandtab:softtabstop=2:ts=2:cino=\:0g0t0
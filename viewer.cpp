@@ -27,6 +27,8 @@
 #include "qtOWL/XFEditor.h"
 #include "LightInteractor.h"
 #include "OWLRenderer.h"
+#include "model/AMRCellModel.h"
+#include "model/ExaStitchModel.h"
 #ifdef HEADLESS
 #include "headless.h"
 #endif
@@ -780,9 +782,41 @@ namespace exa {
         cmdline.shadeMode = std::atoi(argv[++i]);
       }
       else if (arg == "--num-mcs") {
-        cmdline.numMCs.x = std::atoi(argv[++i]);
-        cmdline.numMCs.y = std::atoi(argv[++i]);
-        cmdline.numMCs.z = std::atoi(argv[++i]);
+        // "auto": choose from the model's statistics (see GridResolution.h)
+        if (i+1 < argc && std::string(argv[i+1]) == "auto") {
+          cmdline.numMCs = Model::autoNumGridCells;
+          ++i;
+        } else {
+          if (i+3 >= argc)
+            usage("--num-mcs expects 'auto' or three integers");
+          cmdline.numMCs.x = std::atoi(argv[++i]);
+          cmdline.numMCs.y = std::atoi(argv[++i]);
+          cmdline.numMCs.z = std::atoi(argv[++i]);
+        }
+      }
+      else if (arg == "--zero-copy") {
+        // reference the mmap'ed AMR cell file instead of copying it
+        AMRCellModel::zeroCopy = true;
+      }
+      else if (arg == "--uelem-cache") {
+        // precompute per-element data for the ExaStitch element sampler
+        if (i+1 >= argc)
+          usage("--uelem-cache expects none|bounds|full");
+        const std::string level = argv[++i];
+        if (level == "none")
+          ExaStitchModel::uelemCacheLevel = UElemCache::NONE;
+        else if (level == "bounds")
+          ExaStitchModel::uelemCacheLevel = UElemCache::BOUNDS;
+        else if (level == "full")
+          ExaStitchModel::uelemCacheLevel = UElemCache::FULL;
+        else
+          usage("unknown element cache level '"+level+"'");
+      }
+      else if (arg == "--uelem-cache-budget") {
+        // pick the highest element cache level that fits into <MB>
+        if (i+1 >= argc)
+          usage("--uelem-cache-budget expects a size in MB");
+        ExaStitchModel::uelemCacheBudget = size_t(std::stod(argv[++i])*(1<<20));
       }
       else if (arg == "--light") {
         cmdline.lights[0].pos.x     = std::stof(argv[++i]);